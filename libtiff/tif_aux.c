@@ -88,9 +88,284 @@ _TIFFCheckMalloc(TIFF* tif, tmsize_t nmemb, tmsize_t elem_size, const char* what
 	return _TIFFCheckRealloc(tif, NULL, nmemb, elem_size, what);  
 }
 
+/*
+ * As above, with the allocator and memory accounting of the handle: the
+ * library allocates through these, and releases with _TIFFfreeExt().
+ * The functions above are kept on the global allocator for applications
+ * releasing with _TIFFfree(), possibly after the handle is closed.
+ */
+void*
+_TIFFCheckReallocExt(TIFF* tif, void* buffer,
+		     tmsize_t nmemb, tmsize_t elem_size, const char* what)
+{
+	void* cp = NULL;
+	tmsize_t bytes = nmemb * elem_size;
+
+	/*
+	 * XXX: Check for integer overflow.
+	 */
+	if (nmemb && elem_size && bytes / elem_size == nmemb)
+		cp = _TIFFreallocExt(tif, buffer, bytes);
+
+	if (cp == NULL) {
+		TIFFErrorExt(tif->tif_clientdata, tif->tif_name,
+			     "Failed to allocate memory for %s "
+			     "(%ld elements of %ld bytes each)",
+			     what,(long) nmemb, (long) elem_size);
+	}
+
+	return cp;
+}
+
+void*
+_TIFFCheckMallocExt(TIFF* tif, tmsize_t nmemb, tmsize_t elem_size,
+		    const char* what)
+{
+	return _TIFFCheckReallocExt(tif, NULL, nmemb, elem_size, what);
+}
+
+/*
+ * Directory arena.  Tag values of the current directory are allocated
+ * from a chain of blocks that TIFFFreeDirectory() drops in one go, one
+ * block being kept around for the next directory.  Requests larger than
+ * half a block get a block of their own.  Each allocation is preceded by
+ * its size, so that a value set again can be overwritten in place.
+ * Blocks come from _TIFFArenaBlockAlloc(), see tif_open.c.
+ */
+#define TIFF_SIZE_T_MAX ((size_t) ~ ((size_t)0))
+#define TIFF_TMSIZE_T_MAX (tmsize_t)(TIFF_SIZE_T_MAX >> 1)
+#define	TIFF_ARENA_BLOCKSIZE	4096
+#define	TIFF_ARENA_ALIGN	8
+#define	TIFF_ARENA_HDRSIZE \
+	((tmsize_t)((sizeof (TIFFArenaBlock) + TIFF_ARENA_ALIGN - 1) & \
+	    ~(size_t)(TIFF_ARENA_ALIGN - 1)))
+#define	TIFF_ARENA_DATA(b)	((uint8*)(b) + TIFF_ARENA_HDRSIZE)
+#define	TIFF_ARENA_SIZE(p)	(*(tmsize_t*)((uint8*)(p) - TIFF_ARENA_ALIGN))
+
+static TIFFArenaBlock*
+_TIFFArenaOwner(TIFF* tif, void* p)
+{
+	TIFFArenaBlock* b;
+
+	for (b = tif->tif_arena; b; b = b->next)
+		if ((uint8*) p > TIFF_ARENA_DATA(b) &&
+		    (uint8*) p < TIFF_ARENA_DATA(b) + b->size)
+			return (b);
+	return (NULL);
+}
+
+/*
+ * Hand out bytes (a multiple of TIFF_ARENA_ALIGN) plus their size header.
+ */
+static void*
+_TIFFArenaGet(TIFF* tif, tmsize_t bytes)
+{
+	TIFFArenaBlock* b = tif->tif_arena;
+	tmsize_t size;
+	uint8* cp;
+
+	bytes += TIFF_ARENA_ALIGN;
+	if (b != NULL && b->size - b->used >= bytes) {
+		cp = TIFF_ARENA_DATA(b) + b->used;
+		b->used += bytes;
+	} else {
+		size = bytes > TIFF_ARENA_BLOCKSIZE / 2 ?
+		    bytes : TIFF_ARENA_BLOCKSIZE;
+		b = (TIFFArenaBlock*) _TIFFArenaBlockAlloc(tif,
+		    TIFF_ARENA_HDRSIZE + size);
+		if (b == NULL)
+			return (NULL);
+		b->size = size;
+		b->used = bytes;
+		if (size != TIFF_ARENA_BLOCKSIZE && tif->tif_arena != NULL) {
+			/* keep carving from the current block */
+			b->next = tif->tif_arena->next;
+			tif->tif_arena->next = b;
+		} else {
+			b->next = tif->tif_arena;
+			tif->tif_arena = b;
+		}
+		cp = TIFF_ARENA_DATA(b);
+	}
+	*(tmsize_t*) cp = bytes - TIFF_ARENA_ALIGN;
+	return (cp + TIFF_ARENA_ALIGN);
+}
+
+/*
+ * Return room for nmemb elements in place of p, which may be NULL,
+ * arena memory or memory from _TIFFmallocExt(tif, ).  The contents of p are
+ * not preserved.  An arena allocation that is too small is replaced by
+ * one twice its size, so values that keep growing do not fill the arena.
+ */
+void*
+_TIFFArenaReplace(TIFF* tif, void* p, tmsize_t nmemb, tmsize_t elem_size,
+		  const char* what)
+{
+	tmsize_t bytes = nmemb * elem_size;
+	void* cp = NULL;
+
+	if (nmemb > 0 && elem_size > 0 && bytes / elem_size == nmemb &&
+	    bytes <= TIFF_TMSIZE_T_MAX / 2 - TIFF_ARENA_HDRSIZE) {
+		bytes = (bytes + TIFF_ARENA_ALIGN - 1) &
+		    ~(tmsize_t)(TIFF_ARENA_ALIGN - 1);
+		if (p != NULL && _TIFFArenaOwner(tif, p) != NULL) {
+			if (TIFF_ARENA_SIZE(p) >= bytes)
+				return (p);
+			if (bytes < 2 * TIFF_ARENA_SIZE(p))
+				bytes = 2 * TIFF_ARENA_SIZE(p);
+		} else if (p != NULL)
+			_TIFFfreeExt(tif, p);
+		cp = _TIFFArenaGet(tif, bytes);
+	} else
+		_TIFFArenaFree(tif, p);
+	if (cp == NULL && what != NULL)
+		TIFFErrorExt(tif->tif_clientdata, tif->tif_name,
+			     "Failed to allocate memory for %s "
+			     "(%ld elements of %ld bytes each)",
+			     what, (long) nmemb, (long) elem_size);
+	return (cp);
+}
+
+void*
+_TIFFArenaMalloc(TIFF* tif, tmsize_t nmemb, tmsize_t elem_size,
+		 const char* what)
+{
+	return (_TIFFArenaReplace(tif, NULL, nmemb, elem_size, what));
+}
+
+/*
+ * Release memory that may or may not come from the directory arena;
+ * arena memory is only reclaimed by _TIFFArenaReset().
+ */
+void
+_TIFFArenaFree(TIFF* tif, void* p)
+{
+	if (p != NULL && _TIFFArenaOwner(tif, p) == NULL)
+		_TIFFfreeExt(tif, p);
+}
+
+void
+_TIFFArenaReset(TIFF* tif)
+{
+	TIFFArenaBlock* b = tif->tif_arena;
+	TIFFArenaBlock* keep = NULL;
+
+	while (b != NULL) {
+		TIFFArenaBlock* next = b->next;
+		if (keep == NULL && b->size == TIFF_ARENA_BLOCKSIZE) {
+			keep = b;
+			keep->used = 0;
+			keep->next = NULL;
+		} else
+			_TIFFArenaBlockFree(tif, b);
+		b = next;
+	}
+	tif->tif_arena = keep;
+}
+
+void
+_TIFFArenaRelease(TIFF* tif)
+{
+	_TIFFArenaReset(tif);
+	if (tif->tif_arena != NULL) {
+		_TIFFArenaBlockFree(tif, tif->tif_arena);
+		tif->tif_arena = NULL;
+	}
+}
+
+/*
+ * Buffer pool.  Codec work buffers and other scratch memory whose size
+ * only depends on the image geometry are handed back to the pool of the
+ * handle instead of being freed, so that the next strip, or the next
+ * directory of a similar size, reuses them.  Each buffer is preceded by
+ * its capacity.  Buffers come back uninitialized.
+ */
+#define	TIFF_BUFPOOL_HDRSIZE	16
+#define	TIFF_BUFPOOL_CAPACITY(b)	(*(tmsize_t*) (b))
+
+/* Do not hand out a pooled buffer much larger than what was asked */
+#define	TIFF_BUFPOOL_FITS(cap, size) \
+	((cap) >= (size) && ((cap) - (size) <= 4096 || (cap) / 2 <= (size)))
+
+void*
+_TIFFBufferGet(TIFF* tif, tmsize_t size)
+{
+	uint8* b;
+	int i, best = -1;
+
+	if (size <= 0 || size > TIFF_TMSIZE_T_MAX - TIFF_BUFPOOL_HDRSIZE)
+		return (NULL);
+	for (i = 0; i < TIFF_BUFPOOL_SLOTS; i++) {
+		b = (uint8*) tif->tif_bufpool[i];
+		if (b != NULL && TIFF_BUFPOOL_FITS(TIFF_BUFPOOL_CAPACITY(b), size)
+		    && (best < 0 || TIFF_BUFPOOL_CAPACITY(b) <
+			TIFF_BUFPOOL_CAPACITY(tif->tif_bufpool[best])))
+			best = i;
+	}
+	if (best >= 0) {
+		b = (uint8*) tif->tif_bufpool[best];
+		tif->tif_bufpool[best] = NULL;
+		return (b + TIFF_BUFPOOL_HDRSIZE);
+	}
+	b = (uint8*) _TIFFmallocExt(tif, size + TIFF_BUFPOOL_HDRSIZE);
+	if (b == NULL) {
+		/* Pooled buffers may be what stands in the way */
+		_TIFFBufferPoolRelease(tif);
+		b = (uint8*) _TIFFmallocExt(tif, size + TIFF_BUFPOOL_HDRSIZE);
+		if (b == NULL)
+			return (NULL);
+	}
+	TIFF_BUFPOOL_CAPACITY(b) = size;
+	return (b + TIFF_BUFPOOL_HDRSIZE);
+}
+
+/*
+ * Return a buffer obtained from _TIFFBufferGet.  When the pool is full,
+ * its smallest buffer makes room for a larger one.
+ */
+void
+_TIFFBufferPut(TIFF* tif, void* p)
+{
+	uint8* b;
+	int i, smallest = -1;
+
+	if (p == NULL)
+		return;
+	b = (uint8*) p - TIFF_BUFPOOL_HDRSIZE;
+	for (i = 0; i < TIFF_BUFPOOL_SLOTS; i++) {
+		if (tif->tif_bufpool[i] == NULL) {
+			tif->tif_bufpool[i] = b;
+			return;
+		}
+		if (smallest < 0 || TIFF_BUFPOOL_CAPACITY(tif->tif_bufpool[i]) <
+		    TIFF_BUFPOOL_CAPACITY(tif->tif_bufpool[smallest]))
+			smallest = i;
+	}
+	if (TIFF_BUFPOOL_CAPACITY(tif->tif_bufpool[smallest]) <
+	    TIFF_BUFPOOL_CAPACITY(b)) {
+		_TIFFfreeExt(tif, tif->tif_bufpool[smallest]);
+		tif->tif_bufpool[smallest] = b;
+	} else
+		_TIFFfreeExt(tif, b);
+}
+
+void
+_TIFFBufferPoolRelease(TIFF* tif)
+{
+	int i;
+
+	for (i = 0; i < TIFF_BUFPOOL_SLOTS; i++) {
+		if (tif->tif_bufpool[i] != NULL) {
+			_TIFFfreeExt(tif, tif->tif_bufpool[i]);
+			tif->tif_bufpool[i] = NULL;
+		}
+	}
+}
+
 static int
-TIFFDefaultTransferFunction(TIFFDirectory* td)
+TIFFDefaultTransferFunction(TIFF* tif)
 {
+	TIFFDirectory* td = &tif->tif_dir;
 	uint16 **tf = td->td_transferfunction;
 	tmsize_t i, n, nbytes;
 
@@ -100,7 +375,7 @@ TIFFDefaultTransferFunction(TIFFDirectory* td)
 
 	n = ((tmsize_t)1)<<td->td_bitspersample;
 	nbytes = n * sizeof (uint16);
-        tf[0] = (uint16 *)_TIFFmalloc(nbytes);
+        tf[0] = (uint16 *)_TIFFmallocExt(tif, nbytes);
 	if (tf[0] == NULL)
 		return 0;
 	tf[0][0] = 0;
@@ -110,11 +385,11 @@ TIFFDefaultTransferFunction(TIFFDirectory* td)
 	}
 
 	if (td->td_samplesperpixel - td->td_extrasamples > 1) {
-                tf[1] = (uint16 *)_TIFFmalloc(nbytes);
+                tf[1] = (uint16 *)_TIFFmallocExt(tif, nbytes);
 		if(tf[1] == NULL)
 			goto bad;
 		_TIFFmemcpy(tf[1], tf[0], nbytes);
-                tf[2] = (uint16 *)_TIFFmalloc(nbytes);
+                tf[2] = (uint16 *)_TIFFmallocExt(tif, nbytes);
 		if (tf[2] == NULL)
 			goto bad;
 		_TIFFmemcpy(tf[2], tf[0], nbytes);
@@ -123,21 +398,22 @@ TIFFDefaultTransferFunction(TIFFDirectory* td)
 
 bad:
 	if (tf[0])
-		_TIFFfree(tf[0]);
+		_TIFFfreeExt(tif, tf[0]);
 	if (tf[1])
-		_TIFFfree(tf[1]);
+		_TIFFfreeExt(tif, tf[1]);
 	if (tf[2])
-		_TIFFfree(tf[2]);
+		_TIFFfreeExt(tif, tf[2]);
 	tf[0] = tf[1] = tf[2] = 0;
 	return 0;
 }
 
 static int
-TIFFDefaultRefBlackWhite(TIFFDirectory* td)
+TIFFDefaultRefBlackWhite(TIFF* tif)
 {
+	TIFFDirectory* td = &tif->tif_dir;
 	int i;
 
-        td->td_refblackwhite = (float *)_TIFFmalloc(6*sizeof (float));
+        td->td_refblackwhite = (float *)_TIFFmallocExt(tif, 6*sizeof (float));
 	if (td->td_refblackwhite == NULL)
 		return 0;
         if (td->td_photometric == PHOTOMETRIC_YCBCR) {
@@ -283,7 +559,7 @@ TIFFVGetFieldDefaulted(TIFF* tif, uint32 tag, va_list ap)
 		}
 	case TIFFTAG_TRANSFERFUNCTION:
 		if (!td->td_transferfunction[0] &&
-		    !TIFFDefaultTransferFunction(td)) {
+		    !TIFFDefaultTransferFunction(tif)) {
 			TIFFErrorExt(tif->tif_clientdata, tif->tif_name, "No space for \"TransferFunction\" tag");
 			return (0);
 		}
@@ -294,7 +570,7 @@ TIFFVGetFieldDefaulted(TIFF* tif, uint32 tag, va_list ap)
 		}
 		return (1);
 	case TIFFTAG_REFERENCEBLACKWHITE:
-		if (!td->td_refblackwhite && !TIFFDefaultRefBlackWhite(td))
+		if (!td->td_refblackwhite && !TIFFDefaultRefBlackWhite(tif))
 			return (0);
 		*va_arg(ap, float **) = td->td_refblackwhite;
 		return (1);
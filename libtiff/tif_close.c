@@ -51,11 +51,14 @@ TIFFCleanup(TIFF* tif)
          */
 	if (tif->tif_mode != O_RDONLY)
 		TIFFFlush(tif);
+	_TIFFFreeDirectorySnapshots(tif);
 	(*tif->tif_cleanup)(tif);
 	TIFFFreeDirectory(tif);
+	_TIFFArenaRelease(tif);
+	_TIFFBufferPoolRelease(tif);
 
 	if (tif->tif_dirlist)
-		_TIFFfree(tif->tif_dirlist);
+		_TIFFfreeExt(tif, tif->tif_dirlist);
 
 	/*
          * Clean up client info links.
@@ -65,44 +68,21 @@ TIFFCleanup(TIFF* tif)
 		TIFFClientInfoLink *psLink = tif->tif_clientinfo;
 
 		tif->tif_clientinfo = psLink->next;
-		_TIFFfree( psLink->name );
-		_TIFFfree( psLink );
+		_TIFFfreeExt(tif, psLink->name );
+		_TIFFfreeExt(tif, psLink );
 	}
 
 	if (tif->tif_rawdata && (tif->tif_flags&TIFF_MYBUFFER))
-		_TIFFfree(tif->tif_rawdata);
+		_TIFFfreeExt(tif, tif->tif_rawdata);
 	if (isMapped(tif))
 		TIFFUnmapFileContents(tif, tif->tif_base, (toff_t)tif->tif_size);
 
 	/*
          * Clean up custom fields.
          */
-	if (tif->tif_fields && tif->tif_nfields > 0) {
-		uint32 i;
-
-		for (i = 0; i < tif->tif_nfields; i++) {
-			TIFFField *fld = tif->tif_fields[i];
-			if (fld->field_bit == FIELD_CUSTOM &&
-			    strncmp("Tag ", fld->field_name, 4) == 0) {
-				_TIFFfree(fld->field_name);
-				_TIFFfree(fld);
-			}
-		}
-
-		_TIFFfree(tif->tif_fields);
-	}
-
-        if (tif->tif_nfieldscompat > 0) {
-                uint32 i;
-
-                for (i = 0; i < tif->tif_nfieldscompat; i++) {
-                        if (tif->tif_fieldscompat[i].allocated_size)
-                                _TIFFfree(tif->tif_fieldscompat[i].fields);
-                }
-                _TIFFfree(tif->tif_fieldscompat);
-        }
+	_TIFFFreeFields(tif);
 
-	_TIFFfree(tif);
+	_TIFFfreeExt(tif, tif);
 }
 
 /************************************************************************/
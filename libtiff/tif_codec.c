@@ -30,6 +30,9 @@
  * Builtin Compression Scheme Configuration Support.
  */
 #include "tiffiop.h"
+#ifdef LZMA_SUPPORT
+#include "lzma.h"
+#endif
 
 static int NotConfigured(TIFF*, int);
 
@@ -156,6 +159,66 @@ TIFFIsCODECConfigured(uint16 scheme)
 	return 0;
 }
 
+/************************************************************************/
+/*                   _TIFFBuiltinCODECCapabilities()                    */
+/************************************************************************/
+
+#define	TIFFCODEC_RW	(TIFFCODEC_DECODE|TIFFCODEC_ENCODE)
+#define	TIFFCODEC_RO	(TIFFCODEC_DECODE)
+
+/*
+ * Capabilities of the built-in codec handling the given scheme, or 0 if
+ * the scheme is not built in or not configured.
+ *
+ * PixarLog is not flagged thread safe since it lazily fills global
+ * lookup tables; JBIG has to decode a whole strip at once.
+ */
+uint32
+_TIFFBuiltinCODECCapabilities(uint16 scheme)
+{
+	const TIFFCodec* c;
+
+	for (c = _TIFFBuiltinCODECS; c->name; c++)
+		if (c->scheme == scheme)
+			break;
+	if (c->name == NULL || c->init == NotConfigured)
+		return (0);
+
+	switch (scheme) {
+	case COMPRESSION_NONE:
+	case COMPRESSION_LZW:
+	case COMPRESSION_PACKBITS:
+	case COMPRESSION_CCITTFAX3:
+	case COMPRESSION_CCITTFAX4:
+	case COMPRESSION_DEFLATE:
+	case COMPRESSION_ADOBE_DEFLATE:
+	case COMPRESSION_SGILOG:
+	case COMPRESSION_SGILOG24:
+		return (TIFFCODEC_RW|TIFFCODEC_ROWDECODE|TIFFCODEC_THREADSAFE);
+	case COMPRESSION_JPEG:
+		return (TIFFCODEC_RW|TIFFCODEC_ROWDECODE|TIFFCODEC_THREADSAFE|
+		    TIFFCODEC_REDUCEDRES);
+	case COMPRESSION_OJPEG:
+	case COMPRESSION_THUNDERSCAN:
+	case COMPRESSION_NEXT:
+	case COMPRESSION_CCITTRLE:
+	case COMPRESSION_CCITTRLEW:
+		return (TIFFCODEC_RO|TIFFCODEC_ROWDECODE|TIFFCODEC_THREADSAFE);
+	case COMPRESSION_JBIG:
+		return (TIFFCODEC_RW|TIFFCODEC_THREADSAFE);
+	case COMPRESSION_PIXARLOG:
+		return (TIFFCODEC_RW|TIFFCODEC_ROWDECODE);
+	case COMPRESSION_LZMA:
+#if defined(LZMA_SUPPORT) && LZMA_VERSION >= 50020002
+		return (TIFFCODEC_RW|TIFFCODEC_ROWDECODE|TIFFCODEC_THREADSAFE|
+		    TIFFCODEC_MULTITHREAD);
+#else
+		return (TIFFCODEC_RW|TIFFCODEC_ROWDECODE|TIFFCODEC_THREADSAFE);
+#endif
+	}
+	return (TIFFCODEC_RW);
+}
+
 /*
  * Local Variables:
  * mode: c
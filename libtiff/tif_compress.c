@@ -31,6 +31,12 @@
  */
 #include "tiffiop.h"
 
+#if defined(HAVE_DLFCN_H) && !defined(_WIN32)
+# define TIFF_CODEC_PLUGINS
+# include <dlfcn.h>
+# include <dirent.h>
+#endif
+
 static int
 TIFFNoEncode(TIFF* tif, const char* method)
 {
@@ -154,13 +160,14 @@ _TIFFSetDefaultCompressionState(TIFF* tif)
 	tif->tif_cleanup = _TIFFvoid;
 	tif->tif_defstripsize = _TIFFDefaultStripSize;
 	tif->tif_deftilesize = _TIFFDefaultTileSize;
-	tif->tif_flags &= ~(TIFF_NOBITREV|TIFF_NOREADRAW);
+	tif->tif_flags &= ~(TIFF_NOBITREV|TIFF_NOREADRAW|TIFF_NOROWDECODE);
 }
 
 int
 TIFFSetCompressionScheme(TIFF* tif, int scheme)
 {
 	const TIFFCodec *c = TIFFFindCODEC((uint16) scheme);
+	uint32 caps;
 
 	_TIFFSetDefaultCompressionState(tif);
 	/*
@@ -169,7 +176,12 @@ TIFFSetCompressionScheme(TIFF* tif, int scheme)
 	 * the library does not have builtin support for, but which
 	 * may still be meaningful.
 	 */
-	return (c ? (*c->init)(tif, scheme) : 1);
+	if (c == NULL)
+		return (1);
+	caps = TIFFGetCODECCapabilities((uint16) scheme);
+	if ((caps & (TIFFCODEC_DECODE|TIFFCODEC_ROWDECODE)) == TIFFCODEC_DECODE)
+		tif->tif_flags |= TIFF_NOROWDECODE;
+	return ((*c->init)(tif, scheme));
 }
 
 /*
@@ -180,6 +192,7 @@ TIFFSetCompressionScheme(TIFF* tif, int scheme)
 typedef struct _codec {
 	struct _codec* next;
 	TIFFCodec* info;
+	uint32 caps;		/* TIFFCODEC_* capabilities */
 } codec_t;
 static codec_t* registeredCODECS = NULL;
 
@@ -200,6 +213,19 @@ TIFFFindCODEC(uint16 scheme)
 
 TIFFCodec*
 TIFFRegisterCODEC(uint16 scheme, const char* name, TIFFInitMethod init)
+{
+	return (TIFFRegisterCODECExt(scheme, name, init,
+	    TIFFCODEC_DECODE|TIFFCODEC_ENCODE|TIFFCODEC_ROWDECODE));
+}
+
+/*
+ * Register a codec together with its TIFFCODEC_* capabilities.  Without
+ * TIFFCODEC_ROWDECODE, TIFFReadScanline() is refused on strips of more
+ * than one row.
+ */
+TIFFCodec*
+TIFFRegisterCODECExt(uint16 scheme, const char* name, TIFFInitMethod init,
+		     uint32 caps)
 {
 	codec_t* cd = (codec_t*)
 	    _TIFFmalloc((tmsize_t)(sizeof (codec_t) + sizeof (TIFFCodec) + strlen(name)+1));
@@ -211,6 +237,7 @@ TIFFRegisterCODEC(uint16 scheme, const char* name, TIFFInitMethod init)
 		strcpy(cd->info->name, name);
 		cd->info->scheme = scheme;
 		cd->info->init = init;
+		cd->caps = caps;
 		cd->next = registeredCODECS;
 		registeredCODECS = cd;
 	} else {
@@ -237,6 +264,115 @@ TIFFUnRegisterCODEC(TIFFCodec* c)
 	    "Cannot remove compression scheme %s; not registered", c->name);
 }
 
+/************************************************************************/
+/*                      TIFFGetCODECCapabilities()                      */
+/************************************************************************/
+
+/**
+ * Get the capabilities of the codec that would handle a scheme.
+ *
+ * @return returns a mask of TIFFCODEC_* flags, 0 if no working codec
+ * is available for the scheme.
+ */
+
+uint32
+TIFFGetCODECCapabilities(uint16 scheme)
+{
+	codec_t* cd;
+
+	for (cd = registeredCODECS; cd; cd = cd->next)
+		if (cd->info->scheme == scheme)
+			return (cd->info->init != NULL ? cd->caps : 0);
+	return (_TIFFBuiltinCODECCapabilities(scheme));
+}
+
+/************************************************************************/
+/*                        TIFFLoadCODECPlugins()                        */
+/************************************************************************/
+
+/**
+ * Load every shared object found in a directory and call its
+ * TIFFCodecPluginInit() entry point, which is expected to register one
+ * or more codecs with TIFFRegisterCODECExt(). Plugins stay loaded for
+ * the life of the process.
+ *
+ * @return returns the number of plugins successfully initialised, or -1
+ * if the directory cannot be read or plugins are not supported.
+ */
+
+int
+TIFFLoadCODECPlugins(const char* dirname)
+{
+	static const char module[] = "TIFFLoadCODECPlugins";
+#ifdef TIFF_CODEC_PLUGINS
+	static const char* const suffixes[] = {
+		".so",
+#ifdef __APPLE__
+		".dylib",
+#endif
+		NULL
+	};
+	DIR* dir;
+	struct dirent* ent;
+	int loaded = 0;
+
+	if ((dir = opendir(dirname)) == NULL) {
+		TIFFErrorExt(0, module, "%s: Cannot open plugin directory",
+		    dirname);
+		return (-1);
+	}
+	while ((ent = readdir(dir)) != NULL) {
+		size_t namelen = strlen(ent->d_name);
+		const char* const* sfx;
+		TIFFCodecPluginInitMethod pinit;
+		char* path;
+		void* handle;
+
+		for (sfx = suffixes; *sfx; sfx++) {
+			size_t sfxlen = strlen(*sfx);
+			if (namelen > sfxlen &&
+			    strcmp(ent->d_name + namelen - sfxlen, *sfx) == 0)
+				break;
+		}
+		if (*sfx == NULL)
+			continue;
+
+		path = (char*) _TIFFmalloc(
+		    (tmsize_t)(strlen(dirname) + 1 + namelen + 1));
+		if (path == NULL) {
+			TIFFErrorExt(0, module,
+			    "No space for plugin path %s", ent->d_name);
+			break;
+		}
+		sprintf(path, "%s/%s", dirname, ent->d_name);
+		handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+		if (handle == NULL) {
+			TIFFErrorExt(0, module, "%s", dlerror());
+			_TIFFfree(path);
+			continue;
+		}
+		*(void**) &pinit = dlsym(handle, TIFFCODEC_PLUGIN_INIT);
+		if (pinit == NULL) {
+			TIFFErrorExt(0, module, "%s: No %s entry point",
+			    path, TIFFCODEC_PLUGIN_INIT);
+			dlclose(handle);
+		} else if (!(*pinit)()) {
+			/* may have registered codecs already: keep it loaded */
+			TIFFErrorExt(0, module, "%s: Plugin initialisation failed",
+			    path);
+		} else
+			loaded++;
+		_TIFFfree(path);
+	}
+	closedir(dir);
+	return (loaded);
+#else
+	TIFFErrorExt(0, module,
+	    "%s: Codec plugins are not supported on this platform", dirname);
+	return (-1);
+#endif
+}
+
 /************************************************************************/
 /*                       TIFFGetConfisuredCODECs()                      */
 /************************************************************************/
@@ -266,7 +402,7 @@ TIFFGetConfiguredCODECs()
 			return NULL;
 		}
 		codecs = new_codecs;
-		_TIFFmemcpy(codecs + i - 1, cd, sizeof(TIFFCodec));
+		_TIFFmemcpy(codecs + i - 1, cd->info, sizeof(TIFFCodec));
 		i++;
 	}
 	for (c = _TIFFBuiltinCODECS; c->name; c++) {
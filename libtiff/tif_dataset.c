@@ -0,0 +1,245 @@
+/* $Id$ */
+
+/*
+ * TIFF Library.
+ *
+ * Datasets: the directory chain of a file is walked once, and handles
+ * opened on any of its directories share the file descriptor and the
+ * block cache of tif_range.c.  Reads are positional, so each handle
+ * keeps its own file position; the header and the directories read when
+ * walking the chain are served from the cache.  For pyramids, where a
+ * reader wants the main image and its overviews at once, this replaces
+ * one TIFFOpen() per level, each re-reading the header and walking the
+ * chain up to its directory.
+ */
+#include "tiffiop.h"
+
+typedef struct {
+	uint64		offset;		/* file offset of the directory */
+	uint32		width;
+	uint32		length;
+} TIFFDatasetDir;
+
+struct TIFFDataset {
+	char*		name;
+	TIFFRangeSource* source;
+	TIFFOpenOptions	opts;		/* for the handles */
+	int		hasopts;
+	tdir_t		ndirs;
+	TIFFDatasetDir*	dirs;
+};
+
+/*
+ * Record the offset and image size of every directory of the main chain.
+ * Directories are read lazily: neither custom tag values nor strip/tile
+ * arrays are loaded.  A broken directory ends the chain, as for
+ * TIFFNumberOfDirectories().
+ */
+static int
+_tiffDatasetScan(TIFFDataset* ds)
+{
+	static const char module[] = "TIFFDatasetOpen";
+	TIFF* tif;
+	uint32 maxdirs = 0;
+
+	tif = _TIFFRangeSourceOpen(ds->source, ds->name, "rzO",
+				   ds->hasopts ? &ds->opts : NULL);
+	if (tif == NULL)
+		return (0);
+	for (;;) {
+		TIFFDatasetDir* dir;
+
+		if (ds->ndirs == maxdirs) {
+			TIFFDatasetDir* p;
+			maxdirs = maxdirs ? 2 * maxdirs : 8;
+			if (maxdirs > 65535)
+				maxdirs = 65535;
+			p = (TIFFDatasetDir*) _TIFFrealloc(ds->dirs,
+			    (tmsize_t) (maxdirs * sizeof (TIFFDatasetDir)));
+			if (p == NULL) {
+				TIFFErrorExt(tif->tif_clientdata, module,
+				    "%s: Out of memory (dataset directories)",
+				    ds->name);
+				TIFFClose(tif);
+				return (0);
+			}
+			ds->dirs = p;
+		}
+		dir = &ds->dirs[ds->ndirs++];
+		dir->offset = TIFFCurrentDirOffset(tif);
+		dir->width = tif->tif_dir.td_imagewidth;
+		dir->length = tif->tif_dir.td_imagelength;
+		if (TIFFLastDirectory(tif) || ds->ndirs == 65535)
+			break;
+		if (!TIFFReadDirectory(tif)) {
+			TIFFWarningExt(tif->tif_clientdata, module,
+			    "%s: Directories after %u are not readable",
+			    ds->name, (unsigned) ds->ndirs - 1);
+			break;
+		}
+	}
+	TIFFClose(tif);
+	return (1);
+}
+
+/*
+ * Common part of TIFFDatasetOpen() and TIFFDatasetClientOpen().  If the
+ * open fails the client handle is left to the caller.
+ */
+TIFFDataset*
+_TIFFDatasetOpen(const char* name, thandle_t handle, uint64 size,
+		 TIFFRangeReadProc readproc, TIFFCloseProc closeproc,
+		 TIFFOpenOptions* opts)
+{
+	static const char module[] = "TIFFDatasetOpen";
+	TIFFDataset* ds;
+
+	ds = (TIFFDataset*) _TIFFmalloc(sizeof (TIFFDataset));
+	if (ds == NULL) {
+		TIFFErrorExt(handle, module, "%s: Out of memory (dataset)",
+			     name);
+		return (NULL);
+	}
+	_TIFFmemset(ds, 0, sizeof (TIFFDataset));
+	ds->name = (char*) _TIFFmalloc((tmsize_t) strlen(name) + 1);
+	if (ds->name == NULL) {
+		TIFFErrorExt(handle, module, "%s: Out of memory (dataset)",
+			     name);
+		_TIFFfree(ds);
+		return (NULL);
+	}
+	strcpy(ds->name, name);
+	if (opts != NULL) {
+		ds->opts = *opts;
+		ds->hasopts = 1;
+	}
+	ds->source = _TIFFRangeSourceNew(module, name, handle, size, readproc,
+					 closeproc, opts);
+	if (ds->source == NULL || !_tiffDatasetScan(ds)) {
+		if (ds->source != NULL)
+			_TIFFRangeSourceRelease(ds->source, 0);
+		_TIFFfree(ds->dirs);
+		_TIFFfree(ds->name);
+		_TIFFfree(ds);
+		return (NULL);
+	}
+	return (ds);
+}
+
+/*
+ * Open a dataset on a file of the given size read through readproc, see
+ * TIFFRangeOpen().  closeproc is called on the handle once the dataset
+ * and all the handles opened on it are closed.
+ */
+TIFFDataset*
+TIFFDatasetClientOpen(const char* name, thandle_t handle, uint64 size,
+		      TIFFRangeReadProc readproc, TIFFCloseProc closeproc,
+		      TIFFOpenOptions* opts)
+{
+	return (_TIFFDatasetOpen(name, handle, size, readproc, closeproc, opts));
+}
+
+/*
+ * Guard the state shared by the handles of the dataset with a lock, for
+ * handles used from several threads.  Each handle itself is still to be
+ * used by one thread at a time.
+ */
+void
+TIFFDatasetSetLockProcs(TIFFDataset* ds, TIFFLockProc lockproc,
+			TIFFLockProc unlockproc, void* lockdata)
+{
+	_TIFFRangeSourceSetLock(ds->source, lockproc, unlockproc, lockdata);
+}
+
+tdir_t
+TIFFDatasetNumberOfDirectories(TIFFDataset* ds)
+{
+	return (ds->ndirs);
+}
+
+/*
+ * Return the file offset of directory dirn, or 0 if there is none.
+ */
+uint64
+TIFFDatasetDirectoryOffset(TIFFDataset* ds, tdir_t dirn)
+{
+	return (dirn < ds->ndirs ? ds->dirs[dirn].offset : 0);
+}
+
+int
+TIFFDatasetGetImageSize(TIFFDataset* ds, tdir_t dirn, uint32* width,
+			uint32* length)
+{
+	if (dirn >= ds->ndirs)
+		return (0);
+	*width = ds->dirs[dirn].width;
+	*length = ds->dirs[dirn].length;
+	return (1);
+}
+
+/*
+ * Open a read handle on directory dirn, without walking the chain up to
+ * it.  mode is a reading mode of TIFFOpen().  The handle is closed with
+ * TIFFClose(), before or after the dataset.
+ */
+TIFF*
+TIFFDatasetOpenDirectory(TIFFDataset* ds, tdir_t dirn, const char* mode)
+{
+	static const char module[] = "TIFFDatasetOpenDirectory";
+	char hmode[32];
+	TIFF* tif;
+
+	if (dirn >= ds->ndirs) {
+		TIFFErrorExt(0, module, "%s: Directory %u does not exist",
+			     ds->name, (unsigned) dirn);
+		return ((TIFF*) 0);
+	}
+	if (_TIFFgetMode(mode, module) != O_RDONLY) {
+		TIFFErrorExt(0, module, "%s: Only reading is supported",
+			     ds->name);
+		return ((TIFF*) 0);
+	}
+	if (strlen(mode) >= sizeof (hmode) - 1) {
+		TIFFErrorExt(0, module, "%s: Bad mode \"%s\"", ds->name, mode);
+		return ((TIFF*) 0);
+	}
+	strcpy(hmode, mode);
+	strcat(hmode, "h");
+	tif = _TIFFRangeSourceOpen(ds->source, ds->name, hmode,
+				   ds->hasopts ? &ds->opts : NULL);
+	if (tif == NULL)
+		return ((TIFF*) 0);
+	tif->tif_flags &= ~TIFF_HEADERONLY;
+	if (!TIFFSetSubDirectory(tif, ds->dirs[dirn].offset)) {
+		TIFFClose(tif);
+		return ((TIFF*) 0);
+	}
+	tif->tif_curdir = dirn;
+	tif->tif_rawcc = (tmsize_t) -1;
+	tif->tif_flags |= TIFF_BUFFERSETUP;
+	return (tif);
+}
+
+/*
+ * Close the dataset.  The file stays open for the handles opened on it
+ * until the last one is closed.
+ */
+void
+TIFFDatasetClose(TIFFDataset* ds)
+{
+	if (ds == NULL)
+		return;
+	_TIFFRangeSourceRelease(ds->source, 1);
+	_TIFFfree(ds->dirs);
+	_TIFFfree(ds->name);
+	_TIFFfree(ds);
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 8
+ * fill-column: 78
+ * End:
+ */
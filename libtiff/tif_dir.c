@@ -60,38 +60,146 @@ void _TIFFsetByteArray(void** vpp, void* vp, uint32 n)
     { setByteArray(vpp, vp, n, 1); }
 void _TIFFsetString(char** cpp, char* cp)
     { setByteArray((void**) cpp, (void*) cp, strlen(cp)+1, 1); }
-static void _TIFFsetNString(char** cpp, char* cp, uint32 n)
-    { setByteArray((void**) cpp, (void*) cp, n, 1); }
 void _TIFFsetShortArray(uint16** wpp, uint16* wp, uint32 n)
     { setByteArray((void**) wpp, (void*) wp, n, sizeof (uint16)); }
 void _TIFFsetLongArray(uint32** lpp, uint32* lp, uint32 n)
     { setByteArray((void**) lpp, (void*) lp, n, sizeof (uint32)); }
-static void _TIFFsetLong8Array(uint64** lpp, uint64* lp, uint32 n)
-    { setByteArray((void**) lpp, (void*) lp, n, sizeof (uint64)); }
 void _TIFFsetFloatArray(float** fpp, float* fp, uint32 n)
     { setByteArray((void**) fpp, (void*) fp, n, sizeof (float)); }
 void _TIFFsetDoubleArray(double** dpp, double* dp, uint32 n)
     { setByteArray((void**) dpp, (void*) dp, n, sizeof (double)); }
 
-static void
-setDoubleArrayOneValue(double** vpp, double value, size_t nmemb)
+/*
+ * Like setByteArray, for values that live in the directory arena.
+ * Returns 0 if a non-empty value could not be stored.
+ */
+static int
+setDirArray(TIFF* tif, void** vpp, void* vp, size_t nmemb, size_t elem_size)
 {
-	if (*vpp)
-		_TIFFfree(*vpp);
-	*vpp = _TIFFmalloc(nmemb*sizeof(double));
-	if (*vpp)
-	{
-		while (nmemb--)
-			((double*)*vpp)[nmemb] = value;
+	if (vp) {
+		*vpp = _TIFFArenaReplace(tif, *vpp, (tmsize_t) nmemb,
+		    (tmsize_t) elem_size, NULL);
+		if (*vpp)
+			_TIFFmemcpy(*vpp, vp, (tmsize_t)(nmemb * elem_size));
+		else if (nmemb > 0)
+			return 0;
+	} else if (*vpp) {
+		_TIFFArenaFree(tif, *vpp);
+		*vpp = 0;
+	}
+	return 1;
+}
+
+static int
+setDoubleArrayOneValue(TIFF* tif, double** vpp, double value, size_t nmemb)
+{
+	*vpp = _TIFFArenaReplace(tif, *vpp, (tmsize_t) nmemb, sizeof(double),
+	    NULL);
+	if (*vpp == NULL)
+		return 0;
+	while (nmemb--)
+		((double*)*vpp)[nmemb] = value;
+	return 1;
+}
+
+/*
+ * Number of entries allocated for a custom value list of n entries.
+ */
+static int
+customValueCapacity(int n)
+{
+	int cap = 8;
+
+	while (cap < n)
+		cap <<= 1;
+	return (cap);
+}
+
+/*
+ * The custom value list is kept sorted by tag.  Return the position of
+ * tag in it, or where it would be inserted, setting *found accordingly.
+ */
+static int
+findCustomValue(TIFFDirectory* td, uint32 tag, int* found)
+{
+	int lo = 0, hi = td->td_customValueCount;
+
+	*found = 0;
+	/* Directories are read and copied in tag order */
+	if (hi == 0 || td->td_customValues[hi - 1].info->field_tag < tag)
+		return (hi);
+	while (lo < hi) {
+		int mid = lo + (hi - lo) / 2;
+		uint32 t = td->td_customValues[mid].info->field_tag;
+
+		if (t == tag) {
+			*found = 1;
+			return (mid);
+		}
+		if (t < tag)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return (lo);
+}
+
+static TIFFTagValue*
+getCustomValue(TIFFDirectory* td, uint32 tag)
+{
+	int found;
+	int i = findCustomValue(td, tag, &found);
+
+	return (found ? td->td_customValues + i : NULL);
+}
+
+/*
+ * NumberOfInks is truncated to SamplesPerPixel, since the setting code
+ * for InkNames assumes that there are SamplesPerPixel ink names.
+ * Fixes http://bugzilla.maptools.org/show_bug.cgi?id=2599
+ */
+static int
+getNumberOfInks(TIFF* tif, uint16* value)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	TIFFTagValue* tv = getCustomValue(td, TIFFTAG_NUMBEROFINKS);
+
+	if (tv == NULL || tv->value == NULL)
+		return (0);
+	*value = *(uint16*) tv->value;
+	if (*value > td->td_samplesperpixel) {
+		TIFFWarningExt(tif->tif_clientdata, "_TIFFVGetField",
+		    "Truncating NumberOfInks from %u to %u",
+		    *value, td->td_samplesperpixel);
+		*value = td->td_samplesperpixel;
 	}
+	return (1);
+}
+
+/*
+ * libtiff historically treats SMinSampleValue and SMaxSampleValue as
+ * single values unless TIFF_PERSAMPLE is set: the smallest or largest
+ * of the per-sample values.
+ */
+static double
+combineSampleValues(TIFFDirectory* td, const double* values, int wantmax)
+{
+	double v = values[0];
+	uint16 i;
+
+	for (i = 1; i < td->td_samplesperpixel; ++i)
+		if (wantmax ? values[i] > v : values[i] < v)
+			v = values[i];
+	return (v);
 }
 
 /*
  * Install extra samples information.
  */
 static int
-setExtraSamples(TIFFDirectory* td, va_list ap, uint32* v)
+setExtraSamples(TIFF* tif, va_list ap, uint32* v)
 {
+	TIFFDirectory* td = &tif->tif_dir;
 /* XXX: Unassociated alpha data == 999 is a known Corel Draw bug, see below */
 #define EXTRASAMPLE_COREL_UNASSALPHA 999 
 
@@ -118,8 +226,12 @@ setExtraSamples(TIFFDirectory* td, va_list ap, uint32* v)
 				return 0;
 		}
 	}
+	if (!setDirArray(tif, (void**) &td->td_sampleinfo, va, *v,
+	    sizeof (uint16))) {
+		td->td_extrasamples = 0;
+		return 0;
+	}
 	td->td_extrasamples = (uint16) *v;
-	_TIFFsetShortArray(&td->td_sampleinfo, va, td->td_extrasamples);
 	return 1;
 
 #undef EXTRASAMPLE_COREL_UNASSALPHA
@@ -275,7 +387,7 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
                     "SamplesPerPixel tag value is changing, "
                     "but SMinSampleValue tag was read with a different value. Cancelling it");
                 TIFFClrFieldBit(tif,FIELD_SMINSAMPLEVALUE);
-                _TIFFfree(td->td_sminsamplevalue);
+                _TIFFArenaFree(tif, td->td_sminsamplevalue);
                 td->td_sminsamplevalue = NULL;
             }
             if( td->td_smaxsamplevalue != NULL )
@@ -284,7 +396,7 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
                     "SamplesPerPixel tag value is changing, "
                     "but SMaxSampleValue tag was read with a different value. Cancelling it");
                 TIFFClrFieldBit(tif,FIELD_SMAXSAMPLEVALUE);
-                _TIFFfree(td->td_smaxsamplevalue);
+                _TIFFArenaFree(tif, td->td_smaxsamplevalue);
                 td->td_smaxsamplevalue = NULL;
             }
         }
@@ -308,15 +420,15 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 		break;
 	case TIFFTAG_SMINSAMPLEVALUE:
 		if (tif->tif_flags & TIFF_PERSAMPLE)
-			_TIFFsetDoubleArray(&td->td_sminsamplevalue, va_arg(ap, double*), td->td_samplesperpixel);
+			status = setDirArray(tif, (void**) &td->td_sminsamplevalue, va_arg(ap, double*), td->td_samplesperpixel, sizeof (double));
 		else
-			setDoubleArrayOneValue(&td->td_sminsamplevalue, va_arg(ap, double), td->td_samplesperpixel);
+			status = setDoubleArrayOneValue(tif, &td->td_sminsamplevalue, va_arg(ap, double), td->td_samplesperpixel);
 		break;
 	case TIFFTAG_SMAXSAMPLEVALUE:
 		if (tif->tif_flags & TIFF_PERSAMPLE)
-			_TIFFsetDoubleArray(&td->td_smaxsamplevalue, va_arg(ap, double*), td->td_samplesperpixel);
+			status = setDirArray(tif, (void**) &td->td_smaxsamplevalue, va_arg(ap, double*), td->td_samplesperpixel, sizeof (double));
 		else
-			setDoubleArrayOneValue(&td->td_smaxsamplevalue, va_arg(ap, double), td->td_samplesperpixel);
+			status = setDoubleArrayOneValue(tif, &td->td_smaxsamplevalue, va_arg(ap, double), td->td_samplesperpixel);
 		break;
 	case TIFFTAG_XRESOLUTION:
         dblval = va_arg(ap, double);
@@ -358,19 +470,24 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 		break;
 	case TIFFTAG_COLORMAP:
 		v32 = (uint32)(1L<<td->td_bitspersample);
-		_TIFFsetShortArray(&td->td_colormap[0], va_arg(ap, uint16*), v32);
-		_TIFFsetShortArray(&td->td_colormap[1], va_arg(ap, uint16*), v32);
-		_TIFFsetShortArray(&td->td_colormap[2], va_arg(ap, uint16*), v32);
+		for (i = 0; i < 3; i++)
+			if (!setDirArray(tif, (void**) &td->td_colormap[i],
+			    va_arg(ap, uint16*), v32, sizeof (uint16)))
+				status = 0;
 		break;
 	case TIFFTAG_EXTRASAMPLES:
-		if (!setExtraSamples(td, ap, &v))
+		if (!setExtraSamples(tif, ap, &v))
 			goto badvalue;
 		break;
 	case TIFFTAG_MATTEING:
 		td->td_extrasamples =  (((uint16) va_arg(ap, uint16_vap)) != 0);
 		if (td->td_extrasamples) {
 			uint16 sv = EXTRASAMPLE_ASSOCALPHA;
-			_TIFFsetShortArray(&td->td_sampleinfo, &sv, 1);
+			if (!setDirArray(tif, (void**) &td->td_sampleinfo, &sv, 1,
+			    sizeof (uint16))) {
+				td->td_extrasamples = 0;
+				status = 0;
+			}
 		}
 		break;
 	case TIFFTAG_TILEWIDTH:
@@ -435,8 +552,12 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 	case TIFFTAG_SUBIFD:
 		if ((tif->tif_flags & TIFF_INSUBIFD) == 0) {
 			td->td_nsubifd = (uint16) va_arg(ap, uint16_vap);
-			_TIFFsetLong8Array(&td->td_subifd, (uint64*) va_arg(ap, uint64*),
-			    (uint32) td->td_nsubifd);
+			if (!setDirArray(tif, (void**) &td->td_subifd,
+			    (uint64*) va_arg(ap, uint64*), td->td_nsubifd,
+			    sizeof (uint64))) {
+				td->td_nsubifd = 0;
+				status = 0;
+			}
 		} else {
 			TIFFErrorExt(tif->tif_clientdata, module,
 				     "%s: Sorry, cannot nest SubIFDs",
@@ -454,12 +575,15 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 	case TIFFTAG_TRANSFERFUNCTION:
 		v = (td->td_samplesperpixel - td->td_extrasamples) > 1 ? 3 : 1;
 		for (i = 0; i < v; i++)
-			_TIFFsetShortArray(&td->td_transferfunction[i],
-			    va_arg(ap, uint16*), 1U<<td->td_bitspersample);
+			if (!setDirArray(tif, (void**) &td->td_transferfunction[i],
+			    va_arg(ap, uint16*), 1U<<td->td_bitspersample,
+			    sizeof (uint16)))
+				status = 0;
 		break;
 	case TIFFTAG_REFERENCEBLACKWHITE:
 		/* XXX should check for null range */
-		_TIFFsetFloatArray(&td->td_refblackwhite, va_arg(ap, float*), 6);
+		status = setDirArray(tif, (void**) &td->td_refblackwhite,
+		    va_arg(ap, float*), 6, sizeof (float));
 		break;
 	case TIFFTAG_INKNAMES:
 		v = (uint16) va_arg(ap, uint16_vap);
@@ -467,8 +591,8 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 		v = checkInkNamesString(tif, v, s);
 		status = v > 0;
 		if( v > 0 ) {
-			_TIFFsetNString(&td->td_inknames, s, v);
-			td->td_inknameslen = v;
+			status = setDirArray(tif, (void**) &td->td_inknames, s, v, 1);
+			td->td_inknameslen = status ? v : 0;
 		}
 		break;
 	case TIFFTAG_PERSAMPLE:
@@ -480,7 +604,7 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 		break;
 	default: {
 		TIFFTagValue *tv;
-		int tv_size, iCustom;
+		int tv_size, iCustom, found;
 
 		/*
 		 * This can happen if multiple images are open with different
@@ -501,41 +625,48 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 		}
 
 		/*
-		 * Find the existing entry for this custom value.
+		 * Find the existing entry for this custom value, or insert
+		 * one at its place in the list.
 		 */
-		tv = NULL;
-		for (iCustom = 0; iCustom < td->td_customValueCount; iCustom++) {
-			if (td->td_customValues[iCustom].info->field_tag == tag) {
-				tv = td->td_customValues + iCustom;
-				if (tv->value != NULL) {
-					_TIFFfree(tv->value);
-					tv->value = NULL;
+		iCustom = findCustomValue(td, tag, &found);
+		if (found) {
+			/* the old value is reused or freed below */
+			tv = td->td_customValues + iCustom;
+		} else {
+			int n = td->td_customValueCount;
+
+			/*
+			 * The list lives in the arena: grow it in powers of
+			 * two, its capacity being implied by the count.
+			 */
+			if (td->td_customValues == NULL ||
+			    n + 1 > customValueCapacity(n)) {
+				TIFFTagValue *new_customValues;
+
+				new_customValues = (TIFFTagValue *)
+				    _TIFFArenaMalloc(tif,
+				    customValueCapacity(n + 1),
+				    sizeof(TIFFTagValue), NULL);
+				if (!new_customValues) {
+					TIFFErrorExt(tif->tif_clientdata, module,
+					    "%s: Failed to allocate space for list of custom values",
+					    tif->tif_name);
+					status = 0;
+					goto end;
 				}
-				break;
+				if (n > 0)
+					_TIFFmemcpy(new_customValues,
+					    td->td_customValues,
+					    n * sizeof(TIFFTagValue));
+				_TIFFArenaFree(tif, td->td_customValues);
+				td->td_customValues = new_customValues;
 			}
-		}
-
-		/*
-		 * Grow the custom list if the entry was not found.
-		 */
-		if(tv == NULL) {
-			TIFFTagValue *new_customValues;
-
+			tv = td->td_customValues + iCustom;
+			if (iCustom < n)
+				memmove(tv + 1, tv,
+				    (n - iCustom) * sizeof(TIFFTagValue));
 			td->td_customValueCount++;
-			new_customValues = (TIFFTagValue *)
-			    _TIFFrealloc(td->td_customValues,
-			    sizeof(TIFFTagValue) * td->td_customValueCount);
-			if (!new_customValues) {
-				TIFFErrorExt(tif->tif_clientdata, module,
-				    "%s: Failed to allocate space for list of custom values",
-				    tif->tif_name);
-				status = 0;
-				goto end;
-			}
-
-			td->td_customValues = new_customValues;
 
-			tv = td->td_customValues + (td->td_customValueCount - 1);
 			tv->info = fip;
 			tv->value = NULL;
 			tv->count = 0;
@@ -546,6 +677,8 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 		 */
 		tv_size = _TIFFDataSize(fip->field_type);
 		if (tv_size == 0) {
+			_TIFFArenaFree(tif, tv->value);
+			tv->value = NULL;
 			status = 0;
 			TIFFErrorExt(tif->tif_clientdata, module,
 			    "%s: Bad field type %d for \"%s\"",
@@ -570,7 +703,11 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 				ma=(uint32)(strlen(mb)+1);
 			}
 			tv->count=ma;
-			setByteArray(&tv->value,mb,ma,1);
+			if (!setDirArray(tif,&tv->value,mb,ma,1)) {
+				tv->count = 0;
+				status = 0;
+				goto end;
+			}
 		}
 		else
 		{
@@ -588,6 +725,8 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 				tv->count = fip->field_writecount;
 
 			if (tv->count == 0) {
+				_TIFFArenaFree(tif, tv->value);
+				tv->value = NULL;
 				status = 0;
 				TIFFErrorExt(tif->tif_clientdata, module,
 					     "%s: Null count for \"%s\" (type "
@@ -600,9 +739,10 @@ _TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 				goto end;
 			}
 
-			tv->value = _TIFFCheckMalloc(tif, tv->count, tv_size,
-			    "custom tag binary object");
+			tv->value = _TIFFArenaReplace(tif, tv->value, tv->count,
+			    tv_size, "custom tag binary object");
 			if (!tv->value) {
+				tv->count = 0;
 				status = 0;
 				goto end;
 			}
@@ -812,26 +952,21 @@ TIFFUnsetField(TIFF* tif, uint32 tag)
     if( !fip )
         return 0;
 
+    if( td->td_ndeferred )
+        _TIFFForgetDeferredTag(tif, tag);
+
     if( fip->field_bit != FIELD_CUSTOM )
         TIFFClrFieldBit(tif, fip->field_bit);
     else
     {
-        TIFFTagValue *tv = NULL;
-        int i;
-
-        for (i = 0; i < td->td_customValueCount; i++) {
-                
-            tv = td->td_customValues + i;
-            if( tv->info->field_tag == tag )
-                break;
-        }
+        int found;
+        int i = findCustomValue(td, tag, &found);
 
-        if( i < td->td_customValueCount )
+        if( found )
         {
-            _TIFFfree(tv->value);
-            for( ; i < td->td_customValueCount-1; i++) {
-                td->td_customValues[i] = td->td_customValues[i+1];
-            }
+            _TIFFArenaFree(tif, td->td_customValues[i].value);
+            memmove(td->td_customValues + i, td->td_customValues + i + 1,
+                    (td->td_customValueCount - i - 1) * sizeof(TIFFTagValue));
             td->td_customValueCount--;
         }
     }
@@ -850,8 +985,11 @@ TIFFUnsetField(TIFF* tif, uint32 tag)
 int
 TIFFVSetField(TIFF* tif, uint32 tag, va_list ap)
 {
-	return OkToChangeTag(tif, tag) ?
-	    (*tif->tif_tagmethods.vsetfield)(tif, tag, ap) : 0;
+	if (!OkToChangeTag(tif, tag))
+		return (0);
+	if (tif->tif_dir.td_ndeferred)
+		_TIFFForgetDeferredTag(tif, tag);
+	return (*tif->tif_tagmethods.vsetfield)(tif, tag, ap);
 }
 
 static int
@@ -866,30 +1004,11 @@ _TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 	
         if( tag == TIFFTAG_NUMBEROFINKS )
         {
-            int i;
-            for (i = 0; i < td->td_customValueCount; i++) {
-                uint16 val;
-                TIFFTagValue *tv = td->td_customValues + i;
-                if (tv->info->field_tag != tag)
-                    continue;
-                if( tv->value == NULL )
-                    return 0;
-                val = *(uint16 *)tv->value;
-                /* Truncate to SamplesPerPixel, since the */
-                /* setting code for INKNAMES assume that there are SamplesPerPixel */
-                /* inknames. */
-                /* Fixes http://bugzilla.maptools.org/show_bug.cgi?id=2599 */
-                if( val > td->td_samplesperpixel )
-                {
-                    TIFFWarningExt(tif->tif_clientdata,"_TIFFVGetField",
-                                   "Truncating NumberOfInks from %u to %u",
-                                   val, td->td_samplesperpixel);
-                    val = td->td_samplesperpixel;
-                }
-                *va_arg(ap, uint16*) = val;
-                return 1;
-            }
-            return 0;
+            uint16 val;
+            if( !getNumberOfInks(tif, &val) )
+                return 0;
+            *va_arg(ap, uint16*) = val;
+            return 1;
         }
 
 	/*
@@ -946,29 +1065,15 @@ _TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 			if (tif->tif_flags & TIFF_PERSAMPLE)
 				*va_arg(ap, double**) = td->td_sminsamplevalue;
 			else
-			{
-				/* libtiff historically treats this as a single value. */
-				uint16 i;
-				double v = td->td_sminsamplevalue[0];
-				for (i=1; i < td->td_samplesperpixel; ++i)
-					if( td->td_sminsamplevalue[i] < v )
-						v = td->td_sminsamplevalue[i];
-				*va_arg(ap, double*) = v;
-			}
+				*va_arg(ap, double*) =
+				    combineSampleValues(td, td->td_sminsamplevalue, 0);
 			break;
 		case TIFFTAG_SMAXSAMPLEVALUE:
 			if (tif->tif_flags & TIFF_PERSAMPLE)
 				*va_arg(ap, double**) = td->td_smaxsamplevalue;
 			else
-			{
-				/* libtiff historically treats this as a single value. */
-				uint16 i;
-				double v = td->td_smaxsamplevalue[0];
-				for (i=1; i < td->td_samplesperpixel; ++i)
-					if( td->td_smaxsamplevalue[i] > v )
-						v = td->td_smaxsamplevalue[i];
-				*va_arg(ap, double*) = v;
-			}
+				*va_arg(ap, double*) =
+				    combineSampleValues(td, td->td_smaxsamplevalue, 1);
 			break;
 		case TIFFTAG_XRESOLUTION:
 			*va_arg(ap, float*) = td->td_xresolution;
@@ -1004,12 +1109,12 @@ _TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 		case TIFFTAG_STRIPOFFSETS:
 		case TIFFTAG_TILEOFFSETS:
 			_TIFFFillStriles( tif );
-			*va_arg(ap, uint64**) = td->td_stripoffset;
+			*va_arg(ap, uint64**) = td->td_stripoffset_p;
 			break;
 		case TIFFTAG_STRIPBYTECOUNTS:
 		case TIFFTAG_TILEBYTECOUNTS:
 			_TIFFFillStriles( tif );
-			*va_arg(ap, uint64**) = td->td_stripbytecount;
+			*va_arg(ap, uint64**) = td->td_stripbytecount_p;
 			break;
 		case TIFFTAG_MATTEING:
 			*va_arg(ap, uint16*) =
@@ -1077,7 +1182,7 @@ _TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 			break;
 		default:
 			{
-				int i;
+				TIFFTagValue *tv;
 
 				/*
 				 * This can happen if multiple images are open
@@ -1104,12 +1209,8 @@ _TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 				 * Do we have a custom value?
 				 */
 				ret_val = 0;
-				for (i = 0; i < td->td_customValueCount; i++) {
-					TIFFTagValue *tv = td->td_customValues + i;
-
-					if (tv->info->field_tag != tag)
-						continue;
-
+				tv = getCustomValue(td, tag);
+				if (tv != NULL) {
 					if (fip->field_passcount) {
 						if (fip->field_readcount == TIFF_VARIABLE2)
 							*va_arg(ap, uint32*) = (uint32)tv->count;
@@ -1199,13 +1300,27 @@ _TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 							}
 						}
 					}
-					break;
 				}
 			}
 	}
 	return(ret_val);
 }
 
+/*
+ * Return the description of tag if it is set in the current directory,
+ * fetching its value first if it was deferred.
+ */
+static const TIFFField*
+findSetField(TIFF* tif, uint32 tag)
+{
+	const TIFFField* fip = TIFFFindField(tif, tag, TIFF_ANY);
+
+	if (fip && tif->tif_dir.td_ndeferred)
+		_TIFFFetchDeferredTag(tif, tag);
+	return (fip && (isPseudoTag(tag) || TIFFFieldSet(tif, fip->field_bit)) ?
+	    fip : NULL);
+}
+
 /*
  * Return the value of a field in the
  * internal directory structure.
@@ -1231,14 +1346,452 @@ TIFFGetField(TIFF* tif, uint32 tag, ...)
 int
 TIFFVGetField(TIFF* tif, uint32 tag, va_list ap)
 {
-	const TIFFField* fip = TIFFFindField(tif, tag, TIFF_ANY);
-	return (fip && (isPseudoTag(tag) || TIFFFieldSet(tif, fip->field_bit)) ?
+	return (findSetField(tif, tag) ?
 	    (*tif->tif_tagmethods.vgetfield)(tif, tag, ap) : 0);
 }
 
+/*
+ * Value of a field as found in memory, for the typed accessors below.
+ * Arrays point into the directory or codec state; single values that
+ * are computed or returned by a codec are held in buf.
+ */
+typedef struct {
+	TIFFDataType	type;		/* type of the values in memory */
+	uint32		count;
+	const void*	data;
+	union {
+		uint8	u8;
+		int8	s8;
+		uint16	u16[2];
+		int16	s16;
+		uint32	u32;
+		int32	s32;
+		uint64	u64;
+		int64	s64;
+		float	f;
+		double	d;
+	} buf;
+} TIFFFieldValue;
+
+static int
+setFieldValue(TIFFFieldValue* v, TIFFDataType type, uint32 count,
+	      const void* data)
+{
+	v->type = type;
+	v->count = count;
+	v->data = data;
+	return (1);
+}
+
+/*
+ * Rationals are stored as floats, and directory offsets as plain
+ * integers.
+ */
+static TIFFDataType
+memoryType(TIFFDataType type)
+{
+	switch (type) {
+	case TIFF_RATIONAL:
+	case TIFF_SRATIONAL:
+		return (TIFF_FLOAT);
+	case TIFF_IFD:
+		return (TIFF_LONG);
+	case TIFF_IFD8:
+		return (TIFF_LONG8);
+	default:
+		return (type);
+	}
+}
+
+/*
+ * Locate the value of a directory field, standard or custom.  Fields
+ * made of several arrays (ColorMap, TransferFunction) have no single
+ * location and are only available through TIFFGetField().
+ */
+static int
+getDirFieldValue(TIFF* tif, const TIFFField* fip, TIFFFieldValue* v)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	TIFFTagValue* tv;
+
+	if (fip->field_tag == TIFFTAG_NUMBEROFINKS) {
+		if (!getNumberOfInks(tif, &v->buf.u16[0]))
+			return (0);
+		return (setFieldValue(v, TIFF_SHORT, 1, v->buf.u16));
+	}
+	if (fip->field_bit == FIELD_CUSTOM) {
+		tv = getCustomValue(td, fip->field_tag);
+		if (tv == NULL)
+			return (0);
+		return (setFieldValue(v, memoryType(fip->field_type),
+		    (uint32) tv->count, tv->value));
+	}
+
+	switch (fip->field_tag) {
+	case TIFFTAG_SUBFILETYPE:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_subfiletype));
+	case TIFFTAG_IMAGEWIDTH:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_imagewidth));
+	case TIFFTAG_IMAGELENGTH:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_imagelength));
+	case TIFFTAG_BITSPERSAMPLE:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_bitspersample));
+	case TIFFTAG_COMPRESSION:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_compression));
+	case TIFFTAG_PHOTOMETRIC:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_photometric));
+	case TIFFTAG_THRESHHOLDING:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_threshholding));
+	case TIFFTAG_FILLORDER:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_fillorder));
+	case TIFFTAG_ORIENTATION:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_orientation));
+	case TIFFTAG_SAMPLESPERPIXEL:
+		return (setFieldValue(v, TIFF_SHORT, 1,
+		    &td->td_samplesperpixel));
+	case TIFFTAG_ROWSPERSTRIP:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_rowsperstrip));
+	case TIFFTAG_MINSAMPLEVALUE:
+		return (setFieldValue(v, TIFF_SHORT, 1,
+		    &td->td_minsamplevalue));
+	case TIFFTAG_MAXSAMPLEVALUE:
+		return (setFieldValue(v, TIFF_SHORT, 1,
+		    &td->td_maxsamplevalue));
+	case TIFFTAG_SMINSAMPLEVALUE:
+	case TIFFTAG_SMAXSAMPLEVALUE:
+		{
+			const double* values =
+			    fip->field_tag == TIFFTAG_SMINSAMPLEVALUE ?
+			    td->td_sminsamplevalue : td->td_smaxsamplevalue;
+
+			if (tif->tif_flags & TIFF_PERSAMPLE)
+				return (setFieldValue(v, TIFF_DOUBLE,
+				    td->td_samplesperpixel, values));
+			v->buf.d = combineSampleValues(td, values,
+			    fip->field_tag == TIFFTAG_SMAXSAMPLEVALUE);
+			return (setFieldValue(v, TIFF_DOUBLE, 1, &v->buf.d));
+		}
+	case TIFFTAG_XRESOLUTION:
+		return (setFieldValue(v, TIFF_FLOAT, 1, &td->td_xresolution));
+	case TIFFTAG_YRESOLUTION:
+		return (setFieldValue(v, TIFF_FLOAT, 1, &td->td_yresolution));
+	case TIFFTAG_PLANARCONFIG:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_planarconfig));
+	case TIFFTAG_XPOSITION:
+		return (setFieldValue(v, TIFF_FLOAT, 1, &td->td_xposition));
+	case TIFFTAG_YPOSITION:
+		return (setFieldValue(v, TIFF_FLOAT, 1, &td->td_yposition));
+	case TIFFTAG_RESOLUTIONUNIT:
+		return (setFieldValue(v, TIFF_SHORT, 1,
+		    &td->td_resolutionunit));
+	case TIFFTAG_PAGENUMBER:
+		return (setFieldValue(v, TIFF_SHORT, 2, td->td_pagenumber));
+	case TIFFTAG_HALFTONEHINTS:
+		return (setFieldValue(v, TIFF_SHORT, 2, td->td_halftonehints));
+	case TIFFTAG_STRIPOFFSETS:
+	case TIFFTAG_TILEOFFSETS:
+		_TIFFFillStriles(tif);
+		return (setFieldValue(v, TIFF_LONG8, td->td_nstrips,
+		    td->td_stripoffset_p));
+	case TIFFTAG_STRIPBYTECOUNTS:
+	case TIFFTAG_TILEBYTECOUNTS:
+		_TIFFFillStriles(tif);
+		return (setFieldValue(v, TIFF_LONG8, td->td_nstrips,
+		    td->td_stripbytecount_p));
+	case TIFFTAG_MATTEING:
+		v->buf.u16[0] = (td->td_extrasamples == 1 &&
+		    td->td_sampleinfo[0] == EXTRASAMPLE_ASSOCALPHA);
+		return (setFieldValue(v, TIFF_SHORT, 1, v->buf.u16));
+	case TIFFTAG_EXTRASAMPLES:
+		return (setFieldValue(v, TIFF_SHORT, td->td_extrasamples,
+		    td->td_sampleinfo));
+	case TIFFTAG_TILEWIDTH:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_tilewidth));
+	case TIFFTAG_TILELENGTH:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_tilelength));
+	case TIFFTAG_TILEDEPTH:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_tiledepth));
+	case TIFFTAG_DATATYPE:
+		switch (td->td_sampleformat) {
+		case SAMPLEFORMAT_UINT:
+			v->buf.u16[0] = DATATYPE_UINT;
+			break;
+		case SAMPLEFORMAT_INT:
+			v->buf.u16[0] = DATATYPE_INT;
+			break;
+		case SAMPLEFORMAT_IEEEFP:
+			v->buf.u16[0] = DATATYPE_IEEEFP;
+			break;
+		case SAMPLEFORMAT_VOID:
+			v->buf.u16[0] = DATATYPE_VOID;
+			break;
+		default:
+			return (0);
+		}
+		return (setFieldValue(v, TIFF_SHORT, 1, v->buf.u16));
+	case TIFFTAG_SAMPLEFORMAT:
+		return (setFieldValue(v, TIFF_SHORT, 1, &td->td_sampleformat));
+	case TIFFTAG_IMAGEDEPTH:
+		return (setFieldValue(v, TIFF_LONG, 1, &td->td_imagedepth));
+	case TIFFTAG_SUBIFD:
+		return (setFieldValue(v, TIFF_LONG8, td->td_nsubifd,
+		    td->td_subifd));
+	case TIFFTAG_YCBCRPOSITIONING:
+		return (setFieldValue(v, TIFF_SHORT, 1,
+		    &td->td_ycbcrpositioning));
+	case TIFFTAG_YCBCRSUBSAMPLING:
+		return (setFieldValue(v, TIFF_SHORT, 2,
+		    td->td_ycbcrsubsampling));
+	case TIFFTAG_REFERENCEBLACKWHITE:
+		return (setFieldValue(v, TIFF_FLOAT, 6, td->td_refblackwhite));
+	case TIFFTAG_INKNAMES:
+		return (setFieldValue(v, TIFF_ASCII,
+		    (uint32) td->td_inknameslen, td->td_inknames));
+	default:
+		return (0);
+	}
+}
+
+static int
+callVGetField(TIFF* tif, uint32 tag, ...)
+{
+	int status;
+	va_list ap;
+
+	va_start(ap, tag);
+	status = (*tif->tif_tagmethods.vgetfield)(tif, tag, ap);
+	va_end(ap);
+	return (status);
+}
+
+/*
+ * Codec fields and pseudo-tags live in the codec state and are fetched
+ * through the tag methods with the arguments their set/get type calls
+ * for.
+ */
+static int
+getCodecFieldValue(TIFF* tif, const TIFFField* fip, TIFFFieldValue* v)
+{
+	TIFFSetGetFieldType sg = fip->get_field_type != TIFF_SETGET_UNDEFINED ?
+	    fip->get_field_type : fip->set_field_type;
+	uint32 tag = fip->field_tag;
+	void* data = NULL;
+
+	switch (sg) {
+	case TIFF_SETGET_UINT8:
+		return (callVGetField(tif, tag, &v->buf.u8)
+		    && setFieldValue(v, TIFF_BYTE, 1, &v->buf.u8));
+	case TIFF_SETGET_SINT8:
+		return (callVGetField(tif, tag, &v->buf.s8)
+		    && setFieldValue(v, TIFF_SBYTE, 1, &v->buf.s8));
+	case TIFF_SETGET_UINT16:
+		return (callVGetField(tif, tag, &v->buf.u16[0])
+		    && setFieldValue(v, TIFF_SHORT, 1, v->buf.u16));
+	case TIFF_SETGET_SINT16:
+		return (callVGetField(tif, tag, &v->buf.s16)
+		    && setFieldValue(v, TIFF_SSHORT, 1, &v->buf.s16));
+	case TIFF_SETGET_UINT32:
+		return (callVGetField(tif, tag, &v->buf.u32)
+		    && setFieldValue(v, TIFF_LONG, 1, &v->buf.u32));
+	case TIFF_SETGET_SINT32:
+		return (callVGetField(tif, tag, &v->buf.s32)
+		    && setFieldValue(v, TIFF_SLONG, 1, &v->buf.s32));
+	case TIFF_SETGET_UINT64:
+	case TIFF_SETGET_IFD8:
+		return (callVGetField(tif, tag, &v->buf.u64)
+		    && setFieldValue(v, TIFF_LONG8, 1, &v->buf.u64));
+	case TIFF_SETGET_SINT64:
+		return (callVGetField(tif, tag, &v->buf.s64)
+		    && setFieldValue(v, TIFF_SLONG8, 1, &v->buf.s64));
+	case TIFF_SETGET_FLOAT:
+		return (callVGetField(tif, tag, &v->buf.f)
+		    && setFieldValue(v, TIFF_FLOAT, 1, &v->buf.f));
+	case TIFF_SETGET_DOUBLE:
+		return (callVGetField(tif, tag, &v->buf.d)
+		    && setFieldValue(v, TIFF_DOUBLE, 1, &v->buf.d));
+	case TIFF_SETGET_INT:
+		{
+			int i;
+
+			if (!callVGetField(tif, tag, &i))
+				return (0);
+			v->buf.s32 = (int32) i;
+			return (setFieldValue(v, TIFF_SLONG, 1, &v->buf.s32));
+		}
+	case TIFF_SETGET_UINT16_PAIR:
+		return (callVGetField(tif, tag, &v->buf.u16[0], &v->buf.u16[1])
+		    && setFieldValue(v, TIFF_SHORT, 2, v->buf.u16));
+	case TIFF_SETGET_ASCII:
+		return (callVGetField(tif, tag, &data) && data != NULL
+		    && setFieldValue(v, TIFF_ASCII,
+		    (uint32) strlen((const char*) data) + 1, data));
+	default:
+		break;
+	}
+	if (sg >= TIFF_SETGET_C0_ASCII && sg <= TIFF_SETGET_C0_IFD8
+	    && fip->field_readcount > 0) {
+		return (callVGetField(tif, tag, &data)
+		    && setFieldValue(v, memoryType(fip->field_type),
+		    (uint32) fip->field_readcount, data));
+	}
+	if (sg >= TIFF_SETGET_C16_ASCII && sg <= TIFF_SETGET_C16_IFD8) {
+		uint16 count;
+
+		return (callVGetField(tif, tag, &count, &data)
+		    && setFieldValue(v, memoryType(fip->field_type), count,
+		    data));
+	}
+	if (sg >= TIFF_SETGET_C32_ASCII && sg <= TIFF_SETGET_C32_IFD8) {
+		uint32 count;
+
+		return (callVGetField(tif, tag, &count, &data)
+		    && setFieldValue(v, memoryType(fip->field_type), count,
+		    data));
+	}
+	return (0);
+}
+
+static int
+getFieldValue(TIFF* tif, uint32 tag, TIFFFieldValue* v)
+{
+	const TIFFField* fip = findSetField(tif, tag);
+
+	if (fip == NULL)
+		return (0);
+	if (isPseudoTag(tag) || fip->field_bit >= FIELD_CODEC)
+		return (getCodecFieldValue(tif, fip, v));
+	return (getDirFieldValue(tif, fip, v));
+}
+
+static int
+getUnsignedValue(TIFF* tif, uint32 tag, uint64* value, int maxwidth)
+{
+	TIFFFieldValue v;
+
+	if (!getFieldValue(tif, tag, &v) || v.count != 1
+	    || TIFFDataWidth(v.type) > maxwidth)
+		return (0);
+	switch (v.type) {
+	case TIFF_BYTE:
+	case TIFF_UNDEFINED:
+		*value = *(const uint8*) v.data;
+		return (1);
+	case TIFF_SHORT:
+		*value = *(const uint16*) v.data;
+		return (1);
+	case TIFF_LONG:
+		*value = *(const uint32*) v.data;
+		return (1);
+	case TIFF_LONG8:
+		*value = *(const uint64*) v.data;
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Typed accessors: return the value of a field holding a single
+ * unsigned integer of at most the requested width, or a single number
+ * of any type for TIFFGetFieldDouble().
+ */
+int
+TIFFGetFieldUInt16(TIFF* tif, uint32 tag, uint16* value)
+{
+	uint64 v;
+
+	if (!getUnsignedValue(tif, tag, &v, 2))
+		return (0);
+	*value = (uint16) v;
+	return (1);
+}
+
+int
+TIFFGetFieldUInt32(TIFF* tif, uint32 tag, uint32* value)
+{
+	uint64 v;
+
+	if (!getUnsignedValue(tif, tag, &v, 4))
+		return (0);
+	*value = (uint32) v;
+	return (1);
+}
+
+int
+TIFFGetFieldUInt64(TIFF* tif, uint32 tag, uint64* value)
+{
+	return (getUnsignedValue(tif, tag, value, 8));
+}
+
+int
+TIFFGetFieldDouble(TIFF* tif, uint32 tag, double* value)
+{
+	TIFFFieldValue v;
+
+	if (!getFieldValue(tif, tag, &v) || v.count != 1)
+		return (0);
+	switch (v.type) {
+	case TIFF_BYTE:
+	case TIFF_UNDEFINED:
+		*value = *(const uint8*) v.data;
+		return (1);
+	case TIFF_SBYTE:
+		*value = *(const int8*) v.data;
+		return (1);
+	case TIFF_SHORT:
+		*value = *(const uint16*) v.data;
+		return (1);
+	case TIFF_SSHORT:
+		*value = *(const int16*) v.data;
+		return (1);
+	case TIFF_LONG:
+		*value = *(const uint32*) v.data;
+		return (1);
+	case TIFF_SLONG:
+		*value = *(const int32*) v.data;
+		return (1);
+	case TIFF_LONG8:
+		*value = (double) *(const uint64*) v.data;
+		return (1);
+	case TIFF_SLONG8:
+		*value = (double) *(const int64*) v.data;
+		return (1);
+	case TIFF_FLOAT:
+		*value = *(const float*) v.data;
+		return (1);
+	case TIFF_DOUBLE:
+		*value = *(const double*) v.data;
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+/*
+ * Return the values of a field where they are stored, without copying
+ * them.  They remain valid until the field is changed or the directory
+ * is left.  Rationals are returned as TIFF_FLOAT, directory offsets as
+ * TIFF_LONG or TIFF_LONG8, and strings as TIFF_ASCII counting their
+ * terminating NUL.
+ */
+int
+TIFFGetFieldArray(TIFF* tif, uint32 tag, TIFFDataType* type, uint32* count,
+		  const void** data)
+{
+	TIFFFieldValue v;
+
+	/* Values computed on the fly have no lasting location */
+	if (!getFieldValue(tif, tag, &v) || v.data == (const void*) &v.buf)
+		return (0);
+	*type = v.type;
+	*count = v.count;
+	*data = v.data;
+	return (1);
+}
+
 #define	CleanupField(member) {		\
     if (td->member) {			\
-	_TIFFfree(td->member);		\
+	_TIFFArenaFree(tif, td->member);	\
 	td->member = 0;			\
     }					\
 }
@@ -1265,24 +1818,26 @@ TIFFFreeDirectory(TIFF* tif)
 	CleanupField(td_transferfunction[0]);
 	CleanupField(td_transferfunction[1]);
 	CleanupField(td_transferfunction[2]);
-	CleanupField(td_stripoffset);
-	CleanupField(td_stripbytecount);
+	CleanupField(td_stripoffset_p);
+	CleanupField(td_stripbytecount_p);
 	TIFFClrFieldBit(tif, FIELD_YCBCRSUBSAMPLING);
 	TIFFClrFieldBit(tif, FIELD_YCBCRPOSITIONING);
 
 	/* Cleanup custom tag values */
 	for( i = 0; i < td->td_customValueCount; i++ ) {
 		if (td->td_customValues[i].value)
-			_TIFFfree(td->td_customValues[i].value);
+			_TIFFArenaFree(tif, td->td_customValues[i].value);
 	}
 
 	td->td_customValueCount = 0;
 	CleanupField(td_customValues);
+	td->td_ndeferred = 0;
+	td->td_deferred = NULL;
+	td->td_strilecache = NULL;
+	_TIFFArenaReset(tif);
 
-#if defined(DEFER_STRILE_LOAD)
-        _TIFFmemset( &(td->td_stripoffset_entry), 0, sizeof(TIFFDirEntry));
-        _TIFFmemset( &(td->td_stripbytecount_entry), 0, sizeof(TIFFDirEntry));
-#endif        
+	_TIFFmemset( &(td->td_stripoffset_entry), 0, sizeof(TIFFDirEntry));
+	_TIFFmemset( &(td->td_stripbytecount_entry), 0, sizeof(TIFFDirEntry));
 }
 #undef CleanupField
 
@@ -1357,6 +1912,7 @@ TIFFDefaultDirectory(TIFF* tif)
 	register TIFFDirectory* td = &tif->tif_dir;
 	const TIFFFieldArray* tiffFieldArray;
 
+	_TIFFDetachDirectory(tif);
 	tiffFieldArray = _TIFFGetFields();
 	_TIFFSetupFields(tif, tiffFieldArray);   
 
@@ -1378,7 +1934,6 @@ TIFFDefaultDirectory(TIFF* tif)
 	td->td_ycbcrsubsampling[1] = 2;
 	td->td_ycbcrpositioning = YCBCRPOSITION_CENTERED;
 	tif->tif_postdecode = _TIFFNoPostDecode;  
-	tif->tif_foundfield = NULL;
 	tif->tif_tagmethods.vsetfield = _TIFFVSetField;  
 	tif->tif_tagmethods.vgetfield = _TIFFVGetField;
 	tif->tif_tagmethods.printdir = NULL;
@@ -1392,9 +1947,9 @@ TIFFDefaultDirectory(TIFF* tif)
 
 		for (i = 0; i < tif->tif_nfieldscompat; i++) {
 				if (tif->tif_fieldscompat[i].allocated_size)
-						_TIFFfree(tif->tif_fieldscompat[i].fields);
+						_TIFFfreeExt(tif, tif->tif_fieldscompat[i].fields);
 		}
-		_TIFFfree(tif->tif_fieldscompat);
+		_TIFFfreeExt(tif, tif->tif_fieldscompat);
 		tif->tif_nfieldscompat = 0;
 		tif->tif_fieldscompat = NULL;
 	}
@@ -1640,6 +2195,277 @@ TIFFSetSubDirectory(TIFF* tif, uint64 diroff)
 	return (TIFFReadDirectory(tif));
 }
 
+/*
+ * Directory snapshots.  Instead of being freed when the handle leaves
+ * it, the parsed state of a snapshotted directory -- the TIFFDirectory
+ * and its arena, the field definitions and the codec state -- is moved
+ * into the snapshot, and TIFFRestoreDirectory() moves it back without
+ * reading the directory again.  While the directory is current its
+ * state lives in the handle as usual, and the snapshot only owns it.
+ */
+#define	TIFF_DIRSTATEFLAGS \
+	(TIFF_ISTILED|TIFF_CODERSETUP|TIFF_UPSAMPLED|TIFF_NOBITREV|TIFF_NOREADRAW|\
+	 TIFF_NOROWDECODE)
+
+typedef struct {
+	TIFFDirectory	dir;
+	uint32		flags;		/* TIFF_DIRSTATEFLAGS bits */
+	int		decodestatus;
+	TIFFBoolMethod	fixuptags;
+	TIFFBoolMethod	setupdecode;
+	TIFFPreMethod	predecode;
+	TIFFBoolMethod	setupencode;
+	int		encodestatus;
+	TIFFPreMethod	preencode;
+	TIFFBoolMethod	postencode;
+	TIFFCodeMethod	decoderow;
+	TIFFCodeMethod	encoderow;
+	TIFFCodeMethod	decodestrip;
+	TIFFCodeMethod	encodestrip;
+	TIFFCodeMethod	decodetile;
+	TIFFCodeMethod	encodetile;
+	TIFFVoidMethod	close;
+	TIFFSeekMethod	seek;
+	TIFFVoidMethod	cleanup;
+	TIFFStripMethod	defstripsize;
+	TIFFTileMethod	deftilesize;
+	uint8*		data;
+	tmsize_t	scanlinesize;
+	tmsize_t	scanlineskew;
+	tmsize_t	tilesize;
+	TIFFPostMethod	postdecode;
+	TIFFField**	fields;
+	size_t		nfields;
+	uint32*		fieldslookup;
+	uint32		fieldshashbits;
+	int		fieldsnamevalid;
+	TIFFTagMethods	tagmethods;
+	TIFFFieldArray*	fieldscompat;
+	size_t		nfieldscompat;
+	TIFFArenaBlock*	arena;
+} TIFFDirState;
+
+struct TIFFDirSnapshot {
+	TIFFDirSnapshot* next;		/* snapshots of the same handle */
+	uint64		diroff;
+	uint64		nextdiroff;
+	uint16		curdir;
+	int		held;		/* state is here, not in the handle */
+	TIFFDirState	state;
+};
+
+#define	SwapState(type, member, field) {		\
+	type tmp = st->member;				\
+	st->member = tif->field;			\
+	tif->field = tmp;				\
+}
+
+static void
+exchangeDirState(TIFF* tif, TIFFDirState* st)
+{
+	uint32 flags = tif->tif_flags & TIFF_DIRSTATEFLAGS;
+
+	tif->tif_flags = (tif->tif_flags & ~TIFF_DIRSTATEFLAGS) | st->flags;
+	st->flags = flags;
+	SwapState(TIFFDirectory, dir, tif_dir);
+	SwapState(int, decodestatus, tif_decodestatus);
+	SwapState(TIFFBoolMethod, fixuptags, tif_fixuptags);
+	SwapState(TIFFBoolMethod, setupdecode, tif_setupdecode);
+	SwapState(TIFFPreMethod, predecode, tif_predecode);
+	SwapState(TIFFBoolMethod, setupencode, tif_setupencode);
+	SwapState(int, encodestatus, tif_encodestatus);
+	SwapState(TIFFPreMethod, preencode, tif_preencode);
+	SwapState(TIFFBoolMethod, postencode, tif_postencode);
+	SwapState(TIFFCodeMethod, decoderow, tif_decoderow);
+	SwapState(TIFFCodeMethod, encoderow, tif_encoderow);
+	SwapState(TIFFCodeMethod, decodestrip, tif_decodestrip);
+	SwapState(TIFFCodeMethod, encodestrip, tif_encodestrip);
+	SwapState(TIFFCodeMethod, decodetile, tif_decodetile);
+	SwapState(TIFFCodeMethod, encodetile, tif_encodetile);
+	SwapState(TIFFVoidMethod, close, tif_close);
+	SwapState(TIFFSeekMethod, seek, tif_seek);
+	SwapState(TIFFVoidMethod, cleanup, tif_cleanup);
+	SwapState(TIFFStripMethod, defstripsize, tif_defstripsize);
+	SwapState(TIFFTileMethod, deftilesize, tif_deftilesize);
+	SwapState(uint8*, data, tif_data);
+	SwapState(tmsize_t, scanlinesize, tif_scanlinesize);
+	SwapState(tmsize_t, scanlineskew, tif_scanlineskew);
+	SwapState(tmsize_t, tilesize, tif_tilesize);
+	SwapState(TIFFPostMethod, postdecode, tif_postdecode);
+	SwapState(TIFFField**, fields, tif_fields);
+	SwapState(size_t, nfields, tif_nfields);
+	SwapState(uint32*, fieldslookup, tif_fieldslookup);
+	SwapState(uint32, fieldshashbits, tif_fieldshashbits);
+	SwapState(int, fieldsnamevalid, tif_fieldsnamevalid);
+	SwapState(TIFFTagMethods, tagmethods, tif_tagmethods);
+	SwapState(TIFFFieldArray*, fieldscompat, tif_fieldscompat);
+	SwapState(size_t, nfieldscompat, tif_nfieldscompat);
+	SwapState(TIFFArenaBlock*, arena, tif_arena);
+}
+#undef SwapState
+
+/*
+ * Make the handle hold no directory after its state was moved out or
+ * released: no fields, no codec, nothing allocated.
+ */
+static void
+resetDirState(TIFF* tif)
+{
+	_TIFFmemset(&tif->tif_dir, 0, sizeof (TIFFDirectory));
+	_TIFFSetDefaultCompressionState(tif);
+	tif->tif_flags &= ~TIFF_DIRSTATEFLAGS;
+	tif->tif_data = NULL;
+	tif->tif_scanlinesize = 0;
+	tif->tif_scanlineskew = 0;
+	tif->tif_tilesize = (tmsize_t) -1;
+	tif->tif_postdecode = _TIFFNoPostDecode;
+	tif->tif_tagmethods.vsetfield = _TIFFVSetField;
+	tif->tif_tagmethods.vgetfield = _TIFFVGetField;
+	tif->tif_tagmethods.printdir = NULL;
+}
+
+static void
+freeDirState(TIFF* tif)
+{
+	(*tif->tif_cleanup)(tif);
+	TIFFFreeDirectory(tif);
+	_TIFFArenaRelease(tif);
+	_TIFFFreeFields(tif);
+	resetDirState(tif);
+}
+
+/*
+ * Called before the handle leaves its current directory: if a snapshot
+ * owns it, hand the state over.
+ */
+void
+_TIFFDetachDirectory(TIFF* tif)
+{
+	TIFFDirSnapshot* snap = tif->tif_dirsnapshot;
+
+	if (snap == NULL)
+		return;
+	exchangeDirState(tif, &snap->state);
+	snap->held = 1;
+	tif->tif_dirsnapshot = NULL;
+	resetDirState(tif);
+}
+
+/*
+ * Keep the current directory for TIFFRestoreDirectory().  Nothing is
+ * copied: the snapshot takes over the state of the directory when the
+ * handle moves to another one.  If the current directory already
+ * belongs to a snapshot, that snapshot is returned.
+ */
+TIFFDirSnapshot*
+TIFFSnapshotDirectory(TIFF* tif)
+{
+	static const char module[] = "TIFFSnapshotDirectory";
+	TIFFDirSnapshot* snap;
+
+	if (tif->tif_mode != O_RDONLY) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: Directory snapshots are only supported in read mode",
+		    tif->tif_name);
+		return (NULL);
+	}
+	if (tif->tif_curdir == (uint16) -1) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: No current directory", tif->tif_name);
+		return (NULL);
+	}
+	if (tif->tif_dirsnapshot != NULL)
+		return (tif->tif_dirsnapshot);
+	snap = (TIFFDirSnapshot*) _TIFFmallocExt(tif, sizeof (TIFFDirSnapshot));
+	if (snap == NULL) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: Out of memory (directory snapshot)", tif->tif_name);
+		return (NULL);
+	}
+	_TIFFmemset(snap, 0, sizeof (TIFFDirSnapshot));
+	snap->diroff = tif->tif_diroff;
+	snap->nextdiroff = tif->tif_nextdiroff;
+	snap->curdir = tif->tif_curdir;
+	snap->next = tif->tif_dirsnapshots;
+	tif->tif_dirsnapshots = snap;
+	tif->tif_dirsnapshot = snap;
+	return (snap);
+}
+
+/*
+ * Make the directory kept by snap the current directory.  The directory
+ * left is handed to its own snapshot, or released if it has none.
+ */
+int
+TIFFRestoreDirectory(TIFF* tif, TIFFDirSnapshot* snap)
+{
+	static const char module[] = "TIFFRestoreDirectory";
+	TIFFDirSnapshot* s;
+
+	if (snap == tif->tif_dirsnapshot && snap != NULL)
+		return (1);
+	for (s = tif->tif_dirsnapshots; s != NULL && s != snap; s = s->next)
+		;
+	if (s == NULL || !s->held) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: Not a directory snapshot of this file", tif->tif_name);
+		return (0);
+	}
+	if (tif->tif_dirsnapshot != NULL)
+		_TIFFDetachDirectory(tif);
+	else
+		freeDirState(tif);
+	/* What goes back into the snapshot holds nothing */
+	exchangeDirState(tif, &snap->state);
+	_TIFFmemset(&snap->state, 0, sizeof (TIFFDirState));
+	snap->held = 0;
+	tif->tif_dirsnapshot = snap;
+
+	tif->tif_diroff = snap->diroff;
+	tif->tif_nextdiroff = snap->nextdiroff;
+	tif->tif_curdir = snap->curdir;
+	tif->tif_dirnumber = 0;
+	tif->tif_row = (uint32) -1;
+	tif->tif_curstrip = (uint32) -1;
+	tif->tif_col = (uint32) -1;
+	tif->tif_curtile = (uint32) -1;
+	return (1);
+}
+
+/*
+ * Release a snapshot and the directory state it keeps.  If its
+ * directory is the current one, it stays current and is released like
+ * any other directory.
+ */
+void
+TIFFFreeDirectorySnapshot(TIFF* tif, TIFFDirSnapshot* snap)
+{
+	TIFFDirSnapshot** prev;
+
+	for (prev = &tif->tif_dirsnapshots; *prev != NULL && *prev != snap;
+	     prev = &(*prev)->next)
+		;
+	if (*prev == NULL)
+		return;
+	*prev = snap->next;
+	if (snap == tif->tif_dirsnapshot)
+		tif->tif_dirsnapshot = NULL;
+	else if (snap->held) {
+		/* Release the kept state through the handle */
+		exchangeDirState(tif, &snap->state);
+		freeDirState(tif);
+		exchangeDirState(tif, &snap->state);
+	}
+	_TIFFfreeExt(tif, snap);
+}
+
+void
+_TIFFFreeDirectorySnapshots(TIFF* tif)
+{
+	while (tif->tif_dirsnapshots != NULL)
+		TIFFFreeDirectorySnapshot(tif, tif->tif_dirsnapshots);
+}
+
 /*
  * Return file offset of the current directory.
  */
@@ -1738,9 +2564,11 @@ TIFFUnlinkDirectory(TIFF* tif, uint16 dirn)
 	 * means that the caller can only append to the directory
 	 * chain.
 	 */
+	tif->tif_lastdiroff = 0;
+	tif->tif_lastdirlink = 0;
 	(*tif->tif_cleanup)(tif);
 	if ((tif->tif_flags & TIFF_MYBUFFER) && tif->tif_rawdata) {
-		_TIFFfree(tif->tif_rawdata);
+		_TIFFfreeExt(tif, tif->tif_rawdata);
 		tif->tif_rawdata = NULL;
 		tif->tif_rawcc = 0;
                 tif->tif_rawdataoff = 0;
@@ -58,6 +58,26 @@ typedef struct {
 	} tdir_offset;		/* either offset or the data itself if fits */
 } TIFFDirEntry;
 
+/*
+ * Blocks of StripOffsets/StripByteCounts values read on demand when
+ * the whole arrays are not loaded (TIFF_LAZYSTRILELOAD).
+ */
+#define STRILE_BLOCK_ENTRIES	256
+#define STRILE_CACHE_BLOCKS	8
+
+typedef struct {
+	uint16  tag;                  /* offsets or bytecounts, 0 if unused */
+	uint32  first;                /* first strile in the block */
+	uint32  count;                /* number of values in the block */
+	uint32  lastuse;              /* for least recently used eviction */
+	uint64  value[STRILE_BLOCK_ENTRIES];
+} TIFFStrileBlock;
+
+typedef struct _TIFFStrileCache {
+	uint32  clock;
+	TIFFStrileBlock block[STRILE_CACHE_BLOCKS];
+} TIFFStrileCache;
+
 /*
  * Internal format of a TIFF directory entry.
  */
@@ -95,13 +115,14 @@ typedef struct {
 	 * number of striles */
 	uint32  td_stripsperimage;  
 	uint32  td_nstrips;              /* size of offset & bytecount arrays */
-	uint64* td_stripoffset;
-	uint64* td_stripbytecount;
+	/* the arrays may not be loaded, see TIFFGetStrileOffset() */
+	uint64* td_stripoffset_p;
+	uint64* td_stripbytecount_p;
 	int     td_stripbytecountsorted; /* is the bytecount array sorted ascending? */
-#if defined(DEFER_STRILE_LOAD)
-        TIFFDirEntry td_stripoffset_entry;    /* for deferred loading */
-        TIFFDirEntry td_stripbytecount_entry; /* for deferred loading */
-#endif
+	TIFFDirEntry td_stripoffset_entry;    /* for deferred loading */
+	TIFFDirEntry td_stripbytecount_entry; /* for deferred loading */
+	struct _TIFFStrileCache* td_strilecache; /* values fetched on demand */
+	int     td_deferstrilearraywriting; /* see TIFFDeferStrileArrayWriting() */
 	uint16  td_nsubifd;
 	uint64* td_subifd;
 	/* YCbCr parameters */
@@ -116,6 +137,10 @@ typedef struct {
 
 	int     td_customValueCount;
         TIFFTagValue *td_customValues;
+
+	/* entries whose values are fetched on first use, see TIFF_LAZYDIR */
+	uint32  td_ndeferred;
+	TIFFDirEntry* td_deferred;
 } TIFFDirectory;
 
 /*
@@ -256,9 +281,15 @@ extern "C" {
 extern const TIFFFieldArray* _TIFFGetFields(void);
 extern const TIFFFieldArray* _TIFFGetExifFields(void);
 extern void _TIFFSetupFields(TIFF* tif, const TIFFFieldArray* infoarray);
+extern void _TIFFFreeFields(TIFF* tif);
 extern void _TIFFPrintFieldInfo(TIFF*, FILE*);
 
 extern int _TIFFFillStriles(TIFF*);        
+extern int _TIFFFetchDeferredTag(TIFF*, uint32);
+extern void _TIFFFetchDeferredTags(TIFF*);
+extern void _TIFFForgetDeferredTag(TIFF*, uint32);
+extern void _TIFFDetachDirectory(TIFF*);
+extern void _TIFFFreeDirectorySnapshots(TIFF*);
 
 typedef enum {
 	tfiatImage,
@@ -290,6 +321,7 @@ struct _TIFFField {
 
 extern int _TIFFMergeFields(TIFF*, const TIFFField[], uint32);
 extern const TIFFField* _TIFFFindOrRegisterField(TIFF *, uint32, TIFFDataType);
+extern uint32 _TIFFFindFieldIndex(TIFF *, uint32);
 extern  TIFFField* _TIFFCreateAnonField(TIFF *, uint32, TIFFDataType);
 extern int _TIFFCheckFieldIsValidForCodec(TIFF *tif, ttag_t tag);
 
@@ -284,25 +284,6 @@ tiffFieldArray = { tfiatImage, 0, TIFFArrayCount(tiffFields), (TIFFField*) tiffF
 static const TIFFFieldArray
 exifFieldArray = { tfiatExif, 0, TIFFArrayCount(exifFields), (TIFFField*) exifFields };
 
-/*
- *  We have our own local lfind() equivalent to avoid subtle differences
- *  in types passed to lfind() on different systems. 
- */
-
-static void *
-td_lfind(const void *key, const void *base, size_t *nmemb, size_t size,
-         int(*compar)(const void *, const void *))
-{
-    char *element, *end;
-
-    end = (char *)base + *nmemb * size;
-    for (element = (char *)base; element < end; element += size)
-        if (!compar(key, element))		/* key found */
-            return element;
-
-    return NULL;
-}
-
 const TIFFFieldArray*
 _TIFFGetFields(void)
 {
@@ -325,12 +306,12 @@ _TIFFSetupFields(TIFF* tif, const TIFFFieldArray* fieldarray)
 			TIFFField *fld = tif->tif_fields[i];
 			if (fld->field_bit == FIELD_CUSTOM &&
 				strncmp("Tag ", fld->field_name, 4) == 0) {
-					_TIFFfree(fld->field_name);
-					_TIFFfree(fld);
+					_TIFFfreeExt(tif, fld->field_name);
+					_TIFFfreeExt(tif, fld);
 				}
 		}
 
-		_TIFFfree(tif->tif_fields);
+		_TIFFfreeExt(tif, tif->tif_fields);
 		tif->tif_fields = NULL;
 		tif->tif_nfields = 0;
 	}
@@ -340,6 +321,47 @@ _TIFFSetupFields(TIFF* tif, const TIFFFieldArray* fieldarray)
 	}
 }
 
+/*
+ * Release the registered field definitions: anonymous fields, the tag
+ * table and its lookup tables, and those added by TIFFMergeFieldInfo().
+ */
+void
+_TIFFFreeFields(TIFF* tif)
+{
+	if (tif->tif_fields && tif->tif_nfields > 0) {
+		uint32 i;
+
+		for (i = 0; i < tif->tif_nfields; i++) {
+			TIFFField *fld = tif->tif_fields[i];
+			if (fld->field_bit == FIELD_CUSTOM &&
+			    strncmp("Tag ", fld->field_name, 4) == 0) {
+				_TIFFfreeExt(tif, fld->field_name);
+				_TIFFfreeExt(tif, fld);
+			}
+		}
+
+		_TIFFfreeExt(tif, tif->tif_fields);
+	}
+	tif->tif_fields = NULL;
+	tif->tif_nfields = 0;
+	_TIFFfreeExt(tif, tif->tif_fieldslookup);
+	tif->tif_fieldslookup = NULL;
+	tif->tif_fieldshashbits = 0;
+	tif->tif_fieldsnamevalid = 0;
+
+	if (tif->tif_nfieldscompat > 0) {
+		uint32 i;
+
+		for (i = 0; i < tif->tif_nfieldscompat; i++) {
+			if (tif->tif_fieldscompat[i].allocated_size)
+				_TIFFfreeExt(tif, tif->tif_fieldscompat[i].fields);
+		}
+		_TIFFfreeExt(tif, tif->tif_fieldscompat);
+	}
+	tif->tif_fieldscompat = NULL;
+	tif->tif_nfieldscompat = 0;
+}
+
 static int
 tagCompare(const void* a, const void* b)
 {
@@ -353,18 +375,116 @@ tagCompare(const void* a, const void* b)
 			0 : ((int)tb->field_type - (int)ta->field_type);
 }
 
+/*
+ * The field lookup tables hold indices in tif_fields plus one, 0 marking
+ * an empty slot.  Tags below TIFF_FIELDS_DIRECT, which cover the baseline
+ * and most extension tags, index the first table directly; its entries
+ * are checked against tif_fields rather than cleared.  Other tags and
+ * field names go through open addressed hash tables of
+ * 1 << tif_fieldshashbits slots, kept at most half full.  A tag maps to
+ * its first entry in tif_fields, a name to all of its entries.  The name
+ * table, seldom used, is only built on demand.
+ */
+#define	TIFF_FIELDS_DIRECT	1024
+
+static uint32
+tagHash(uint32 tag, uint32 bits)
+{
+	return (uint32) (tag * 2654435761U) >> (32 - bits);
+}
+
+static uint32
+tagNameHash(const char* name, uint32 bits)
+{
+	uint32 h = 2166136261U;
+
+	while (*name != '\0')
+		h = (h ^ (uint8) *name++) * 16777619U;
+	return (h >> (32 - bits));
+}
+
+/*
+ * Enter tif_fields[i] in the tag tables.  Entries must be added from the
+ * last to the first for a tag to map to its first definition.
+ */
+static void
+_TIFFAddFieldLookup(TIFF* tif, uint32 i)
+{
+	uint32 tag = tif->tif_fields[i]->field_tag;
+	uint32 bits = tif->tif_fieldshashbits;
+	uint32 mask = ((uint32) 1 << bits) - 1;
+	uint32* taghash = tif->tif_fieldslookup + TIFF_FIELDS_DIRECT;
+	uint32 h;
+
+	tif->tif_fieldsnamevalid = 0;
+	if (tag < TIFF_FIELDS_DIRECT) {
+		tif->tif_fieldslookup[tag] = i + 1;
+		return;
+	}
+	for (h = tagHash(tag, bits); taghash[h] != 0; h = (h + 1) & mask)
+		if (tif->tif_fields[taghash[h] - 1]->field_tag == tag)
+			break;
+	taghash[h] = i + 1;
+}
+
+/*
+ * Rebuild the tag tables from tif_fields, with room for nfields entries.
+ */
 static int
-tagNameCompare(const void* a, const void* b)
+_TIFFSetupFieldLookup(TIFF* tif, size_t nfields)
 {
-	const TIFFField* ta = *(const TIFFField**) a;
-	const TIFFField* tb = *(const TIFFField**) b;
-	int ret = strcmp(ta->field_name, tb->field_name);
+	uint32 bits = tif->tif_fieldshashbits;
+	size_t i;
+
+	if (bits == 0 || ((size_t) 1 << bits) < 2 * nfields) {
+		uint32* lookup;
+		tmsize_t size;
+
+		if (bits == 0)
+			bits = 8;
+		while (((size_t) 1 << bits) < 2 * nfields)
+			bits++;
+		size = TIFF_FIELDS_DIRECT + ((tmsize_t) 2 << bits);
+		lookup = (uint32*) _TIFFCheckMallocExt(tif, size,
+		    sizeof (uint32), "for field lookup tables");
+		_TIFFfreeExt(tif, tif->tif_fieldslookup);
+		tif->tif_fieldslookup = NULL;
+		tif->tif_fieldshashbits = 0;
+		if (!lookup)
+			return 0;
+		_TIFFmemset(lookup, 0, size * sizeof (uint32));
+		tif->tif_fieldslookup = lookup;
+		tif->tif_fieldshashbits = bits;
+	} else {
+		_TIFFmemset(tif->tif_fieldslookup + TIFF_FIELDS_DIRECT, 0,
+		    ((tmsize_t) 1 << bits) * sizeof (uint32));
+	}
+	for (i = tif->tif_nfields; i > 0; i--)
+		_TIFFAddFieldLookup(tif, (uint32) (i - 1));
+	tif->tif_fieldsnamevalid = 0;
+	return 1;
+}
 
-	if (ret)
-		return ret;
-	else
-		return (ta->field_type == TIFF_ANY) ?
-			0 : ((int)tb->field_type - (int)ta->field_type);
+static void
+_TIFFSetupFieldNameLookup(TIFF* tif)
+{
+	uint32 bits = tif->tif_fieldshashbits;
+	uint32 mask = ((uint32) 1 << bits) - 1;
+	uint32* namehash = tif->tif_fieldslookup + TIFF_FIELDS_DIRECT + mask + 1;
+	uint32 h;
+	size_t i;
+
+	_TIFFmemset(namehash, 0, ((tmsize_t) 1 << bits) * sizeof (uint32));
+	for (i = 0; i < tif->tif_nfields; i++) {
+		const char* name = tif->tif_fields[i]->field_name;
+		if (name == NULL)
+			continue;
+		for (h = tagNameHash(name, bits); namehash[h] != 0;
+		     h = (h + 1) & mask)
+			;
+		namehash[h] = (uint32) i + 1;
+	}
+	tif->tif_fieldsnamevalid = 1;
 }
 
 int
@@ -374,17 +494,16 @@ _TIFFMergeFields(TIFF* tif, const TIFFField info[], uint32 n)
 	static const char reason[] = "for fields array";
 	/* TIFFField** tp; */
 	uint32 i;
-
-        tif->tif_foundfield = NULL;
+	size_t nfields;
 
 	if (tif->tif_fields && tif->tif_nfields > 0) {
 		tif->tif_fields = (TIFFField**)
-			_TIFFCheckRealloc(tif, tif->tif_fields,
+			_TIFFCheckReallocExt(tif, tif->tif_fields,
 					  (tif->tif_nfields + n),
 					  sizeof(TIFFField *), reason);
 	} else {
 		tif->tif_fields = (TIFFField **)
-			_TIFFCheckMalloc(tif, n, sizeof(TIFFField *),
+			_TIFFCheckMallocExt(tif, n, sizeof(TIFFField *),
 					 reason);
 	}
 	if (!tif->tif_fields) {
@@ -392,8 +511,17 @@ _TIFFMergeFields(TIFF* tif, const TIFFField info[], uint32 n)
 			     "Failed to allocate fields array");
 		return 0;
 	}
+	if ((tif->tif_fieldslookup == NULL || tif->tif_nfields == 0
+	     || ((size_t) 1 << tif->tif_fieldshashbits)
+		< 2 * (tif->tif_nfields + n))
+	    && !_TIFFSetupFieldLookup(tif, tif->tif_nfields + n)) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+			     "Failed to allocate field lookup tables");
+		return 0;
+	}
 
 	/* tp = tif->tif_fields + tif->tif_nfields; */
+	nfields = tif->tif_nfields;
 	for (i = 0; i < n; i++) {
 		const TIFFField *fip =
 			TIFFFindField(tif, info[i].field_tag, TIFF_ANY);
@@ -401,13 +529,17 @@ _TIFFMergeFields(TIFF* tif, const TIFFField info[], uint32 n)
                 /* only add definitions that aren't already present */
 		if (!fip) {
                         tif->tif_fields[tif->tif_nfields] = (TIFFField *) (info+i);
+                        _TIFFAddFieldLookup(tif, (uint32) tif->tif_nfields);
                         tif->tif_nfields++;
                 }
 	}
 
         /* Sort the field info by tag number */
-	qsort(tif->tif_fields, tif->tif_nfields,
-	      sizeof(TIFFField *), tagCompare);
+	if (tif->tif_nfields != nfields) {
+		qsort(tif->tif_fields, tif->tif_nfields,
+		      sizeof(TIFFField *), tagCompare);
+		(void) _TIFFSetupFieldLookup(tif, tif->tif_nfields);
+	}
 
 	return n;
 }
@@ -504,56 +636,76 @@ _TIFFDataSize(TIFFDataType type)
 	}
 }
 
-const TIFFField*
-TIFFFindField(TIFF* tif, uint32 tag, TIFFDataType dt)
+/*
+ * Index in tif_fields of the first definition of tag, or (uint32) -1.
+ */
+uint32
+_TIFFFindFieldIndex(TIFF* tif, uint32 tag)
 {
-	TIFFField key = {0, 0, 0, TIFF_NOTYPE, 0, 0, 0, 0, 0, 0, NULL, NULL};
-	TIFFField* pkey = &key;
-	const TIFFField **ret;
-	if (tif->tif_foundfield && tif->tif_foundfield->field_tag == tag &&
-	    (dt == TIFF_ANY || dt == tif->tif_foundfield->field_type))
-		return tif->tif_foundfield;
+	uint32 bits, mask, h, i;
+	const uint32* taghash;
 
 	/* If we are invoked with no field information, then just return. */
-	if (!tif->tif_fields)
-		return NULL;
+	if (!tif->tif_fields || !tif->tif_fieldslookup)
+		return (uint32) -1;
+
+	if (tag < TIFF_FIELDS_DIRECT) {
+		i = tif->tif_fieldslookup[tag];
+		if (i == 0 || i > tif->tif_nfields
+		    || tif->tif_fields[i - 1]->field_tag != tag)
+			return (uint32) -1;
+		return i - 1;
+	}
 
-	/* NB: use sorted search (e.g. binary search) */
+	bits = tif->tif_fieldshashbits;
+	mask = ((uint32) 1 << bits) - 1;
+	taghash = tif->tif_fieldslookup + TIFF_FIELDS_DIRECT;
+	for (h = tagHash(tag, bits); (i = taghash[h]) != 0; h = (h + 1) & mask)
+		if (tif->tif_fields[i - 1]->field_tag == tag)
+			return i - 1;
+	return (uint32) -1;
+}
 
-	key.field_tag = tag;
-	key.field_type = dt;
+const TIFFField*
+TIFFFindField(TIFF* tif, uint32 tag, TIFFDataType dt)
+{
+	uint32 i = _TIFFFindFieldIndex(tif, tag);
 
-	ret = (const TIFFField **) bsearch(&pkey, tif->tif_fields,
-					   tif->tif_nfields,
-					   sizeof(TIFFField *), tagCompare);
-	return tif->tif_foundfield = (ret ? *ret : NULL);
+	if (i == (uint32) -1)
+		return NULL;
+	if (dt == TIFF_ANY)
+		return tif->tif_fields[i];
+
+	/* Definitions of a tag with different types follow each other */
+	for (; i < tif->tif_nfields && tif->tif_fields[i]->field_tag == tag; i++)
+		if (tif->tif_fields[i]->field_type == dt)
+			return tif->tif_fields[i];
+	return NULL;
 }
 
 static const TIFFField*
 _TIFFFindFieldByName(TIFF* tif, const char *field_name, TIFFDataType dt)
 {
-	TIFFField key = {0, 0, 0, TIFF_NOTYPE, 0, 0, 0, 0, 0, 0, NULL, NULL};
-	TIFFField* pkey = &key;
-	const TIFFField **ret;
-	if (tif->tif_foundfield
-	    && streq(tif->tif_foundfield->field_name, field_name)
-	    && (dt == TIFF_ANY || dt == tif->tif_foundfield->field_type))
-		return (tif->tif_foundfield);
+	uint32 bits, mask, h, i;
+	const uint32* namehash;
 
 	/* If we are invoked with no field information, then just return. */
-	if (!tif->tif_fields)
+	if (!tif->tif_fields || !tif->tif_fieldslookup)
 		return NULL;
 
-	/* NB: use linear search since list is sorted by key#, not name */
-
-	key.field_name = (char *)field_name;
-	key.field_type = dt;
-
-	ret = (const TIFFField **) 
-            td_lfind(&pkey, tif->tif_fields, &tif->tif_nfields,
-                     sizeof(TIFFField *), tagNameCompare);
-
-	return tif->tif_foundfield = (ret ? *ret : NULL);
+	if (!tif->tif_fieldsnamevalid)
+		_TIFFSetupFieldNameLookup(tif);
+	bits = tif->tif_fieldshashbits;
+	mask = ((uint32) 1 << bits) - 1;
+	namehash = tif->tif_fieldslookup + TIFF_FIELDS_DIRECT + mask + 1;
+	for (h = tagNameHash(field_name, bits); (i = namehash[h]) != 0;
+	     h = (h + 1) & mask) {
+		const TIFFField* fip = tif->tif_fields[i - 1];
+		if (streq(fip->field_name, field_name)
+		    && (dt == TIFF_ANY || dt == fip->field_type))
+			return fip;
+	}
+	return NULL;
 }
 
 const TIFFField*
@@ -638,7 +790,7 @@ _TIFFCreateAnonField(TIFF *tif, uint32 tag, TIFFDataType field_type)
 	TIFFField *fld;
 	(void) tif;
 
-	fld = (TIFFField *) _TIFFmalloc(sizeof (TIFFField));
+	fld = (TIFFField *) _TIFFmallocExt(tif, sizeof (TIFFField));
 	if (fld == NULL)
 	    return NULL;
 	_TIFFmemset(fld, 0, sizeof(TIFFField));
@@ -710,9 +862,9 @@ _TIFFCreateAnonField(TIFF *tif, uint32 tag, TIFFDataType field_type)
 	fld->field_bit = FIELD_CUSTOM;
 	fld->field_oktochange = TRUE;
 	fld->field_passcount = TRUE;
-	fld->field_name = (char *) _TIFFmalloc(32);
+	fld->field_name = (char *) _TIFFmallocExt(tif, 32);
 	if (fld->field_name == NULL) {
-	    _TIFFfree(fld);
+	    _TIFFfreeExt(tif, fld);
 	    return NULL;
 	}
 	fld->field_subfields = NULL;
@@ -897,12 +1049,12 @@ TIFFMergeFieldInfo(TIFF* tif, const TIFFFieldInfo info[], uint32 n)
 
 	if (tif->tif_nfieldscompat > 0) {
 		tif->tif_fieldscompat = (TIFFFieldArray *)
-			_TIFFCheckRealloc(tif, tif->tif_fieldscompat,
+			_TIFFCheckReallocExt(tif, tif->tif_fieldscompat,
 					  tif->tif_nfieldscompat + 1,
 					  sizeof(TIFFFieldArray), reason);
 	} else {
 		tif->tif_fieldscompat = (TIFFFieldArray *)
-			_TIFFCheckMalloc(tif, 1, sizeof(TIFFFieldArray),
+			_TIFFCheckMallocExt(tif, 1, sizeof(TIFFFieldArray),
 					 reason);
 	}
 	if (!tif->tif_fieldscompat) {
@@ -916,7 +1068,7 @@ TIFFMergeFieldInfo(TIFF* tif, const TIFFFieldInfo info[], uint32 n)
 	tif->tif_fieldscompat[nfields].allocated_size = n;
 	tif->tif_fieldscompat[nfields].count = n;
 	tif->tif_fieldscompat[nfields].fields =
-		(TIFFField *)_TIFFCheckMalloc(tif, n, sizeof(TIFFField),
+		(TIFFField *)_TIFFCheckMallocExt(tif, n, sizeof(TIFFField),
 					      reason);
 	if (!tif->tif_fieldscompat[nfields].fields) {
 		TIFFErrorExt(tif->tif_clientdata, module,
@@ -165,10 +165,19 @@ static uint16 TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 static int TIFFFetchNormalTag(TIFF*, TIFFDirEntry*, int recover);
 static int TIFFFetchStripThing(TIFF* tif, TIFFDirEntry* dir, uint32 nstrips, uint64** lpp);
 static int TIFFFetchSubjectDistance(TIFF*, TIFFDirEntry*);
+static int TIFFCheckColorArray(TIFF*, TIFFDirEntry*, uint32*);
+static void TIFFFetchColorArray(TIFF*, TIFFDirEntry*, uint32);
+static int TIFFDeferTag(TIFF*, TIFFDirEntry*);
+static uint32 TIFFFindDeferredTag(TIFF*, uint32);
+static void TIFFFetchDeferredEntry(TIFF*, TIFFDirEntry*);
 static void ChopUpSingleUncompressedStrip(TIFF*);
 static uint64 TIFFReadUInt64(const uint8 *value);
 
 static int _TIFFFillStrilesInternal( TIFF *tif, int loadStripByteCount );
+static int TIFFIsEmptyDirEntry(TIFFDirEntry* dirent);
+static int TIFFStrileEntryIsLazy(TIFF* tif, TIFFDirEntry* dirent);
+static int TIFFFetchStrileValue(TIFF* tif, TIFFDirEntry* dirent, uint32 strile, uint64* value);
+static uint64 TIFFGetStrileValue(TIFF* tif, uint32 strile, TIFFDirEntry* dirent, uint64** parray, int* pbErr);
 
 typedef union _UInt64Aligned_t
 {
@@ -805,8 +814,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryDataAndRealloc(
             }
 #endif
 
-            new_dest = (uint8*) _TIFFrealloc(
-                            *pdest, already_read + to_read);
+            new_dest = (uint8*) _TIFFreallocExt(tif, *pdest, already_read + to_read);
             if( new_dest == NULL )
             {
                 TIFFErrorExt(tif->tif_clientdata, tif->tif_name,
@@ -873,7 +881,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryArrayWithLimit(
 	}
 	else
 	{
-		data=_TIFFCheckMalloc(tif, *count, typesize, "ReadDirEntryArray");
+		data=_TIFFCheckMallocExt(tif, *count, typesize, "ReadDirEntryArray");
 		if (data==0)
 			return(TIFFReadDirEntryErrAlloc);
 	}
@@ -893,7 +901,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryArrayWithLimit(
 				err=TIFFReadDirEntryDataAndRealloc(tif,(uint64)offset,(tmsize_t)datasize,&data);
 			if (err!=TIFFReadDirEntryErrOk)
 			{
-				_TIFFfree(data);
+				_TIFFfreeExt(tif, data);
 				return(err);
 			}
 		}
@@ -914,7 +922,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryArrayWithLimit(
 				err=TIFFReadDirEntryDataAndRealloc(tif,(uint64)offset,(tmsize_t)datasize,&data);
 			if (err!=TIFFReadDirEntryErrOk)
 			{
-				_TIFFfree(data);
+				_TIFFfreeExt(tif, data);
 				return(err);
 			}
 		}
@@ -974,7 +982,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryByteArray(TIFF* tif, TIFFDirEntr
 					err=TIFFReadDirEntryCheckRangeByteSbyte(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -983,10 +991,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryByteArray(TIFF* tif, TIFFDirEntr
 				return(TIFFReadDirEntryErrOk);
 			}
 	}
-	data=(uint8*)_TIFFmalloc(count);
+	data=(uint8*)_TIFFmallocExt(tif, count);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -1100,10 +1108,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryByteArray(TIFF* tif, TIFFDirEntr
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -1150,7 +1158,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySbyteArray(TIFF* tif, TIFFDirEnt
 					err=TIFFReadDirEntryCheckRangeSbyteByte(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -1162,10 +1170,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySbyteArray(TIFF* tif, TIFFDirEnt
 			*value=(int8*)origdata;
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(int8*)_TIFFmalloc(count);
+	data=(int8*)_TIFFmallocExt(tif, count);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -1279,10 +1287,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySbyteArray(TIFF* tif, TIFFDirEnt
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -1334,7 +1342,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryShortArray(TIFF* tif, TIFFDirEnt
 					err=TIFFReadDirEntryCheckRangeShortSshort(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -1343,10 +1351,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryShortArray(TIFF* tif, TIFFDirEnt
 				return(TIFFReadDirEntryErrOk);
 			}
 	}
-	data=(uint16*)_TIFFmalloc(count*2);
+	data=(uint16*)_TIFFmallocExt(tif, count*2);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -1451,10 +1459,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryShortArray(TIFF* tif, TIFFDirEnt
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -1501,7 +1509,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySshortArray(TIFF* tif, TIFFDirEn
 					err=TIFFReadDirEntryCheckRangeSshortShort(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -1515,10 +1523,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySshortArray(TIFF* tif, TIFFDirEn
 				TIFFSwabArrayOfShort((uint16*)(*value),count);
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(int16*)_TIFFmalloc(count*2);
+	data=(int16*)_TIFFmallocExt(tif, count*2);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -1618,10 +1626,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySshortArray(TIFF* tif, TIFFDirEn
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -1673,7 +1681,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryLongArray(TIFF* tif, TIFFDirEntr
 					err=TIFFReadDirEntryCheckRangeLongSlong(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -1682,10 +1690,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryLongArray(TIFF* tif, TIFFDirEntr
 				return(TIFFReadDirEntryErrOk);
 			}
 	}
-	data=(uint32*)_TIFFmalloc(count*4);
+	data=(uint32*)_TIFFmallocExt(tif, count*4);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -1787,10 +1795,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryLongArray(TIFF* tif, TIFFDirEntr
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -1837,7 +1845,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySlongArray(TIFF* tif, TIFFDirEnt
 					err=TIFFReadDirEntryCheckRangeSlongLong(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -1851,10 +1859,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySlongArray(TIFF* tif, TIFFDirEnt
 				TIFFSwabArrayOfLong((uint32*)(*value),count);
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(int32*)_TIFFmalloc(count*4);
+	data=(int32*)_TIFFmallocExt(tif, count*4);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -1948,10 +1956,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySlongArray(TIFF* tif, TIFFDirEnt
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -2004,7 +2012,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryLong8ArrayWithLimit(
 					err=TIFFReadDirEntryCheckRangeLong8Slong8(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -2013,10 +2021,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryLong8ArrayWithLimit(
 				return(TIFFReadDirEntryErrOk);
 			}
 	}
-	data=(uint64*)_TIFFmalloc(count*8);
+	data=(uint64*)_TIFFmallocExt(tif, count*8);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -2115,10 +2123,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryLong8ArrayWithLimit(
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	if (err!=TIFFReadDirEntryErrOk)
 	{
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		return(err);
 	}
 	*value=data;
@@ -2170,7 +2178,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySlong8Array(TIFF* tif, TIFFDirEn
 					err=TIFFReadDirEntryCheckRangeSlong8Long8(*m);
 					if (err!=TIFFReadDirEntryErrOk)
 					{
-						_TIFFfree(origdata);
+						_TIFFfreeExt(tif, origdata);
 						return(err);
 					}
 					m++;
@@ -2184,10 +2192,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySlong8Array(TIFF* tif, TIFFDirEn
 				TIFFSwabArrayOfLong8((uint64*)(*value),count);
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(int64*)_TIFFmalloc(count*8);
+	data=(int64*)_TIFFmallocExt(tif, count*8);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -2275,7 +2283,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntrySlong8Array(TIFF* tif, TIFFDirEn
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	*value=data;
 	return(TIFFReadDirEntryErrOk);
 }
@@ -2319,10 +2327,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryFloatArray(TIFF* tif, TIFFDirEnt
 			*value=(float*)origdata;
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(float*)_TIFFmalloc(count*sizeof(float));
+	data=(float*)_TIFFmallocExt(tif, count*sizeof(float));
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -2519,7 +2527,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryFloatArray(TIFF* tif, TIFFDirEnt
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	*value=data;
 	return(TIFFReadDirEntryErrOk);
 }
@@ -2564,10 +2572,10 @@ TIFFReadDirEntryDoubleArray(TIFF* tif, TIFFDirEntry* direntry, double** value)
 			*value=(double*)origdata;
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(double*)_TIFFmalloc(count*sizeof(double));
+	data=(double*)_TIFFmallocExt(tif, count*sizeof(double));
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -2757,7 +2765,7 @@ TIFFReadDirEntryDoubleArray(TIFF* tif, TIFFDirEntry* direntry, double** value)
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	*value=data;
 	return(TIFFReadDirEntryErrOk);
 }
@@ -2793,10 +2801,10 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryIfd8Array(TIFF* tif, TIFFDirEntr
 				TIFFSwabArrayOfLong8(*value,count);
 			return(TIFFReadDirEntryErrOk);
 	}
-	data=(uint64*)_TIFFmalloc(count*8);
+	data=(uint64*)_TIFFmallocExt(tif, count*8);
 	if (data==0)
 	{
-		_TIFFfree(origdata);
+		_TIFFfreeExt(tif, origdata);
 		return(TIFFReadDirEntryErrAlloc);
 	}
 	switch (direntry->tdir_type)
@@ -2818,7 +2826,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryIfd8Array(TIFF* tif, TIFFDirEntr
 			}
 			break;
 	}
-	_TIFFfree(origdata);
+	_TIFFfreeExt(tif, origdata);
 	*value=data;
 	return(TIFFReadDirEntryErrOk);
 }
@@ -2847,7 +2855,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryPersampleShort(TIFF* tif, TIFFDi
 		}
 		nb--;
 	}
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(err);
 }
 
@@ -2876,7 +2884,7 @@ static enum TIFFReadDirEntryErr TIFFReadDirEntryPersampleDouble(TIFF* tif, TIFFD
 		}
 		nb--;
 	}
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(err);
 }
 #endif
@@ -3526,6 +3534,7 @@ TIFFReadDirectory(TIFF* tif)
 	tif->tif_diroff=tif->tif_nextdiroff;
 	if (!TIFFCheckDirOffset(tif,tif->tif_nextdiroff))
 		return 0;           /* last offset or bad offset (IFD looping) */
+	_TIFFDetachDirectory(tif);  /* keep a snapshotted directory */
 	(*tif->tif_cleanup)(tif);   /* cleanup any previous compression state */
 	tif->tif_curdir++;
         nextdiroff = tif->tif_nextdiroff;
@@ -3700,8 +3709,6 @@ TIFFReadDirectory(TIFF* tif)
 	if ((tif->tif_dir.td_compression==COMPRESSION_OJPEG)&&
 	    (tif->tif_dir.td_planarconfig==PLANARCONFIG_SEPARATE))
 	{
-        if (!_TIFFFillStriles(tif))
-            goto bad;
 		dp=TIFFReadDirectoryFindEntry(tif,dir,dircount,TIFFTAG_STRIPOFFSETS);
 		if ((dp!=0)&&(dp->tdir_count==1))
 		{
@@ -3768,6 +3775,13 @@ TIFFReadDirectory(TIFF* tif)
 			goto bad;
 		}
 	}
+	/*
+	 * In lazy directory mode, array and blob values are left in
+	 * the file and only fetched when asked for.
+	 */
+	if (tif->tif_flags&TIFF_LAZYDIR)
+		tif->tif_dir.td_deferred=(TIFFDirEntry*)_TIFFArenaMalloc(tif,
+		    dircount,sizeof(TIFFDirEntry),"for deferred directory entries");
 	/*
 	 * Second pass: extract other information.
 	 */
@@ -3832,18 +3846,15 @@ TIFFReadDirectory(TIFF* tif)
 					tif->tif_flags |= TIFF_PERSAMPLE;
 					m = TIFFSetField(tif,dp->tdir_tag,data);
 					tif->tif_flags = saved_flags;
-					_TIFFfree(data);
+					_TIFFfreeExt(tif, data);
 					if (!m)
 						goto bad;
 				}
 				break;
 			case TIFFTAG_STRIPOFFSETS:
 			case TIFFTAG_TILEOFFSETS:
-#if defined(DEFER_STRILE_LOAD)
-                                _TIFFmemcpy( &(tif->tif_dir.td_stripoffset_entry),
-                                             dp, sizeof(TIFFDirEntry) );
-#else                          
-                                if( tif->tif_dir.td_stripoffset != NULL )
+                                if( tif->tif_dir.td_stripoffset_p != NULL ||
+                                    tif->tif_dir.td_stripoffset_entry.tdir_count != 0 )
                                 {
                                     TIFFErrorExt(tif->tif_clientdata, module,
                                         "tif->tif_dir.td_stripoffset is "
@@ -3851,17 +3862,17 @@ TIFFReadDirectory(TIFF* tif)
                                         "StripOffsets/TileOffsets tag");
                                     goto bad;
                                 }
-				if (!TIFFFetchStripThing(tif,dp,tif->tif_dir.td_nstrips,&tif->tif_dir.td_stripoffset))  
+                                _TIFFmemcpy( &(tif->tif_dir.td_stripoffset_entry),
+                                             dp, sizeof(TIFFDirEntry) );
+                                if( (tif->tif_flags&TIFF_DEFERSTRILELOAD) == 0 &&
+                                    !TIFFIsEmptyDirEntry(dp) &&
+                                    !TIFFFetchStripThing(tif,dp,tif->tif_dir.td_nstrips,&tif->tif_dir.td_stripoffset_p))
 					goto bad;
-#endif                                
 				break;
 			case TIFFTAG_STRIPBYTECOUNTS:
 			case TIFFTAG_TILEBYTECOUNTS:
-#if defined(DEFER_STRILE_LOAD)
-                                _TIFFmemcpy( &(tif->tif_dir.td_stripbytecount_entry),
-                                             dp, sizeof(TIFFDirEntry) );
-#else                          
-                                if( tif->tif_dir.td_stripbytecount != NULL )
+                                if( tif->tif_dir.td_stripbytecount_p != NULL ||
+                                    tif->tif_dir.td_stripbytecount_entry.tdir_count != 0 )
                                 {
                                     TIFFErrorExt(tif->tif_clientdata, module,
                                         "tif->tif_dir.td_stripbytecount is "
@@ -3869,18 +3880,17 @@ TIFFReadDirectory(TIFF* tif)
                                         "StripByteCounts/TileByteCounts tag");
                                     goto bad;
                                 }
-                                if (!TIFFFetchStripThing(tif,dp,tif->tif_dir.td_nstrips,&tif->tif_dir.td_stripbytecount))  
+                                _TIFFmemcpy( &(tif->tif_dir.td_stripbytecount_entry),
+                                             dp, sizeof(TIFFDirEntry) );
+                                if( (tif->tif_flags&TIFF_DEFERSTRILELOAD) == 0 &&
+                                    !TIFFIsEmptyDirEntry(dp) &&
+                                    !TIFFFetchStripThing(tif,dp,tif->tif_dir.td_nstrips,&tif->tif_dir.td_stripbytecount_p))
 					goto bad;
-#endif                                
 				break;
 			case TIFFTAG_COLORMAP:
 			case TIFFTAG_TRANSFERFUNCTION:
 				{
-					enum TIFFReadDirEntryErr err;
-					uint32 countpersample;
-					uint32 countrequired;
 					uint32 incrementpersample;
-					uint16* value=NULL;
                     /* It would be dangerous to instantiate those tag values */
                     /* since if td_bitspersample has not yet been read (due to */
                     /* unordered tags), it could be read afterwards with a */
@@ -3894,43 +3904,9 @@ TIFFReadDirectory(TIFF* tif)
                                        fip ? fip->field_name : "unknown tagname");
                         continue;
                     }
-					/* ColorMap or TransferFunction for high bit */
-					/* depths do not make much sense and could be */
-					/* used as a denial of service vector */
-					if (tif->tif_dir.td_bitspersample > 24)
-					{
-					    fip = TIFFFieldWithTag(tif,dp->tdir_tag);
-					    TIFFWarningExt(tif->tif_clientdata,module,
-						"Ignoring %s because BitsPerSample=%d>24",
-						fip ? fip->field_name : "unknown tagname",
-						tif->tif_dir.td_bitspersample);
-					    continue;
-					}
-					countpersample=(1U<<tif->tif_dir.td_bitspersample);
-					if ((dp->tdir_tag==TIFFTAG_TRANSFERFUNCTION)&&(dp->tdir_count==(uint64)countpersample))
-					{
-						countrequired=countpersample;
-						incrementpersample=0;
-					}
-					else
-					{
-						countrequired=3*countpersample;
-						incrementpersample=countpersample;
-					}
-					if (dp->tdir_count!=(uint64)countrequired)
-						err=TIFFReadDirEntryErrCount;
-					else
-						err=TIFFReadDirEntryShortArray(tif,dp,&value);
-					if (err!=TIFFReadDirEntryErrOk)
-                    {
-						fip = TIFFFieldWithTag(tif,dp->tdir_tag);
-						TIFFReadDirEntryOutputErr(tif,err,module,fip ? fip->field_name : "unknown tagname",1);
-                    }
-					else
-					{
-						TIFFSetField(tif,dp->tdir_tag,value,value+incrementpersample,value+2*incrementpersample);
-						_TIFFfree(value);
-					}
+					if (TIFFCheckColorArray(tif,dp,&incrementpersample)&&
+					    !TIFFDeferTag(tif,dp))
+						TIFFFetchColorArray(tif,dp,incrementpersample);
 				}
 				break;
 /* BEGIN REV 4.0 COMPATIBILITY */
@@ -3953,10 +3929,23 @@ TIFFReadDirectory(TIFF* tif)
 				break;
 /* END REV 4.0 COMPATIBILITY */
 			default:
-				(void) TIFFFetchNormalTag(tif, dp, TRUE);
+				if (!TIFFDeferTag(tif,dp))
+					(void) TIFFFetchNormalTag(tif, dp, TRUE);
 				break;
 		}
 	}
+	/*
+	 * A directory written with TIFFDeferStrileArrayWriting() has empty
+	 * strile array entries until TIFFForceStrileArrayWriting() is used.
+	 * In update mode, start with arrays placing all data at the end of
+	 * the file, as for a new directory.
+	 */
+	if (TIFFIsEmptyDirEntry(&tif->tif_dir.td_stripoffset_entry) &&
+	    TIFFIsEmptyDirEntry(&tif->tif_dir.td_stripbytecount_entry))
+	{
+		if (tif->tif_mode == O_RDWR && !TIFFSetupStrips(tif))
+			goto bad;
+	}
 	/*
 	 * OJPEG hack:
 	 * - If a) compression is OJPEG, and b) photometric tag is missing,
@@ -4030,7 +4019,8 @@ TIFFReadDirectory(TIFF* tif)
 	 * Verify Palette image has a Colormap.
 	 */
 	if (tif->tif_dir.td_photometric == PHOTOMETRIC_PALETTE &&
-	    !TIFFFieldSet(tif, FIELD_COLORMAP)) {
+	    !TIFFFieldSet(tif, FIELD_COLORMAP) &&
+	    TIFFFindDeferredTag(tif, TIFFTAG_COLORMAP) == tif->tif_dir.td_ndeferred) {
 		if ( tif->tif_dir.td_bitspersample>=8 && tif->tif_dir.td_samplesperpixel==3)
 			tif->tif_dir.td_photometric = PHOTOMETRIC_RGB;
 		else if (tif->tif_dir.td_bitspersample>=8)
@@ -4082,18 +4072,17 @@ TIFFReadDirectory(TIFF* tif)
 		 *     dumped out.
 		 */
 		#define	BYTECOUNTLOOKSBAD \
-		    ( (tif->tif_dir.td_stripbytecount[0] == 0 && tif->tif_dir.td_stripoffset[0] != 0) || \
+		    ( (TIFFGetStrileByteCount(tif, 0) == 0 && TIFFGetStrileOffset(tif, 0) != 0) || \
 		      (tif->tif_dir.td_compression == COMPRESSION_NONE && \
-		       (tif->tif_dir.td_stripoffset[0] <= TIFFGetFileSize(tif) && \
-		        tif->tif_dir.td_stripbytecount[0] > TIFFGetFileSize(tif) - tif->tif_dir.td_stripoffset[0])) || \
+		       (TIFFGetStrileOffset(tif, 0) <= TIFFGetFileSize(tif) && \
+		        TIFFGetStrileByteCount(tif, 0) > TIFFGetFileSize(tif) - TIFFGetStrileOffset(tif, 0))) || \
 		      (tif->tif_mode == O_RDONLY && \
 		       tif->tif_dir.td_compression == COMPRESSION_NONE && \
-		       tif->tif_dir.td_stripbytecount[0] < TIFFScanlineSize64(tif) * tif->tif_dir.td_imagelength) )
+		       TIFFGetStrileByteCount(tif, 0) < TIFFScanlineSize64(tif) * tif->tif_dir.td_imagelength) )
 
 		} else if (tif->tif_dir.td_nstrips == 1
                            && !(tif->tif_flags&TIFF_ISTILED)
-                           && _TIFFFillStriles(tif)
-			   && tif->tif_dir.td_stripoffset[0] != 0
+			   && TIFFGetStrileOffset(tif, 0) != 0
 			   && BYTECOUNTLOOKSBAD) {
 			/*
 			 * XXX: Plexus (and others) sometimes give a value of
@@ -4106,33 +4095,32 @@ TIFFReadDirectory(TIFF* tif)
 			if(EstimateStripByteCounts(tif, dir, dircount) < 0)
 			    goto bad;
 
-#if !defined(DEFER_STRILE_LOAD)
 		} else if (tif->tif_dir.td_planarconfig == PLANARCONFIG_CONTIG
 			   && tif->tif_dir.td_nstrips > 2
 			   && tif->tif_dir.td_compression == COMPRESSION_NONE
-			   && tif->tif_dir.td_stripbytecount[0] != tif->tif_dir.td_stripbytecount[1]
-			   && tif->tif_dir.td_stripbytecount[0] != 0
-			   && tif->tif_dir.td_stripbytecount[1] != 0 ) {
+			   && (tif->tif_flags&(TIFF_DEFERSTRILELOAD|TIFF_LAZYSTRILELOAD)) != TIFF_DEFERSTRILELOAD
+			   && TIFFGetStrileByteCount(tif, 0) != TIFFGetStrileByteCount(tif, 1)
+			   && TIFFGetStrileByteCount(tif, 0) != 0
+			   && TIFFGetStrileByteCount(tif, 1) != 0 ) {
 			/*
 			 * XXX: Some vendors fill StripByteCount array with
 			 * absolutely wrong values (it can be equal to
 			 * StripOffset array, for example). Catch this case
 			 * here.
                          *
-                         * We avoid this check if deferring strile loading
-                         * as it would always force us to load the strip/tile
-                         * information.
+                         * We avoid this check if deferring loading of whole
+                         * strile arrays as it would always force us to load
+                         * them; reading single values on demand is cheap.
 			 */
 			TIFFWarningExt(tif->tif_clientdata, module,
 			    "Wrong \"StripByteCounts\" field, ignoring and calculating from imagelength");
 			if (EstimateStripByteCounts(tif, dir, dircount) < 0)
 			    goto bad;
-#endif /* !defined(DEFER_STRILE_LOAD) */                        
 		}
 	}
 	if (dir)
 	{
-		_TIFFfree(dir);
+		_TIFFfreeExt(tif, dir);
 		dir=NULL;
 	}
 	if (!TIFFFieldSet(tif, FIELD_MAXSAMPLEVALUE))
@@ -4147,20 +4135,18 @@ TIFFReadDirectory(TIFF* tif)
 	 * bytecounts array. See also comments for TIFFAppendToStrip()
 	 * function in tif_write.c.
 	 */
-#if !defined(DEFER_STRILE_LOAD)        
-	if (tif->tif_dir.td_nstrips > 1) {
+	if (tif->tif_dir.td_nstrips > 1 && tif->tif_dir.td_stripoffset_p) {
 		uint32 strip;
 
 		tif->tif_dir.td_stripbytecountsorted = 1;
 		for (strip = 1; strip < tif->tif_dir.td_nstrips; strip++) {
-			if (tif->tif_dir.td_stripoffset[strip - 1] >
-			    tif->tif_dir.td_stripoffset[strip]) {
+			if (tif->tif_dir.td_stripoffset_p[strip - 1] >
+			    tif->tif_dir.td_stripoffset_p[strip]) {
 				tif->tif_dir.td_stripbytecountsorted = 0;
 				break;
 			}
 		}
 	}
-#endif /* !defined(DEFER_STRILE_LOAD) */
         
 	/*
 	 * An opportunity for compression mode dependent tag fixup
@@ -4181,7 +4167,7 @@ TIFFReadDirectory(TIFF* tif)
 	    (tif->tif_dir.td_compression==COMPRESSION_NONE)&&  
 	    ((tif->tif_flags&(TIFF_STRIPCHOP|TIFF_ISTILED))==TIFF_STRIPCHOP))
     {
-        if ( !_TIFFFillStriles(tif) || !tif->tif_dir.td_stripbytecount )
+        if ( !_TIFFFillStriles(tif) || !tif->tif_dir.td_stripbytecount_p )
             return 0;
 		ChopUpSingleUncompressedStrip(tif);
     }
@@ -4225,7 +4211,7 @@ TIFFReadDirectory(TIFF* tif)
 	return (1);
 bad:
 	if (dir)
-		_TIFFfree(dir);
+		_TIFFfreeExt(tif, dir);
 	return (0);
 }
 
@@ -4266,33 +4252,7 @@ TIFFReadDirectoryFindEntry(TIFF* tif, TIFFDirEntry* dir, uint16 dircount, uint16
 static void
 TIFFReadDirectoryFindFieldInfo(TIFF* tif, uint16 tagid, uint32* fii)
 {
-	int32 ma,mb,mc;
-	ma=-1;
-	mc=(int32)tif->tif_nfields;
-	while (1)
-	{
-		if (ma+1==mc)
-		{
-			*fii = FAILED_FII;
-			return;
-		}
-		mb=(ma+mc)/2;
-		if (tif->tif_fields[mb]->field_tag==(uint32)tagid)
-			break;
-		if (tif->tif_fields[mb]->field_tag<(uint32)tagid)
-			ma=mb;
-		else
-			mc=mb;
-	}
-	while (1)
-	{
-		if (mb==0)
-			break;
-		if (tif->tif_fields[mb-1]->field_tag!=(uint32)tagid)
-			break;
-		mb--;
-	}
-	*fii=mb;
+	*fii = _TIFFFindFieldIndex(tif, tagid);
 }
 
 /*
@@ -4310,6 +4270,7 @@ TIFFReadCustomDirectory(TIFF* tif, toff_t diroff,
 	uint16 di;
 	const TIFFField* fip;
 	uint32 fii;
+	_TIFFDetachDirectory(tif);
 	_TIFFSetupFields(tif, infoarray);
 	dircount=TIFFFetchDirectory(tif,diroff,&dir,NULL);
 	if (!dircount)
@@ -4398,7 +4359,7 @@ TIFFReadCustomDirectory(TIFF* tif, toff_t diroff,
 		}
 	}
 	if (dir)
-		_TIFFfree(dir);
+		_TIFFfreeExt(tif, dir);
 	return 1;
 }
 
@@ -4427,12 +4388,12 @@ EstimateStripByteCounts(TIFF* tif, TIFFDirEntry* dir, uint16 dircount)
         if( !_TIFFFillStrilesInternal( tif, 0 ) )
             return -1;
 
-	if (td->td_stripbytecount)
-		_TIFFfree(td->td_stripbytecount);
-	td->td_stripbytecount = (uint64*)
-	    _TIFFCheckMalloc(tif, td->td_nstrips, sizeof (uint64),
+	if (td->td_stripbytecount_p)
+		_TIFFfreeExt(tif, td->td_stripbytecount_p);
+	td->td_stripbytecount_p = (uint64*)
+	    _TIFFCheckMallocExt(tif, td->td_nstrips, sizeof (uint64),
 		"for \"StripByteCounts\" array");
-        if( td->td_stripbytecount == NULL )
+        if( td->td_stripbytecount_p == NULL )
             return -1;
 
 	if (td->td_compression != COMPRESSION_NONE) {
@@ -4477,7 +4438,7 @@ EstimateStripByteCounts(TIFF* tif, TIFFDirEntry* dir, uint16 dircount)
 		if (td->td_planarconfig == PLANARCONFIG_SEPARATE)
 			space /= td->td_samplesperpixel;
 		for (strip = 0; strip < td->td_nstrips; strip++)
-			td->td_stripbytecount[strip] = space;
+			td->td_stripbytecount_p[strip] = space;
 		/*
 		 * This gross hack handles the case were the offset to
 		 * the last strip is past the place where we think the strip
@@ -4486,18 +4447,18 @@ EstimateStripByteCounts(TIFF* tif, TIFFDirEntry* dir, uint16 dircount)
 		 * of data in the strip and trim this number back accordingly.
 		 */
 		strip--;
-		if (td->td_stripoffset[strip]+td->td_stripbytecount[strip] > filesize)
-			td->td_stripbytecount[strip] = filesize - td->td_stripoffset[strip];
+		if (td->td_stripoffset_p[strip]+td->td_stripbytecount_p[strip] > filesize)
+			td->td_stripbytecount_p[strip] = filesize - td->td_stripoffset_p[strip];
 	} else if (isTiled(tif)) {
 		uint64 bytespertile = TIFFTileSize64(tif);
 
 		for (strip = 0; strip < td->td_nstrips; strip++)
-		    td->td_stripbytecount[strip] = bytespertile;
+		    td->td_stripbytecount_p[strip] = bytespertile;
 	} else {
 		uint64 rowbytes = TIFFScanlineSize64(tif);
 		uint32 rowsperstrip = td->td_imagelength/td->td_stripsperimage;
 		for (strip = 0; strip < td->td_nstrips; strip++)
-			td->td_stripbytecount[strip] = rowbytes * rowsperstrip;
+			td->td_stripbytecount_p[strip] = rowbytes * rowsperstrip;
 	}
 	TIFFSetFieldBit(tif, FIELD_STRIPBYTECOUNTS);
 	if (!TIFFFieldSet(tif, FIELD_ROWSPERSTRIP))
@@ -4548,7 +4509,7 @@ TIFFCheckDirOffset(TIFF* tif, uint64 diroff)
 		 * XXX: Reduce memory allocation granularity of the dirlist
 		 * array.
 		 */
-		new_dirlist = (uint64*)_TIFFCheckRealloc(tif, tif->tif_dirlist,
+		new_dirlist = (uint64*)_TIFFCheckReallocExt(tif, tif->tif_dirlist,
 		    tif->tif_dirnumber, 2 * sizeof(uint64), "for IFD list");
 		if (!new_dirlist)
 			return 0;
@@ -4657,7 +4618,7 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 			dircount16 = (uint16)dircount64;
 			dirsize = 20;
 		}
-		origdir = _TIFFCheckMalloc(tif, dircount16,
+		origdir = _TIFFCheckMallocExt(tif, dircount16,
 		    dirsize, "to read TIFF directory");
 		if (origdir == NULL)
 			return 0;
@@ -4665,7 +4626,7 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 			TIFFErrorExt(tif->tif_clientdata, module,
 				"%.100s: Can not read TIFF directory",
 				tif->tif_name);
-			_TIFFfree(origdir);
+			_TIFFfreeExt(tif, origdir);
 			return 0;
 		}
 		/*
@@ -4759,7 +4720,7 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 			             "Sanity check on directory count failed, zero tag directories not supported");
 			return 0;
 		}
-		origdir = _TIFFCheckMalloc(tif, dircount16,
+		origdir = _TIFFCheckMallocExt(tif, dircount16,
 						dirsize,
 						"to read TIFF directory");
 		if (origdir == NULL)
@@ -4768,7 +4729,7 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 		if ((m<off)||(m<(tmsize_t)(dircount16*dirsize))||(m>tif->tif_size)) {
 			TIFFErrorExt(tif->tif_clientdata, module,
 				     "Can not read TIFF directory");
-			_TIFFfree(origdir);
+			_TIFFfreeExt(tif, origdir);
 			return 0;
 		} else {
 			_TIFFmemcpy(origdir, tif->tif_base + off,
@@ -4802,12 +4763,12 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 			}
 		}
 	}
-	dir = (TIFFDirEntry*)_TIFFCheckMalloc(tif, dircount16,
+	dir = (TIFFDirEntry*)_TIFFCheckMallocExt(tif, dircount16,
 						sizeof(TIFFDirEntry),
 						"to read TIFF directory");
 	if (dir==0)
 	{
-		_TIFFfree(origdir);
+		_TIFFfreeExt(tif, origdir);
 		return 0;
 	}
 	ma=(uint8*)origdir;
@@ -4828,6 +4789,7 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 				TIFFSwabLong((uint32*)ma);
 			mb->tdir_count=(uint64)(*(uint32*)ma);
 			ma+=sizeof(uint32);
+			mb->tdir_offset.toff_long8=0;
 			*(uint32*)(&mb->tdir_offset)=*(uint32*)ma;
 			ma+=sizeof(uint32);
 		}
@@ -4842,7 +4804,7 @@ TIFFFetchDirectory(TIFF* tif, uint64 diroff, TIFFDirEntry** pdir,
 		}
 		mb++;
 	}
-	_TIFFfree(origdir);
+	_TIFFfreeExt(tif, origdir);
 	*pdir = dir;
 	return dircount16;
 }
@@ -4902,22 +4864,22 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						if ((uint32)dp->tdir_count+1!=dp->tdir_count+1)
 							o=NULL;
 						else
-							o=_TIFFmalloc((uint32)dp->tdir_count+1);
+							o=_TIFFmallocExt(tif, (uint32)dp->tdir_count+1);
 						if (o==NULL)
 						{
 							if (data!=NULL)
-								_TIFFfree(data);
+								_TIFFfreeExt(tif, data);
 							return(0);
 						}
 						_TIFFmemcpy(o,data,(uint32)dp->tdir_count);
 						o[(uint32)dp->tdir_count]=0;
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						data=o;
 					}
 					n=TIFFSetField(tif,dp->tdir_tag,data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!n)
 						return(0);
 				}
@@ -5030,7 +4992,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 				{
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,data[0],data[1]);
-					_TIFFfree(data);
+					_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5055,7 +5017,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5077,7 +5039,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5099,7 +5061,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5121,7 +5083,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5148,7 +5110,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
                         }
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5170,7 +5132,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5192,7 +5154,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5214,7 +5176,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5236,7 +5198,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5258,7 +5220,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5280,7 +5242,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5302,7 +5264,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 						int m;
 						m=TIFFSetField(tif,dp->tdir_tag,(uint16)(dp->tdir_count),data);
 						if (data!=0)
-							_TIFFfree(data);
+							_TIFFfreeExt(tif, data);
 						if (!m)
 							return(0);
 					}
@@ -5325,7 +5287,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
                     }
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5342,7 +5304,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5359,7 +5321,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5376,7 +5338,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5393,7 +5355,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5410,7 +5372,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5427,7 +5389,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5444,7 +5406,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5461,7 +5423,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5478,7 +5440,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5495,7 +5457,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5512,7 +5474,7 @@ TIFFFetchNormalTag(TIFF* tif, TIFFDirEntry* dp, int recover)
 					int m;
 					m=TIFFSetField(tif,dp->tdir_tag,(uint32)(dp->tdir_count),data);
 					if (data!=0)
-						_TIFFfree(data);
+						_TIFFfreeExt(tif, data);
 					if (!m)
 						return(0);
 				}
@@ -5562,18 +5524,18 @@ TIFFFetchStripThing(TIFF* tif, TIFFDirEntry* dir, uint32 nstrips, uint64** lpp)
 
 		if( nstrips > max_nstrips )
 		{
-			_TIFFfree(data);
+			_TIFFfreeExt(tif, data);
 			return(0);
 		}
 
-		resizeddata=(uint64*)_TIFFCheckMalloc(tif,nstrips,sizeof(uint64),"for strip array");
+		resizeddata=(uint64*)_TIFFCheckMallocExt(tif,nstrips,sizeof(uint64),"for strip array");
 		if (resizeddata==0) {
-			_TIFFfree(data);
+			_TIFFfreeExt(tif, data);
 			return(0);
 		}
                 _TIFFmemcpy(resizeddata,data,(uint32)dir->tdir_count*sizeof(uint64));
                 _TIFFmemset(resizeddata+(uint32)dir->tdir_count,0,(nstrips-(uint32)dir->tdir_count)*sizeof(uint64));
-		_TIFFfree(data);
+		_TIFFfreeExt(tif, data);
 		data=resizeddata;
 	}
 	*lpp=data;
@@ -5638,6 +5600,185 @@ TIFFFetchSubjectDistance(TIFF* tif, TIFFDirEntry* dir)
 	}
 }
 
+/*
+ * Check a ColorMap or TransferFunction entry against BitsPerSample and
+ * return the distance between the per-sample tables.
+ */
+static int
+TIFFCheckColorArray(TIFF* tif, TIFFDirEntry* dp, uint32* incrementpersample)
+{
+	static const char module[] = "TIFFReadDirectory";
+	const TIFFField* fip;
+	uint32 countpersample;
+	uint32 countrequired;
+	/* ColorMap or TransferFunction for high bit */
+	/* depths do not make much sense and could be */
+	/* used as a denial of service vector */
+	if (tif->tif_dir.td_bitspersample > 24)
+	{
+		fip = TIFFFieldWithTag(tif,dp->tdir_tag);
+		TIFFWarningExt(tif->tif_clientdata,module,
+		    "Ignoring %s because BitsPerSample=%d>24",
+		    fip ? fip->field_name : "unknown tagname",
+		    tif->tif_dir.td_bitspersample);
+		return(0);
+	}
+	countpersample=(1U<<tif->tif_dir.td_bitspersample);
+	if ((dp->tdir_tag==TIFFTAG_TRANSFERFUNCTION)&&(dp->tdir_count==(uint64)countpersample))
+	{
+		countrequired=countpersample;
+		*incrementpersample=0;
+	}
+	else
+	{
+		countrequired=3*countpersample;
+		*incrementpersample=countpersample;
+	}
+	if (dp->tdir_count!=(uint64)countrequired)
+	{
+		fip = TIFFFieldWithTag(tif,dp->tdir_tag);
+		TIFFReadDirEntryOutputErr(tif,TIFFReadDirEntryErrCount,module,
+		    fip ? fip->field_name : "unknown tagname",1);
+		return(0);
+	}
+	return(1);
+}
+
+/*
+ * Fetch and set a ColorMap or TransferFunction checked by
+ * TIFFCheckColorArray.
+ */
+static void
+TIFFFetchColorArray(TIFF* tif, TIFFDirEntry* dp, uint32 incrementpersample)
+{
+	static const char module[] = "TIFFReadDirectory";
+	enum TIFFReadDirEntryErr err;
+	uint16* value=NULL;
+	err=TIFFReadDirEntryShortArray(tif,dp,&value);
+	if (err!=TIFFReadDirEntryErrOk)
+	{
+		const TIFFField* fip = TIFFFieldWithTag(tif,dp->tdir_tag);
+		TIFFReadDirEntryOutputErr(tif,err,module,fip ? fip->field_name : "unknown tagname",1);
+	}
+	else
+	{
+		TIFFSetField(tif,dp->tdir_tag,value,value+incrementpersample,value+2*incrementpersample);
+		_TIFFfreeExt(tif, value);
+	}
+}
+
+/*
+ * In lazy directory mode, keep an entry whose value does not fit in
+ * the entry itself in the deferred table instead of fetching it now.
+ * Only custom tags, the ColorMap and the TransferFunction are deferred;
+ * everything the library needs to set up decoding is read eagerly.
+ */
+static int
+TIFFDeferTag(TIFF* tif, TIFFDirEntry* dp)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	if (td->td_deferred==NULL)
+		return(0);
+	if ((dp->tdir_tag!=TIFFTAG_COLORMAP)&&(dp->tdir_tag!=TIFFTAG_TRANSFERFUNCTION))
+	{
+		uint32 fii;
+		int width;
+		TIFFReadDirectoryFindFieldInfo(tif,dp->tdir_tag,&fii);
+		if ((fii==FAILED_FII)||(tif->tif_fields[fii]->field_bit!=FIELD_CUSTOM))
+			return(0);
+		width=TIFFDataWidth((TIFFDataType)dp->tdir_type);
+		if ((width==0)||
+		    (dp->tdir_count<=(uint64)(((tif->tif_flags&TIFF_BIGTIFF)?8:4)/width)))
+			return(0);
+	}
+	td->td_deferred[td->td_ndeferred++]=*dp;
+	return(1);
+}
+
+/*
+ * Return the index of the deferred entry for tag, or td_ndeferred.
+ */
+static uint32
+TIFFFindDeferredTag(TIFF* tif, uint32 tag)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	uint32 n;
+	for (n=0; n<td->td_ndeferred; n++)
+	{
+		if (td->td_deferred[n].tdir_tag==tag)
+			break;
+	}
+	return(n);
+}
+
+/*
+ * Fetch a deferred entry.  The directory is not marked dirty, as the
+ * value is the one already in the file.
+ */
+static void
+TIFFFetchDeferredEntry(TIFF* tif, TIFFDirEntry* dp)
+{
+	uint32 dirty = tif->tif_flags & TIFF_DIRTYDIRECT;
+	uint32 incrementpersample;
+	if ((dp->tdir_tag==TIFFTAG_COLORMAP)||(dp->tdir_tag==TIFFTAG_TRANSFERFUNCTION))
+	{
+		if (TIFFCheckColorArray(tif,dp,&incrementpersample))
+			TIFFFetchColorArray(tif,dp,incrementpersample);
+	}
+	else
+		(void) TIFFFetchNormalTag(tif,dp,TRUE);
+	tif->tif_flags = (tif->tif_flags & ~TIFF_DIRTYDIRECT) | dirty;
+}
+
+/*
+ * Fetch the value of tag if a lazy directory read deferred it.
+ */
+int
+_TIFFFetchDeferredTag(TIFF* tif, uint32 tag)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	TIFFDirEntry entry;
+	uint32 n;
+	n=TIFFFindDeferredTag(tif,tag);
+	if (n==td->td_ndeferred)
+		return(0);
+	entry=td->td_deferred[n];
+	_TIFFForgetDeferredTag(tif,tag);
+	TIFFFetchDeferredEntry(tif,&entry);
+	return(1);
+}
+
+/*
+ * Fetch every deferred value, for code that walks the whole directory.
+ */
+void
+_TIFFFetchDeferredTags(TIFF* tif)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	uint32 count = td->td_ndeferred;
+	uint32 n;
+	td->td_ndeferred=0;
+	for (n=0; n<count; n++)
+		TIFFFetchDeferredEntry(tif,&td->td_deferred[n]);
+}
+
+/*
+ * Drop the deferred entry for tag, if any, once its value is set or
+ * unset by other means.
+ */
+void
+_TIFFForgetDeferredTag(TIFF* tif, uint32 tag)
+{
+	TIFFDirectory* td = &tif->tif_dir;
+	uint32 n;
+	n=TIFFFindDeferredTag(tif,tag);
+	if (n==td->td_ndeferred)
+		return;
+	td->td_ndeferred--;
+	for (; n<td->td_ndeferred; n++)
+		td->td_deferred[n]=td->td_deferred[n+1];
+}
+
 /*
  * Replace a single strip (tile) of uncompressed data by multiple strips
  * (tiles), each approximately STRIP_SIZE_DEFAULT bytes. This is useful for
@@ -5659,13 +5800,13 @@ ChopUpSingleUncompressedStrip(TIFF* tif)
 	uint64* newcounts;
 	uint64* newoffsets;
 
-	bytecount = td->td_stripbytecount[0];
+	bytecount = td->td_stripbytecount_p[0];
         /* On a newly created file, just re-opened to be filled, we */
         /* don't want strip chop to trigger as it is going to cause issues */
         /* later ( StripOffsets and StripByteCounts improperly filled) . */
         if( bytecount == 0 && tif->tif_mode != O_RDONLY )
             return;
-	offset = td->td_stripoffset[0];
+	offset = td->td_stripoffset_p[0];
 	assert(td->td_planarconfig == PLANARCONFIG_CONTIG);
 	if ((td->td_photometric == PHOTOMETRIC_YCBCR)&&
 	    (!isUpSampled(tif)))
@@ -5698,9 +5839,9 @@ ChopUpSingleUncompressedStrip(TIFF* tif)
         if( nstrips == 0 )
             return;
 
-	newcounts = (uint64*) _TIFFCheckMalloc(tif, nstrips, sizeof (uint64),
+	newcounts = (uint64*) _TIFFCheckMallocExt(tif, nstrips, sizeof (uint64),
 				"for chopped \"StripByteCounts\" array");
-	newoffsets = (uint64*) _TIFFCheckMalloc(tif, nstrips, sizeof (uint64),
+	newoffsets = (uint64*) _TIFFCheckMallocExt(tif, nstrips, sizeof (uint64),
 				"for chopped \"StripOffsets\" array");
 	if (newcounts == NULL || newoffsets == NULL) {
 		/*
@@ -5708,9 +5849,9 @@ ChopUpSingleUncompressedStrip(TIFF* tif)
 		 * the original one strip information.
 		 */
 		if (newcounts != NULL)
-			_TIFFfree(newcounts);
+			_TIFFfreeExt(tif, newcounts);
 		if (newoffsets != NULL)
-			_TIFFfree(newoffsets);
+			_TIFFfreeExt(tif, newoffsets);
 		return;
 	}
 	/*
@@ -5731,10 +5872,10 @@ ChopUpSingleUncompressedStrip(TIFF* tif)
 	td->td_stripsperimage = td->td_nstrips = nstrips;
 	TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
 
-	_TIFFfree(td->td_stripbytecount);
-	_TIFFfree(td->td_stripoffset);
-	td->td_stripbytecount = newcounts;
-	td->td_stripoffset = newoffsets;
+	_TIFFfreeExt(tif, td->td_stripbytecount_p);
+	_TIFFfreeExt(tif, td->td_stripoffset_p);
+	td->td_stripbytecount_p = newcounts;
+	td->td_stripoffset_p = newoffsets;
 	td->td_stripbytecountsorted = 1;
 }
 
@@ -5745,39 +5886,40 @@ int _TIFFFillStriles( TIFF *tif )
 
 static int _TIFFFillStrilesInternal( TIFF *tif, int loadStripByteCount )
 {
-#if defined(DEFER_STRILE_LOAD)
         register TIFFDirectory *td = &tif->tif_dir;
         int return_value = 1;
 
-        if( td->td_stripoffset != NULL )
+        if( (tif->tif_flags&TIFF_DEFERSTRILELOAD) == 0 )
+                return 1;
+
+        if( td->td_stripoffset_p != NULL )
                 return 1;
 
         if( td->td_stripoffset_entry.tdir_count == 0 )
                 return 0;
 
         if (!TIFFFetchStripThing(tif,&(td->td_stripoffset_entry),
-                                 td->td_nstrips,&td->td_stripoffset))
+                                 td->td_nstrips,&td->td_stripoffset_p))
         {
                 return_value = 0;
         }
 
         if (loadStripByteCount &&
+            td->td_stripbytecount_p == NULL &&
+            td->td_stripbytecount_entry.tdir_count != 0 &&
             !TIFFFetchStripThing(tif,&(td->td_stripbytecount_entry),
-                                 td->td_nstrips,&td->td_stripbytecount))
+                                 td->td_nstrips,&td->td_stripbytecount_p))
         {
                 return_value = 0;
         }
 
-        _TIFFmemset( &(td->td_stripoffset_entry), 0, sizeof(TIFFDirEntry));
-        _TIFFmemset( &(td->td_stripbytecount_entry), 0, sizeof(TIFFDirEntry));
-
 	if (tif->tif_dir.td_nstrips > 1 && return_value == 1 ) {
 		uint32 strip;
 
 		tif->tif_dir.td_stripbytecountsorted = 1;
 		for (strip = 1; strip < tif->tif_dir.td_nstrips; strip++) {
-			if (tif->tif_dir.td_stripoffset[strip - 1] >
-			    tif->tif_dir.td_stripoffset[strip]) {
+			if (tif->tif_dir.td_stripoffset_p[strip - 1] >
+			    tif->tif_dir.td_stripoffset_p[strip]) {
 				tif->tif_dir.td_stripbytecountsorted = 0;
 				break;
 			}
@@ -5785,13 +5927,224 @@ static int _TIFFFillStrilesInternal( TIFF *tif, int loadStripByteCount )
 	}
 
         return return_value;
-#else /* !defined(DEFER_STRILE_LOAD) */
-        (void) tif;
-        (void) loadStripByteCount;
-        return 1;
-#endif 
 }
 
+/*
+ * Check for an entry that only reserves its slot in the directory, as
+ * written by TIFFDeferStrileArrayWriting().
+ */
+static int
+TIFFIsEmptyDirEntry(TIFFDirEntry* dirent)
+{
+	return (dirent->tdir_tag!=0&&dirent->tdir_type==0&&
+	    dirent->tdir_count==0&&dirent->tdir_offset.toff_long8==0);
+}
+
+/*
+ * Check whether single values of a StripOffsets/StripByteCounts entry
+ * can be read on demand.  Other entries (signed or unusual types,
+ * too few values, values stored in the entry itself) are loaded whole.
+ */
+static int
+TIFFStrileEntryIsLazy(TIFF* tif, TIFFDirEntry* dirent)
+{
+	uint32 width;
+	switch (dirent->tdir_type)
+	{
+		case TIFF_SHORT:
+			width=2;
+			break;
+		case TIFF_LONG:
+			width=4;
+			break;
+		case TIFF_LONG8:
+			width=8;
+			break;
+		default:
+			return(0);
+	}
+	if (dirent->tdir_count<(uint64)tif->tif_dir.td_nstrips)
+		return(0);
+	if (dirent->tdir_count<=(uint64)(((tif->tif_flags&TIFF_BIGTIFF)?8:4)/width))
+		return(0);
+	return(1);
+}
+
+/*
+ * Read value strile of a StripOffsets/StripByteCounts entry through the
+ * directory's strile cache, which keeps the few blocks of values most
+ * recently used.
+ */
+static int
+TIFFFetchStrileValue(TIFF* tif, TIFFDirEntry* dirent, uint32 strile,
+    uint64* value)
+{
+	static const char module[] = "TIFFFetchStrileValue";
+	TIFFDirectory *td = &tif->tif_dir;
+	TIFFStrileCache* cache = td->td_strilecache;
+	TIFFStrileBlock* block;
+	enum TIFFReadDirEntryErr err;
+	uint32 first, count, width, n;
+	uint64 dataoff;
+	uint8* raw;
+
+	if (cache==NULL)
+	{
+		cache=(TIFFStrileCache*)_TIFFArenaMalloc(tif,1,
+		    sizeof(TIFFStrileCache),"for strile cache");
+		if (cache==NULL)
+			return(0);
+		_TIFFmemset(cache,0,sizeof(TIFFStrileCache));
+		td->td_strilecache=cache;
+	}
+	first=strile-strile%STRILE_BLOCK_ENTRIES;
+	for (n=0; n<STRILE_CACHE_BLOCKS; n++)
+	{
+		block=&cache->block[n];
+		if ((block->tag==dirent->tdir_tag)&&(block->first==first))
+		{
+			block->lastuse=++cache->clock;
+			*value=block->value[strile-first];
+			return(1);
+		}
+	}
+	block=&cache->block[0];
+	for (n=1; n<STRILE_CACHE_BLOCKS; n++)
+	{
+		if (cache->block[n].lastuse<block->lastuse)
+			block=&cache->block[n];
+	}
+	block->tag=0;
+
+	width=(dirent->tdir_type==TIFF_SHORT)?2:
+	    ((dirent->tdir_type==TIFF_LONG)?4:8);
+	count=td->td_nstrips-first;
+	if (count>STRILE_BLOCK_ENTRIES)
+		count=STRILE_BLOCK_ENTRIES;
+	if (!(tif->tif_flags&TIFF_BIGTIFF))
+	{
+		uint32 offset=dirent->tdir_offset.toff_long;
+		if (tif->tif_flags&TIFF_SWAB)
+			TIFFSwabLong(&offset);
+		dataoff=offset;
+	}
+	else
+	{
+		dataoff=dirent->tdir_offset.toff_long8;
+		if (tif->tif_flags&TIFF_SWAB)
+			TIFFSwabLong8(&dataoff);
+	}
+	if (dataoff>(~(uint64)0)-(uint64)first*width)
+		err=TIFFReadDirEntryErrIo;
+	else
+	{
+		/*
+		 * The raw values are read at the start of the block and
+		 * widened in place from the last one down.
+		 */
+		raw=(uint8*)block->value;
+		err=TIFFReadDirEntryData(tif,dataoff+(uint64)first*width,
+		    (tmsize_t)count*width,raw);
+	}
+	if (err!=TIFFReadDirEntryErrOk)
+	{
+		const TIFFField* fip = TIFFFieldWithTag(tif,dirent->tdir_tag);
+		TIFFReadDirEntryOutputErr(tif,err,module,
+		    fip ? fip->field_name : "unknown tagname",0);
+		return(0);
+	}
+	for (n=count; n-->0;)
+	{
+		if (width==2)
+		{
+			uint16 v;
+			_TIFFmemcpy(&v,raw+n*2,2);
+			if (tif->tif_flags&TIFF_SWAB)
+				TIFFSwabShort(&v);
+			block->value[n]=v;
+		}
+		else if (width==4)
+		{
+			uint32 v;
+			_TIFFmemcpy(&v,raw+n*4,4);
+			if (tif->tif_flags&TIFF_SWAB)
+				TIFFSwabLong(&v);
+			block->value[n]=v;
+		}
+		else if (tif->tif_flags&TIFF_SWAB)
+			TIFFSwabLong8(&block->value[n]);
+	}
+	block->tag=dirent->tdir_tag;
+	block->first=first;
+	block->count=count;
+	block->lastuse=++cache->clock;
+	*value=block->value[strile-first];
+	return(1);
+}
+
+static uint64
+TIFFGetStrileValue(TIFF* tif, uint32 strile, TIFFDirEntry* dirent,
+    uint64** parray, int* pbErr)
+{
+	TIFFDirectory *td = &tif->tif_dir;
+	uint64 value;
+
+	if (pbErr)
+		*pbErr=0;
+	if (strile>=td->td_nstrips)
+		goto bad;
+	if (*parray==NULL)
+	{
+		if ((tif->tif_flags&TIFF_LAZYSTRILELOAD)&&
+		    TIFFStrileEntryIsLazy(tif,dirent))
+		{
+			if (!TIFFFetchStrileValue(tif,dirent,strile,&value))
+				goto bad;
+			return(value);
+		}
+		if (!_TIFFFillStriles(tif)||*parray==NULL)
+			goto bad;
+	}
+	return((*parray)[strile]);
+bad:
+	if (pbErr)
+		*pbErr=1;
+	return(0);
+}
+
+/*
+ * Return the file offset of strip or tile strile, or 0 on error.
+ */
+uint64
+TIFFGetStrileOffset(TIFF* tif, uint32 strile)
+{
+	return TIFFGetStrileOffsetWithErr(tif,strile,NULL);
+}
+
+uint64
+TIFFGetStrileOffsetWithErr(TIFF* tif, uint32 strile, int* pbErr)
+{
+	TIFFDirectory *td = &tif->tif_dir;
+	return TIFFGetStrileValue(tif,strile,&(td->td_stripoffset_entry),
+	    &(td->td_stripoffset_p),pbErr);
+}
+
+/*
+ * Return the byte count of strip or tile strile, or 0 on error.
+ */
+uint64
+TIFFGetStrileByteCount(TIFF* tif, uint32 strile)
+{
+	return TIFFGetStrileByteCountWithErr(tif,strile,NULL);
+}
+
+uint64
+TIFFGetStrileByteCountWithErr(TIFF* tif, uint32 strile, int* pbErr)
+{
+	TIFFDirectory *td = &tif->tif_dir;
+	return TIFFGetStrileValue(tif,strile,&(td->td_stripbytecount_entry),
+	    &(td->td_stripbytecount_p),pbErr);
+}
 
 /* vim: set ts=8 sts=8 sw=8 noet: */
 /*
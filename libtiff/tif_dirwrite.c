@@ -167,6 +167,7 @@ static int TIFFWriteDirectoryTagCheckedDouble(TIFF* tif, uint32* ndir, TIFFDirEn
 static int TIFFWriteDirectoryTagCheckedDoubleArray(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag, uint32 count, double* value);
 static int TIFFWriteDirectoryTagCheckedIfdArray(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag, uint32 count, uint32* value);
 static int TIFFWriteDirectoryTagCheckedIfd8Array(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag, uint32 count, uint64* value);
+static int TIFFWriteDirectoryTagEmpty(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag);
 
 static int TIFFWriteDirectoryTagData(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag, uint16 datatype, uint32 count, uint32 datalength, void* data);
 
@@ -195,7 +196,8 @@ TIFFCheckpointDirectory(TIFF* tif)
 {
 	int rc;
 	/* Setup the strips arrays, if they haven't already been. */
-	if (tif->tif_dir.td_stripoffset == NULL)
+	_TIFFFillStriles( tif );
+	if (tif->tif_dir.td_stripoffset_p == NULL)
 	    (void) TIFFSetupStrips(tif);
 	rc = TIFFWriteDirectorySec(tif,TRUE,FALSE,NULL);
 	(void) TIFFSetWriteOffset(tif, TIFFSeekFile(tif, 0, SEEK_END));
@@ -226,7 +228,10 @@ TIFFRewriteDirectory( TIFF *tif )
 	/*
 	 * Find and zero the pointer to this directory, so that TIFFLinkDirectory
 	 * will cause it to be added after this directories current pre-link.
+	 * The end of the chain moves, so it is looked up again on linking.
 	 */
+	tif->tif_lastdiroff = 0;
+	tif->tif_lastdirlink = 0;
 
 	if (!(tif->tif_flags&TIFF_BIGTIFF))
 	{
@@ -360,6 +365,89 @@ TIFFRewriteDirectory( TIFF *tif )
 	return TIFFWriteDirectory( tif );
 }
 
+/*
+ * Make the next TIFFWriteDirectory() of the current directory leave the
+ * StripOffsets/StripByteCounts (or TileOffsets/TileByteCounts) entries
+ * empty, so that the directory can be written before its image data.
+ * The arrays are then written with TIFFForceStrileArrayWriting().
+ */
+int
+TIFFDeferStrileArrayWriting(TIFF* tif)
+{
+	static const char module[] = "TIFFDeferStrileArrayWriting";
+
+	if (tif->tif_mode == O_RDONLY) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "File not open for writing");
+		return (0);
+	}
+	if (tif->tif_diroff != 0) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "Directory has already been written");
+		return (0);
+	}
+	tif->tif_dir.td_deferstrilearraywriting = TRUE;
+	return (1);
+}
+
+/*
+ * Write the strile arrays of the current directory, which must have been
+ * read back from a file where it was written with empty entries (see
+ * TIFFDeferStrileArrayWriting()).  The first call appends arrays of
+ * zeroes at the end of the file; the following ones, once image data
+ * has been written, update them in place.  The directory itself is not
+ * moved, so it may not have other pending changes.
+ */
+int
+TIFFForceStrileArrayWriting(TIFF* tif)
+{
+	static const char module[] = "TIFFForceStrileArrayWriting";
+	TIFFDirectory* td = &tif->tif_dir;
+
+	if (tif->tif_mode == O_RDONLY) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "File not open for writing");
+		return (0);
+	}
+	if (tif->tif_diroff == 0) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "Directory has not yet been written");
+		return (0);
+	}
+	if (tif->tif_flags & TIFF_DIRTYDIRECT) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "Directory has changes other than the strile arrays, "
+		    "TIFFRewriteDirectory() should be used instead");
+		return (0);
+	}
+	if (!(tif->tif_flags & TIFF_DIRTYSTRIP)) {
+		if (!(td->td_stripoffset_entry.tdir_tag != 0 &&
+		      td->td_stripoffset_entry.tdir_type == 0 &&
+		      td->td_stripoffset_entry.tdir_count == 0 &&
+		      td->td_stripbytecount_entry.tdir_tag != 0 &&
+		      td->td_stripbytecount_entry.tdir_type == 0 &&
+		      td->td_stripbytecount_entry.tdir_count == 0)) {
+			TIFFErrorExt(tif->tif_clientdata, module,
+			    "Directory was not written with "
+			    "TIFFDeferStrileArrayWriting()");
+			return (0);
+		}
+		if (td->td_stripoffset_p == NULL && !TIFFSetupStrips(tif))
+			return (0);
+	}
+	if (!TIFFFlushData(tif))
+		return (0);
+	if (!_TIFFRewriteField(tif,
+	    isTiled(tif) ? TIFFTAG_TILEOFFSETS : TIFFTAG_STRIPOFFSETS,
+	    TIFF_LONG8, td->td_nstrips, td->td_stripoffset_p)
+	    || !_TIFFRewriteField(tif,
+	    isTiled(tif) ? TIFFTAG_TILEBYTECOUNTS : TIFFTAG_STRIPBYTECOUNTS,
+	    TIFF_LONG8, td->td_nstrips, td->td_stripbytecount_p))
+		return (0);
+	tif->tif_flags &= ~(TIFF_DIRTYSTRIP|TIFF_BEENWRITING);
+	return (1);
+}
+
 static int
 TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 {
@@ -369,10 +457,13 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 	uint32 dirsize;
 	void* dirmem;
 	uint32 m;
+	int inchain=0;
 	if (tif->tif_mode == O_RDONLY)
 		return (1);
 
         _TIFFFillStriles( tif );
+	if (tif->tif_dir.td_ndeferred)
+		_TIFFFetchDeferredTags(tif);
         
 	/*
 	 * Clear write state so that subsequent images with
@@ -411,7 +502,7 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 		}
 		if ((tif->tif_flags & TIFF_MYBUFFER) && tif->tif_rawdata)
 		{
-			_TIFFfree(tif->tif_rawdata);
+			_TIFFfreeExt(tif, tif->tif_rawdata);
 			tif->tif_rawdata = NULL;
 			tif->tif_rawcc = 0;
 			tif->tif_rawdatasize = 0;
@@ -526,24 +617,33 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 				if (!TIFFWriteDirectoryTagShortArray(tif,&ndir,dir,TIFFTAG_PAGENUMBER,2,&tif->tif_dir.td_pagenumber[0]))
 					goto bad;
 			}
-			if (TIFFFieldSet(tif,FIELD_STRIPBYTECOUNTS))
+			if (tif->tif_dir.td_deferstrilearraywriting)
+			{
+				/* Written later by TIFFForceStrileArrayWriting() */
+				if (!TIFFWriteDirectoryTagEmpty(tif,&ndir,dir,isTiled(tif)?TIFFTAG_TILEBYTECOUNTS:TIFFTAG_STRIPBYTECOUNTS))
+					goto bad;
+				if (!TIFFWriteDirectoryTagEmpty(tif,&ndir,dir,isTiled(tif)?TIFFTAG_TILEOFFSETS:TIFFTAG_STRIPOFFSETS))
+					goto bad;
+			}
+			else if (TIFFFieldSet(tif,FIELD_STRIPBYTECOUNTS))
 			{
 				if (!isTiled(tif))
 				{
-					if (!TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_STRIPBYTECOUNTS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripbytecount))
+					if (!TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_STRIPBYTECOUNTS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripbytecount_p))
 						goto bad;
 				}
 				else
 				{
-					if (!TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_TILEBYTECOUNTS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripbytecount))
+					if (!TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_TILEBYTECOUNTS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripbytecount_p))
 						goto bad;
 				}
 			}
-			if (TIFFFieldSet(tif,FIELD_STRIPOFFSETS))
+			if (!tif->tif_dir.td_deferstrilearraywriting &&
+			    TIFFFieldSet(tif,FIELD_STRIPOFFSETS))
 			{
 				if (!isTiled(tif))
 				{
-                    /* td_stripoffset might be NULL in an odd OJPEG case. See
+                    /* td_stripoffset_p might be NULL in an odd OJPEG case. See
                      *  tif_dirread.c around line 3634.
                      * XXX: OJPEG hack.
                      * If a) compression is OJPEG, b) it's not a tiled TIFF,
@@ -554,13 +654,13 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
                      * We can get here when using tiffset on such a file.
                      * See http://bugzilla.maptools.org/show_bug.cgi?id=2500
                     */
-                    if (tif->tif_dir.td_stripoffset != NULL &&
-                        !TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_STRIPOFFSETS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripoffset))
+                    if (tif->tif_dir.td_stripoffset_p != NULL &&
+                        !TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_STRIPOFFSETS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripoffset_p))
                         goto bad;
 				}
 				else
 				{
-					if (!TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_TILEOFFSETS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripoffset))
+					if (!TIFFWriteDirectoryTagLongLong8Array(tif,&ndir,dir,TIFFTAG_TILEOFFSETS,tif->tif_dir.td_nstrips,tif->tif_dir.td_stripoffset_p))
 						goto bad;
 				}
 			}
@@ -781,7 +881,7 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 		}
 		if (dir!=NULL)
 			break;
-		dir=_TIFFmalloc(ndir*sizeof(TIFFDirEntry));
+		dir=_TIFFmallocExt(tif, ndir*sizeof(TIFFDirEntry));
 		if (dir==NULL)
 		{
 			TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -789,8 +889,14 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 		}
 		if (isimage)
 		{
-			if ((tif->tif_diroff==0)&&(!TIFFLinkDirectory(tif)))
-				goto bad;
+			if (tif->tif_diroff==0)
+			{
+				inchain=!(tif->tif_flags&TIFF_INSUBIFD);
+				if (!TIFFLinkDirectory(tif))
+					goto bad;
+			}
+			else
+				inchain=(tif->tif_diroff==tif->tif_lastdiroff);
 		}
 		else
 			tif->tif_diroff=(TIFFSeekFile(tif,0,SEEK_END)+1)&(~((toff_t)1));
@@ -800,6 +906,24 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 			dirsize=2+ndir*12+4;
 		else
 			dirsize=8+ndir*20+8;
+		/*
+		 * Remember where the end of the directory chain is, so
+		 * the next directory can be linked without walking it.
+		 */
+		if (inchain)
+		{
+			if (tif->tif_nextdiroff==0)
+			{
+				tif->tif_lastdiroff=tif->tif_diroff;
+				tif->tif_lastdirlink=tif->tif_diroff+dirsize-
+				    ((tif->tif_flags&TIFF_BIGTIFF)?8:4);
+			}
+			else
+			{
+				tif->tif_lastdiroff=0;
+				tif->tif_lastdirlink=0;
+			}
+		}
 		tif->tif_dataoff=tif->tif_diroff+dirsize;
 		if (!(tif->tif_flags&TIFF_BIGTIFF))
 			tif->tif_dataoff=(uint32)tif->tif_dataoff;
@@ -836,7 +960,7 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 				tif->tif_subifdoff=tif->tif_diroff+8+na*20+12;
 		}
 	}
-	dirmem=_TIFFmalloc(dirsize);
+	dirmem=_TIFFmallocExt(tif, dirsize);
 	if (dirmem==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -911,7 +1035,7 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 		if (tif->tif_flags&TIFF_SWAB)
 			TIFFSwabLong8((uint64*)n);
 	}
-	_TIFFfree(dir);
+	_TIFFfreeExt(tif, dir);
 	dir=NULL;
 	if (!SeekOK(tif,tif->tif_diroff))
 	{
@@ -923,7 +1047,7 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 		TIFFErrorExt(tif->tif_clientdata,module,"IO error writing directory");
 		goto bad;
 	}
-	_TIFFfree(dirmem);
+	_TIFFfreeExt(tif, dirmem);
 	if (imagedone)
 	{
 		TIFFFreeDirectory(tif);
@@ -939,9 +1063,9 @@ TIFFWriteDirectorySec(TIFF* tif, int isimage, int imagedone, uint64* pdiroff)
 	return(1);
 bad:
 	if (dir!=NULL)
-		_TIFFfree(dir);
+		_TIFFfreeExt(tif, dir);
 	if (dirmem!=NULL)
-		_TIFFfree(dirmem);
+		_TIFFfreeExt(tif, dirmem);
 	return(0);
 }
 
@@ -1015,7 +1139,7 @@ TIFFWriteDirectoryTagSampleformatArray(TIFF* tif, uint32* ndir, TIFFDirEntry* di
 	void* conv;
 	uint32 i;
 	int ok;
-	conv = _TIFFmalloc(count*sizeof(double));
+	conv = _TIFFmallocExt(tif, count*sizeof(double));
 	if (conv == NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata, module, "Out of memory");
@@ -1080,7 +1204,7 @@ TIFFWriteDirectoryTagSampleformatArray(TIFF* tif, uint32* ndir, TIFFDirEntry* di
 			ok = 0;
 	}
 
-	_TIFFfree(conv);
+	_TIFFfreeExt(tif, conv);
 	return (ok);
 }
 
@@ -1175,7 +1299,7 @@ TIFFWriteDirectoryTagBytePerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, u
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(uint8));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(uint8));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1184,7 +1308,7 @@ TIFFWriteDirectoryTagBytePerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, u
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedByteArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1227,7 +1351,7 @@ TIFFWriteDirectoryTagSbytePerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(int8));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(int8));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1236,7 +1360,7 @@ TIFFWriteDirectoryTagSbytePerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedSbyteArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1276,7 +1400,7 @@ TIFFWriteDirectoryTagShortPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(uint16));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(uint16));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1285,7 +1409,7 @@ TIFFWriteDirectoryTagShortPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedShortArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 
@@ -1327,7 +1451,7 @@ TIFFWriteDirectoryTagSshortPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(int16));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(int16));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1336,7 +1460,7 @@ TIFFWriteDirectoryTagSshortPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedSshortArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1377,7 +1501,7 @@ TIFFWriteDirectoryTagLongPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, u
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(uint32));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(uint32));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1386,7 +1510,7 @@ TIFFWriteDirectoryTagLongPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, u
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedLongArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1429,7 +1553,7 @@ TIFFWriteDirectoryTagSlongPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(int32));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(int32));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1438,7 +1562,7 @@ TIFFWriteDirectoryTagSlongPerSample(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedSlongArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1559,7 +1683,7 @@ static int TIFFWriteDirectoryTagFloatPerSample(TIFF* tif, uint32* ndir, TIFFDirE
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(float));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(float));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1568,7 +1692,7 @@ static int TIFFWriteDirectoryTagFloatPerSample(TIFF* tif, uint32* ndir, TIFFDirE
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedFloatArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1608,7 +1732,7 @@ static int TIFFWriteDirectoryTagDoublePerSample(TIFF* tif, uint32* ndir, TIFFDir
 		(*ndir)++;
 		return(1);
 	}
-	m=_TIFFmalloc(tif->tif_dir.td_samplesperpixel*sizeof(double));
+	m=_TIFFmallocExt(tif, tif->tif_dir.td_samplesperpixel*sizeof(double));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1617,7 +1741,7 @@ static int TIFFWriteDirectoryTagDoublePerSample(TIFF* tif, uint32* ndir, TIFFDir
 	for (na=m, nb=0; nb<tif->tif_dir.td_samplesperpixel; na++, nb++)
 		*na=value;
 	o=TIFFWriteDirectoryTagCheckedDoubleArray(tif,ndir,dir,tag,tif->tif_dir.td_samplesperpixel,m);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 #endif
@@ -1694,7 +1818,7 @@ TIFFWriteDirectoryTagLongLong8Array(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
     ** and convert to long format.
     */
 
-    p = _TIFFmalloc(count*sizeof(uint32));
+    p = _TIFFmallocExt(tif, count*sizeof(uint32));
     if (p==NULL)
     {
         TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1707,14 +1831,14 @@ TIFFWriteDirectoryTagLongLong8Array(TIFF* tif, uint32* ndir, TIFFDirEntry* dir,
         {
             TIFFErrorExt(tif->tif_clientdata,module,
                          "Attempt to write value larger than 0xFFFFFFFF in Classic TIFF file.");
-            _TIFFfree(p);
+            _TIFFfreeExt(tif, p);
             return(0);
         }
         *q= (uint32)(*ma);
     }
 
     o=TIFFWriteDirectoryTagCheckedLongArray(tif,ndir,dir,tag,count,p);
-    _TIFFfree(p);
+    _TIFFfreeExt(tif, p);
 
     return(o);
 }
@@ -1752,7 +1876,7 @@ TIFFWriteDirectoryTagIfdIfd8Array(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, ui
     ** and convert to long format.
     */
 
-    p = _TIFFmalloc(count*sizeof(uint32));
+    p = _TIFFmallocExt(tif, count*sizeof(uint32));
     if (p==NULL)
     {
         TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1765,14 +1889,14 @@ TIFFWriteDirectoryTagIfdIfd8Array(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, ui
         {
             TIFFErrorExt(tif->tif_clientdata,module,
                          "Attempt to write value larger than 0xFFFFFFFF in Classic TIFF file.");
-            _TIFFfree(p);
+            _TIFFfreeExt(tif, p);
             return(0);
         }
         *q= (uint32)(*ma);
     }
 
     o=TIFFWriteDirectoryTagCheckedIfdArray(tif,ndir,dir,tag,count,p);
-    _TIFFfree(p);
+    _TIFFfreeExt(tif, p);
 
     return(o);
 }
@@ -1806,7 +1930,7 @@ TIFFWriteDirectoryTagShortLongLong8Array(TIFF* tif, uint32* ndir, TIFFDirEntry*
 	{
 		uint16* p;
 		uint16* q;
-		p=_TIFFmalloc(count*sizeof(uint16));
+		p=_TIFFmallocExt(tif, count*sizeof(uint16));
 		if (p==NULL)
 		{
 			TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1815,13 +1939,13 @@ TIFFWriteDirectoryTagShortLongLong8Array(TIFF* tif, uint32* ndir, TIFFDirEntry*
 		for (ma=value, mb=0, q=p; mb<count; ma++, mb++, q++)
 			*q=(uint16)(*ma);
 		o=TIFFWriteDirectoryTagCheckedShortArray(tif,ndir,dir,tag,count,p);
-		_TIFFfree(p);
+		_TIFFfreeExt(tif, p);
 	}
 	else if (n==1)
 	{
 		uint32* p;
 		uint32* q;
-		p=_TIFFmalloc(count*sizeof(uint32));
+		p=_TIFFmallocExt(tif, count*sizeof(uint32));
 		if (p==NULL)
 		{
 			TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1830,7 +1954,7 @@ TIFFWriteDirectoryTagShortLongLong8Array(TIFF* tif, uint32* ndir, TIFFDirEntry*
 		for (ma=value, mb=0, q=p; mb<count; ma++, mb++, q++)
 			*q=(uint32)(*ma);
 		o=TIFFWriteDirectoryTagCheckedLongArray(tif,ndir,dir,tag,count,p);
-		_TIFFfree(p);
+		_TIFFfreeExt(tif, p);
 	}
 	else
 	{
@@ -1853,7 +1977,7 @@ TIFFWriteDirectoryTagColormap(TIFF* tif, uint32* ndir, TIFFDirEntry* dir)
 		return(1);
 	}
 	m=(1<<tif->tif_dir.td_bitspersample);
-	n=_TIFFmalloc(3*m*sizeof(uint16));
+	n=_TIFFmallocExt(tif, 3*m*sizeof(uint16));
 	if (n==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1863,7 +1987,7 @@ TIFFWriteDirectoryTagColormap(TIFF* tif, uint32* ndir, TIFFDirEntry* dir)
 	_TIFFmemcpy(&n[m],tif->tif_dir.td_colormap[1],m*sizeof(uint16));
 	_TIFFmemcpy(&n[2*m],tif->tif_dir.td_colormap[2],m*sizeof(uint16));
 	o=TIFFWriteDirectoryTagCheckedShortArray(tif,ndir,dir,TIFFTAG_COLORMAP,3*m,n);
-	_TIFFfree(n);
+	_TIFFfreeExt(tif, n);
 	return(o);
 }
 
@@ -1902,7 +2026,7 @@ TIFFWriteDirectoryTagTransferfunction(TIFF* tif, uint32* ndir, TIFFDirEntry* dir
 	}
 	if (n==0)
 		n=1;
-	o=_TIFFmalloc(n*m*sizeof(uint16));
+	o=_TIFFmallocExt(tif, n*m*sizeof(uint16));
 	if (o==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1914,7 +2038,7 @@ TIFFWriteDirectoryTagTransferfunction(TIFF* tif, uint32* ndir, TIFFDirEntry* dir
 	if (n>2)
 		_TIFFmemcpy(&o[2*m],tif->tif_dir.td_transferfunction[2],m*sizeof(uint16));
 	p=TIFFWriteDirectoryTagCheckedShortArray(tif,ndir,dir,TIFFTAG_TRANSFERFUNCTION,n*m,o);
-	_TIFFfree(o);
+	_TIFFfreeExt(tif, o);
 	return(p);
 }
 
@@ -1938,7 +2062,7 @@ TIFFWriteDirectoryTagSubifd(TIFF* tif, uint32* ndir, TIFFDirEntry* dir)
 		uint64* pa;
 		uint32* pb;
 		uint16 p;
-		o=_TIFFmalloc(tif->tif_dir.td_nsubifd*sizeof(uint32));
+		o=_TIFFmallocExt(tif, tif->tif_dir.td_nsubifd*sizeof(uint32));
 		if (o==NULL)
 		{
 			TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1954,13 +2078,13 @@ TIFFWriteDirectoryTagSubifd(TIFF* tif, uint32* ndir, TIFFDirEntry* dir)
                         if( *pa > 0xFFFFFFFFUL)
                         {
                             TIFFErrorExt(tif->tif_clientdata,module,"Illegal value for SubIFD tag");
-                            _TIFFfree(o);
+                            _TIFFfreeExt(tif, o);
                             return(0);
                         }
 			*pb++=(uint32)(*pa++);
 		}
 		n=TIFFWriteDirectoryTagCheckedIfdArray(tif,ndir,dir,TIFFTAG_SUBIFD,tif->tif_dir.td_nsubifd,o);
-		_TIFFfree(o);
+		_TIFFfreeExt(tif, o);
 	}
 	else
 		n=TIFFWriteDirectoryTagCheckedIfd8Array(tif,ndir,dir,TIFFTAG_SUBIFD,tif->tif_dir.td_nsubifd,tif->tif_dir.td_subifd);
@@ -2233,7 +2357,7 @@ TIFFWriteDirectoryTagCheckedRationalArray(TIFF* tif, uint32* ndir, TIFFDirEntry*
 	uint32 nc;
 	int o;
 	assert(sizeof(uint32)==4);
-	m=_TIFFmalloc(count*2*sizeof(uint32));
+	m=_TIFFmallocExt(tif, count*2*sizeof(uint32));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -2266,7 +2390,7 @@ TIFFWriteDirectoryTagCheckedRationalArray(TIFF* tif, uint32* ndir, TIFFDirEntry*
 	if (tif->tif_flags&TIFF_SWAB)
 		TIFFSwabArrayOfLong(m,count*2);
 	o=TIFFWriteDirectoryTagData(tif,ndir,dir,tag,TIFF_RATIONAL,count,count*8,&m[0]);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 
@@ -2280,7 +2404,7 @@ TIFFWriteDirectoryTagCheckedSrationalArray(TIFF* tif, uint32* ndir, TIFFDirEntry
 	uint32 nc;
 	int o;
 	assert(sizeof(int32)==4);
-	m=_TIFFmalloc(count*2*sizeof(int32));
+	m=_TIFFmallocExt(tif, count*2*sizeof(int32));
 	if (m==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -2328,7 +2452,7 @@ TIFFWriteDirectoryTagCheckedSrationalArray(TIFF* tif, uint32* ndir, TIFFDirEntry
 	if (tif->tif_flags&TIFF_SWAB)
 		TIFFSwabArrayOfLong((uint32*)m,count*2);
 	o=TIFFWriteDirectoryTagData(tif,ndir,dir,tag,TIFF_SRATIONAL,count,count*8,&m[0]);
-	_TIFFfree(m);
+	_TIFFfreeExt(tif, m);
 	return(o);
 }
 
@@ -2403,18 +2527,34 @@ TIFFWriteDirectoryTagCheckedIfd8Array(TIFF* tif, uint32* ndir, TIFFDirEntry* dir
 	return(TIFFWriteDirectoryTagData(tif,ndir,dir,tag,TIFF_IFD8,count,count*8,value));
 }
 
+/*
+ * Write an entry without type nor values, which only reserves its slot
+ * in the directory; see TIFFDeferStrileArrayWriting().
+ */
+static int
+TIFFWriteDirectoryTagEmpty(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag)
+{
+	if (dir==NULL)
+	{
+		(*ndir)++;
+		return(1);
+	}
+	return(TIFFWriteDirectoryTagData(tif,ndir,dir,tag,TIFF_NOTYPE,0,0,NULL));
+}
+
 static int
 TIFFWriteDirectoryTagData(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag, uint16 datatype, uint32 count, uint32 datalength, void* data)
 {
 	static const char module[] = "TIFFWriteDirectoryTagData";
 	uint32 m;
-	m=0;
-	while (m<(*ndir))
+	/* From the end: entries mostly come in tag order */
+	m=*ndir;
+	while (m>0)
 	{
-		assert(dir[m].tdir_tag!=tag);
-		if (dir[m].tdir_tag>tag)
+		assert(dir[m-1].tdir_tag!=tag);
+		if (dir[m-1].tdir_tag<tag)
 			break;
-		m++;
+		m--;
 	}
 	if (m<(*ndir))
 	{
@@ -2427,7 +2567,10 @@ TIFFWriteDirectoryTagData(TIFF* tif, uint32* ndir, TIFFDirEntry* dir, uint16 tag
 	dir[m].tdir_count=count;
 	dir[m].tdir_offset.toff_long8 = 0;
 	if (datalength<=((tif->tif_flags&TIFF_BIGTIFF)?0x8U:0x4U))
-		_TIFFmemcpy(&dir[m].tdir_offset,data,datalength);
+	{
+		if (datalength!=0)
+			_TIFFmemcpy(&dir[m].tdir_offset,data,datalength);
+	}
 	else
 	{
 		uint64 na,nb;
@@ -2557,7 +2700,20 @@ TIFFLinkDirectory(TIFF* tif)
 			return (1);
 		}
 		/*
-		 * Not the first directory, search to the last and append.
+		 * Not the first directory.  If the last directory written
+		 * is known to end the chain, link to it directly.
+		 */
+		if (tif->tif_lastdirlink != 0) {
+			(void) TIFFSeekFile(tif, tif->tif_lastdirlink, SEEK_SET);
+			if (!WriteOK(tif, &m, 4)) {
+				TIFFErrorExt(tif->tif_clientdata, module,
+				     "Error writing directory link");
+				return (0);
+			}
+			return (1);
+		}
+		/*
+		 * Otherwise search to the last and append.
 		 */
 		nextdir = tif->tif_header.classic.tiff_diroff;
 		while(1) {
@@ -2616,7 +2772,20 @@ TIFFLinkDirectory(TIFF* tif)
 			return (1);
 		}
 		/*
-		 * Not the first directory, search to the last and append.
+		 * Not the first directory.  If the last directory written
+		 * is known to end the chain, link to it directly.
+		 */
+		if (tif->tif_lastdirlink != 0) {
+			(void) TIFFSeekFile(tif, tif->tif_lastdirlink, SEEK_SET);
+			if (!WriteOK(tif, &m, 8)) {
+				TIFFErrorExt(tif->tif_clientdata, module,
+				     "Error writing directory link");
+				return (0);
+			}
+			return (1);
+		}
+		/*
+		 * Otherwise search to the last and append.
 		 */
 		nextdir = tif->tif_header.big.tiff_diroff;
 		while(1) {
@@ -2777,6 +2946,7 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
             break;
 
         read_offset += dirsize;
+        dircount--;
     }
 
     if( entry_tag != tag )
@@ -2841,7 +3011,7 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
 /*      swabbing as needed.                                             */
 /* -------------------------------------------------------------------- */
     buf_to_write =
-	    (uint8 *)_TIFFCheckMalloc(tif, count, TIFFDataWidth(datatype),
+	    (uint8 *)_TIFFCheckMallocExt(tif, count, TIFFDataWidth(datatype),
 				      "for field buffer.");
     if (!buf_to_write)
         return 0;
@@ -2858,7 +3028,7 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
                 (int32) ((int64 *) data)[i];
             if( (int64) ((int32 *) buf_to_write)[i] != ((int64 *) data)[i] )
             {
-                _TIFFfree( buf_to_write );
+                _TIFFfreeExt(tif, buf_to_write );
                 TIFFErrorExt( tif->tif_clientdata, module, 
                               "Value exceeds 32bit range of output type." );
                 return 0;
@@ -2876,7 +3046,7 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
                 (uint32) ((uint64 *) data)[i];
             if( (uint64) ((uint32 *) buf_to_write)[i] != ((uint64 *) data)[i] )
             {
-                _TIFFfree( buf_to_write );
+                _TIFFfreeExt(tif, buf_to_write );
                 TIFFErrorExt( tif->tif_clientdata, module, 
                               "Value exceeds 32bit range of output type." );
                 return 0;
@@ -2922,20 +3092,20 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
     if( entry_count == (uint64)count && entry_type == (uint16) datatype )
     {
         if (!SeekOK(tif, entry_offset)) {
-            _TIFFfree( buf_to_write );
+            _TIFFfreeExt(tif, buf_to_write );
             TIFFErrorExt(tif->tif_clientdata, module,
                          "%s: Seek error accessing TIFF directory",
                          tif->tif_name);
             return 0;
         }
         if (!WriteOK(tif, buf_to_write, count*TIFFDataWidth(datatype))) {
-            _TIFFfree( buf_to_write );
+            _TIFFfreeExt(tif, buf_to_write );
             TIFFErrorExt(tif->tif_clientdata, module,
                          "Error writing directory link");
             return (0);
         }
 
-        _TIFFfree( buf_to_write );
+        _TIFFfreeExt(tif, buf_to_write );
         return 1;
     }
 
@@ -2947,24 +3117,18 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
         entry_offset = TIFFSeekFile(tif,0,SEEK_END);
         
         if (!WriteOK(tif, buf_to_write, count*TIFFDataWidth(datatype))) {
-            _TIFFfree( buf_to_write );
+            _TIFFfreeExt(tif, buf_to_write );
             TIFFErrorExt(tif->tif_clientdata, module,
                          "Error writing directory link");
             return (0);
         }
     }
-    else
-    {
-        memcpy( &entry_offset, buf_to_write, count*TIFFDataWidth(datatype));
-    }
-
-    _TIFFfree( buf_to_write );
-    buf_to_write = 0;
 
 /* -------------------------------------------------------------------- */
 /*      Adjust the directory entry.                                     */
 /* -------------------------------------------------------------------- */
     entry_type = datatype;
+    entry_count = (uint64)count;
     memcpy( direntry_raw + 2, &entry_type, sizeof(uint16) );
     if (tif->tif_flags&TIFF_SWAB)
         TIFFSwabShort( (uint16 *) (direntry_raw + 2) );
@@ -2978,10 +3142,19 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
         if (tif->tif_flags&TIFF_SWAB)
             TIFFSwabLong( (uint32 *) (direntry_raw + 4) );
 
-        value = (uint32) entry_offset;
-        memcpy( direntry_raw + 8, &value, sizeof(uint32) );
-        if (tif->tif_flags&TIFF_SWAB)
-            TIFFSwabLong( (uint32 *) (direntry_raw + 8) );
+        if( value_in_entry )
+        {
+            memset( direntry_raw + 8, 0, sizeof(uint32) );
+            memcpy( direntry_raw + 8, buf_to_write,
+                    count*TIFFDataWidth(datatype) );
+        }
+        else
+        {
+            value = (uint32) entry_offset;
+            memcpy( direntry_raw + 8, &value, sizeof(uint32) );
+            if (tif->tif_flags&TIFF_SWAB)
+                TIFFSwabLong( (uint32 *) (direntry_raw + 8) );
+        }
     }
     else
     {
@@ -2989,11 +3162,23 @@ _TIFFRewriteField(TIFF* tif, uint16 tag, TIFFDataType in_datatype,
         if (tif->tif_flags&TIFF_SWAB)
             TIFFSwabLong8( (uint64 *) (direntry_raw + 4) );
 
-        memcpy( direntry_raw + 12, &entry_offset, sizeof(uint64) );
-        if (tif->tif_flags&TIFF_SWAB)
-            TIFFSwabLong8( (uint64 *) (direntry_raw + 12) );
+        if( value_in_entry )
+        {
+            memset( direntry_raw + 12, 0, sizeof(uint64) );
+            memcpy( direntry_raw + 12, buf_to_write,
+                    count*TIFFDataWidth(datatype) );
+        }
+        else
+        {
+            memcpy( direntry_raw + 12, &entry_offset, sizeof(uint64) );
+            if (tif->tif_flags&TIFF_SWAB)
+                TIFFSwabLong8( (uint64 *) (direntry_raw + 12) );
+        }
     }
 
+    _TIFFfreeExt(tif, buf_to_write );
+    buf_to_write = 0;
+
 /* -------------------------------------------------------------------- */
 /*      Write the directory entry out to disk.                          */
 /* -------------------------------------------------------------------- */
@@ -507,7 +507,7 @@ Fax3SetupState(TIFF* tif)
 	Fax3BaseState* sp = Fax3State(tif);
 	int needsRefLine;
 	Fax3CodecState* dsp = (Fax3CodecState*) Fax3State(tif);
-	tmsize_t rowbytes;
+	tmsize_t rowbytes, runsbytes;
 	uint32 rowpixels, nruns;
 
 	if (td->td_bitspersample != 1) {
@@ -540,6 +540,7 @@ Fax3SetupState(TIFF* tif)
 	  
 	  TIFFroundup and TIFFSafeMultiply return zero on integer overflow
 	*/
+	_TIFFBufferPut(tif, dsp->runs);
 	dsp->runs=(uint32*) NULL;
 	nruns = TIFFroundup_32(rowpixels,32);
 	if (needsRefLine) {
@@ -551,12 +552,19 @@ Fax3SetupState(TIFF* tif)
 			     rowpixels);
 		return (0);
 	}
-	dsp->runs = (uint32*) _TIFFCheckMalloc(tif,
-					       TIFFSafeMultiply(uint32,nruns,2),
-					       sizeof (uint32),
-					       "for Group 3/4 run arrays");
-	if (dsp->runs == NULL)
+	runsbytes = (tmsize_t) TIFFSafeMultiply(uint32,nruns,2) * sizeof (uint32);
+	if (runsbytes / sizeof (uint32) != TIFFSafeMultiply(uint32,nruns,2))
+		dsp->runs = NULL;
+	else
+		dsp->runs = (uint32*) _TIFFBufferGet(tif, runsbytes);
+	if (dsp->runs == NULL) {
+		TIFFErrorExt(tif->tif_clientdata, tif->tif_name,
+			     "Failed to allocate memory for Group 3/4 run arrays "
+			     "(%lu elements of %lu bytes each)",
+			     (unsigned long) TIFFSafeMultiply(uint32,nruns,2),
+			     (unsigned long) sizeof (uint32));
 		return (0);
+	}
 	memset( dsp->runs, 0, TIFFSafeMultiply(uint32,nruns,2)*sizeof(uint32));
 	dsp->curruns = dsp->runs;
 	if (needsRefLine)
@@ -579,14 +587,17 @@ Fax3SetupState(TIFF* tif)
 		 * is referenced.  The reference line must
 		 * be initialized to be ``white'' (done elsewhere).
 		 */
-		esp->refline = (unsigned char*) _TIFFmalloc(rowbytes);
+		_TIFFBufferPut(tif, esp->refline);
+		esp->refline = (unsigned char*) _TIFFBufferGet(tif, rowbytes);
 		if (esp->refline == NULL) {
 			TIFFErrorExt(tif->tif_clientdata, module,
 			    "No space for Group 3/4 reference line");
 			return (0);
 		}
-	} else					/* 1d encoding */
+	} else {				/* 1d encoding */
+		_TIFFBufferPut(tif, EncoderState(tif)->refline);
 		EncoderState(tif)->refline = NULL;
+	}
 
 	return (1);
 }
@@ -1160,12 +1171,11 @@ Fax3Cleanup(TIFF* tif)
 	tif->tif_tagmethods.vsetfield = sp->b.vsetparent;
 	tif->tif_tagmethods.printdir = sp->b.printdir;
 
-	if (sp->runs)
-		_TIFFfree(sp->runs);
-	if (sp->refline)
-		_TIFFfree(sp->refline);
+	/* The run arrays are kept for the next directory */
+	_TIFFBufferPut(tif, sp->runs);
+	_TIFFBufferPut(tif, sp->refline);
 
-	_TIFFfree(tif->tif_data);
+	_TIFFfreeExt(tif, tif->tif_data);
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -1348,7 +1358,7 @@ InitCCITTFax3(TIFF* tif)
 	 * Allocate state block so tag methods have storage to record values.
 	 */
 	tif->tif_data = (uint8*)
-		_TIFFmalloc(sizeof (Fax3CodecState));
+		_TIFFmallocExt(tif, sizeof (Fax3CodecState));
 
 	if (tif->tif_data == NULL) {
 		TIFFErrorExt(tif->tif_clientdata, module,
@@ -216,38 +216,38 @@ void
 TIFFRGBAImageEnd(TIFFRGBAImage* img)
 {
 	if (img->Map) {
-		_TIFFfree(img->Map);
+		_TIFFfreeExt(img->tif, img->Map);
 		img->Map = NULL;
 	}
 	if (img->BWmap) {
-		_TIFFfree(img->BWmap);
+		_TIFFfreeExt(img->tif, img->BWmap);
 		img->BWmap = NULL;
 	}
 	if (img->PALmap) {
-		_TIFFfree(img->PALmap);
+		_TIFFfreeExt(img->tif, img->PALmap);
 		img->PALmap = NULL;
 	}
 	if (img->ycbcr) {
-		_TIFFfree(img->ycbcr);
+		_TIFFfreeExt(img->tif, img->ycbcr);
 		img->ycbcr = NULL;
 	}
 	if (img->cielab) {
-		_TIFFfree(img->cielab);
+		_TIFFfreeExt(img->tif, img->cielab);
 		img->cielab = NULL;
 	}
 	if (img->UaToAa) {
-		_TIFFfree(img->UaToAa);
+		_TIFFfreeExt(img->tif, img->UaToAa);
 		img->UaToAa = NULL;
 	}
 	if (img->Bitdepth16To8) {
-		_TIFFfree(img->Bitdepth16To8);
+		_TIFFfreeExt(img->tif, img->Bitdepth16To8);
 		img->Bitdepth16To8 = NULL;
 	}
 
 	if( img->redcmap ) {
-		_TIFFfree( img->redcmap );
-		_TIFFfree( img->greencmap );
-		_TIFFfree( img->bluecmap );
+		_TIFFfreeExt(img->tif, img->redcmap );
+		_TIFFfreeExt(img->tif, img->greencmap );
+		_TIFFfreeExt(img->tif, img->bluecmap );
                 img->redcmap = img->greencmap = img->bluecmap = NULL;
 	}
 }
@@ -367,9 +367,9 @@ TIFFRGBAImageBegin(TIFFRGBAImage* img, TIFF* tif, int stop, char emsg[1024])
 
 			/* copy the colormaps so we can modify them */
 			n_color = (1U << img->bitspersample);
-			img->redcmap = (uint16 *) _TIFFmalloc(sizeof(uint16)*n_color);
-			img->greencmap = (uint16 *) _TIFFmalloc(sizeof(uint16)*n_color);
-			img->bluecmap = (uint16 *) _TIFFmalloc(sizeof(uint16)*n_color);
+			img->redcmap = (uint16 *) _TIFFmallocExt(tif, sizeof(uint16)*n_color);
+			img->greencmap = (uint16 *) _TIFFmallocExt(tif, sizeof(uint16)*n_color);
+			img->bluecmap = (uint16 *) _TIFFmallocExt(tif, sizeof(uint16)*n_color);
 			if( !img->redcmap || !img->greencmap || !img->bluecmap ) {
 				sprintf(emsg, "Out of memory for colormap copy");
                                 goto fail_return;
@@ -703,7 +703,7 @@ gtTileContig(TIFFRGBAImage* img, uint32* raster, uint32 w, uint32 h)
 
         y += ((flip & FLIP_VERTICALLY) ? -(int32) nrow : (int32) nrow);
     }
-    _TIFFfree(buf);
+    _TIFFfreeExt(tif, buf);
 
     if (flip & FLIP_HORIZONTALLY) {
 	    uint32 line;
@@ -903,7 +903,7 @@ gtTileSeparate(TIFFRGBAImage* img, uint32* raster, uint32 w, uint32 h)
 		}
 	}
 
-	_TIFFfree(buf);
+	_TIFFfreeExt(tif, buf);
 	return (ret);
 }
 
@@ -991,7 +991,7 @@ gtStripContig(TIFFRGBAImage* img, uint32* raster, uint32 w, uint32 h)
 		}
 	}
 
-	_TIFFfree(buf);
+	_TIFFfreeExt(tif, buf);
 	return (ret);
 }
 
@@ -1140,7 +1140,7 @@ gtStripSeparate(TIFFRGBAImage* img, uint32* raster, uint32 w, uint32 h)
 		}
 	}
 
-	_TIFFfree(buf);
+	_TIFFfreeExt(tif, buf);
 	return (ret);
 }
 
@@ -2278,8 +2278,7 @@ initYCbCrConversion(TIFFRGBAImage* img)
 	float *luma, *refBlackWhite;
 
 	if (img->ycbcr == NULL) {
-		img->ycbcr = (TIFFYCbCrToRGB*) _TIFFmalloc(
-		    TIFFroundup_32(sizeof (TIFFYCbCrToRGB), sizeof (long))  
+		img->ycbcr = (TIFFYCbCrToRGB*) _TIFFmallocExt(img->tif, TIFFroundup_32(sizeof (TIFFYCbCrToRGB), sizeof (long))  
 		    + 4*256*sizeof (TIFFRGBValue)
 		    + 2*256*sizeof (int)
 		    + 3*256*sizeof (int32)
@@ -2341,7 +2340,7 @@ initCIELabConversion(TIFFRGBAImage* img)
 
 	if (!img->cielab) {
 		img->cielab = (TIFFCIELabToRGB *)
-			_TIFFmalloc(sizeof(TIFFCIELabToRGB));
+			_TIFFmallocExt(img->tif, sizeof(TIFFCIELabToRGB));
 		if (!img->cielab) {
 			TIFFErrorExt(img->tif->tif_clientdata, module,
 			    "No space for CIE L*a*b*->RGB conversion state.");
@@ -2356,7 +2355,7 @@ initCIELabConversion(TIFFRGBAImage* img)
 	if (TIFFCIELabToRGBInit(img->cielab, &display_sRGB, refWhite) < 0) {
 		TIFFErrorExt(img->tif->tif_clientdata, module,
 		    "Failed to initialize CIE L*a*b*->RGB conversion state.");
-		_TIFFfree(img->cielab);
+		_TIFFfreeExt(img->tif, img->cielab);
 		return NULL;
 	}
 
@@ -2382,8 +2381,7 @@ makebwmap(TIFFRGBAImage* img)
     if( nsamples == 0 )
         nsamples = 1;
 
-    img->BWmap = (uint32**) _TIFFmalloc(
-	256*sizeof (uint32 *)+(256*nsamples*sizeof(uint32)));
+    img->BWmap = (uint32**) _TIFFmallocExt(img->tif, 256*sizeof (uint32 *)+(256*nsamples*sizeof(uint32)));
     if (img->BWmap == NULL) {
 		TIFFErrorExt(img->tif->tif_clientdata, TIFFFileName(img->tif), "No space for B&W mapping table");
 		return (0);
@@ -2440,7 +2438,7 @@ setupMap(TIFFRGBAImage* img)
     if( img->bitspersample == 16 )
         range = (int32) 255;
 
-    img->Map = (TIFFRGBValue*) _TIFFmalloc((range+1) * sizeof (TIFFRGBValue));
+    img->Map = (TIFFRGBValue*) _TIFFmallocExt(img->tif, (range+1) * sizeof (TIFFRGBValue));
     if (img->Map == NULL) {
 		TIFFErrorExt(img->tif->tif_clientdata, TIFFFileName(img->tif),
 			"No space for photometric conversion table");
@@ -2463,7 +2461,7 @@ setupMap(TIFFRGBAImage* img)
 	if (!makebwmap(img))
 	    return (0);
 	/* no longer need Map, free it */
-	_TIFFfree(img->Map);
+	_TIFFfreeExt(img->tif, img->Map);
 	img->Map = NULL;
     }
     return (1);
@@ -2518,8 +2516,7 @@ makecmap(TIFFRGBAImage* img)
     uint32 *p;
     int i;
 
-    img->PALmap = (uint32**) _TIFFmalloc(
-	256*sizeof (uint32 *)+(256*nsamples*sizeof(uint32)));
+    img->PALmap = (uint32**) _TIFFmallocExt(img->tif, 256*sizeof (uint32 *)+(256*nsamples*sizeof(uint32)));
     if (img->PALmap == NULL) {
 		TIFFErrorExt(img->tif->tif_clientdata, TIFFFileName(img->tif), "No space for Palette mapping table");
 		return (0);
@@ -2832,7 +2829,7 @@ BuildMapUaToAa(TIFFRGBAImage* img)
 	uint8* m;
 	uint16 na,nv;
 	assert(img->UaToAa==NULL);
-	img->UaToAa=_TIFFmalloc(65536);
+	img->UaToAa=_TIFFmallocExt(img->tif, 65536);
 	if (img->UaToAa==NULL)
 	{
 		TIFFErrorExt(img->tif->tif_clientdata,module,"Out of memory");
@@ -2854,7 +2851,7 @@ BuildMapBitdepth16To8(TIFFRGBAImage* img)
 	uint8* m;
 	uint32 n;
 	assert(img->Bitdepth16To8==NULL);
-	img->Bitdepth16To8=_TIFFmalloc(65536);
+	img->Bitdepth16To8=_TIFFmallocExt(img->tif, 65536);
 	if (img->Bitdepth16To8==NULL)
 	{
 		TIFFErrorExt(img->tif->tif_clientdata,module,"Out of memory");
@@ -0,0 +1,552 @@
+/* $Id$ */
+
+/*
+ * TIFF Library.
+ *
+ * HTTP range client: read-only access to files served over HTTP/1.1,
+ * one range request per read of the block cache of tif_range.c.  The
+ * connection is kept alive between requests.  Only plain http:// URLs
+ * are handled; other transports can be plugged in with TIFFRangeOpen().
+ */
+
+#include "tif_config.h"
+
+#ifdef HAVE_SYS_TYPES_H
+# include <sys/types.h>
+#endif
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffiop.h"
+
+#ifndef MSG_NOSIGNAL
+# define MSG_NOSIGNAL 0
+#endif
+
+typedef struct {
+	char*		url;
+	char*		host;		/* host[:port], for the Host header */
+	char*		hostname;
+	const char*	port;
+	char*		path;
+	int		fd;		/* connection, or -1 */
+	int		keepalive;	/* connection may be reused */
+	uint8*		head;		/* start of the file, read when opening */
+	tmsize_t	headsize;
+	int		whole;		/* head holds the whole file */
+	char		rbuf[4096];	/* receive buffer */
+	size_t		rpos, rlen;
+} TIFFHTTPFile;
+
+typedef struct {
+	int		status;
+	int		keepalive;
+	uint64		length;		/* Content-Length */
+	int		haslength;
+	uint64		rangestart;	/* Content-Range */
+	uint64		total;
+	int		hasrange;
+	int		chunked;
+} TIFFHTTPResponse;
+
+static void
+_tiffHTTPDisconnect(TIFFHTTPFile* hf)
+{
+	if (hf->fd >= 0)
+		close(hf->fd);
+	hf->fd = -1;
+	hf->rpos = hf->rlen = 0;
+}
+
+static int
+_tiffHTTPConnect(TIFFHTTPFile* hf)
+{
+	static const char module[] = "TIFFOpenHTTP";
+	struct addrinfo hints, *res, *ai;
+	int err;
+
+	_TIFFmemset(&hints, 0, sizeof (hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	err = getaddrinfo(hf->hostname, hf->port, &hints, &res);
+	if (err != 0) {
+		TIFFErrorExt(0, module, "%s: %s", hf->url, gai_strerror(err));
+		return (0);
+	}
+	for (ai = res; ai != NULL; ai = ai->ai_next) {
+		hf->fd = socket(ai->ai_family, ai->ai_socktype,
+				ai->ai_protocol);
+		if (hf->fd < 0)
+			continue;
+		if (connect(hf->fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(hf->fd);
+		hf->fd = -1;
+	}
+	freeaddrinfo(res);
+	if (hf->fd < 0) {
+		TIFFErrorExt(0, module, "%s: Cannot connect", hf->url);
+		return (0);
+	}
+	hf->rpos = hf->rlen = 0;
+	return (1);
+}
+
+static int
+_tiffHTTPSend(TIFFHTTPFile* hf, const char* buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t n = send(hf->fd, buf, len, MSG_NOSIGNAL);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return (0);
+		buf += n;
+		len -= (size_t) n;
+	}
+	return (1);
+}
+
+static int
+_tiffHTTPFill(TIFFHTTPFile* hf)
+{
+	ssize_t n;
+
+	do {
+		n = recv(hf->fd, hf->rbuf, sizeof (hf->rbuf), 0);
+	} while (n < 0 && errno == EINTR);
+	if (n <= 0)
+		return (0);
+	hf->rpos = 0;
+	hf->rlen = (size_t) n;
+	return (1);
+}
+
+/*
+ * Read a header line, without its line terminator.  Overlong lines are
+ * truncated.
+ */
+static int
+_tiffHTTPGetLine(TIFFHTTPFile* hf, char* line, size_t size)
+{
+	size_t len = 0;
+
+	for (;;) {
+		char c;
+		if (hf->rpos == hf->rlen && !_tiffHTTPFill(hf))
+			return (0);
+		c = hf->rbuf[hf->rpos++];
+		if (c == '\n')
+			break;
+		if (c != '\r' && len + 1 < size)
+			line[len++] = c;
+	}
+	line[len] = '\0';
+	return (1);
+}
+
+/*
+ * Read size bytes of the body into buf, or drop them if buf is NULL.
+ */
+static int
+_tiffHTTPGetBody(TIFFHTTPFile* hf, uint8* buf, uint64 size)
+{
+	while (size > 0) {
+		size_t n;
+		if (hf->rpos == hf->rlen && !_tiffHTTPFill(hf))
+			return (0);
+		n = hf->rlen - hf->rpos;
+		if ((uint64) n > size)
+			n = (size_t) size;
+		if (buf != NULL) {
+			_TIFFmemcpy(buf, hf->rbuf + hf->rpos, (tmsize_t) n);
+			buf += n;
+		}
+		hf->rpos += n;
+		size -= n;
+	}
+	return (1);
+}
+
+static const char*
+_tiffHTTPParseUInt64(const char* cp, uint64* value)
+{
+	const char* start = cp;
+
+	*value = 0;
+	while (*cp >= '0' && *cp <= '9') {
+		if (*value > ((~(uint64)0) - 9) / 10)
+			return (NULL);
+		*value = *value * 10 + (uint64) (*cp++ - '0');
+	}
+	return (cp == start ? NULL : cp);
+}
+
+/* Case insensitive match of a header name, returning its value */
+static const char*
+_tiffHTTPHeader(const char* line, const char* name)
+{
+	while (*name != '\0') {
+		char c = *line++;
+		if (c >= 'A' && c <= 'Z')
+			c = (char) (c - 'A' + 'a');
+		if (c != *name++)
+			return (NULL);
+	}
+	if (*line++ != ':')
+		return (NULL);
+	while (*line == ' ' || *line == '\t')
+		line++;
+	return (line);
+}
+
+static int
+_tiffHTTPContains(const char* value, const char* token)
+{
+	size_t len = strlen(token);
+
+	for (; *value != '\0'; value++) {
+		size_t i;
+		for (i = 0; i < len; i++) {
+			char c = value[i];
+			if (c >= 'A' && c <= 'Z')
+				c = (char) (c - 'A' + 'a');
+			if (c != token[i])
+				break;
+		}
+		if (i == len)
+			return (1);
+	}
+	return (0);
+}
+
+static int
+_tiffHTTPGetResponse(TIFFHTTPFile* hf, TIFFHTTPResponse* resp)
+{
+	char line[1024];
+	const char* cp;
+
+	_TIFFmemset(resp, 0, sizeof (*resp));
+	if (!_tiffHTTPGetLine(hf, line, sizeof (line)) || strlen(line) < 9
+	    || strncmp(line, "HTTP/1.", 7) != 0 || line[8] != ' ')
+		return (0);
+	resp->keepalive = line[7] != '0';
+	resp->status = atoi(line + 9);
+	for (;;) {
+		if (!_tiffHTTPGetLine(hf, line, sizeof (line)))
+			return (0);
+		if (line[0] == '\0')
+			break;
+		if ((cp = _tiffHTTPHeader(line, "content-length")) != NULL) {
+			resp->haslength =
+			    _tiffHTTPParseUInt64(cp, &resp->length) != NULL;
+		} else if ((cp = _tiffHTTPHeader(line, "content-range"))
+			   != NULL) {
+			uint64 end;
+			if (strncmp(cp, "bytes ", 6) != 0)
+				continue;
+			cp += 6;
+			if (*cp == '*')
+				cp++;
+			else if ((cp = _tiffHTTPParseUInt64(cp,
+			    &resp->rangestart)) == NULL || *cp++ != '-'
+			    || (cp = _tiffHTTPParseUInt64(cp, &end)) == NULL)
+				continue;
+			if (*cp++ == '/'
+			    && _tiffHTTPParseUInt64(cp, &resp->total) != NULL)
+				resp->hasrange = 1;
+		} else if ((cp = _tiffHTTPHeader(line, "connection")) != NULL) {
+			if (_tiffHTTPContains(cp, "close"))
+				resp->keepalive = 0;
+			else if (_tiffHTTPContains(cp, "keep-alive"))
+				resp->keepalive = 1;
+		} else if ((cp = _tiffHTTPHeader(line, "transfer-encoding"))
+			   != NULL) {
+			resp->chunked = _tiffHTTPContains(cp, "chunked");
+		}
+	}
+	return (1);
+}
+
+/*
+ * Read size bytes at offset into buf.  The total file size is returned
+ * through total when the server reports it.  A server ignoring the range
+ * sends the whole file: this is only accepted when reading the head,
+ * which then grows to hold all of it.
+ */
+static tmsize_t
+_tiffHTTPGet(TIFFHTTPFile* hf, uint64 offset, void* buf, tmsize_t size,
+	     uint64* total)
+{
+	static const char module[] = "TIFFOpenHTTP";
+	TIFFHTTPResponse resp;
+	char request[1024];
+	size_t len;
+	tmsize_t got = 0;
+	int attempt;
+
+	len = strlen(hf->path) + strlen(hf->host) + 128;
+	if (len > sizeof (request)) {
+		TIFFErrorExt(0, module, "%s: URL too long", hf->url);
+		return ((tmsize_t) -1);
+	}
+	sprintf(request, "GET %s HTTP/1.1\r\nHost: %s\r\n"
+		"Range: bytes=" TIFF_UINT64_FORMAT "-" TIFF_UINT64_FORMAT "\r\n"
+		"\r\n", hf->path, hf->host, (TIFF_UINT64_T) offset,
+		(TIFF_UINT64_T) (offset + (uint64) size - 1));
+
+	/* A kept alive connection may have been closed by the server */
+	for (attempt = 0; ; attempt++) {
+		int reused = hf->fd >= 0;
+		if (!reused && !_tiffHTTPConnect(hf))
+			return ((tmsize_t) -1);
+		if (_tiffHTTPSend(hf, request, strlen(request))
+		    && _tiffHTTPGetResponse(hf, &resp))
+			break;
+		_tiffHTTPDisconnect(hf);
+		if (!reused || attempt > 0) {
+			TIFFErrorExt(0, module, "%s: No valid response",
+				     hf->url);
+			return ((tmsize_t) -1);
+		}
+	}
+	hf->keepalive = resp.keepalive;
+	if (resp.chunked) {
+		TIFFErrorExt(0, module,
+			     "%s: Chunked transfer encoding is not supported",
+			     hf->url);
+		_tiffHTTPDisconnect(hf);
+		return ((tmsize_t) -1);
+	}
+
+	switch (resp.status) {
+	case 206:
+		if (!resp.haslength || !resp.hasrange
+		    || resp.rangestart != offset || resp.length > (uint64) size) {
+			TIFFErrorExt(0, module, "%s: Unexpected range in response",
+				     hf->url);
+			_tiffHTTPDisconnect(hf);
+			return ((tmsize_t) -1);
+		}
+		if (!_tiffHTTPGetBody(hf, (uint8*) buf, resp.length))
+			goto truncated;
+		got = (tmsize_t) resp.length;
+		if (total != NULL)
+			*total = resp.total;
+		break;
+	case 200:
+		/*
+		 * Reading the body up to the offset asked for on every request
+		 * would make reading the file quadratic.
+		 */
+		if ((uint8*) buf != hf->head || offset != 0) {
+			TIFFErrorExt(0, module,
+				     "%s: Server does not honour range requests",
+				     hf->url);
+			_tiffHTTPDisconnect(hf);
+			return ((tmsize_t) -1);
+		}
+		if (!resp.haslength) {
+			TIFFErrorExt(0, module, "%s: Missing Content-Length",
+				     hf->url);
+			_tiffHTTPDisconnect(hf);
+			return ((tmsize_t) -1);
+		}
+		if (resp.length > (uint64) size) {
+			uint8* head = NULL;
+			if ((uint64) (tmsize_t) resp.length == resp.length
+			    && (tmsize_t) resp.length > 0)
+				head = (uint8*) _TIFFrealloc(hf->head,
+				    (tmsize_t) resp.length);
+			if (head == NULL) {
+				TIFFErrorExt(0, module,
+				    "%s: Out of memory reading the whole file",
+				    hf->url);
+				_tiffHTTPDisconnect(hf);
+				return ((tmsize_t) -1);
+			}
+			hf->head = head;
+		}
+		if (!_tiffHTTPGetBody(hf, hf->head, resp.length))
+			goto truncated;
+		got = (tmsize_t) resp.length;
+		hf->whole = 1;
+		if (total != NULL)
+			*total = resp.length;
+		break;
+	case 416:
+		/* Range beyond the end of the file */
+		if (resp.haslength && !_tiffHTTPGetBody(hf, NULL, resp.length))
+			goto truncated;
+		if (total != NULL && resp.hasrange)
+			*total = resp.total;
+		break;
+	default:
+		TIFFErrorExt(0, module, "%s: HTTP status %d", hf->url,
+			     resp.status);
+		_tiffHTTPDisconnect(hf);
+		return ((tmsize_t) -1);
+	}
+	if (!hf->keepalive)
+		_tiffHTTPDisconnect(hf);
+	return (got);
+
+truncated:
+	TIFFErrorExt(0, module, "%s: Truncated response", hf->url);
+	_tiffHTTPDisconnect(hf);
+	return ((tmsize_t) -1);
+}
+
+static tmsize_t
+_tiffHTTPReadProc(thandle_t h, uint64 offset, void* buf, tmsize_t size)
+{
+	TIFFHTTPFile* hf = (TIFFHTTPFile*) h;
+
+	/* Served from the first bytes read when opening */
+	if (offset + (uint64) size <= (uint64) hf->headsize) {
+		_TIFFmemcpy(buf, hf->head + offset, size);
+		return (size);
+	}
+	if (hf->whole) {
+		if (offset >= (uint64) hf->headsize)
+			return (0);
+		size = hf->headsize - (tmsize_t) offset;
+		_TIFFmemcpy(buf, hf->head + offset, size);
+		return (size);
+	}
+	return (_tiffHTTPGet(hf, offset, buf, size, NULL));
+}
+
+static int
+_tiffHTTPCloseProc(thandle_t h)
+{
+	TIFFHTTPFile* hf = (TIFFHTTPFile*) h;
+
+	_tiffHTTPDisconnect(hf);
+	_TIFFfree(hf->head);
+	_TIFFfree(hf);
+	return (0);
+}
+
+/*
+ * Split http://host[:port]/path into its parts, all stored after the
+ * TIFFHTTPFile structure.
+ */
+static TIFFHTTPFile*
+_tiffHTTPParseURL(const char* url)
+{
+	static const char module[] = "TIFFOpenHTTP";
+	TIFFHTTPFile* hf;
+	const char *host, *path, *port;
+	size_t urllen = strlen(url), hostlen;
+	char* cp;
+
+	if (strncmp(url, "http://", 7) != 0) {
+		TIFFErrorExt(0, module, "%s: Only http:// URLs are supported",
+			     url);
+		return (NULL);
+	}
+	host = url + 7;
+	path = strchr(host, '/');
+	if (path == NULL)
+		path = host + strlen(host);
+	hostlen = (size_t) (path - host);
+	if (hostlen == 0) {
+		TIFFErrorExt(0, module, "%s: Missing host name", url);
+		return (NULL);
+	}
+	port = host + hostlen;
+	while (port > host && port[-1] >= '0' && port[-1] <= '9')
+		port--;
+	if (port == host || port[-1] != ':' || port == host + hostlen)
+		port = NULL;
+
+	hf = (TIFFHTTPFile*) _TIFFmalloc((tmsize_t) (sizeof (TIFFHTTPFile)
+	    + 2 * (urllen + hostlen) + 4));
+	if (hf == NULL) {
+		TIFFErrorExt(0, module, "%s: Out of memory", url);
+		return (NULL);
+	}
+	_TIFFmemset(hf, 0, sizeof (TIFFHTTPFile));
+	hf->fd = -1;
+	cp = (char*) (hf + 1);
+	hf->url = strcpy(cp, url);
+	cp += urllen + 1;
+	hf->host = cp;
+	_TIFFmemcpy(cp, host, (tmsize_t) hostlen);
+	cp[hostlen] = '\0';
+	cp += hostlen + 1;
+	hf->hostname = cp;
+	if (port != NULL) {
+		_TIFFmemcpy(cp, host, (tmsize_t) (port - 1 - host));
+		cp[port - 1 - host] = '\0';
+		hf->port = hf->host + (port - host);
+	} else {
+		_TIFFmemcpy(cp, host, (tmsize_t) hostlen);
+		cp[hostlen] = '\0';
+		hf->port = "80";
+	}
+	cp += hostlen + 1;
+	hf->path = strcpy(cp, *path != '\0' ? path : "/");
+	return (hf);
+}
+
+/*
+ * Open a file served over HTTP.  The first block of the file is fetched
+ * when opening, to learn its size.  If the server does not honour range
+ * requests, the whole file is read then, and served from memory.
+ */
+TIFF*
+TIFFOpenHTTP(const char* url, const char* mode, TIFFOpenOptions* opts)
+{
+	static const char module[] = "TIFFOpenHTTP";
+	TIFFHTTPFile* hf;
+	tmsize_t blocksize = 16384;
+	uint64 size = 0;
+	TIFF* tif;
+
+	if (_TIFFgetMode(mode, module) != O_RDONLY) {
+		TIFFErrorExt(0, module, "%s: Only reading is supported", url);
+		return ((TIFF*) 0);
+	}
+	hf = _tiffHTTPParseURL(url);
+	if (hf == NULL)
+		return ((TIFF*) 0);
+	if (opts != NULL && opts->range_cache && opts->range_block_size > 0)
+		blocksize = opts->range_block_size;
+	hf->head = (uint8*) _TIFFmalloc(blocksize);
+	if (hf->head == NULL) {
+		TIFFErrorExt(0, module, "%s: Out of memory", url);
+		goto bad;
+	}
+	hf->headsize = _tiffHTTPGet(hf, 0, hf->head, blocksize, &size);
+	if (hf->headsize < 0)
+		goto bad;
+	if (size == 0) {
+		TIFFErrorExt(0, module, "%s: Cannot get the file size", url);
+		goto bad;
+	}
+	tif = TIFFRangeOpen(url, mode, (thandle_t) hf, size,
+			    _tiffHTTPReadProc, _tiffHTTPCloseProc, opts);
+	if (tif != NULL)
+		return (tif);
+bad:
+	_tiffHTTPCloseProc((thandle_t) hf);
+	return ((TIFF*) 0);
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 8
+ * fill-column: 78
+ * End:
+ */
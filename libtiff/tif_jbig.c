@@ -53,17 +53,19 @@ static int JBIGDecode(TIFF* tif, uint8* buffer, tmsize_t size, uint16 s)
 	struct jbg_dec_state decoder;
 	int decodeStatus = 0;
 	unsigned char* pImage = NULL;
-	(void) size, (void) s;
+	unsigned long decodedSize;
+	(void) s;
 
+	/* Only the bytes actually read for the strip are handed to JBIG-KIT */
 	if (isFillOrder(tif, tif->tif_dir.td_fillorder))
 	{
-		TIFFReverseBits(tif->tif_rawdata, tif->tif_rawdatasize);
+		TIFFReverseBits(tif->tif_rawcp, tif->tif_rawcc);
 	}
 
 	jbg_dec_init(&decoder);
 
 #if defined(HAVE_JBG_NEWLEN)
-	jbg_newlen(tif->tif_rawdata, (size_t)tif->tif_rawdatasize);
+	jbg_newlen(tif->tif_rawcp, (size_t)tif->tif_rawcc);
 	/*
 	 * I do not check the return status of jbg_newlen because even if this
 	 * function fails it does not necessarily mean that decoding the image
@@ -76,8 +78,8 @@ static int JBIGDecode(TIFF* tif, uint8* buffer, tmsize_t size, uint16 s)
 	 */
 #endif /* HAVE_JBG_NEWLEN */
 
-	decodeStatus = jbg_dec_in(&decoder, (unsigned char*)tif->tif_rawdata,
-				  (size_t)tif->tif_rawdatasize, NULL);
+	decodeStatus = jbg_dec_in(&decoder, (unsigned char*)tif->tif_rawcp,
+				  (size_t)tif->tif_rawcc, NULL);
 	if (JBG_EOK != decodeStatus)
 	{
 		/*
@@ -98,12 +100,42 @@ static int JBIGDecode(TIFF* tif, uint8* buffer, tmsize_t size, uint16 s)
 		return 0;
 	}
 
+	/*
+	 * JBIG-KIT always decodes into its own bitmap, so there is one
+	 * copy into the caller buffer; it is bounded by the buffer size.
+	 */
+	decodedSize = jbg_dec_getsize(&decoder);
+	if ((tmsize_t)decodedSize < size)
+	{
+		TIFFWarningExt(tif->tif_clientdata, "JBIG",
+			       "Only decoded %lu bytes, whereas %lu requested",
+			       decodedSize, (unsigned long)size);
+	}
+	else if ((tmsize_t)decodedSize > size)
+	{
+		TIFFErrorExt(tif->tif_clientdata, "JBIG",
+			     "Decoded %lu bytes, whereas %lu were requested",
+			     decodedSize, (unsigned long)size);
+		jbg_dec_free(&decoder);
+		return 0;
+	}
 	pImage = jbg_dec_getimage(&decoder, 0);
-	_TIFFmemcpy(buffer, pImage, jbg_dec_getsize(&decoder));
+	_TIFFmemcpy(buffer, pImage, decodedSize);
 	jbg_dec_free(&decoder);
+
+	tif->tif_rawcp += tif->tif_rawcc;
+	tif->tif_rawcc = 0;
+
 	return 1;
 }
 
+/*
+ * Size of the output buffer used when encoding.  Encoded data is
+ * passed on to the file in small pieces as JBIG-KIT produces it, so
+ * there is no need for a buffer the size of the uncompressed strip.
+ */
+#define JBIG_OUTPUT_BUFFER	(64*1024)
+
 static int JBIGSetupEncode(TIFF* tif)
 {
 	if (TIFFNumberOfStrips(tif) != 1)
@@ -112,6 +144,21 @@ static int JBIGSetupEncode(TIFF* tif)
 		return 0;
 	}
 
+	/*
+	 * Replace the default strip-sized buffer by a smaller one, unless
+	 * the buffer was provided by the application or the strip is being
+	 * rewritten (the buffer is then sized to detect that it grows).
+	 */
+	if ((tif->tif_flags & TIFF_MYBUFFER) &&
+	    tif->tif_rawdatasize > JBIG_OUTPUT_BUFFER &&
+	    tif->tif_rawcc == 0 &&
+	    (tif->tif_dir.td_stripbytecount_p == NULL ||
+	     tif->tif_dir.td_stripbytecount_p[0] == 0))
+	{
+		if (!TIFFWriteBufferSetup(tif, NULL, JBIG_OUTPUT_BUFFER))
+			return 0;
+	}
+
 	return 1;
 }
 
@@ -50,6 +50,7 @@ int TIFFFillStrip(TIFF* tif, uint32 strip);
 int TIFFFillTile(TIFF* tif, uint32 tile);
 int TIFFReInitJPEG_12( TIFF *tif, int scheme, int is_encode );
 int TIFFJPEGIsFullStripRequired_12(TIFF* tif);
+int TIFFJPEGCopyCoefficients_12(TIFF* in, TIFF* out);
 
 /* We undefine FAR to avoid conflict with JPEG definition */
 
@@ -178,6 +179,7 @@ typedef struct {
 	int		jpegquality;	/* Compression quality level */
 	int		jpegcolormode;	/* Auto RGB<=>YCbCr convert? */
 	int		jpegtablesmode;	/* What to put in JPEGTables */
+	int		jpegscaledenom;	/* Reduced resolution decoding factor */
 
         int             ycbcrsampling_fetched;
         int             max_allowed_scan_number;
@@ -191,6 +193,7 @@ static int JPEGEncode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s);
 static int JPEGEncodeRaw(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s);
 static int JPEGInitializeLibJPEG(TIFF * tif, int decode );
 static int DecodeRowError(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s);
+static int DecodeRowScaledError(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s);
 
 #define	FIELD_JPEGTABLES	(FIELD_CODEC+0)
 
@@ -198,7 +201,8 @@ static const TIFFField jpegFields[] = {
     { TIFFTAG_JPEGTABLES, -3, -3, TIFF_UNDEFINED, 0, TIFF_SETGET_C32_UINT8, TIFF_SETGET_C32_UINT8, FIELD_JPEGTABLES, FALSE, TRUE, "JPEGTables", NULL },
     { TIFFTAG_JPEGQUALITY, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED, FIELD_PSEUDO, TRUE, FALSE, "", NULL },
     { TIFFTAG_JPEGCOLORMODE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED, FIELD_PSEUDO, FALSE, FALSE, "", NULL },
-    { TIFFTAG_JPEGTABLESMODE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED, FIELD_PSEUDO, FALSE, FALSE, "", NULL }
+    { TIFFTAG_JPEGTABLESMODE, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED, FIELD_PSEUDO, FALSE, FALSE, "", NULL },
+    { TIFFTAG_JPEGSCALEDENOM, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED, FIELD_PSEUDO, FALSE, FALSE, "", NULL }
 };
 
 /*
@@ -375,8 +379,8 @@ TIFFjpeg_has_multiple_scans(JPEGState* sp)
 	return CALLJPEG(sp, 0, jpeg_has_multiple_scans(&sp->cinfo.d));
 }
 
-static int
-TIFFjpeg_start_decompress(JPEGState* sp)
+static void
+TIFFjpeg_set_progress_monitor(JPEGState* sp)
 {
         const char* sz_max_allowed_scan_number;
         /* progress monitor */
@@ -386,7 +390,12 @@ TIFFjpeg_start_decompress(JPEGState* sp)
         sz_max_allowed_scan_number = getenv("LIBTIFF_JPEG_MAX_ALLOWED_SCAN_NUMBER");
         if( sz_max_allowed_scan_number )
             sp->max_allowed_scan_number = atoi(sz_max_allowed_scan_number);
+}
 
+static int
+TIFFjpeg_start_decompress(JPEGState* sp)
+{
+	TIFFjpeg_set_progress_monitor(sp);
 	return CALLVJPEG(sp, jpeg_start_decompress(&sp->cinfo.d));
 }
 
@@ -422,6 +431,54 @@ TIFFjpeg_destroy(JPEGState* sp)
 	return CALLVJPEG(sp, jpeg_destroy(&sp->cinfo.comm));
 }
 
+static jvirt_barray_ptr*
+TIFFjpeg_read_coefficients(JPEGState* sp)
+{
+	TIFFjpeg_set_progress_monitor(sp);
+	return CALLJPEG(sp, (jvirt_barray_ptr*) NULL,
+	    jpeg_read_coefficients(&sp->cinfo.d));
+}
+
+static int
+TIFFjpeg_copy_critical_parameters(JPEGState* src, JPEGState* dst)
+{
+	return CALLVJPEG(dst,
+	    jpeg_copy_critical_parameters(&src->cinfo.d, &dst->cinfo.c));
+}
+
+static int
+TIFFjpeg_write_coefficients(JPEGState* sp, jvirt_barray_ptr* coef_arrays)
+{
+	return CALLVJPEG(sp, jpeg_write_coefficients(&sp->cinfo.c, coef_arrays));
+}
+
+static jvirt_barray_ptr
+TIFFjpeg_request_virt_barray(JPEGState* sp, JDIMENSION blocksperrow,
+			     JDIMENSION numrows, JDIMENSION maxaccess)
+{
+	return CALLJPEG(sp, (jvirt_barray_ptr) NULL,
+	    (*sp->cinfo.comm.mem->request_virt_barray)
+		(&sp->cinfo.comm, JPOOL_IMAGE, TRUE,
+		 blocksperrow, numrows, maxaccess));
+}
+
+static int
+TIFFjpeg_realize_virt_arrays(JPEGState* sp)
+{
+	return CALLVJPEG(sp,
+	    (*sp->cinfo.comm.mem->realize_virt_arrays)(&sp->cinfo.comm));
+}
+
+static JBLOCKROW
+TIFFjpeg_access_virt_barray(JPEGState* sp, jvirt_barray_ptr ptr,
+			    JDIMENSION row, boolean writable)
+{
+	JBLOCKARRAY rows = CALLJPEG(sp, (JBLOCKARRAY) NULL,
+	    (*sp->cinfo.comm.mem->access_virt_barray)
+		(&sp->cinfo.comm, ptr, row, 1, writable));
+	return rows != NULL ? rows[0] : NULL;
+}
+
 static JSAMPARRAY
 TIFFjpeg_alloc_sarray(JPEGState* sp, int pool_id,
 		      JDIMENSION samplesperrow, JDIMENSION numrows)
@@ -518,7 +575,7 @@ tables_empty_output_buffer(j_compress_ptr cinfo)
 	void* newbuf;
 
 	/* the entire buffer has been filled; enlarge it by 1000 bytes */
-	newbuf = _TIFFrealloc((void*) sp->jpegtables,
+	newbuf = _TIFFreallocExt(sp->tif, (void*) sp->jpegtables,
 			      (tmsize_t) (sp->jpegtables_length + 1000));
 	if (newbuf == NULL)
 		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 100);
@@ -547,9 +604,9 @@ TIFFjpeg_tables_dest(JPEGState* sp, TIFF* tif)
 	 * Initial size is 1000 bytes, which is usually adequate.
 	 */
 	if (sp->jpegtables)
-		_TIFFfree(sp->jpegtables);
+		_TIFFfreeExt(tif, sp->jpegtables);
 	sp->jpegtables_length = 1000;
-	sp->jpegtables = (void*) _TIFFmalloc((tmsize_t) sp->jpegtables_length);
+	sp->jpegtables = (void*) _TIFFmallocExt(tif, (tmsize_t) sp->jpegtables_length);
 	if (sp->jpegtables == NULL) {
 		sp->jpegtables_length = 0;
 		TIFFErrorExt(sp->tif->tif_clientdata, "TIFFjpeg_tables_dest", "No space for JPEGTables");
@@ -689,11 +746,15 @@ alloc_downsampled_buffers(TIFF* tif, jpeg_component_info* comp_info,
 
 	for (ci = 0, compptr = comp_info; ci < num_components;
 	     ci++, compptr++) {
+		JDIMENSION width = compptr->width_in_blocks * DCTSIZE;
+		JDIMENSION rows = (JDIMENSION) (compptr->v_samp_factor*DCTSIZE);
+
 		samples_per_clump += compptr->h_samp_factor *
 			compptr->v_samp_factor;
-		buf = TIFFjpeg_alloc_sarray(sp, JPOOL_IMAGE,
-				compptr->width_in_blocks * DCTSIZE,
-				(JDIMENSION) (compptr->v_samp_factor*DCTSIZE));
+		if (!_TIFFCheckMemoryBudget(tif,
+		    (uint64) width * rows * sizeof(JSAMPLE)))
+			return (0);
+		buf = TIFFjpeg_alloc_sarray(sp, JPOOL_IMAGE, width, rows);
 		if (buf == NULL)
 			return (0);
 		sp->ds_buffer[ci] = buf;
@@ -783,11 +844,8 @@ JPEGFixupTagsSubsampling(TIFF* tif)
 	static const char module[] = "JPEGFixupTagsSubsampling";
 	struct JPEGFixupTagsSubsamplingData m;
 
-        _TIFFFillStriles( tif );
-        
-        if( tif->tif_dir.td_stripbytecount == NULL
-            || tif->tif_dir.td_stripoffset == NULL
-            || tif->tif_dir.td_stripbytecount[0] == 0 )
+        if( TIFFGetStrileByteCount(tif, 0) == 0
+            || TIFFGetStrileOffset(tif, 0) == 0 )
         {
             /* Do not even try to check if the first strip/tile does not
                yet exist, as occurs when GDAL has created a new NULL file
@@ -797,7 +855,7 @@ JPEGFixupTagsSubsampling(TIFF* tif)
 
 	m.tif=tif;
 	m.buffersize=2048;
-	m.buffer=_TIFFmalloc(m.buffersize);
+	m.buffer=_TIFFmallocExt(tif, m.buffersize);
 	if (m.buffer==NULL)
 	{
 		TIFFWarningExt(tif->tif_clientdata,module,
@@ -806,13 +864,13 @@ JPEGFixupTagsSubsampling(TIFF* tif)
 	}
 	m.buffercurrentbyte=NULL;
 	m.bufferbytesleft=0;
-	m.fileoffset=tif->tif_dir.td_stripoffset[0];
+	m.fileoffset=TIFFGetStrileOffset(tif, 0);
 	m.filepositioned=0;
-	m.filebytesleft=tif->tif_dir.td_stripbytecount[0];
+	m.filebytesleft=TIFFGetStrileByteCount(tif, 0);
 	if (!JPEGFixupTagsSubsamplingSec(&m))
 		TIFFWarningExt(tif->tif_clientdata,module,
 		    "Unable to auto-correct subsampling values, likely corrupt JPEG compressed data in first strip/tile; auto-correcting skipped");
-	_TIFFfree(m.buffer);
+	_TIFFfreeExt(tif, m.buffer);
 }
 
 static int
@@ -1241,6 +1299,9 @@ JPEGPreDecode(TIFF* tif, uint16 s)
                         (unsigned)TIFF_LIBJPEG_LARGEST_MEM_ALLOC);
                     return (0);
             }
+            /* libjpeg memory is not seen by the handle allocator */
+            if( !_TIFFCheckMemoryBudget(tif, nRequiredMemory) )
+                    return (0);
         }
 
 	if (td->td_planarconfig == PLANARCONFIG_CONTIG) {
@@ -1287,6 +1348,18 @@ JPEGPreDecode(TIFF* tif, uint16 s)
 			downsampled_output = TRUE;
 		/* XXX what about up-sampling? */
 	}
+	/* Reduced resolution decoding, through libjpeg DCT scaling */
+	sp->cinfo.d.scale_num = 1;
+	sp->cinfo.d.scale_denom = 1;
+	if (sp->jpegscaledenom > 1) {
+		if (downsampled_output) {
+			TIFFErrorExt(tif->tif_clientdata, module,
+				     "Reduced resolution decoding of subsampled "
+				     "data requires JPEGCOLORMODE_RGB");
+			return (0);
+		}
+		sp->cinfo.d.scale_denom = (unsigned int) sp->jpegscaledenom;
+	}
 	if (downsampled_output) {
 		/* Need to use raw-data interface to libjpeg */
 		sp->cinfo.d.raw_data_out = TRUE;
@@ -1306,6 +1379,18 @@ JPEGPreDecode(TIFF* tif, uint16 s)
 	/* Start JPEG decompressor */
 	if (!TIFFjpeg_start_decompress(sp))
 		return (0);
+	if (sp->cinfo.d.scale_denom > 1) {
+		/*
+		 * Scanlines are returned at the reduced width, packed one
+		 * after the other.  Row-wise access does not make sense since
+		 * tif_row can no longer be matched with the output.
+		 */
+		sp->bytesperline = (tmsize_t) TIFFhowmany8_64(
+			(uint64) sp->cinfo.d.output_width *
+			sp->cinfo.d.output_components *
+			td->td_bitspersample);
+		tif->tif_decoderow = DecodeRowScaledError;
+	}
 	/* Allocate downsampled-data buffers if needed */
 	if (downsampled_output) {
 		if (!alloc_downsampled_buffers(tif, sp->cinfo.d.comp_info,
@@ -1321,6 +1406,16 @@ JPEGPreDecode(TIFF* tif, uint16 s)
  * "Standard" case: returned data is not downsampled.
  */
 #if !JPEG_LIB_MK1_OR_12BIT
+/*
+ * Maximum number of scanlines requested from libjpeg in a single
+ * jpeg_read_scanlines() call.  libjpeg returns at most one row group
+ * (max_v_samp_factor rows, or rec_outbuf_height) per call, so this only
+ * needs to be large enough to cover that.
+ */
+#ifndef JPEG_MAX_BATCH_ROWS
+#define JPEG_MAX_BATCH_ROWS 16
+#endif
+
 static int
 JPEGDecode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
 {
@@ -1339,12 +1434,12 @@ JPEGDecode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
                 return 0;
         
 	nrows = cc / sp->bytesperline;
-	if (cc % sp->bytesperline)
+	if (cc % sp->bytesperline && sp->cinfo.d.scale_denom == 1)
 		TIFFWarningExt(tif->tif_clientdata, tif->tif_name,
                                "fractional scanline not read");
 
-	if( nrows > (tmsize_t) sp->cinfo.d.image_height )
-		nrows = sp->cinfo.d.image_height;
+	if( nrows > (tmsize_t) sp->cinfo.d.output_height )
+		nrows = sp->cinfo.d.output_height;
 
 	/* data is expected to be read in multiples of a scanline */
 	if (nrows)
@@ -1353,17 +1448,29 @@ JPEGDecode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
                 {
                         /*
                          * In the libjpeg6b-9a 8bit case.  We read directly into
-                         * the TIFF buffer.
+                         * the TIFF buffer.  Hand libjpeg as many row pointers
+                         * as the caller buffer holds (up to JPEG_MAX_BATCH_ROWS)
+                         * so that a whole row group, as produced by the
+                         * upsampler, is emitted per call instead of a single
+                         * scanline.
                          */
-                        JSAMPROW bufptr = (JSAMPROW)buf;
+                        JSAMPROW bufptrs[JPEG_MAX_BATCH_ROWS];
+                        int nbatch, i, nread;
 
-                        if (TIFFjpeg_read_scanlines(sp, &bufptr, 1) != 1)
+                        nbatch = (nrows > JPEG_MAX_BATCH_ROWS) ?
+                                JPEG_MAX_BATCH_ROWS : (int) nrows;
+                        for (i = 0; i < nbatch; i++)
+                                bufptrs[i] = (JSAMPROW)(buf + i * sp->bytesperline);
+
+                        nread = TIFFjpeg_read_scanlines(sp, bufptrs, nbatch);
+                        if (nread <= 0 || nread > nbatch)
                                 return (0);
 
-                        ++tif->tif_row;
-                        buf += sp->bytesperline;
-                        cc -= sp->bytesperline;
-                } while (--nrows > 0);
+                        tif->tif_row += nread;
+                        buf += nread * sp->bytesperline;
+                        cc -= nread * sp->bytesperline;
+                        nrows -= nread;
+                } while (nrows > 0);
         }
 
         /* Update information on consumed data */
@@ -1395,12 +1502,12 @@ JPEGDecode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
                 return 0;
         
 	nrows = cc / sp->bytesperline;
-	if (cc % sp->bytesperline)
+	if (cc % sp->bytesperline && sp->cinfo.d.scale_denom == 1)
 		TIFFWarningExt(tif->tif_clientdata, tif->tif_name,
                                "fractional scanline not read");
 
-	if( nrows > (tmsize_t) sp->cinfo.d.image_height )
-		nrows = sp->cinfo.d.image_height;
+	if( nrows > (tmsize_t) sp->cinfo.d.output_height )
+		nrows = sp->cinfo.d.output_height;
 
 	/* data is expected to be read in multiples of a scanline */
 	if (nrows)
@@ -1414,7 +1521,7 @@ JPEGDecode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
                 if( sp->cinfo.d.data_precision == 12 )
                 {
                         line_work_buf = (JSAMPROW)
-                                _TIFFmalloc(sizeof(short) * sp->cinfo.d.output_width
+                                _TIFFmallocExt(tif, sizeof(short) * sp->cinfo.d.output_width
                                             * sp->cinfo.d.num_components );
                 }
 
@@ -1469,7 +1576,7 @@ JPEGDecode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
                } while (--nrows > 0);
 
                if( line_work_buf != NULL )
-                       _TIFFfree( line_work_buf );
+                       _TIFFfreeExt(tif, line_work_buf );
         }
 
         /* Update information on consumed data */
@@ -1495,6 +1602,19 @@ DecodeRowError(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
     return 0;
 }
 
+/*ARGSUSED*/ static int
+DecodeRowScaledError(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
+
+{
+    (void) buf;
+    (void) cc;
+    (void) s;
+
+    TIFFErrorExt(tif->tif_clientdata, "TIFFReadScanline",
+                 "scanline oriented access is not supported when TIFFTAG_JPEGSCALEDENOM is set, use strip or tile oriented access." );
+    return 0;
+}
+
 /*
  * Decode a chunk of pixels.
  * Returned data is downsampled per sampling factors.
@@ -1522,7 +1642,7 @@ JPEGDecodeRaw(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
 		int samples_per_clump = sp->samplesperclump;
 
 #if defined(JPEG_LIB_MK1_OR_12BIT)
-		unsigned short* tmpbuf = _TIFFmalloc(sizeof(unsigned short) *
+		unsigned short* tmpbuf = _TIFFmallocExt(tif, sizeof(unsigned short) *
 						     sp->cinfo.d.output_width *
 						     sp->cinfo.d.num_components);
 		if(tmpbuf==NULL) {
@@ -1634,7 +1754,7 @@ JPEGDecodeRaw(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
 		} while (nrows > 0);
 
 #if defined(JPEG_LIB_MK1_OR_12BIT)
-		_TIFFfree(tmpbuf);
+		_TIFFfreeExt(tif, tmpbuf);
 #endif
 
 	}
@@ -1645,6 +1765,640 @@ JPEGDecodeRaw(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
 }
 
 
+/*
+ * Lossless transcoding.
+ *
+ * TIFFJPEGCopyCoefficients() copies the image of the current directory of
+ * "in" to "out", both JPEG compressed, by moving the quantized DCT
+ * coefficients of the input strips/tiles into new output strips/tiles.
+ * This allows changing the strip/tile layout of an image without the
+ * generation loss of decompressing and recompressing it.
+ * Output strips/tiles are written as complete JPEG streams, without
+ * JPEGTables, and with optimized Huffman tables.
+ *
+ * Both images must have the same size, samples per pixel, photometric
+ * interpretation and subsampling, be contiguous, and have their strip/tile
+ * boundaries on MCU boundaries.  All input strips/tiles must also use the
+ * same quantization tables.
+ */
+
+/* Number of bytes read from each input strip/tile to check its header */
+#define JPEGCOPY_HEADER_PREFIX 16384
+
+typedef struct {
+	JPEGState* state;		/* decompressor, NULL if not loaded */
+	jvirt_barray_ptr* coefs;	/* coefficients of each component */
+} JPEGCopyChunk;
+
+typedef struct {
+	TIFF* in;
+	TIFF* out;
+	void* tables;			/* JPEGTables of input, or NULL */
+	uint32 tableslen;
+	int ncomp;
+	int hsamp, vsamp;		/* sampling factors of component 0 */
+	uint32 in_width, in_height;	/* input strip/tile size in pixels */
+	uint32 in_across, in_down;	/* number of input strips/tiles */
+	uint32 out_width, out_height;	/* output strip/tile size in pixels */
+	uint32 out_across, out_down;	/* number of output strips/tiles */
+	JPEGCopyChunk* chunks;		/* decoded input strips/tiles */
+	UINT16 quantval[MAX_COMPONENTS][DCTSIZE2];
+} JPEGCopyContext;
+
+/*
+ * Source manager for a strip/tile held in memory.  The data pointers
+ * are set up by the caller.
+ */
+static void
+copy_init_source(j_decompress_ptr cinfo)
+{
+	(void) cinfo;
+}
+
+/*
+ * Used when only the beginning of a strip/tile was read to check its
+ * header: bail out silently, the caller retries with the whole data.
+ */
+static boolean
+copy_fill_input_buffer(j_decompress_ptr cinfo)
+{
+	JPEGState* sp = (JPEGState*) cinfo;
+
+	LONGJMP(sp->exit_jmpbuf, 1);
+	return (TRUE);
+}
+
+/*
+ * Destination manager building a strip/tile in memory, in the
+ * jpegtables buffer (see TIFFjpeg_tables_dest()).
+ */
+static boolean
+copy_empty_output_buffer(j_compress_ptr cinfo)
+{
+	JPEGState* sp = (JPEGState*) cinfo;
+	uint32 length = sp->jpegtables_length;
+	void* newbuf;
+
+	/* the entire buffer has been filled; double its size */
+	if (length > 0x7FFFFFFFU)
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 100);
+	newbuf = _TIFFreallocExt(sp->tif, sp->jpegtables, (tmsize_t) length * 2);
+	if (newbuf == NULL)
+		ERREXIT1(cinfo, JERR_OUT_OF_MEMORY, 100);
+	sp->dest.next_output_byte = (JOCTET*) newbuf + length;
+	sp->dest.free_in_buffer = (size_t) length;
+	sp->jpegtables = newbuf;
+	sp->jpegtables_length = length * 2;
+	return (TRUE);
+}
+
+static JPEGState*
+JPEGCopyNewState(TIFF* tif, int decompress)
+{
+	JPEGState* sp = (JPEGState*) _TIFFmallocExt(tif, sizeof(JPEGState));
+
+	if (sp == NULL) {
+		TIFFErrorExt(tif->tif_clientdata, "TIFFJPEGCopyCoefficients",
+			     "No space for JPEG state block");
+		return (NULL);
+	}
+	_TIFFmemset(sp, 0, sizeof(JPEGState));
+	sp->tif = tif;
+	if (!(decompress ? TIFFjpeg_create_decompress(sp) :
+			   TIFFjpeg_create_compress(sp))) {
+		_TIFFfreeExt(tif, sp);
+		return (NULL);
+	}
+	return (sp);
+}
+
+static void
+JPEGCopyFreeState(JPEGState* sp)
+{
+	if (sp != NULL) {
+		TIFFjpeg_destroy(sp);
+		_TIFFfreeExt(sp->tif, sp);
+	}
+}
+
+static void
+JPEGCopyLayout(TIFF* tif, uint32* width, uint32* height,
+	       uint32* across, uint32* down)
+{
+	TIFFDirectory *td = &tif->tif_dir;
+
+	if (isTiled(tif)) {
+		*width = td->td_tilewidth;
+		*height = td->td_tilelength;
+	} else {
+		*width = td->td_imagewidth;
+		*height = td->td_rowsperstrip;
+		if (*height > td->td_imagelength)
+			*height = td->td_imagelength;
+	}
+	if (*width == 0 || *height == 0) {
+		*across = *down = 0;
+		return;
+	}
+	*across = TIFFhowmany_32(td->td_imagewidth, *width);
+	*down = TIFFhowmany_32(td->td_imagelength, *height);
+}
+
+/*
+ * Check that strip/tile boundaries fall on MCU boundaries.
+ */
+static int
+JPEGCopyLayoutOK(JPEGCopyContext* ctx, uint32 width, uint32 height,
+		 uint32 across, uint32 down)
+{
+	if (across == 0 || down == 0)
+		return (0);
+	if (across > 1 && width % (DCTSIZE * ctx->hsamp) != 0)
+		return (0);
+	if (down > 1 && height % (DCTSIZE * ctx->vsamp) != 0)
+		return (0);
+	return (1);
+}
+
+/*
+ * Read an input strip/tile, or only its first maxsize bytes
+ * if maxsize is not 0.
+ */
+static uint8*
+JPEGCopyReadRaw(JPEGCopyContext* ctx, uint32 chunk, tmsize_t maxsize,
+		tmsize_t* size, int* truncated)
+{
+	TIFF* in = ctx->in;
+	uint64 bytecount = TIFFGetStrileByteCount(in, chunk);
+	tmsize_t n;
+	uint8* buf;
+
+	if (bytecount == 0 || (uint64)(tmsize_t) bytecount != bytecount) {
+		TIFFErrorExt(in->tif_clientdata, "TIFFJPEGCopyCoefficients",
+			     "Invalid byte count for %s %lu",
+			     isTiled(in) ? "tile" : "strip",
+			     (unsigned long) chunk);
+		return (NULL);
+	}
+	n = (tmsize_t) bytecount;
+	*truncated = (maxsize > 0 && n > maxsize);
+	if (*truncated)
+		n = maxsize;
+	buf = (uint8*) _TIFFmallocExt(in, n);
+	if (buf == NULL) {
+		TIFFErrorExt(in->tif_clientdata, "TIFFJPEGCopyCoefficients",
+			     "No space for strip/tile buffer");
+		return (NULL);
+	}
+	if (isTiled(in))
+		n = TIFFReadRawTile(in, chunk, buf, n);
+	else
+		n = TIFFReadRawStrip(in, chunk, buf, n);
+	if (n <= 0) {
+		_TIFFfreeExt(in, buf);
+		return (NULL);
+	}
+	*size = n;
+	return (buf);
+}
+
+/*
+ * Set up a decompressor for an input strip/tile and read its header.
+ * Returns 1 if the strip/tile can be copied, 0 if it cannot, -1 on error.
+ * The decompressor and raw data are returned in *psp and *pdata, and must
+ * be released by the caller in all cases.
+ */
+static int
+JPEGCopyOpenChunk(JPEGCopyContext* ctx, uint32 chunk, tmsize_t maxsize,
+		  JPEGState** psp, uint8** pdata)
+{
+	TIFF* in = ctx->in;
+	TIFFDirectory *td = &in->tif_dir;
+	JPEGState* sp;
+	tmsize_t size;
+	uint32 width, height;
+	int truncated, ci;
+
+	for (;;) {
+		*psp = NULL;
+		*pdata = JPEGCopyReadRaw(ctx, chunk, maxsize, &size,
+					 &truncated);
+		if (*pdata == NULL)
+			return (-1);
+		*psp = sp = JPEGCopyNewState(in, TRUE);
+		if (sp == NULL)
+			return (-1);
+		if (ctx->tables != NULL) {
+			sp->jpegtables = ctx->tables;
+			sp->jpegtables_length = ctx->tableslen;
+			TIFFjpeg_tables_src(sp);
+			if (TIFFjpeg_read_header(sp, FALSE)
+			    != JPEG_HEADER_TABLES_ONLY)
+				return (-1);
+		}
+		TIFFjpeg_data_src(sp);
+		sp->src.init_source = copy_init_source;
+		if (truncated)
+			sp->src.fill_input_buffer = copy_fill_input_buffer;
+		sp->src.next_input_byte = (const JOCTET*) *pdata;
+		sp->src.bytes_in_buffer = (size_t) size;
+		if (TIFFjpeg_read_header(sp, TRUE) == JPEG_HEADER_OK)
+			break;
+		if (!truncated)
+			return (-1);
+		/* header larger than what was read: retry with whole data */
+		JPEGCopyFreeState(sp);
+		_TIFFfreeExt(ctx->in, *pdata);
+		maxsize = 0;
+	}
+
+	/* Check stream parameters against the directory */
+	if (isTiled(in)) {
+		width = td->td_tilewidth;
+		height = td->td_tilelength;
+	} else {
+		width = td->td_imagewidth;
+		height = td->td_imagelength - chunk * ctx->in_height;
+		if (height > ctx->in_height)
+			height = ctx->in_height;
+	}
+	if (sp->cinfo.d.image_width < width ||
+	    sp->cinfo.d.image_height < height ||
+	    sp->cinfo.d.num_components != ctx->ncomp ||
+	    sp->cinfo.d.data_precision != td->td_bitspersample)
+		return (0);
+	for (ci = 0; ci < ctx->ncomp; ci++) {
+		jpeg_component_info* compptr = &sp->cinfo.d.comp_info[ci];
+
+		if (compptr->h_samp_factor != (ci == 0 ? ctx->hsamp : 1) ||
+		    compptr->v_samp_factor != (ci == 0 ? ctx->vsamp : 1) ||
+		    compptr->quant_tbl_no < 0 ||
+		    compptr->quant_tbl_no >= NUM_QUANT_TBLS ||
+		    sp->cinfo.d.quant_tbl_ptrs[compptr->quant_tbl_no] == NULL)
+			return (0);
+	}
+	return (1);
+}
+
+/*
+ * Check the headers of all input strips/tiles before writing anything,
+ * so that the caller can fall back to decompressing and recompressing.
+ */
+static int
+JPEGCopyPrescan(JPEGCopyContext* ctx)
+{
+	static const char module[] = "TIFFJPEGCopyCoefficients";
+	uint32 chunk, nchunks = ctx->in_across * ctx->in_down;
+	int ret = 1;
+	int ci;
+
+	for (chunk = 0; chunk < nchunks && ret == 1; chunk++) {
+		JPEGState* sp;
+		uint8* data;
+
+		ret = JPEGCopyOpenChunk(ctx, chunk, JPEGCOPY_HEADER_PREFIX,
+					&sp, &data);
+		for (ci = 0; ci < ctx->ncomp && ret == 1; ci++) {
+			JQUANT_TBL* qtbl = sp->cinfo.d.quant_tbl_ptrs[
+				sp->cinfo.d.comp_info[ci].quant_tbl_no];
+
+			if (chunk == 0)
+				_TIFFmemcpy(ctx->quantval[ci], qtbl->quantval,
+					    sizeof(ctx->quantval[ci]));
+			else if (_TIFFmemcmp(ctx->quantval[ci], qtbl->quantval,
+					     sizeof(ctx->quantval[ci])) != 0)
+				ret = 0;
+		}
+		if (ret == 1) {
+			/* libjpeg keeps all the coefficients in memory */
+			toff_t nRequiredMemory =
+			    (toff_t)sp->cinfo.d.image_width *
+			    sp->cinfo.d.image_height *
+			    sp->cinfo.d.num_components * sizeof(JCOEF);
+
+			if( nRequiredMemory > TIFF_LIBJPEG_LARGEST_MEM_ALLOC &&
+			    getenv("LIBTIFF_ALLOW_LARGE_LIBJPEG_MEM_ALLOC") == NULL )
+			{
+				TIFFErrorExt(ctx->in->tif_clientdata, module,
+				    "Copying this strip/tile would require "
+				    "libjpeg to allocate at least %u bytes. "
+				    "This is disabled since above the %u "
+				    "threshold. You may override this "
+				    "restriction by defining the "
+				    "LIBTIFF_ALLOW_LARGE_LIBJPEG_MEM_ALLOC "
+				    "environment variable.",
+				    (unsigned)nRequiredMemory,
+				    (unsigned)TIFF_LIBJPEG_LARGEST_MEM_ALLOC);
+				ret = -1;
+			}
+		}
+		JPEGCopyFreeState(sp);
+		if (data != NULL)
+			_TIFFfreeExt(ctx->in, data);
+	}
+	return (ret);
+}
+
+/*
+ * Return an input strip/tile with its coefficients, decoding it if not
+ * already done.
+ */
+static JPEGCopyChunk*
+JPEGCopyGetChunk(JPEGCopyContext* ctx, uint32 chunk)
+{
+	JPEGCopyChunk* c = &ctx->chunks[chunk];
+	JPEGState* sp;
+	uint8* data;
+	int ret, ci;
+
+	if (c->state != NULL)
+		return (c);
+	ret = JPEGCopyOpenChunk(ctx, chunk, 0, &sp, &data);
+	if (ret == 1) {
+		c->coefs = TIFFjpeg_read_coefficients(sp);
+		if (c->coefs == NULL)
+			ret = -1;
+	}
+	for (ci = 0; ci < ctx->ncomp && ret == 1; ci++) {
+		JQUANT_TBL* qtbl = sp->cinfo.d.comp_info[ci].quant_table;
+
+		if (qtbl == NULL ||
+		    _TIFFmemcmp(ctx->quantval[ci], qtbl->quantval,
+				sizeof(ctx->quantval[ci])) != 0)
+			ret = 0;
+	}
+	if (ret == 0)
+		TIFFErrorExt(ctx->in->tif_clientdata,
+			     "TIFFJPEGCopyCoefficients",
+			     "Unexpected JPEG parameters in %s %lu",
+			     isTiled(ctx->in) ? "tile" : "strip",
+			     (unsigned long) chunk);
+	if (data != NULL)
+		_TIFFfreeExt(ctx->in, data);
+	if (ret != 1) {
+		JPEGCopyFreeState(sp);
+		c->coefs = NULL;
+		return (NULL);
+	}
+	c->state = sp;
+	return (c);
+}
+
+static void
+JPEGCopyFreeChunk(JPEGCopyChunk* c)
+{
+	JPEGCopyFreeState(c->state);
+	c->state = NULL;
+	c->coefs = NULL;
+}
+
+/*
+ * Assemble and write one output strip/tile.
+ */
+static int
+JPEGCopyWriteChunk(JPEGCopyContext* ctx, JPEGState* dst, uint32 chunk)
+{
+	TIFF* out = ctx->out;
+	TIFFDirectory *td = &out->tif_dir;
+	uint32 mcu_width = DCTSIZE * ctx->hsamp;
+	uint32 mcu_height = DCTSIZE * ctx->vsamp;
+	uint32 x0 = (chunk % ctx->out_across) * ctx->out_width;
+	uint32 y0 = (chunk / ctx->out_across) * ctx->out_height;
+	uint32 width, height;
+	jvirt_barray_ptr coefs[MAX_COMPONENTS];
+	JPEGCopyChunk* c;
+	tmsize_t cc;
+	int ci;
+
+	if (isTiled(out)) {
+		width = ctx->out_width;
+		height = ctx->out_height;
+	} else {
+		width = td->td_imagewidth;
+		height = td->td_imagelength - y0;
+		if (height > ctx->out_height)
+			height = ctx->out_height;
+	}
+
+	/* Take parameters and quantization tables from the first input */
+	c = JPEGCopyGetChunk(ctx, (y0 / ctx->in_height) * ctx->in_across +
+			     x0 / ctx->in_width);
+	if (c == NULL)
+		return (0);
+	if (!TIFFjpeg_tables_dest(dst, out))
+		return (0);
+	dst->dest.empty_output_buffer = copy_empty_output_buffer;
+	if (!TIFFjpeg_copy_critical_parameters(c->state, dst))
+		return (0);
+	dst->cinfo.c.image_width = width;
+	dst->cinfo.c.image_height = height;
+	dst->cinfo.c.write_JFIF_header = FALSE;
+	dst->cinfo.c.write_Adobe_marker = FALSE;
+	dst->cinfo.c.optimize_coding = TRUE;
+
+	for (ci = 0; ci < ctx->ncomp; ci++) {
+		int h = ci == 0 ? ctx->hsamp : 1;
+		int v = ci == 0 ? ctx->vsamp : 1;
+		/* size in blocks, as computed by libjpeg */
+		JDIMENSION bw = (JDIMENSION) TIFFhowmany_64(
+			(uint64) width * h, DCTSIZE * ctx->hsamp);
+		JDIMENSION bh = (JDIMENSION) TIFFhowmany_64(
+			(uint64) height * v, DCTSIZE * ctx->vsamp);
+
+		coefs[ci] = TIFFjpeg_request_virt_barray(dst,
+		    (JDIMENSION) TIFFhowmany_64(bw, h) * h,
+		    (JDIMENSION) TIFFhowmany_64(bh, v) * v, (JDIMENSION) v);
+		if (coefs[ci] == NULL)
+			return (0);
+	}
+	if (!TIFFjpeg_realize_virt_arrays(dst))
+		return (0);
+
+	for (ci = 0; ci < ctx->ncomp; ci++) {
+		int h = ci == 0 ? ctx->hsamp : 1;
+		int v = ci == 0 ? ctx->vsamp : 1;
+		JDIMENSION bw = (JDIMENSION) TIFFhowmany_64(
+			(uint64) width * h, DCTSIZE * ctx->hsamp);
+		JDIMENSION bh = (JDIMENSION) TIFFhowmany_64(
+			(uint64) height * v, DCTSIZE * ctx->vsamp);
+		/* origin of the output, and input size, in blocks */
+		uint32 bx0 = x0 / mcu_width * h;
+		uint32 by0 = y0 / mcu_height * v;
+		uint32 in_bw = ctx->in_across > 1 ?
+		    ctx->in_width / mcu_width * h : 0xFFFFFFFFU;
+		uint32 in_bh = ctx->in_down > 1 ?
+		    ctx->in_height / mcu_height * v : 0xFFFFFFFFU;
+		JDIMENSION bx, by;
+
+		for (by = 0; by < bh; by++) {
+			uint32 row = (by0 + by) / in_bh;
+			uint32 sy = (by0 + by) - row * in_bh;
+			JBLOCKROW dstrow;
+
+			if (row >= ctx->in_down)
+				break;
+			dstrow = TIFFjpeg_access_virt_barray(dst, coefs[ci],
+							     by, TRUE);
+			if (dstrow == NULL)
+				return (0);
+			for (bx = 0; bx < bw; ) {
+				uint32 col = (bx0 + bx) / in_bw;
+				uint32 sx = (bx0 + bx) - col * in_bw;
+				uint32 n = in_bw - sx;
+				jpeg_component_info* compptr;
+
+				if (col >= ctx->in_across)
+					break;
+				if (n > bw - bx)
+					n = bw - bx;
+				c = JPEGCopyGetChunk(ctx,
+						     row * ctx->in_across + col);
+				if (c == NULL)
+					return (0);
+				compptr = &c->state->cinfo.d.comp_info[ci];
+				if (sy < compptr->height_in_blocks &&
+				    sx < compptr->width_in_blocks) {
+					uint32 m = compptr->width_in_blocks - sx;
+					JBLOCKROW srcrow;
+
+					if (m > n)
+						m = n;
+					srcrow = TIFFjpeg_access_virt_barray(
+					    c->state, c->coefs[ci], sy, FALSE);
+					if (srcrow == NULL)
+						return (0);
+					_TIFFmemcpy(dstrow + bx, srcrow + sx,
+						    m * sizeof(JBLOCK));
+				}
+				bx += n;
+			}
+		}
+	}
+
+	if (!TIFFjpeg_write_coefficients(dst, coefs) ||
+	    !TIFFjpeg_finish_compress(dst))
+		return (0);
+	if (isTiled(out))
+		cc = TIFFWriteRawTile(out, chunk, dst->jpegtables,
+				      (tmsize_t) dst->jpegtables_length);
+	else
+		cc = TIFFWriteRawStrip(out, chunk, dst->jpegtables,
+				       (tmsize_t) dst->jpegtables_length);
+	return (cc == (tmsize_t) dst->jpegtables_length);
+}
+
+/*
+ * Returns 1 on success, 0 if the image cannot be copied this way (nothing
+ * is written then), and -1 on error.
+ */
+int
+TIFFJPEGCopyCoefficients(TIFF* in, TIFF* out)
+{
+	TIFFDirectory *itd = &in->tif_dir;
+	TIFFDirectory *otd = &out->tif_dir;
+	JPEGCopyContext ctx;
+	JPEGState* dst;
+	uint32 nchunks, released, row, col;
+	int ret;
+
+#if defined(JPEG_DUAL_MODE_8_12) && !defined(TIFFJPEGCopyCoefficients)
+	if( itd->td_bitspersample == 12 )
+		return TIFFJPEGCopyCoefficients_12( in, out );
+#endif
+
+#if defined(JPEG_LIB_MK1_OR_12BIT)
+	if (itd->td_bitspersample != 12)
+#else
+	if (itd->td_bitspersample != 8)
+#endif
+		return (0);
+	if (itd->td_compression != COMPRESSION_JPEG ||
+	    otd->td_compression != COMPRESSION_JPEG ||
+	    otd->td_bitspersample != itd->td_bitspersample ||
+	    itd->td_planarconfig != PLANARCONFIG_CONTIG ||
+	    otd->td_planarconfig != PLANARCONFIG_CONTIG ||
+	    itd->td_samplesperpixel != otd->td_samplesperpixel ||
+	    itd->td_samplesperpixel > MAX_COMPONENTS ||
+	    itd->td_photometric != otd->td_photometric ||
+	    itd->td_imagewidth != otd->td_imagewidth ||
+	    itd->td_imagelength != otd->td_imagelength ||
+	    itd->td_imagedepth != 1 || otd->td_imagedepth != 1)
+		return (0);
+
+	_TIFFmemset(&ctx, 0, sizeof(ctx));
+	ctx.in = in;
+	ctx.out = out;
+	ctx.ncomp = itd->td_samplesperpixel;
+	ctx.hsamp = ctx.vsamp = 1;
+	if (itd->td_photometric == PHOTOMETRIC_YCBCR) {
+		if (itd->td_ycbcrsubsampling[0] != otd->td_ycbcrsubsampling[0] ||
+		    itd->td_ycbcrsubsampling[1] != otd->td_ycbcrsubsampling[1] ||
+		    itd->td_ycbcrsubsampling[0] < 1 ||
+		    itd->td_ycbcrsubsampling[0] > 4 ||
+		    itd->td_ycbcrsubsampling[1] < 1 ||
+		    itd->td_ycbcrsubsampling[1] > 4)
+			return (0);
+		ctx.hsamp = itd->td_ycbcrsubsampling[0];
+		ctx.vsamp = itd->td_ycbcrsubsampling[1];
+	}
+	JPEGCopyLayout(in, &ctx.in_width, &ctx.in_height,
+		       &ctx.in_across, &ctx.in_down);
+	JPEGCopyLayout(out, &ctx.out_width, &ctx.out_height,
+		       &ctx.out_across, &ctx.out_down);
+	if (!JPEGCopyLayoutOK(&ctx, ctx.in_width, ctx.in_height,
+			      ctx.in_across, ctx.in_down) ||
+	    !JPEGCopyLayoutOK(&ctx, ctx.out_width, ctx.out_height,
+			      ctx.out_across, ctx.out_down))
+		return (0);
+	if ((uint64) ctx.in_across * ctx.in_down > itd->td_nstrips)
+		return (0);
+	nchunks = ctx.in_across * ctx.in_down;
+	if (TIFFFieldSet(in, FIELD_JPEGTABLES))
+		TIFFGetField(in, TIFFTAG_JPEGTABLES,
+			     &ctx.tableslen, &ctx.tables);
+
+	ret = JPEGCopyPrescan(&ctx);
+	if (ret != 1)
+		return (ret);
+
+	ctx.chunks = (JPEGCopyChunk*) _TIFFCheckMallocExt(in, nchunks,
+	    sizeof(JPEGCopyChunk), "for JPEG strips/tiles");
+	if (ctx.chunks == NULL)
+		return (-1);
+	_TIFFmemset(ctx.chunks, 0, nchunks * sizeof(JPEGCopyChunk));
+	dst = JPEGCopyNewState(out, FALSE);
+	if (dst == NULL) {
+		_TIFFfreeExt(in, ctx.chunks);
+		return (-1);
+	}
+
+	/*
+	 * Output strips/tiles are written in order, and input ones are
+	 * kept decoded until no longer needed by the current output row.
+	 */
+	released = 0;
+	for (row = 0; row < ctx.out_down && ret == 1; row++) {
+		uint32 first = row * ctx.out_height / ctx.in_height;
+
+		for (; released < first * ctx.in_across; released++)
+			JPEGCopyFreeChunk(&ctx.chunks[released]);
+		for (col = 0; col < ctx.out_across && ret == 1; col++) {
+			if (!JPEGCopyWriteChunk(&ctx, dst,
+						row * ctx.out_across + col))
+				ret = -1;
+		}
+	}
+
+	for (; released < nchunks; released++)
+		JPEGCopyFreeChunk(&ctx.chunks[released]);
+	_TIFFfreeExt(in, ctx.chunks);
+	if (dst->jpegtables != NULL)
+		_TIFFfreeExt(out, dst->jpegtables);
+	JPEGCopyFreeState(dst);
+	return (ret);
+}
+
+
 /*
  * JPEG Encoding.
  */
@@ -2056,7 +2810,7 @@ JPEGEncode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
         if( sp->cinfo.c.data_precision == 12 )
         {
             line16_count = (int)((sp->bytesperline * 2) / 3);
-            line16 = (short *) _TIFFmalloc(sizeof(short) * line16_count);
+            line16 = (short *) _TIFFmallocExt(tif, sizeof(short) * line16_count);
             if (!line16)
             {
                 TIFFErrorExt(tif->tif_clientdata,
@@ -2100,7 +2854,7 @@ JPEGEncode(TIFF* tif, uint8* buf, tmsize_t cc, uint16 s)
 
         if( sp->cinfo.c.data_precision == 12 )
         {
-            _TIFFfree( line16 );
+            _TIFFfreeExt(tif, line16 );
         }
             
 	return (1);
@@ -2242,8 +2996,8 @@ JPEGCleanup(TIFF* tif)
         if( sp->cinfo_initialized )
                 TIFFjpeg_destroy(sp);	/* release libjpeg resources */
         if (sp->jpegtables)		/* tag value */
-                _TIFFfree(sp->jpegtables);
-	_TIFFfree(tif->tif_data);	/* release local state */
+                _TIFFfreeExt(tif, sp->jpegtables);
+	_TIFFfreeExt(tif, tif->tif_data);	/* release local state */
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -2300,7 +3054,14 @@ JPEGVSetField(TIFF* tif, uint32 tag, va_list ap)
 			/* XXX */
 			return (0);
 		}
-		_TIFFsetByteArray(&sp->jpegtables, va_arg(ap, void*), v32);
+		/* allocated like the rest of the codec state */
+		_TIFFfreeExt(tif, sp->jpegtables);
+		sp->jpegtables = _TIFFmallocExt(tif, (tmsize_t) v32);
+		if (sp->jpegtables == NULL) {
+			sp->jpegtables_length = 0;
+			return (0);
+		}
+		_TIFFmemcpy(sp->jpegtables, va_arg(ap, void*), (tmsize_t) v32);
 		sp->jpegtables_length = v32;
 		TIFFSetFieldBit(tif, FIELD_JPEGTABLES);
 		break;
@@ -2320,6 +3081,18 @@ JPEGVSetField(TIFF* tif, uint32 tag, va_list ap)
 	case TIFFTAG_JPEGTABLESMODE:
 		sp->jpegtablesmode = (int) va_arg(ap, int);
 		return (1);			/* pseudo tag */
+	case TIFFTAG_JPEGSCALEDENOM:
+	{
+		int denom = (int) va_arg(ap, int);
+		if (denom != 1 && denom != 2 && denom != 4 && denom != 8) {
+			TIFFErrorExt(tif->tif_clientdata, "JPEGVSetField",
+				     "Invalid JPEG scale denominator %d, "
+				     "should be 1, 2, 4 or 8", denom);
+			return (0);
+		}
+		sp->jpegscaledenom = denom;
+		return (1);			/* pseudo tag */
+	}
 	case TIFFTAG_YCBCRSUBSAMPLING:
 		/* mark the fact that we have a real ycbcrsubsampling! */
 		sp->ycbcrsampling_fetched = 1;
@@ -2360,6 +3133,9 @@ JPEGVGetField(TIFF* tif, uint32 tag, va_list ap)
 		case TIFFTAG_JPEGTABLESMODE:
 			*va_arg(ap, int*) = sp->jpegtablesmode;
 			break;
+		case TIFFTAG_JPEGSCALEDENOM:
+			*va_arg(ap, int*) = sp->jpegscaledenom;
+			break;
 		default:
 			return (*sp->vgetparent)(tif, tag, ap);
 	}
@@ -2499,7 +3275,7 @@ TIFFInitJPEG(TIFF* tif, int scheme)
 	/*
 	 * Allocate state block so tag methods have storage to record values.
 	 */
-	tif->tif_data = (uint8*) _TIFFmalloc(sizeof (JPEGState));
+	tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof (JPEGState));
 
 	if (tif->tif_data == NULL) {
 		TIFFErrorExt(tif->tif_clientdata,
@@ -2527,6 +3303,7 @@ TIFFInitJPEG(TIFF* tif, int scheme)
 	sp->jpegquality = 75;			/* Default IJG quality */
 	sp->jpegcolormode = JPEGCOLORMODE_RAW;
 	sp->jpegtablesmode = JPEGTABLESMODE_QUANT | JPEGTABLESMODE_HUFF;
+	sp->jpegscaledenom = 1;
         sp->ycbcrsampling_fetched = 0;
 
 	/*
@@ -2571,7 +3348,7 @@ here hopefully is harmless.
             TIFFSetFieldBit(tif, FIELD_JPEGTABLES);
 */
             sp->jpegtables_length = SIZE_OF_JPEGTABLES;
-            sp->jpegtables = (void *) _TIFFmalloc(sp->jpegtables_length);
+            sp->jpegtables = (void *) _TIFFmallocExt(tif, sp->jpegtables_length);
             if (sp->jpegtables)
             {
                 _TIFFmemset(sp->jpegtables, 0, SIZE_OF_JPEGTABLES);
@@ -2588,6 +3365,16 @@ here hopefully is harmless.
 
 	return 1;
 }
+#else /* !JPEG_SUPPORT */
+
+int
+TIFFJPEGCopyCoefficients(TIFF* in, TIFF* out)
+{
+	(void) in;
+	(void) out;
+	return (0);
+}
+
 #endif /* JPEG_SUPPORT */
 
 /* vim: set ts=8 sts=8 sw=8 noet: */
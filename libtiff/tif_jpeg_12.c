@@ -5,6 +5,7 @@
 
 #  define TIFFInitJPEG TIFFInitJPEG_12
 #  define TIFFJPEGIsFullStripRequired TIFFJPEGIsFullStripRequired_12
+#  define TIFFJPEGCopyCoefficients TIFFJPEGCopyCoefficients_12
 
 int
 TIFFInitJPEG_12(TIFF* tif, int scheme);
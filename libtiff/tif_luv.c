@@ -167,6 +167,11 @@ struct logLuvState {
 	tmsize_t                tbuflen;        /* buffer length */
 	void (*tfunc)(LogLuvState*, uint8*, tmsize_t);
 
+	uint8*                  pbuf;           /* byte planes for run decoding */
+	tmsize_t                pbuflen;        /* plane buffer length */
+	double*                 ytab;           /* Y from LogL code magnitude */
+	double*                 uvtab;          /* X/Y and Z/Y from chroma code */
+
 	TIFFVSetMethod          vgetparent;     /* super-class method */
 	TIFFVSetMethod          vsetparent;     /* super-class method */
 };
@@ -178,6 +183,61 @@ struct logLuvState {
 
 #define MINRUN 4 /* minimum run length */
 
+/*
+ * Decode one byte plane of a row.  Runs and literal strings are
+ * expanded with memset and memcpy; the planes are then interleaved
+ * into pixels in a single pass.  Returns the number of pixels decoded.
+ */
+static tmsize_t
+LogLuvDecodePlane(uint8* pp, tmsize_t npixels, unsigned char** bpp, tmsize_t* ccp)
+{
+	unsigned char* bp = *bpp;
+	tmsize_t cc = *ccp;
+	tmsize_t i, n;
+
+	for (i = 0; i < npixels && cc > 0; ) {
+		if (*bp >= 128) {		/* run */
+			if( cc < 2 )
+				break;
+			n = *bp++ + (2-128);
+			if (n > npixels - i)
+				n = npixels - i;
+			_TIFFmemset(pp + i, *bp++, n);
+			cc -= 2;
+		} else {			/* non-run */
+			n = *bp++;		/* nul is noop */
+			cc--;
+			if (n > cc)
+				n = cc;
+			if (n > npixels - i)
+				n = npixels - i;
+			_TIFFmemcpy(pp + i, bp, n);
+			bp += n;
+			cc -= n;
+		}
+		i += n;
+	}
+	*bpp = bp;
+	*ccp = cc;
+	return (i);
+}
+
+static uint8*
+LogLuvPlaneBuffer(TIFF* tif, LogLuvState* sp, tmsize_t size)
+{
+	if (sp->pbuflen < size) {
+		uint8* p = (uint8*) _TIFFreallocExt(tif, sp->pbuf, size);
+		if (p == NULL) {
+			TIFFErrorExt(tif->tif_clientdata, tif->tif_name,
+			    "No space for SGILog plane buffer");
+			return (NULL);
+		}
+		sp->pbuf = p;
+		sp->pbuflen = size;
+	}
+	return (sp->pbuf);
+}
+
 /*
  * Decode a string of 16-bit gray pixels.
  */
@@ -186,14 +246,13 @@ LogL16Decode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 {
 	static const char module[] = "LogL16Decode";
 	LogLuvState* sp = DecoderState(tif);
-	int shft;
+	int plane;
 	tmsize_t i;
 	tmsize_t npixels;
 	unsigned char* bp;
 	int16* tp;
-	int16 b;
+	uint8* pp;
 	tmsize_t cc;
-	int rc;
 
 	assert(s == 0);
 	assert(sp != NULL);
@@ -210,27 +269,14 @@ LogL16Decode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 		}
 		tp = (int16*) sp->tbuf;
 	}
-	_TIFFmemset((void*) tp, 0, npixels*sizeof (tp[0]));
+	if ((pp = LogLuvPlaneBuffer(tif, sp, npixels*2)) == NULL)
+		return (0);
 
 	bp = (unsigned char*) tif->tif_rawcp;
 	cc = tif->tif_rawcc;
 	/* get each byte string */
-	for (shft = 2*8; (shft -= 8) >= 0; ) {
-		for (i = 0; i < npixels && cc > 0; ) {
-			if (*bp >= 128) {		/* run */
-				if( cc < 2 )
-					break;
-				rc = *bp++ + (2-128);
-				b = (int16)(*bp++ << shft);
-				cc -= 2;
-				while (rc-- && i < npixels)
-					tp[i++] |= b;
-			} else {			/* non-run */
-				rc = *bp++;		/* nul is noop */
-				while (--cc && rc-- && i < npixels)
-					tp[i++] |= (int16)*bp++ << shft;
-			}
-		}
+	for (plane = 0; plane < 2; plane++) {
+		i = LogLuvDecodePlane(pp + plane*npixels, npixels, &bp, &cc);
 		if (i != npixels) {
 #if defined(__WIN32__) && (defined(_MSC_VER) || defined(__MINGW32__))
 			TIFFErrorExt(tif->tif_clientdata, module,
@@ -248,6 +294,8 @@ LogL16Decode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 			return (0);
 		}
 	}
+	for (i = 0; i < npixels; i++)
+		tp[i] = (int16)(pp[i] << 8 | pp[npixels+i]);
 	(*sp->tfunc)(sp, op, npixels);
 	tif->tif_rawcp = (uint8*) bp;
 	tif->tif_rawcc = cc;
@@ -319,14 +367,13 @@ LogLuvDecode32(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 {
 	static const char module[] = "LogLuvDecode32";
 	LogLuvState* sp;
-	int shft;
+	int plane;
 	tmsize_t i;
 	tmsize_t npixels;
 	unsigned char* bp;
 	uint32* tp;
-	uint32 b;
+	uint8* pp;
 	tmsize_t cc;
-	int rc;
 
 	assert(s == 0);
 	sp = DecoderState(tif);
@@ -344,27 +391,14 @@ LogLuvDecode32(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 		}
 		tp = (uint32*) sp->tbuf;
 	}
-	_TIFFmemset((void*) tp, 0, npixels*sizeof (tp[0]));
+	if ((pp = LogLuvPlaneBuffer(tif, sp, npixels*4)) == NULL)
+		return (0);
 
 	bp = (unsigned char*) tif->tif_rawcp;
 	cc = tif->tif_rawcc;
 	/* get each byte string */
-	for (shft = 4*8; (shft -= 8) >= 0; ) {
-		for (i = 0; i < npixels && cc > 0; ) {
-			if (*bp >= 128) {		/* run */
-				if( cc < 2 )
-					break;
-				rc = *bp++ + (2-128);
-				b = (uint32)*bp++ << shft;
-				cc -= 2;
-				while (rc-- && i < npixels)
-					tp[i++] |= b;
-			} else {			/* non-run */
-				rc = *bp++;		/* nul is noop */
-				while (--cc && rc-- && i < npixels)
-					tp[i++] |= (uint32)*bp++ << shft;
-			}
-		}
+	for (plane = 0; plane < 4; plane++) {
+		i = LogLuvDecodePlane(pp + plane*npixels, npixels, &bp, &cc);
 		if (i != npixels) {
 #if defined(__WIN32__) && (defined(_MSC_VER) || defined(__MINGW32__))
 			TIFFErrorExt(tif->tif_clientdata, module,
@@ -382,6 +416,16 @@ LogLuvDecode32(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 			return (0);
 		}
 	}
+	{
+		uint8* p0 = pp;
+		uint8* p1 = pp + npixels;
+		uint8* p2 = pp + 2*npixels;
+		uint8* p3 = pp + 3*npixels;
+
+		for (i = 0; i < npixels; i++)
+			tp[i] = (uint32)p0[i] << 24 | (uint32)p1[i] << 16 |
+			    (uint32)p2[i] << 8 | p3[i];
+	}
 	(*sp->tfunc)(sp, op, npixels);
 	tif->tif_rawcp = (uint8*) bp;
 	tif->tif_rawcc = cc;
@@ -778,14 +822,27 @@ LogL16fromY(double Y, int em)	/* get 16-bit LogL from Y */
 	return (0);
 }
 
+/*
+ * Decoding to float or 8-bit values goes through per-state lookup
+ * tables, built by LogLuvInitTables() when decoding is set up:
+ * ytab holds the luminance for each LogL magnitude, and uvtab the
+ * X/Y and Z/Y ratios for each chroma code.  The tables hold exactly
+ * what the conversion routines below compute, so results are identical.
+ */
+#define	LogL16Y(sp, p16)	(((p16) & 0x8000) ? \
+				-(sp)->ytab[(p16) & 0x7fff] : \
+				(sp)->ytab[(p16) & 0x7fff])
+
 static void
 L16toY(LogLuvState* sp, uint8* op, tmsize_t n)
 {
 	int16* l16 = (int16*) sp->tbuf;
 	float* yp = (float*) op;
 
-	while (n-- > 0)
-		*yp++ = (float)LogL16toY(*l16++);
+	while (n-- > 0) {
+		*yp++ = (float)LogL16Y(sp, *l16);
+		l16++;
+	}
 }
 
 static void
@@ -795,7 +852,8 @@ L16toGry(LogLuvState* sp, uint8* op, tmsize_t n)
 	uint8* gp = (uint8*) op;
 
 	while (n-- > 0) {
-		double Y = LogL16toY(*l16++);
+		double Y = LogL16Y(sp, *l16);
+		l16++;
 		*gp++ = (uint8) ((Y <= 0.) ? 0 : (Y >= 1.) ? 255 : (int)(256.*sqrt(Y)));
 	}
 }
@@ -1018,6 +1076,19 @@ LogLuv24fromXYZ(float XYZ[3], int em)
 	return (Le << 14 | Ce);
 }
 
+/*
+ * Convert luminance and chroma table entries to XYZ.
+ */
+#define	LogLuvTabtoXYZ(L, uvp, XYZ) { \
+	if ((L) <= 0.) { \
+		(XYZ)[0] = (XYZ)[1] = (XYZ)[2] = 0.; \
+	} else { \
+		(XYZ)[0] = (float)((uvp)[0] * (L)); \
+		(XYZ)[1] = (float)(L); \
+		(XYZ)[2] = (float)((uvp)[1] * (L)); \
+	} \
+}
+
 static void
 Luv24toXYZ(LogLuvState* sp, uint8* op, tmsize_t n)
 {
@@ -1025,7 +1096,8 @@ Luv24toXYZ(LogLuvState* sp, uint8* op, tmsize_t n)
 	float* xyz = (float*) op;
 
 	while (n-- > 0) {
-		LogLuv24toXYZ(*luv, xyz);
+		double L = sp->ytab[*luv>>14 & 0x3ff];
+		LogLuvTabtoXYZ(L, sp->uvtab + 2*(*luv & 0x3fff), xyz);
 		xyz += 3;
 		luv++;
 	}
@@ -1059,10 +1131,12 @@ Luv24toRGB(LogLuvState* sp, uint8* op, tmsize_t n)
 
 	while (n-- > 0) {
 		float xyz[3];
+		double L = sp->ytab[*luv>>14 & 0x3ff];
 
-		LogLuv24toXYZ(*luv++, xyz);
+		LogLuvTabtoXYZ(L, sp->uvtab + 2*(*luv & 0x3fff), xyz);
 		XYZtoRGB24(xyz, rgb);
 		rgb += 3;
+		luv++;
 	}
 }
 
@@ -1166,8 +1240,10 @@ Luv32toXYZ(LogLuvState* sp, uint8* op, tmsize_t n)
 	float* xyz = (float*) op;
 
 	while (n-- > 0) {
-		LogLuv32toXYZ(*luv++, xyz);
+		double L = LogL16Y(sp, *luv >> 16);
+		LogLuvTabtoXYZ(L, sp->uvtab + 2*(*luv & 0xffff), xyz);
 		xyz += 3;
+		luv++;
 	}
 }
 
@@ -1197,10 +1273,12 @@ Luv32toRGB(LogLuvState* sp, uint8* op, tmsize_t n)
 
 	while (n-- > 0) {
 		float xyz[3];
+		double L = LogL16Y(sp, *luv >> 16);
 
-		LogLuv32toXYZ(*luv++, xyz);
+		LogLuvTabtoXYZ(L, sp->uvtab + 2*(*luv & 0xffff), xyz);
 		XYZtoRGB24(xyz, rgb);
 		rgb += 3;
+		luv++;
 	}
 }
 
@@ -1239,6 +1317,81 @@ Luv32fromLuv48(LogLuvState* sp, uint8* op, tmsize_t n)
 	}
 }
 
+/*
+ * Store the X/Y and Z/Y ratios for chromaticity (u,v).
+ */
+static void
+LogLuvSetUV(double* uvp, double u, double v)
+{
+	double	s, x, y;
+
+	s = 1./(6.*u - 16.*v + 12.);
+	x = 9.*u * s;
+	y = 4.*v * s;
+	uvp[0] = x/y;
+	uvp[1] = (1.-x-y)/y;
+}
+
+/*
+ * Build the decoding lookup tables for the LogL/LogLuv
+ * encoding of the current directory.
+ */
+static int
+LogLuvInitTables(TIFF* tif)
+{
+	static const char module[] = "LogLuvInitTables";
+	LogLuvState* sp = DecoderState(tif);
+	TIFFDirectory* td = &tif->tif_dir;
+	int nl, nuv, i, luv24;
+
+	if (sp->ytab != NULL)
+		return (1);
+	/* LogL is coded with LogL16 whatever the compression scheme */
+	luv24 = td->td_compression == COMPRESSION_SGILOG24 &&
+	    td->td_photometric == PHOTOMETRIC_LOGLUV;
+	if (luv24) {
+		nl = 1<<10;
+		nuv = 1<<14;
+	} else {
+		nl = 1<<15;
+		nuv = td->td_photometric == PHOTOMETRIC_LOGLUV ? 1<<16 : 0;
+	}
+	sp->ytab = (double*) _TIFFmallocExt(tif, nl * sizeof (double));
+	if (nuv)
+		sp->uvtab = (double*) _TIFFmallocExt(tif, 2 * nuv * sizeof (double));
+	if (sp->ytab == NULL || (nuv && sp->uvtab == NULL)) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "No space for SGILog lookup tables");
+		if (sp->ytab)
+			_TIFFfreeExt(tif, sp->ytab);
+		if (sp->uvtab)
+			_TIFFfreeExt(tif, sp->uvtab);
+		sp->ytab = NULL;
+		sp->uvtab = NULL;
+		return (0);
+	}
+	if (luv24) {
+		for (i = 0; i < nl; i++)
+			sp->ytab[i] = LogL10toY(i);
+		for (i = 0; i < nuv; i++) {
+			double u, v;
+
+			if (uv_decode(&u, &v, i) < 0) {
+				u = U_NEU; v = V_NEU;
+			}
+			LogLuvSetUV(sp->uvtab + 2*i, u, v);
+		}
+	} else {
+		for (i = 0; i < nl; i++)
+			sp->ytab[i] = LogL16toY(i);
+		for (i = 0; i < nuv; i++)
+			LogLuvSetUV(sp->uvtab + 2*i,
+			    1./UVSCALE * ((i>>8 & 0xff) + .5),
+			    1./UVSCALE * ((i & 0xff) + .5));
+	}
+	return (1);
+}
+
 static void
 _logLuvNop(LogLuvState* sp, uint8* op, tmsize_t n)
 {
@@ -1319,7 +1472,7 @@ LogL16InitState(TIFF* tif)
         else
             sp->tbuflen = multiply_ms(td->td_imagewidth, td->td_imagelength);
 	if (multiply_ms(sp->tbuflen, sizeof (int16)) == 0 ||
-	    (sp->tbuf = (uint8*) _TIFFmalloc(sp->tbuflen * sizeof (int16))) == NULL) {
+	    (sp->tbuf = (uint8*) _TIFFmallocExt(tif, sp->tbuflen * sizeof (int16))) == NULL) {
 		TIFFErrorExt(tif->tif_clientdata, module, "No space for SGILog translation buffer");
 		return (0);
 	}
@@ -1421,7 +1574,7 @@ LogLuvInitState(TIFF* tif)
         else
             sp->tbuflen = multiply_ms(td->td_imagewidth, td->td_imagelength);
 	if (multiply_ms(sp->tbuflen, sizeof (uint32)) == 0 ||
-	    (sp->tbuf = (uint8*) _TIFFmalloc(sp->tbuflen * sizeof (uint32))) == NULL) {
+	    (sp->tbuf = (uint8*) _TIFFmallocExt(tif, sp->tbuflen * sizeof (uint32))) == NULL) {
 		TIFFErrorExt(tif->tif_clientdata, module, "No space for SGILog translation buffer");
 		return (0);
 	}
@@ -1474,6 +1627,10 @@ LogLuvSetupDecode(TIFF* tif)
 				break;
 			}
 		}
+		if ((sp->user_datafmt == SGILOGDATAFMT_FLOAT ||
+		    sp->user_datafmt == SGILOGDATAFMT_8BIT) &&
+		    !LogLuvInitTables(tif))
+			break;
 		return (1);
 	case PHOTOMETRIC_LOGL:
 		if (!LogL16InitState(tif))
@@ -1487,6 +1644,10 @@ LogLuvSetupDecode(TIFF* tif)
 			sp->tfunc = L16toGry;
 			break;
 		}
+		if ((sp->user_datafmt == SGILOGDATAFMT_FLOAT ||
+		    sp->user_datafmt == SGILOGDATAFMT_8BIT) &&
+		    !LogLuvInitTables(tif))
+			break;
 		return (1);
 	default:
 		TIFFErrorExt(tif->tif_clientdata, module,
@@ -1604,8 +1765,14 @@ LogLuvCleanup(TIFF* tif)
 	tif->tif_tagmethods.vsetfield = sp->vsetparent;
 
 	if (sp->tbuf)
-		_TIFFfree(sp->tbuf);
-	_TIFFfree(sp);
+		_TIFFfreeExt(tif, sp->tbuf);
+	if (sp->pbuf)
+		_TIFFfreeExt(tif, sp->pbuf);
+	if (sp->ytab)
+		_TIFFfreeExt(tif, sp->ytab);
+	if (sp->uvtab)
+		_TIFFfreeExt(tif, sp->uvtab);
+	_TIFFfreeExt(tif, sp);
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -1714,7 +1881,7 @@ TIFFInitSGILog(TIFF* tif, int scheme)
 	/*
 	 * Allocate state block so tag methods have storage to record values.
 	 */
-	tif->tif_data = (uint8*) _TIFFmalloc(sizeof (LogLuvState));
+	tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof (LogLuvState));
 	if (tif->tif_data == NULL)
 		goto bad;
 	sp = (LogLuvState*) tif->tif_data;
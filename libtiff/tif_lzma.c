@@ -50,7 +50,9 @@ typedef struct {
 	lzma_options_delta opt_delta;		/* delta filter options */
 	lzma_options_lzma opt_lzma;		/* LZMA2 filter options */
 	int             preset;			/* compression level */
+	int             threads;		/* worker threads, 0 for one per CPU */
 	lzma_check	check;			/* type of the integrity check */
+	lzma_allocator	allocator;		/* routes to the handle allocator */
 	int             state;			/* state flags */
 #define LSTATE_INIT_DECODE 0x01
 #define LSTATE_INIT_ENCODE 0x02
@@ -99,6 +101,132 @@ LZMAStrerror(lzma_ret ret)
 	}
 }
 
+/*
+ * Number of worker threads to use for the current stream.
+ */
+static uint32_t
+LZMAThreads(LZMAState* sp)
+{
+#if LZMA_VERSION >= 50020002
+	if (sp->threads == 0) {
+		uint32_t n = lzma_cputhreads();
+		return n > 0 ? n : 1;
+	}
+#endif
+	return sp->threads > 0 ? (uint32_t) sp->threads : 1;
+}
+
+/*
+ * liblzma allocation hooks.  Worker threads of the multithreaded coders
+ * call the allocator concurrently, so the handle allocator (which need
+ * not be thread-safe) is only used for single-threaded streams.
+ */
+static void*
+LZMAAlloc(void* opaque, size_t nmemb, size_t size)
+{
+	if (size != 0 && nmemb > (((size_t) -1) >> 1) / size)
+		return NULL;
+	return _TIFFmallocExt((TIFF*) opaque, (tmsize_t) (nmemb * size));
+}
+
+static void
+LZMAFree(void* opaque, void* ptr)
+{
+	_TIFFfreeExt((TIFF*) opaque, ptr);
+}
+
+/*
+ * Select the allocator for a stream about to be (re)initialized with the
+ * given number of threads.  A coder left over from a previous init must
+ * be released with the allocator that created it.
+ */
+static void
+LZMASetAllocator(LZMAState* sp, uint32_t threads)
+{
+	const lzma_allocator* a = threads > 1 ? NULL : &sp->allocator;
+
+	if (sp->stream.allocator != a) {
+		lzma_end(&sp->stream);
+		sp->stream.allocator = a;
+	}
+}
+
+/*
+ * Initialize the stream encoder.  With more than one thread, liblzma
+ * splits the data into blocks that are compressed in parallel, which
+ * also lets a multithreaded decoder decompress them in parallel.
+ */
+static lzma_ret
+LZMAStreamEncoder(TIFF* tif)
+{
+	LZMAState* sp = LState(tif);
+#if LZMA_VERSION >= 50020002
+	uint32_t threads = LZMAThreads(sp);
+
+	LZMASetAllocator(sp, threads);
+	if (threads > 1) {
+		lzma_mt mt;
+
+		memset(&mt, 0, sizeof(mt));
+		mt.threads = threads;
+		/*
+		 * Blocks of one dictionary size (instead of liblzma's default
+		 * of three) keep more threads busy on a strip, at little cost
+		 * in compression ratio.
+		 */
+		mt.block_size = sp->opt_lzma.dict_size;
+		if (mt.block_size < (1 << 20))
+			mt.block_size = 1 << 20;
+		mt.timeout = 0;
+		mt.filters = sp->filters;
+		mt.check = sp->check;
+		/* The worker threads bypass the handle allocator */
+		if (!_TIFFCheckMemoryBudget(tif,
+		    lzma_stream_encoder_mt_memusage(&mt)))
+			return LZMA_MEMLIMIT_ERROR;
+		return lzma_stream_encoder_mt(&sp->stream, &mt);
+	}
+#else
+	LZMASetAllocator(sp, 1);
+#endif
+	return lzma_stream_encoder(&sp->stream, sp->filters, sp->check);
+}
+
+/*
+ * Initialize the stream decoder.  Memory limits are disabled; UINT64_MAX
+ * is a flag to disable the limit, we are passing (uint64_t)-1 which
+ * should be the same.  The multithreaded decoder, which does not use the
+ * handle allocator, stops at the memory budget of the handle instead.
+ */
+static lzma_ret
+LZMAStreamDecoder(TIFF* tif)
+{
+	LZMAState* sp = LState(tif);
+#if LZMA_VERSION >= 50040002
+	uint32_t threads = LZMAThreads(sp);
+
+	LZMASetAllocator(sp, threads);
+	if (threads > 1) {
+		lzma_mt mt;
+		uint64 budget;
+
+		TIFFGetMemoryBudget(tif, &budget, NULL);
+		if (tif->tif_maxsinglememalloc != 0
+		    && budget > (uint64) tif->tif_maxsinglememalloc)
+			budget = (uint64) tif->tif_maxsinglememalloc;
+		memset(&mt, 0, sizeof(mt));
+		mt.threads = threads;
+		mt.timeout = 0;
+		mt.memlimit_threading = (uint64_t)-1;
+		mt.memlimit_stop = budget > 0 ? (uint64_t) budget : 1;
+		return lzma_stream_decoder_mt(&sp->stream, &mt);
+	}
+#else
+	LZMASetAllocator(sp, 1);
+#endif
+	return lzma_stream_decoder(&sp->stream, (uint64_t)-1, 0);
+}
+
 static int
 LZMAFixupTags(TIFF* tif)
 {
@@ -147,11 +275,7 @@ LZMAPreDecode(TIFF* tif, uint16 s)
 		return 0;
 	}
 
-	/*
-	 * Disable memory limit when decoding. UINT64_MAX is a flag to disable
-	 * the limit, we are passing (uint64_t)-1 which should be the same.
-	 */
-	ret = lzma_stream_decoder(&sp->stream, (uint64_t)-1, 0);
+	ret = LZMAStreamDecoder(tif);
 	if (ret != LZMA_OK) {
 		TIFFErrorExt(tif->tif_clientdata, module,
 			     "Error initializing the stream decoder, %s",
@@ -194,8 +318,13 @@ LZMADecode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 		if (ret == LZMA_STREAM_END)
 			break;
 		if (ret == LZMA_MEMLIMIT_ERROR) {
-			lzma_ret r = lzma_stream_decoder(&sp->stream,
-							 lzma_memusage(&sp->stream), 0);
+			lzma_ret r;
+
+			if (!_TIFFCheckMemoryBudget(tif,
+			    lzma_memusage(&sp->stream)))
+				break;
+			r = lzma_stream_decoder(&sp->stream,
+						lzma_memusage(&sp->stream), 0);
 			if (r != LZMA_OK) {
 				TIFFErrorExt(tif->tif_clientdata, module,
 					     "Error initializing the stream decoder, %s",
@@ -262,7 +391,7 @@ LZMAPreEncode(TIFF* tif, uint16 s)
 			     "Liblzma cannot deal with buffers this size");
 		return 0;
 	}
-	return (lzma_stream_encoder(&sp->stream, sp->filters, sp->check) == LZMA_OK);
+	return (LZMAStreamEncoder(tif) == LZMA_OK);
 }
 
 /*
@@ -353,7 +482,7 @@ LZMACleanup(TIFF* tif)
 		lzma_end(&sp->stream);
 		sp->state = 0;
 	}
-	_TIFFfree(sp);
+	_TIFFfreeExt(tif, sp);
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -370,9 +499,7 @@ LZMAVSetField(TIFF* tif, uint32 tag, va_list ap)
 		sp->preset = (int) va_arg(ap, int);
 		lzma_lzma_preset(&sp->opt_lzma, sp->preset);
 		if (sp->state & LSTATE_INIT_ENCODE) {
-			lzma_ret ret = lzma_stream_encoder(&sp->stream,
-							   sp->filters,
-							   sp->check);
+			lzma_ret ret = LZMAStreamEncoder(tif);
 			if (ret != LZMA_OK) {
 				TIFFErrorExt(tif->tif_clientdata, module,
 					     "Liblzma error: %s",
@@ -380,6 +507,16 @@ LZMAVSetField(TIFF* tif, uint32 tag, va_list ap)
 			}
 		}
 		return 1;
+	case TIFFTAG_LZMATHREADS:
+		sp->threads = (int) va_arg(ap, int);
+		if (sp->threads < 0) {
+			TIFFErrorExt(tif->tif_clientdata, module,
+				     "Invalid number of threads %d",
+				     sp->threads);
+			sp->threads = 1;
+			return 0;
+		}
+		return 1;
 	default:
 		return (*sp->vsetparent)(tif, tag, ap);
 	}
@@ -395,6 +532,9 @@ LZMAVGetField(TIFF* tif, uint32 tag, va_list ap)
 	case TIFFTAG_LZMAPRESET:
 		*va_arg(ap, int*) = sp->preset;
 		break;
+	case TIFFTAG_LZMATHREADS:
+		*va_arg(ap, int*) = sp->threads;
+		break;
 	default:
 		return (*sp->vgetparent)(tif, tag, ap);
 	}
@@ -404,6 +544,8 @@ LZMAVGetField(TIFF* tif, uint32 tag, va_list ap)
 static const TIFFField lzmaFields[] = {
 	{ TIFFTAG_LZMAPRESET, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED,
 		FIELD_PSEUDO, TRUE, FALSE, "LZMA2 Compression Preset", NULL },
+	{ TIFFTAG_LZMATHREADS, 0, 0, TIFF_ANY, 0, TIFF_SETGET_INT, TIFF_SETGET_UNDEFINED,
+		FIELD_PSEUDO, TRUE, FALSE, "LZMA2 Threads", NULL },
 };
 
 int
@@ -427,11 +569,15 @@ TIFFInitLZMA(TIFF* tif, int scheme)
 	/*
 	 * Allocate state block so tag methods have storage to record values.
 	 */
-	tif->tif_data = (uint8*) _TIFFmalloc(sizeof(LZMAState));
+	tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof(LZMAState));
 	if (tif->tif_data == NULL)
 		goto bad;
 	sp = LState(tif);
 	memcpy(&sp->stream, &tmp_stream, sizeof(lzma_stream));
+	sp->allocator.alloc = LZMAAlloc;
+	sp->allocator.free = LZMAFree;
+	sp->allocator.opaque = tif;
+	sp->stream.allocator = &sp->allocator;
 
 	/*
 	 * Override parent get/set field methods.
@@ -443,6 +589,7 @@ TIFFInitLZMA(TIFF* tif, int scheme)
 
 	/* Default values for codec-specific fields */
 	sp->preset = LZMA_PRESET_DEFAULT;		/* default comp. level */
+	sp->threads = 1;
 	sp->check = LZMA_CHECK_NONE;
 	sp->state = 0;
 
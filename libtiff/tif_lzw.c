@@ -208,7 +208,7 @@ LZWSetupDecode(TIFF* tif)
 		 * Allocate state block so tag methods have storage to record
 		 * values.
 		*/
-		tif->tif_data = (uint8*) _TIFFmalloc(sizeof(LZWCodecState));
+		tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof(LZWCodecState));
 		if (tif->tif_data == NULL)
 		{
 			TIFFErrorExt(tif->tif_clientdata, module, "No space for LZW state block");
@@ -229,7 +229,7 @@ LZWSetupDecode(TIFF* tif)
 	assert(sp != NULL);
 
 	if (sp->dec_codetab == NULL) {
-		sp->dec_codetab = (code_t*)_TIFFmalloc(CSIZE*sizeof (code_t));
+		sp->dec_codetab = (code_t*)_TIFFBufferGet(tif, CSIZE*sizeof (code_t));
 		if (sp->dec_codetab == NULL) {
 			TIFFErrorExt(tif->tif_clientdata, module,
 				     "No space for LZW code table");
@@ -805,7 +805,8 @@ LZWSetupEncode(TIFF* tif)
 	LZWCodecState* sp = EncoderState(tif);
 
 	assert(sp != NULL);
-	sp->enc_hashtab = (hash_t*) _TIFFmalloc(HSIZE*sizeof (hash_t));
+	if (sp->enc_hashtab == NULL)
+		sp->enc_hashtab = (hash_t*) _TIFFBufferGet(tif, HSIZE*sizeof (hash_t));
 	if (sp->enc_hashtab == NULL) {
 		TIFFErrorExt(tif->tif_clientdata, module,
 			     "No space for LZW hash table");
@@ -1131,13 +1132,11 @@ LZWCleanup(TIFF* tif)
 
 	assert(tif->tif_data != 0);
 
-	if (DecoderState(tif)->dec_codetab)
-		_TIFFfree(DecoderState(tif)->dec_codetab);
+	/* The tables are kept for the next directory */
+	_TIFFBufferPut(tif, DecoderState(tif)->dec_codetab);
+	_TIFFBufferPut(tif, EncoderState(tif)->enc_hashtab);
 
-	if (EncoderState(tif)->enc_hashtab)
-		_TIFFfree(EncoderState(tif)->enc_hashtab);
-
-	_TIFFfree(tif->tif_data);
+	_TIFFfreeExt(tif, tif->tif_data);
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -1151,7 +1150,7 @@ TIFFInitLZW(TIFF* tif, int scheme)
 	/*
 	 * Allocate state block so tag methods have storage to record values.
 	 */
-	tif->tif_data = (uint8*) _TIFFmalloc(sizeof (LZWCodecState));
+	tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof (LZWCodecState));
 	if (tif->tif_data == NULL)
 		goto bad;
 	DecoderState(tif)->dec_codetab = NULL;
@@ -143,7 +143,9 @@
  * 	enough so as to not result in significant call overhead. It should be at least a few
  * 	bytes to accommodate some structures (this is verified in asserts), but it would not be
  * 	sensible to make it this small anyway, and it should be at most 64K since it is indexed
- * 	with uint16. We recommend 2K.
+ * 	with uint16. We recommend 2K. This buffer is used for reading headers; compressed
+ * 	image data is read in blocks of up to OJPEG_BULK_BUFFER bytes, typically a whole
+ * 	strile, or accessed directly in place if the file is memory-mapped.
  * EGYPTIANWALK: You could also define EGYPTIANWALK here, but it is not used anywhere and has
  * 	absolutely no effect. That is why most people insist the EGYPTIANWALK is a bit silly.
  */
@@ -153,6 +155,7 @@
 #define LONGJMP(jbuf,code) longjmp(jbuf,code)
 #define JMP_BUF jmp_buf
 #define OJPEG_BUFFER 2048
+#define OJPEG_BULK_BUFFER (16*1024*1024)
 /* define EGYPTIANWALK */
 
 #define JPEG_MARKER_SOF0 0xC0
@@ -329,11 +332,16 @@ typedef struct {
 	uint64 in_buffer_file_pos;
 	uint8 in_buffer_file_pos_log;
 	uint64 in_buffer_file_togo;
-	uint16 in_buffer_togo;
+	uint32 in_buffer_togo;
 	uint8* in_buffer_cur;
 	uint8 in_buffer[OJPEG_BUFFER];
+	uint8* in_bulk_buffer;
+	uint32 in_bulk_buffer_size;
 	OJPEGStateOutState out_state;
 	uint8 out_buffer[OJPEG_BUFFER];
+	uint8* header_stream;
+	uint32 header_stream_len;
+	uint8 header_stream_plane;
 	uint8* skip_buffer;
 } OJPEGState;
 
@@ -373,6 +381,8 @@ static int OJPEGReadHeaderInfoSecTablesDcTable(TIFF* tif);
 static int OJPEGReadHeaderInfoSecTablesAcTable(TIFF* tif);
 
 static int OJPEGReadBufferFill(OJPEGState* sp);
+static int OJPEGReadBufferFillBlock(OJPEGState* sp, int bulk);
+static int OJPEGReadBufferFillBulk(OJPEGState* sp);
 static int OJPEGReadByte(OJPEGState* sp, uint8* byte);
 static int OJPEGReadBytePeek(OJPEGState* sp, uint8* byte);
 static void OJPEGReadByteAdvance(OJPEGState* sp);
@@ -381,6 +391,7 @@ static int OJPEGReadBlock(OJPEGState* sp, uint16 len, void* mem);
 static void OJPEGReadSkip(OJPEGState* sp, uint16 len);
 
 static int OJPEGWriteStream(TIFF* tif, void** mem, uint32* len);
+static int OJPEGWriteStreamHeader(TIFF* tif, void** mem, uint32* len);
 static void OJPEGWriteStreamSoi(TIFF* tif, void** mem, uint32* len);
 static void OJPEGWriteStreamQTable(TIFF* tif, uint8 table_index, void** mem, uint32* len);
 static void OJPEGWriteStreamDcTable(TIFF* tif, uint8 table_index, void** mem, uint32* len);
@@ -434,7 +445,7 @@ TIFFInitOJPEG(TIFF* tif, int scheme)
 	}
 
 	/* state block */
-	sp=_TIFFmalloc(sizeof(OJPEGState));
+	sp=_TIFFmallocExt(tif, sizeof(OJPEGState));
 	if (sp==NULL)
 	{
 		TIFFErrorExt(tif->tif_clientdata,module,"No space for OJPEG state block");
@@ -768,7 +779,7 @@ OJPEGPreDecodeSkipScanlines(TIFF* tif)
 	uint32 m;
 	if (sp->skip_buffer==NULL)
 	{
-		sp->skip_buffer=_TIFFmalloc(sp->bytes_per_line);
+		sp->skip_buffer=_TIFFmallocExt(tif, sp->bytes_per_line);
 		if (sp->skip_buffer==NULL)
 		{
 			TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -948,38 +959,42 @@ OJPEGCleanup(TIFF* tif)
 		tif->tif_tagmethods.vsetfield=sp->vsetparent;
 		tif->tif_tagmethods.printdir=sp->printdir;
 		if (sp->qtable[0]!=0)
-			_TIFFfree(sp->qtable[0]);
+			_TIFFfreeExt(tif, sp->qtable[0]);
 		if (sp->qtable[1]!=0)
-			_TIFFfree(sp->qtable[1]);
+			_TIFFfreeExt(tif, sp->qtable[1]);
 		if (sp->qtable[2]!=0)
-			_TIFFfree(sp->qtable[2]);
+			_TIFFfreeExt(tif, sp->qtable[2]);
 		if (sp->qtable[3]!=0)
-			_TIFFfree(sp->qtable[3]);
+			_TIFFfreeExt(tif, sp->qtable[3]);
 		if (sp->dctable[0]!=0)
-			_TIFFfree(sp->dctable[0]);
+			_TIFFfreeExt(tif, sp->dctable[0]);
 		if (sp->dctable[1]!=0)
-			_TIFFfree(sp->dctable[1]);
+			_TIFFfreeExt(tif, sp->dctable[1]);
 		if (sp->dctable[2]!=0)
-			_TIFFfree(sp->dctable[2]);
+			_TIFFfreeExt(tif, sp->dctable[2]);
 		if (sp->dctable[3]!=0)
-			_TIFFfree(sp->dctable[3]);
+			_TIFFfreeExt(tif, sp->dctable[3]);
 		if (sp->actable[0]!=0)
-			_TIFFfree(sp->actable[0]);
+			_TIFFfreeExt(tif, sp->actable[0]);
 		if (sp->actable[1]!=0)
-			_TIFFfree(sp->actable[1]);
+			_TIFFfreeExt(tif, sp->actable[1]);
 		if (sp->actable[2]!=0)
-			_TIFFfree(sp->actable[2]);
+			_TIFFfreeExt(tif, sp->actable[2]);
 		if (sp->actable[3]!=0)
-			_TIFFfree(sp->actable[3]);
+			_TIFFfreeExt(tif, sp->actable[3]);
 		if (sp->libjpeg_session_active!=0)
 			OJPEGLibjpegSessionAbort(tif);
 		if (sp->subsampling_convert_ycbcrbuf!=0)
-			_TIFFfree(sp->subsampling_convert_ycbcrbuf);
+			_TIFFfreeExt(tif, sp->subsampling_convert_ycbcrbuf);
 		if (sp->subsampling_convert_ycbcrimage!=0)
-			_TIFFfree(sp->subsampling_convert_ycbcrimage);
+			_TIFFfreeExt(tif, sp->subsampling_convert_ycbcrimage);
 		if (sp->skip_buffer!=0)
-			_TIFFfree(sp->skip_buffer);
-		_TIFFfree(sp);
+			_TIFFfreeExt(tif, sp->skip_buffer);
+		if (sp->in_bulk_buffer!=0)
+			_TIFFfreeExt(tif, sp->in_bulk_buffer);
+		if (sp->header_stream!=0)
+			_TIFFfreeExt(tif, sp->header_stream);
+		_TIFFfreeExt(tif, sp);
 		tif->tif_data=NULL;
 		_TIFFSetDefaultCompressionState(tif);
 	}
@@ -992,8 +1007,6 @@ OJPEGSubsamplingCorrect(TIFF* tif)
 	OJPEGState* sp=(OJPEGState*)tif->tif_data;
 	uint8 mh;
 	uint8 mv;
-        _TIFFFillStriles( tif );
-        
 	assert(sp->subsamplingcorrect_done==0);
 	if ((tif->tif_dir.td_samplesperpixel!=3) || ((tif->tif_dir.td_photometric!=PHOTOMETRIC_YCBCR) &&
 	    (tif->tif_dir.td_photometric!=PHOTOMETRIC_ITULAB)))
@@ -1199,7 +1212,7 @@ OJPEGWriteHeaderInfo(TIFF* tif)
 			sp->subsampling_convert_ybuflen=sp->subsampling_convert_ylinelen*sp->subsampling_convert_ylines;
 			sp->subsampling_convert_cbuflen=sp->subsampling_convert_clinelen*sp->subsampling_convert_clines;
 			sp->subsampling_convert_ycbcrbuflen=sp->subsampling_convert_ybuflen+2*sp->subsampling_convert_cbuflen;
-			sp->subsampling_convert_ycbcrbuf=_TIFFmalloc(sp->subsampling_convert_ycbcrbuflen);
+			sp->subsampling_convert_ycbcrbuf=_TIFFmallocExt(tif, sp->subsampling_convert_ycbcrbuflen);
 			if (sp->subsampling_convert_ycbcrbuf==0)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1209,7 +1222,7 @@ OJPEGWriteHeaderInfo(TIFF* tif)
 			sp->subsampling_convert_cbbuf=sp->subsampling_convert_ybuf+sp->subsampling_convert_ybuflen;
 			sp->subsampling_convert_crbuf=sp->subsampling_convert_cbbuf+sp->subsampling_convert_cbuflen;
 			sp->subsampling_convert_ycbcrimagelen=3+sp->subsampling_convert_ylines+2*sp->subsampling_convert_clines;
-			sp->subsampling_convert_ycbcrimage=_TIFFmalloc(sp->subsampling_convert_ycbcrimagelen*sizeof(uint8*));
+			sp->subsampling_convert_ycbcrimage=_TIFFmallocExt(tif, sp->subsampling_convert_ycbcrimagelen*sizeof(uint8*));
 			if (sp->subsampling_convert_ycbcrimage==0)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1438,7 +1451,7 @@ OJPEGReadHeaderInfoSecStreamDqt(TIFF* tif)
 				return(0);
 			}
 			na=sizeof(uint32)+69;
-			nb=_TIFFmalloc(na);
+			nb=_TIFFmallocExt(tif, na);
 			if (nb==0)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1450,18 +1463,18 @@ OJPEGReadHeaderInfoSecStreamDqt(TIFF* tif)
 			nb[sizeof(uint32)+2]=0;
 			nb[sizeof(uint32)+3]=67;
 			if (OJPEGReadBlock(sp,65,&nb[sizeof(uint32)+4])==0) {
-				_TIFFfree(nb);
+				_TIFFfreeExt(tif, nb);
 				return(0);
 			}
 			o=nb[sizeof(uint32)+4]&15;
 			if (3<o)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Corrupt DQT marker in JPEG data");
-				_TIFFfree(nb);
+				_TIFFfreeExt(tif, nb);
 				return(0);
 			}
 			if (sp->qtable[o]!=0)
-				_TIFFfree(sp->qtable[o]);
+				_TIFFfreeExt(tif, sp->qtable[o]);
 			sp->qtable[o]=nb;
 			m-=65;
 		} while(m>0);
@@ -1495,7 +1508,7 @@ OJPEGReadHeaderInfoSecStreamDht(TIFF* tif)
 	else
 	{
 		na=sizeof(uint32)+2+m;
-		nb=_TIFFmalloc(na);
+		nb=_TIFFmallocExt(tif, na);
 		if (nb==0)
 		{
 			TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1507,7 +1520,7 @@ OJPEGReadHeaderInfoSecStreamDht(TIFF* tif)
 		nb[sizeof(uint32)+2]=(m>>8);
 		nb[sizeof(uint32)+3]=(m&255);
 		if (OJPEGReadBlock(sp,m-2,&nb[sizeof(uint32)+4])==0) {
-                        _TIFFfree(nb);
+                        _TIFFfreeExt(tif, nb);
 			return(0);
                 }
 		o=nb[sizeof(uint32)+4];
@@ -1516,11 +1529,11 @@ OJPEGReadHeaderInfoSecStreamDht(TIFF* tif)
 			if (3<o)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Corrupt DHT marker in JPEG data");
-                                _TIFFfree(nb);
+                                _TIFFfreeExt(tif, nb);
 				return(0);
 			}
 			if (sp->dctable[o]!=0)
-				_TIFFfree(sp->dctable[o]);
+				_TIFFfreeExt(tif, sp->dctable[o]);
 			sp->dctable[o]=nb;
 		}
 		else
@@ -1528,18 +1541,18 @@ OJPEGReadHeaderInfoSecStreamDht(TIFF* tif)
 			if ((o&240)!=16)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Corrupt DHT marker in JPEG data");
-                                _TIFFfree(nb);
+                                _TIFFfreeExt(tif, nb);
 				return(0);
 			}
 			o&=15;
 			if (3<o)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Corrupt DHT marker in JPEG data");
-                                _TIFFfree(nb);
+                                _TIFFfreeExt(tif, nb);
 				return(0);
 			}
 			if (sp->actable[o]!=0)
-				_TIFFfree(sp->actable[o]);
+				_TIFFfreeExt(tif, sp->actable[o]);
 			sp->actable[o]=nb;
 		}
 	}
@@ -1775,7 +1788,7 @@ OJPEGReadHeaderInfoSecTablesQTable(TIFF* tif)
 				}
 			}
 			oa=sizeof(uint32)+69;
-			ob=_TIFFmalloc(oa);
+			ob=_TIFFmallocExt(tif, oa);
 			if (ob==0)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1791,11 +1804,11 @@ OJPEGReadHeaderInfoSecTablesQTable(TIFF* tif)
 			p=(uint32)TIFFReadFile(tif,&ob[sizeof(uint32)+5],64);
 			if (p!=64)
                         {
-                                _TIFFfree(ob);
+                                _TIFFfreeExt(tif, ob);
 				return(0);
                         }
 			if (sp->qtable[m]!=0)
-				_TIFFfree(sp->qtable[m]);
+				_TIFFfreeExt(tif, sp->qtable[m]);
 			sp->qtable[m]=ob;
 			sp->sof_tq[m]=m;
 		}
@@ -1843,7 +1856,7 @@ OJPEGReadHeaderInfoSecTablesDcTable(TIFF* tif)
 			for (n=0; n<16; n++)
 				q+=o[n];
 			ra=sizeof(uint32)+21+q;
-			rb=_TIFFmalloc(ra);
+			rb=_TIFFmallocExt(tif, ra);
 			if (rb==0)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1860,11 +1873,11 @@ OJPEGReadHeaderInfoSecTablesDcTable(TIFF* tif)
 			p=(uint32)TIFFReadFile(tif,&(rb[sizeof(uint32)+21]),q);
 			if (p!=q)
                         {
-                                _TIFFfree(rb);
+                                _TIFFfreeExt(tif, rb);
 				return(0);
                         }
 			if (sp->dctable[m]!=0)
-				_TIFFfree(sp->dctable[m]);
+				_TIFFfreeExt(tif, sp->dctable[m]);
 			sp->dctable[m]=rb;
 			sp->sos_tda[m]=(m<<4);
 		}
@@ -1912,7 +1925,7 @@ OJPEGReadHeaderInfoSecTablesAcTable(TIFF* tif)
 			for (n=0; n<16; n++)
 				q+=o[n];
 			ra=sizeof(uint32)+21+q;
-			rb=_TIFFmalloc(ra);
+			rb=_TIFFmallocExt(tif, ra);
 			if (rb==0)
 			{
 				TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
@@ -1929,11 +1942,11 @@ OJPEGReadHeaderInfoSecTablesAcTable(TIFF* tif)
 			p=(uint32)TIFFReadFile(tif,&(rb[sizeof(uint32)+21]),q);
 			if (p!=q)
                         {
-                                _TIFFfree(rb);
+                                _TIFFfreeExt(tif, rb);
 				return(0);
                         }
 			if (sp->actable[m]!=0)
-				_TIFFfree(sp->actable[m]);
+				_TIFFfreeExt(tif, sp->actable[m]);
 			sp->actable[m]=rb;
 			sp->sos_tda[m]=(sp->sos_tda[m]|m);
 		}
@@ -1945,6 +1958,12 @@ OJPEGReadHeaderInfoSecTablesAcTable(TIFF* tif)
 
 static int
 OJPEGReadBufferFill(OJPEGState* sp)
+{
+	return(OJPEGReadBufferFillBlock(sp,0));
+}
+
+static int
+OJPEGReadBufferFillBlock(OJPEGState* sp, int bulk)
 {
 	uint16 m;
 	tmsize_t n;
@@ -1954,6 +1973,8 @@ OJPEGReadBufferFill(OJPEGState* sp)
 	{
 		if (sp->in_buffer_file_togo!=0)
 		{
+			if ((bulk!=0) && (sp->in_buffer_file_togo>OJPEG_BUFFER))
+				return(OJPEGReadBufferFillBulk(sp));
 			if (sp->in_buffer_file_pos_log==0)
 			{
 				TIFFSeekFile(sp->tif,sp->in_buffer_file_pos,SEEK_SET);
@@ -1991,29 +2012,25 @@ OJPEGReadBufferFill(OJPEGState* sp)
 				sp->in_buffer_source=osibsStrile;
                                 break;
 			case osibsStrile:
-				if (!_TIFFFillStriles( sp->tif ) 
-				    || sp->tif->tif_dir.td_stripoffset == NULL
-				    || sp->tif->tif_dir.td_stripbytecount == NULL)
-					return 0;
-
 				if (sp->in_buffer_next_strile==sp->in_buffer_strile_count)
 					sp->in_buffer_source=osibsEof;
 				else
 				{
-					sp->in_buffer_file_pos=sp->tif->tif_dir.td_stripoffset[sp->in_buffer_next_strile];
+					int err=0;
+					sp->in_buffer_file_pos=TIFFGetStrileOffsetWithErr(sp->tif,sp->in_buffer_next_strile,&err);
+					if (err)
+						return(0);
 					if (sp->in_buffer_file_pos!=0)
 					{
 						if (sp->in_buffer_file_pos>=sp->file_size)
 							sp->in_buffer_file_pos=0;
-						else if (sp->tif->tif_dir.td_stripbytecount==NULL)
-							sp->in_buffer_file_togo=sp->file_size-sp->in_buffer_file_pos;
 						else
 						{
-							if (sp->tif->tif_dir.td_stripbytecount == 0) {
+							sp->in_buffer_file_togo=TIFFGetStrileByteCountWithErr(sp->tif,sp->in_buffer_next_strile,&err);
+							if (err) {
 								TIFFErrorExt(sp->tif->tif_clientdata,sp->tif->tif_name,"Strip byte counts are missing");
 								return(0);
 							}
-							sp->in_buffer_file_togo=sp->tif->tif_dir.td_stripbytecount[sp->in_buffer_next_strile];
 							if (sp->in_buffer_file_togo==0)
 								sp->in_buffer_file_pos=0;
 							else if (sp->in_buffer_file_pos+sp->in_buffer_file_togo>sp->file_size)
@@ -2030,6 +2047,57 @@ OJPEGReadBufferFill(OJPEGState* sp)
 	return(1);
 }
 
+/*
+ * Make the remainder of the current block of compressed data (typically a
+ * whole strile) available at once, either in place if the file is
+ * memory-mapped, or through a single read in the bulk buffer.
+ */
+static int
+OJPEGReadBufferFillBulk(OJPEGState* sp)
+{
+	TIFF* tif=sp->tif;
+	uint64 m;
+	tmsize_t n;
+	m=sp->in_buffer_file_togo;
+	if (isMapped(tif) && (sp->in_buffer_file_pos<=(uint64)tif->tif_size) &&
+	    (m<=(uint64)tif->tif_size-sp->in_buffer_file_pos) && (m<=0xFFFFFFFFU))
+	{
+		sp->in_buffer_cur=tif->tif_base+(tmsize_t)sp->in_buffer_file_pos;
+		sp->in_buffer_file_pos_log=0;
+	}
+	else
+	{
+		if (m>OJPEG_BULK_BUFFER)
+			m=OJPEG_BULK_BUFFER;
+		if (m>sp->in_bulk_buffer_size)
+		{
+			uint8* buf=_TIFFreallocExt(tif, sp->in_bulk_buffer,(tmsize_t)m);
+			if (buf==0)
+			{
+				TIFFErrorExt(tif->tif_clientdata,"OJPEGReadBufferFillBulk","Out of memory");
+				return(0);
+			}
+			sp->in_bulk_buffer=buf;
+			sp->in_bulk_buffer_size=(uint32)m;
+		}
+		if (sp->in_buffer_file_pos_log==0)
+		{
+			TIFFSeekFile(tif,sp->in_buffer_file_pos,SEEK_SET);
+			sp->in_buffer_file_pos_log=1;
+		}
+		n=TIFFReadFile(tif,sp->in_bulk_buffer,(tmsize_t)m);
+		if (n<=0)
+			return(0);
+		assert((uint64)n<=m);
+		m=(uint64)n;
+		sp->in_buffer_cur=sp->in_bulk_buffer;
+	}
+	sp->in_buffer_togo=(uint32)m;
+	sp->in_buffer_file_togo-=m;
+	sp->in_buffer_file_pos+=m;
+	return(1);
+}
+
 static int
 OJPEGReadByte(OJPEGState* sp, uint8* byte)
 {
@@ -2149,65 +2217,138 @@ OJPEGWriteStream(TIFF* tif, void** mem, uint32* len)
 		switch(sp->out_state)
 		{
 			case ososSoi:
-				OJPEGWriteStreamSoi(tif,mem,len);
+				if (OJPEGWriteStreamHeader(tif,mem,len)==0)
+					return(0);
+				break;
+			case ososCompressed:
+				if (OJPEGWriteStreamCompressed(tif,mem,len)==0)
+					return(0);
+				break;
+			case ososRst:
+				OJPEGWriteStreamRst(tif,mem,len);
+				break;
+			case ososEoi:
+				OJPEGWriteStreamEoi(tif,mem,len);
+				break;
+			default:
+				/* header parts are assembled by OJPEGWriteStreamHeader */
+				assert(0);
+				return(0);
+		}
+	} while (*len==0);
+	return(1);
+}
+
+/*
+ * The stream header, SOI up to SOS, does not change between libjpeg
+ * sessions of a same plane.  It is assembled once in a single block,
+ * which is handed to libjpeg in one go.
+ */
+static int
+OJPEGWriteStreamHeader(TIFF* tif, void** mem, uint32* len)
+{
+	static const char module[]="OJPEGWriteStreamHeader";
+	OJPEGState* sp=(OJPEGState*)tif->tif_data;
+	void* m;
+	uint32 n;
+	uint8 i;
+	if ((sp->header_stream!=0) && (sp->header_stream_plane==sp->plane_sample_offset))
+	{
+		*mem=(void*)sp->header_stream;
+		*len=sp->header_stream_len;
+		sp->out_state=ososCompressed;
+		return(1);
+	}
+	if (sp->header_stream!=0)
+	{
+		_TIFFfreeExt(tif, sp->header_stream);
+		sp->header_stream=0;
+	}
+	/* SOI, DRI, SOF and SOS fit in OJPEG_BUFFER each */
+	n=4*OJPEG_BUFFER;
+	for (i=0; i<4; i++)
+	{
+		if (sp->qtable[i]!=0)
+			n+=*((uint32*)sp->qtable[i]);
+		if (sp->dctable[i]!=0)
+			n+=*((uint32*)sp->dctable[i]);
+		if (sp->actable[i]!=0)
+			n+=*((uint32*)sp->actable[i]);
+	}
+	sp->header_stream=_TIFFmallocExt(tif, n);
+	if (sp->header_stream==0)
+	{
+		TIFFErrorExt(tif->tif_clientdata,module,"Out of memory");
+		return(0);
+	}
+	sp->header_stream_len=0;
+	while (sp->out_state!=ososCompressed)
+	{
+		m=0;
+		n=0;
+		switch(sp->out_state)
+		{
+			case ososSoi:
+				OJPEGWriteStreamSoi(tif,&m,&n);
 				break;
 			case ososQTable0:
-				OJPEGWriteStreamQTable(tif,0,mem,len);
+				OJPEGWriteStreamQTable(tif,0,&m,&n);
 				break;
 			case ososQTable1:
-				OJPEGWriteStreamQTable(tif,1,mem,len);
+				OJPEGWriteStreamQTable(tif,1,&m,&n);
 				break;
 			case ososQTable2:
-				OJPEGWriteStreamQTable(tif,2,mem,len);
+				OJPEGWriteStreamQTable(tif,2,&m,&n);
 				break;
 			case ososQTable3:
-				OJPEGWriteStreamQTable(tif,3,mem,len);
+				OJPEGWriteStreamQTable(tif,3,&m,&n);
 				break;
 			case ososDcTable0:
-				OJPEGWriteStreamDcTable(tif,0,mem,len);
+				OJPEGWriteStreamDcTable(tif,0,&m,&n);
 				break;
 			case ososDcTable1:
-				OJPEGWriteStreamDcTable(tif,1,mem,len);
+				OJPEGWriteStreamDcTable(tif,1,&m,&n);
 				break;
 			case ososDcTable2:
-				OJPEGWriteStreamDcTable(tif,2,mem,len);
+				OJPEGWriteStreamDcTable(tif,2,&m,&n);
 				break;
 			case ososDcTable3:
-				OJPEGWriteStreamDcTable(tif,3,mem,len);
+				OJPEGWriteStreamDcTable(tif,3,&m,&n);
 				break;
 			case ososAcTable0:
-				OJPEGWriteStreamAcTable(tif,0,mem,len);
+				OJPEGWriteStreamAcTable(tif,0,&m,&n);
 				break;
 			case ososAcTable1:
-				OJPEGWriteStreamAcTable(tif,1,mem,len);
+				OJPEGWriteStreamAcTable(tif,1,&m,&n);
 				break;
 			case ososAcTable2:
-				OJPEGWriteStreamAcTable(tif,2,mem,len);
+				OJPEGWriteStreamAcTable(tif,2,&m,&n);
 				break;
 			case ososAcTable3:
-				OJPEGWriteStreamAcTable(tif,3,mem,len);
+				OJPEGWriteStreamAcTable(tif,3,&m,&n);
 				break;
 			case ososDri:
-				OJPEGWriteStreamDri(tif,mem,len);
+				OJPEGWriteStreamDri(tif,&m,&n);
 				break;
 			case ososSof:
-				OJPEGWriteStreamSof(tif,mem,len);
+				OJPEGWriteStreamSof(tif,&m,&n);
 				break;
 			case ososSos:
-				OJPEGWriteStreamSos(tif,mem,len);
-				break;
-			case ososCompressed:
-				if (OJPEGWriteStreamCompressed(tif,mem,len)==0)
-					return(0);
-				break;
-			case ososRst:
-				OJPEGWriteStreamRst(tif,mem,len);
-				break;
-			case ososEoi:
-				OJPEGWriteStreamEoi(tif,mem,len);
+				OJPEGWriteStreamSos(tif,&m,&n);
 				break;
+			default:
+				assert(0);
+				return(0);
 		}
-	} while (*len==0);
+		if (n!=0)
+		{
+			_TIFFmemcpy(sp->header_stream+sp->header_stream_len,m,n);
+			sp->header_stream_len+=n;
+		}
+	}
+	sp->header_stream_plane=sp->plane_sample_offset;
+	*mem=(void*)sp->header_stream;
+	*len=sp->header_stream_len;
 	return(1);
 }
 
@@ -2352,7 +2493,7 @@ OJPEGWriteStreamCompressed(TIFF* tif, void** mem, uint32* len)
 	OJPEGState* sp=(OJPEGState*)tif->tif_data;
 	if (sp->in_buffer_togo==0)
 	{
-		if (OJPEGReadBufferFill(sp)==0)
+		if (OJPEGReadBufferFillBlock(sp,1)==0)
 			return(0);
 		assert(sp->in_buffer_togo>0);
 	}
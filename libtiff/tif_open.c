@@ -69,6 +69,379 @@ _TIFFgetMode(const char* mode, const char* module)
 	return (m);
 }
 
+/*
+ * Per-handle open options.
+ */
+TIFFOpenOptions*
+TIFFOpenOptionsAlloc(void)
+{
+	TIFFOpenOptions* opts =
+	    (TIFFOpenOptions*) _TIFFmalloc(sizeof(TIFFOpenOptions));
+
+	if (opts != NULL)
+		_TIFFmemset(opts, 0, sizeof(TIFFOpenOptions));
+	return (opts);
+}
+
+void
+TIFFOpenOptionsFree(TIFFOpenOptions* opts)
+{
+	_TIFFfree(opts);
+}
+
+/*
+ * Route the allocations made on behalf of the handle through the given
+ * procedures, which get user_data as first argument.  NULL procedures
+ * select _TIFFmalloc and friends.
+ */
+void
+TIFFOpenOptionsSetAllocator(TIFFOpenOptions* opts, TIFFAllocProc allocproc,
+			    TIFFReallocProc reallocproc, TIFFFreeProc freeproc,
+			    void* user_data)
+{
+	if (allocproc == NULL || reallocproc == NULL || freeproc == NULL) {
+		allocproc = NULL;
+		reallocproc = NULL;
+		freeproc = NULL;
+		user_data = NULL;
+	}
+	opts->alloc = allocproc;
+	opts->realloc = reallocproc;
+	opts->free = freeproc;
+	opts->user_data = user_data;
+}
+
+/*
+ * Keep count of the memory used by the handle, see TIFFGetMemoryUsage().
+ */
+void
+TIFFOpenOptionsSetMemoryAccounting(TIFFOpenOptions* opts, int enable)
+{
+	opts->memaccount = enable != 0;
+}
+
+/*
+ * Refuse any single allocation larger than max_single_mem_alloc bytes
+ * made on behalf of the handle.  0 removes the limit.
+ */
+void
+TIFFOpenOptionsSetMaxSingleMemAlloc(TIFFOpenOptions* opts,
+				    tmsize_t max_single_mem_alloc)
+{
+	opts->max_single_mem_alloc =
+	    max_single_mem_alloc > 0 ? max_single_mem_alloc : 0;
+}
+
+/*
+ * Refuse allocations that would bring the memory held by the handle
+ * above max_cumulated_mem_alloc bytes.  0 removes the limit.  This
+ * implies memory accounting.
+ */
+void
+TIFFOpenOptionsSetMaxCumulatedMemAlloc(TIFFOpenOptions* opts,
+				       tmsize_t max_cumulated_mem_alloc)
+{
+	opts->max_cumulated_mem_alloc =
+	    max_cumulated_mem_alloc > 0 ? max_cumulated_mem_alloc : 0;
+}
+
+/*
+ * Obtain the blocks of the directory arena of the handle, which holds
+ * its tag values, from the given procedures rather than from the handle
+ * allocator.  They get user_data as first argument.  The blocks still
+ * count against the limits and memory accounting of the handle.  NULL
+ * procedures select the handle allocator.
+ */
+void
+TIFFOpenOptionsSetDirectoryAllocator(TIFFOpenOptions* opts,
+				     TIFFArenaAllocProc allocproc,
+				     TIFFArenaFreeProc freeproc,
+				     void* user_data)
+{
+	if (allocproc == NULL || freeproc == NULL) {
+		allocproc = NULL;
+		freeproc = NULL;
+		user_data = NULL;
+	}
+	opts->arena_alloc = allocproc;
+	opts->arena_free = freeproc;
+	opts->arena_user_data = user_data;
+}
+
+/*
+ * Block cache used by TIFFRangeOpen() and TIFFOpenHTTP(): blocks of
+ * block_size bytes, at most max_blocks of them, and up to readahead
+ * blocks fetched beyond a sequential read.  0 (or a negative readahead)
+ * selects the default for that setting.
+ */
+void
+TIFFOpenOptionsSetRangeCache(TIFFOpenOptions* opts, tmsize_t block_size,
+			     int max_blocks, int readahead)
+{
+	opts->range_cache = 1;
+	opts->range_block_size = block_size;
+	opts->range_max_blocks = max_blocks;
+	opts->range_readahead = readahead;
+}
+
+/*
+ * With memory accounting on, every allocation is preceded by a header
+ * holding its size; TIFF_MEMHDR keeps the returned memory aligned the
+ * way malloc() aligns it.
+ */
+#define	TIFF_MEMHDR	16
+#define	TIFF_SIZE_T_MAX ((size_t) ~ ((size_t)0))
+#define	TIFF_TMSIZE_T_MAX (tmsize_t)(TIFF_SIZE_T_MAX >> 1)
+
+/* Nothing to do beyond calling _TIFFmalloc and friends */
+#define	_TIFFPlainAlloc(tif) \
+	((tif) == NULL || ((tif)->tif_allocproc == NULL \
+	    && !(tif)->tif_memaccount && (tif)->tif_maxsinglememalloc == 0))
+
+/*
+ * Check that growing an allocation by oldsize to newsize bytes stays
+ * within the limits of the handle.
+ */
+static int
+_TIFFMemoryAllowed(TIFF* tif, tmsize_t oldsize, tmsize_t newsize,
+		   const char* module)
+{
+	if (tif->tif_maxsinglememalloc != 0
+	    && newsize > tif->tif_maxsinglememalloc) {
+		tif->tif_memrefused++;
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "Memory allocation of " TIFF_UINT64_FORMAT
+		    " bytes is beyond the " TIFF_UINT64_FORMAT
+		    " byte limit defined in open options",
+		    (uint64) newsize, (uint64) tif->tif_maxsinglememalloc);
+		return (0);
+	}
+	if (tif->tif_maxcumulatedmemalloc != 0 && newsize > oldsize
+	    && (uint64) (newsize - oldsize) > (uint64) tif->tif_maxcumulatedmemalloc
+	    - tif->tif_curmem) {
+		tif->tif_memrefused++;
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "Cumulated memory allocation of " TIFF_UINT64_FORMAT
+		    " + " TIFF_UINT64_FORMAT " bytes is beyond the "
+		    TIFF_UINT64_FORMAT " cumulated byte limit defined in"
+		    " open options", tif->tif_curmem,
+		    (uint64) (newsize - oldsize),
+		    (uint64) tif->tif_maxcumulatedmemalloc);
+		return (0);
+	}
+	return (1);
+}
+
+static void*
+_TIFFRawMalloc(TIFF* tif, tmsize_t s)
+{
+	return (tif->tif_allocproc ?
+	    (*tif->tif_allocproc)(tif->tif_allocdata, s) : _TIFFmalloc(s));
+}
+
+static void
+_TIFFAccount(TIFF* tif, tmsize_t oldsize, tmsize_t newsize)
+{
+	tif->tif_curmem = tif->tif_curmem - (uint64) oldsize + (uint64) newsize;
+	if (newsize > oldsize)
+		tif->tif_totalmem += (uint64)(newsize - oldsize);
+	if (tif->tif_curmem > tif->tif_peakmem)
+		tif->tif_peakmem = tif->tif_curmem;
+}
+
+void*
+_TIFFmallocExt(TIFF* tif, tmsize_t s)
+{
+	uint8* p;
+
+	if (_TIFFPlainAlloc(tif))
+		return (_TIFFmalloc(s));
+	if (s <= 0 || !_TIFFMemoryAllowed(tif, 0, s, "_TIFFmallocExt"))
+		return (NULL);
+	if (!tif->tif_memaccount)
+		return (_TIFFRawMalloc(tif, s));
+	if (s > TIFF_TMSIZE_T_MAX - TIFF_MEMHDR)
+		return (NULL);
+	p = (uint8*) _TIFFRawMalloc(tif, s + TIFF_MEMHDR);
+	if (p == NULL)
+		return (NULL);
+	*(tmsize_t*) p = s;
+	_TIFFAccount(tif, 0, s);
+	return (p + TIFF_MEMHDR);
+}
+
+void*
+_TIFFcallocExt(TIFF* tif, tmsize_t nmemb, tmsize_t siz)
+{
+	void* p;
+
+	if (_TIFFPlainAlloc(tif))
+		return (_TIFFcalloc(nmemb, siz));
+	if (nmemb <= 0 || siz <= 0 || nmemb > TIFF_TMSIZE_T_MAX / siz)
+		return (NULL);
+	p = _TIFFmallocExt(tif, nmemb * siz);
+	if (p != NULL)
+		_TIFFmemset(p, 0, nmemb * siz);
+	return (p);
+}
+
+void*
+_TIFFreallocExt(TIFF* tif, void* p, tmsize_t s)
+{
+	uint8* base;
+	tmsize_t oldsize;
+
+	if (_TIFFPlainAlloc(tif))
+		return (_TIFFrealloc(p, s));
+	if (p == NULL)
+		return (_TIFFmallocExt(tif, s));
+	if (s <= 0) {
+		_TIFFfreeExt(tif, p);
+		return (NULL);
+	}
+	if (!tif->tif_memaccount) {
+		if (!_TIFFMemoryAllowed(tif, 0, s, "_TIFFreallocExt"))
+			return (NULL);
+		return (tif->tif_reallocproc ?
+		    (*tif->tif_reallocproc)(tif->tif_allocdata, p, s) :
+		    _TIFFrealloc(p, s));
+	}
+	if (s > TIFF_TMSIZE_T_MAX - TIFF_MEMHDR)
+		return (NULL);
+	base = (uint8*) p - TIFF_MEMHDR;
+	oldsize = *(tmsize_t*) base;
+	if (!_TIFFMemoryAllowed(tif, oldsize, s, "_TIFFreallocExt"))
+		return (NULL);
+	base = (uint8*) (tif->tif_reallocproc ?
+	    (*tif->tif_reallocproc)(tif->tif_allocdata, base, s + TIFF_MEMHDR) :
+	    _TIFFrealloc(base, s + TIFF_MEMHDR));
+	if (base == NULL)
+		return (NULL);
+	*(tmsize_t*) base = s;
+	_TIFFAccount(tif, oldsize, s);
+	return (base + TIFF_MEMHDR);
+}
+
+void
+_TIFFfreeExt(TIFF* tif, void* p)
+{
+	if (_TIFFPlainAlloc(tif)) {
+		_TIFFfree(p);
+		return;
+	}
+	if (p == NULL)
+		return;
+	if (tif->tif_memaccount) {
+		p = (uint8*) p - TIFF_MEMHDR;
+		_TIFFAccount(tif, *(tmsize_t*) p, 0);
+	}
+	if (tif->tif_freeproc)
+		(*tif->tif_freeproc)(tif->tif_allocdata, p);
+	else
+		_TIFFfree(p);
+}
+
+/*
+ * Blocks of the directory arena, see tif_aux.c: like _TIFFmallocExt and
+ * _TIFFfreeExt, through the arena allocator of the open options if any.
+ */
+void*
+_TIFFArenaBlockAlloc(TIFF* tif, tmsize_t s)
+{
+	uint8* p;
+
+	if (tif->tif_arenaalloc == NULL)
+		return (_TIFFmallocExt(tif, s));
+	if (s <= 0 || !_TIFFMemoryAllowed(tif, 0, s, "_TIFFArenaBlockAlloc"))
+		return (NULL);
+	if (!tif->tif_memaccount)
+		return ((*tif->tif_arenaalloc)(tif->tif_arenauser, s));
+	if (s > TIFF_TMSIZE_T_MAX - TIFF_MEMHDR)
+		return (NULL);
+	p = (uint8*) (*tif->tif_arenaalloc)(tif->tif_arenauser,
+	    s + TIFF_MEMHDR);
+	if (p == NULL)
+		return (NULL);
+	*(tmsize_t*) p = s;
+	_TIFFAccount(tif, 0, s);
+	return (p + TIFF_MEMHDR);
+}
+
+void
+_TIFFArenaBlockFree(TIFF* tif, void* p)
+{
+	if (tif->tif_arenaalloc == NULL) {
+		_TIFFfreeExt(tif, p);
+		return;
+	}
+	if (p == NULL)
+		return;
+	if (tif->tif_memaccount) {
+		p = (uint8*) p - TIFF_MEMHDR;
+		_TIFFAccount(tif, *(tmsize_t*) p, 0);
+	}
+	(*tif->tif_arenafree)(tif->tif_arenauser, p);
+}
+
+/*
+ * Check that size bytes more would fit in the limits of the handle, for
+ * memory that third-party libraries allocate on its behalf without
+ * going through _TIFFmallocExt (libjpeg, multithreaded liblzma).
+ */
+int
+_TIFFCheckMemoryBudget(TIFF* tif, uint64 size)
+{
+	if (tif->tif_maxsinglememalloc == 0 && tif->tif_maxcumulatedmemalloc == 0)
+		return (1);
+	if (size > (uint64) TIFF_TMSIZE_T_MAX)
+		size = (uint64) TIFF_TMSIZE_T_MAX;
+	return (_TIFFMemoryAllowed(tif, 0, (tmsize_t) size,
+	    "_TIFFCheckMemoryBudget"));
+}
+
+/*
+ * Report the memory allocated on behalf of a handle opened with memory
+ * accounting: what is held now, the most held at once and the total
+ * allocated since it was opened.  Any pointer may be NULL.
+ */
+int
+TIFFGetMemoryUsage(TIFF* tif, uint64* current, uint64* peak, uint64* total)
+{
+	if (!tif->tif_memaccount)
+		return (0);
+	if (current)
+		*current = tif->tif_curmem;
+	if (peak)
+		*peak = tif->tif_peakmem;
+	if (total)
+		*total = tif->tif_totalmem;
+	return (1);
+}
+
+/*
+ * Report how many more bytes the handle may allocate before hitting its
+ * cumulated memory limit, and how many allocations the limits refused
+ * so far.  Returns 0 if no limit was set; remaining is then the largest
+ * uint64.  Any pointer may be NULL.
+ */
+int
+TIFFGetMemoryBudget(TIFF* tif, uint64* remaining, uint64* refused)
+{
+	if (remaining) {
+		if (tif->tif_maxcumulatedmemalloc == 0)
+			*remaining = (uint64) -1;
+		else if (tif->tif_curmem >= (uint64) tif->tif_maxcumulatedmemalloc)
+			*remaining = 0;
+		else
+			*remaining = (uint64) tif->tif_maxcumulatedmemalloc
+			    - tif->tif_curmem;
+	}
+	if (refused)
+		*refused = tif->tif_memrefused;
+	return (tif->tif_maxsinglememalloc != 0
+	    || tif->tif_maxcumulatedmemalloc != 0);
+}
+
 TIFF*
 TIFFClientOpen(
 	const char* name, const char* mode,
@@ -81,9 +454,28 @@ TIFFClientOpen(
 	TIFFMapFileProc mapproc,
 	TIFFUnmapFileProc unmapproc
 )
+{
+	return (TIFFClientOpenExt(name, mode, clientdata, readproc, writeproc,
+	    seekproc, closeproc, sizeproc, mapproc, unmapproc, NULL));
+}
+
+TIFF*
+TIFFClientOpenExt(
+	const char* name, const char* mode,
+	thandle_t clientdata,
+	TIFFReadWriteProc readproc,
+	TIFFReadWriteProc writeproc,
+	TIFFSeekProc seekproc,
+	TIFFCloseProc closeproc,
+	TIFFSizeProc sizeproc,
+	TIFFMapFileProc mapproc,
+	TIFFUnmapFileProc unmapproc,
+	TIFFOpenOptions* opts
+)
 {
 	static const char module[] = "TIFFClientOpen";
 	TIFF *tif;
+	TIFF hooks;
 	int m;
 	const char* cp;
 
@@ -116,12 +508,32 @@ TIFFClientOpen(
 	m = _TIFFgetMode(mode, module);
 	if (m == -1)
 		goto bad2;
-	tif = (TIFF *)_TIFFmalloc((tmsize_t)(sizeof (TIFF) + strlen(name) + 1));
+	/*
+	 * The TIFF structure itself comes from the handle's allocator.
+	 */
+	_TIFFmemset(&hooks, 0, sizeof (hooks));
+	if (opts) {
+		hooks.tif_allocproc = opts->alloc;
+		hooks.tif_reallocproc = opts->realloc;
+		hooks.tif_freeproc = opts->free;
+		hooks.tif_allocdata = opts->user_data;
+		hooks.tif_memaccount = opts->memaccount
+		    || opts->max_cumulated_mem_alloc != 0;
+		hooks.tif_maxsinglememalloc = opts->max_single_mem_alloc;
+		hooks.tif_maxcumulatedmemalloc =
+		    opts->max_cumulated_mem_alloc;
+		hooks.tif_arenaalloc = opts->arena_alloc;
+		hooks.tif_arenafree = opts->arena_free;
+		hooks.tif_arenauser = opts->arena_user_data;
+	}
+	hooks.tif_clientdata = clientdata;
+	tif = (TIFF *)_TIFFmallocExt(&hooks,
+	    (tmsize_t)(sizeof (TIFF) + strlen(name) + 1));
 	if (tif == NULL) {
 		TIFFErrorExt(clientdata, module, "%s: Out of memory (TIFF structure)", name);
 		goto bad2;
 	}
-	_TIFFmemset(tif, 0, sizeof (*tif));
+	_TIFFmemcpy(tif, &hooks, sizeof (*tif));
 	tif->tif_name = (char *)tif + sizeof (TIFF);
 	strcpy(tif->tif_name, name);
 	tif->tif_mode = m &~ (O_CREAT|O_TRUNC);
@@ -163,6 +575,10 @@ TIFFClientOpen(
 		tif->tif_flags |= STRIPCHOP_DEFAULT;
 	#endif
 
+	#ifdef DEFER_STRILE_LOAD
+	tif->tif_flags |= TIFF_DEFERSTRILELOAD;
+	#endif
+
 	/*
 	 * Process library-specific flags in the open mode string.
 	 * The following flags may be used to control intrinsic library
@@ -183,6 +599,10 @@ TIFFClientOpen(
 	 * 'h' read TIFF header only, do not load the first IFD
 	 * '4' ClassicTIFF for creating a file (default)
 	 * '8' BigTIFF for creating a file
+	 * 'z' fetch array and blob tag values only when they are asked for
+	 * 'D' load the strip/tile offset and bytecount arrays on first use
+	 * 'O' read strip/tile offsets and bytecounts one block at a time,
+	 *     as they are needed (read-only, implies 'D')
 	 *
 	 * The use of the 'l' and 'b' flags is strongly discouraged.
 	 * These flags are provided solely because numerous vendors,
@@ -260,6 +680,17 @@ TIFFClientOpen(
 			case 'h':
 				tif->tif_flags |= TIFF_HEADERONLY;
 				break;
+			case 'z':
+				tif->tif_flags |= TIFF_LAZYDIR;
+				break;
+			case 'D':
+				tif->tif_flags |= TIFF_DEFERSTRILELOAD;
+				break;
+			case 'O':
+				if (m == O_RDONLY)
+					tif->tif_flags |= (TIFF_LAZYSTRILELOAD |
+					    TIFF_DEFERSTRILELOAD);
+				break;
 			case '8':
 				if (m&O_CREAT)
 					tif->tif_flags |= TIFF_BIGTIFF;
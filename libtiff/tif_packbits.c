@@ -38,7 +38,7 @@ PackBitsPreEncode(TIFF* tif, uint16 s)
 {
 	(void) s;
 
-        tif->tif_data = (uint8*)_TIFFmalloc(sizeof(tmsize_t));
+        tif->tif_data = (uint8*)_TIFFmallocExt(tif, sizeof(tmsize_t));
 	if (tif->tif_data == NULL)
 		return (0);
 	/*
@@ -55,7 +55,7 @@ static int
 PackBitsPostEncode(TIFF* tif)
 {
         if (tif->tif_data)
-            _TIFFfree(tif->tif_data);
+            _TIFFfreeExt(tif, tif->tif_data);
 	return (1);
 }
 
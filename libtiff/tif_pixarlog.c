@@ -166,7 +166,7 @@ horizontalAccumulateF(uint16 *wp, int n, int stride, float *op,
 	    n -= stride;
 	    while (n > 0) {
 		REPEAT(stride,
-		    wp[stride] += *wp; *op = ToLinearF[*wp&mask]; wp++; op++)
+		    *wp += wp[-stride]; *op = ToLinearF[*wp&mask]; wp++; op++)
 		n -= stride;
 	    }
 	}
@@ -233,7 +233,7 @@ horizontalAccumulate12(uint16 *wp, int n, int stride, int16 *op,
 	    n -= stride;
 	    while (n > 0) {
 		REPEAT(stride,
-		    wp[stride] += *wp; t0 = ToLinearF[wp[stride]&mask]*SCALE12;
+		    *wp += wp[-stride]; t0 = ToLinearF[*wp&mask]*SCALE12;
 		    *op = CLAMP12(t0);  wp++; op++)
 		n -= stride;
 	    }
@@ -282,7 +282,7 @@ horizontalAccumulate16(uint16 *wp, int n, int stride, uint16 *op,
 	    n -= stride;
 	    while (n > 0) {
 		REPEAT(stride,
-		    wp[stride] += *wp; *op = ToLinear16[*wp&mask]; wp++; op++)
+		    *wp += wp[-stride]; *op = ToLinear16[*wp&mask]; wp++; op++)
 		n -= stride;
 	    }
 	}
@@ -331,7 +331,7 @@ horizontalAccumulate11(uint16 *wp, int n, int stride, uint16 *op)
 	    n -= stride;
 	    while (n > 0) {
 		REPEAT(stride,
-		    wp[stride] += *wp; *op = *wp&mask; wp++; op++)
+		    *wp += wp[-stride]; *op = *wp&mask; wp++; op++)
 		n -= stride;
 	    }
 	}
@@ -379,7 +379,7 @@ horizontalAccumulate8(uint16 *wp, int n, int stride, unsigned char *op,
 	    n -= stride;
 	    while (n > 0) {
 		REPEAT(stride,
-		    wp[stride] += *wp; *op = ToLinear8[*wp&mask]; wp++; op++)
+		    *wp += wp[-stride]; *op = ToLinear8[*wp&mask]; wp++; op++)
 		n -= stride;
 	    }
 	}
@@ -445,7 +445,7 @@ horizontalAccumulate8abgr(uint16 *wp, int n, int stride, unsigned char *op,
 	    n -= stride;
 	    while (n > 0) {
 		REPEAT(stride,
-		    wp[stride] += *wp; *op = ToLinear8[*wp&mask]; wp++; op++)
+		    *wp += wp[-stride]; *op = ToLinear8[*wp&mask]; wp++; op++)
 		n -= stride;
 	    }
 	}
@@ -461,6 +461,9 @@ typedef	struct {
 	z_stream		stream;
 	tmsize_t		tbuf_size; /* only set/used on reading for now */
 	uint16			*tbuf; 
+	uint16			*tbuf_next; /* next decoded sample to return */
+	tmsize_t		tbuf_left;  /* decoded samples not returned yet */
+	tmsize_t		tbuf_odd;   /* bytes of a sample not complete yet */
 	uint16			stride;
 	int			state;
 	int			user_datafmt;
@@ -480,7 +483,7 @@ typedef	struct {
 } PixarLogState;
 
 static int
-PixarLogMakeTables(PixarLogState *sp)
+PixarLogMakeTables(TIFF* tif, PixarLogState *sp)
 {
 
 /*
@@ -513,20 +516,20 @@ PixarLogMakeTables(PixarLogState *sp)
     LogK1 = (float)(1./c);	/* if (v >= 2)  token = k1*log(v*k2) */
     LogK2 = (float)(1./b);
     lt2size = (int)(2./linstep) + 1;
-    FromLT2 = (uint16 *)_TIFFmalloc(lt2size*sizeof(uint16));
-    From14 = (uint16 *)_TIFFmalloc(16384*sizeof(uint16));
-    From8 = (uint16 *)_TIFFmalloc(256*sizeof(uint16));
-    ToLinearF = (float *)_TIFFmalloc(TSIZEP1 * sizeof(float));
-    ToLinear16 = (uint16 *)_TIFFmalloc(TSIZEP1 * sizeof(uint16));
-    ToLinear8 = (unsigned char *)_TIFFmalloc(TSIZEP1 * sizeof(unsigned char));
+    FromLT2 = (uint16 *)_TIFFmallocExt(tif, lt2size*sizeof(uint16));
+    From14 = (uint16 *)_TIFFmallocExt(tif, 16384*sizeof(uint16));
+    From8 = (uint16 *)_TIFFmallocExt(tif, 256*sizeof(uint16));
+    ToLinearF = (float *)_TIFFmallocExt(tif, TSIZEP1 * sizeof(float));
+    ToLinear16 = (uint16 *)_TIFFmallocExt(tif, TSIZEP1 * sizeof(uint16));
+    ToLinear8 = (unsigned char *)_TIFFmallocExt(tif, TSIZEP1 * sizeof(unsigned char));
     if (FromLT2 == NULL || From14  == NULL || From8   == NULL ||
 	 ToLinearF == NULL || ToLinear16 == NULL || ToLinear8 == NULL) {
-	if (FromLT2) _TIFFfree(FromLT2);
-	if (From14) _TIFFfree(From14);
-	if (From8) _TIFFfree(From8);
-	if (ToLinearF) _TIFFfree(ToLinearF);
-	if (ToLinear16) _TIFFfree(ToLinear16);
-	if (ToLinear8) _TIFFfree(ToLinear8);
+	if (FromLT2) _TIFFfreeExt(tif, FromLT2);
+	if (From14) _TIFFfreeExt(tif, From14);
+	if (From8) _TIFFfreeExt(tif, From8);
+	if (ToLinearF) _TIFFfreeExt(tif, ToLinearF);
+	if (ToLinear16) _TIFFfreeExt(tif, ToLinear16);
+	if (ToLinear8) _TIFFfreeExt(tif, ToLinear8);
 	sp->FromLT2 = NULL;
 	sp->From14 = NULL;
 	sp->From8 = NULL;
@@ -659,6 +662,25 @@ add_ms(tmsize_t m1, tmsize_t m2)
 	return m1 + m2;
 }
 
+/*
+ * zlib allocation hooks: route the inflate/deflate working storage
+ * through the allocator of the handle that owns the stream.
+ */
+static voidpf
+PixarLogAlloc(voidpf opaque, uInt items, uInt size)
+{
+	if (size != 0 && items > ((uInt) ~ (uInt) 0) / size)
+		return (Z_NULL);
+	return ((voidpf) _TIFFmallocExt((TIFF*) opaque,
+	    (tmsize_t) items * (tmsize_t) size));
+}
+
+static void
+PixarLogFree(voidpf opaque, voidpf ptr)
+{
+	_TIFFfreeExt((TIFF*) opaque, ptr);
+}
+
 static int
 PixarLogFixupTags(TIFF* tif)
 {
@@ -701,14 +723,14 @@ PixarLogSetupDecode(TIFF* tif)
 	tbuf_size = add_ms(tbuf_size, sizeof(uint16) * sp->stride);
 	if (tbuf_size == 0)
 		return (0);   /* TODO: this is an error return without error report through TIFFErrorExt */
-	sp->tbuf = (uint16 *) _TIFFmalloc(tbuf_size);
+	sp->tbuf = (uint16 *) _TIFFmallocExt(tif, tbuf_size);
 	if (sp->tbuf == NULL)
 		return (0);
 	sp->tbuf_size = tbuf_size;
 	if (sp->user_datafmt == PIXARLOGDATAFMT_UNKNOWN)
 		sp->user_datafmt = PixarLogGuessDataFmt(td);
 	if (sp->user_datafmt == PIXARLOGDATAFMT_UNKNOWN) {
-                _TIFFfree(sp->tbuf);
+                _TIFFfreeExt(tif, sp->tbuf);
                 sp->tbuf = NULL;
                 sp->tbuf_size = 0;
 		TIFFErrorExt(tif->tif_clientdata, module,
@@ -718,7 +740,7 @@ PixarLogSetupDecode(TIFF* tif)
 	}
 
 	if (inflateInit(&sp->stream) != Z_OK) {
-                _TIFFfree(sp->tbuf);
+                _TIFFfreeExt(tif, sp->tbuf);
                 sp->tbuf = NULL;
                 sp->tbuf_size = 0;
 		TIFFErrorExt(tif->tif_clientdata, module, "%s", sp->stream.msg ? sp->stream.msg : "(null)");
@@ -751,6 +773,9 @@ PixarLogPreDecode(TIFF* tif, uint16 s)
 		TIFFErrorExt(tif->tif_clientdata, module, "ZLib cannot deal with buffers this size");
 		return (0);
 	}
+	sp->tbuf_next = sp->tbuf;
+	sp->tbuf_left = 0;
+	sp->tbuf_odd = 0;
 	return (inflateReset(&sp->stream) == Z_OK);
 }
 
@@ -790,61 +815,92 @@ PixarLogDecode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
 	(void) s;
 	assert(sp != NULL);
 
-        sp->stream.next_in = tif->tif_rawcp;
-	sp->stream.avail_in = (uInt) tif->tif_rawcc;
-
-	sp->stream.next_out = (unsigned char *) sp->tbuf;
-	assert(sizeof(sp->stream.avail_out)==4);  /* if this assert gets raised,
-	    we need to simplify this code to reflect a ZLib that is likely updated
-	    to deal with 8byte memory sizes, though this code will respond
-	    appropriately even before we simplify it */
-	sp->stream.avail_out = (uInt) (nsamples * sizeof(uint16));
-	if (sp->stream.avail_out != nsamples * sizeof(uint16))
-	{
-		TIFFErrorExt(tif->tif_clientdata, module, "ZLib cannot deal with buffers this size");
-		return (0);
-	}
 	/* Check that we will not fill more than what was allocated */
-	if ((tmsize_t)sp->stream.avail_out > sp->tbuf_size)
+	if ((tmsize_t)(nsamples * sizeof(uint16)) > sp->tbuf_size)
 	{
 		TIFFErrorExt(tif->tif_clientdata, module, "sp->stream.avail_out > sp->tbuf_size");
 		return (0);
 	}
-	do {
-		int state = inflate(&sp->stream, Z_PARTIAL_FLUSH);
-		if (state == Z_STREAM_END) {
-			break;			/* XXX */
-		}
-		if (state == Z_DATA_ERROR) {
-			TIFFErrorExt(tif->tif_clientdata, module,
-			    "Decoding error at scanline %lu, %s",
-			    (unsigned long) tif->tif_row, sp->stream.msg ? sp->stream.msg : "(null)");
-			if (inflateSync(&sp->stream) != Z_OK)
-				return (0);
-			continue;
-		}
-		if (state != Z_OK) {
-			TIFFErrorExt(tif->tif_clientdata, module, "ZLib error: %s",
-			    sp->stream.msg ? sp->stream.msg : "(null)");
+
+	/*
+	 * Inflate everything that is left of the strip or tile in one go,
+	 * rather than a row at a time when reading scanlines; subsequent
+	 * rows are then returned from the translation buffer.
+	 */
+	if (sp->tbuf_left < nsamples) {
+		tmsize_t ndecoded, nbytes;
+
+		/*
+		 * When the strip is only partly loaded, the input may end in
+		 * the middle of a sample: keep its first byte for the next
+		 * call.
+		 */
+		nbytes = sp->tbuf_left * sizeof(uint16) + sp->tbuf_odd;
+		if (nbytes > 0 && sp->tbuf_next != sp->tbuf)
+			memmove(sp->tbuf, sp->tbuf_next, nbytes);
+		sp->tbuf_next = sp->tbuf;
+
+		sp->stream.next_in = tif->tif_rawcp;
+		sp->stream.avail_in = (uInt) tif->tif_rawcc;
+
+		sp->stream.next_out = (unsigned char *) sp->tbuf + nbytes;
+		assert(sizeof(sp->stream.avail_out)==4);  /* if this assert gets raised,
+		    we need to simplify this code to reflect a ZLib that is likely updated
+		    to deal with 8byte memory sizes, though this code will respond
+		    appropriately even before we simplify it */
+		sp->stream.avail_out = (uInt) (sp->tbuf_size - nbytes);
+		if ((tmsize_t)sp->stream.avail_out != sp->tbuf_size - nbytes)
+		{
+			TIFFErrorExt(tif->tif_clientdata, module, "ZLib cannot deal with buffers this size");
 			return (0);
 		}
-	} while (sp->stream.avail_out > 0);
+		do {
+			int state = inflate(&sp->stream, Z_PARTIAL_FLUSH);
+			if (state == Z_STREAM_END || state == Z_BUF_ERROR) {
+				break;			/* no more data */
+			}
+			if (state == Z_DATA_ERROR) {
+				TIFFErrorExt(tif->tif_clientdata, module,
+				    "Decoding error at scanline %lu, %s",
+				    (unsigned long) tif->tif_row, sp->stream.msg ? sp->stream.msg : "(null)");
+				if (inflateSync(&sp->stream) != Z_OK)
+					return (0);
+				continue;
+			}
+			if (state != Z_OK) {
+				TIFFErrorExt(tif->tif_clientdata, module, "ZLib error: %s",
+				    sp->stream.msg ? sp->stream.msg : "(null)");
+				return (0);
+			}
+		} while (sp->stream.avail_out > 0);
+
+		tif->tif_rawcp = sp->stream.next_in;
+		tif->tif_rawcc = sp->stream.avail_in;
+
+		nbytes = (tmsize_t) (sp->stream.next_out -
+		    (unsigned char *) sp->tbuf);
+		ndecoded = nbytes / sizeof(uint16) - sp->tbuf_left;
+		sp->tbuf_odd = nbytes % sizeof(uint16);
+		/* Swap bytes in the data if from a different endian machine. */
+		if (tif->tif_flags & TIFF_SWAB)
+			TIFFSwabArrayOfShort(sp->tbuf + sp->tbuf_left, ndecoded);
+		sp->tbuf_left += ndecoded;
+	}
 
 	/* hopefully, we got all the bytes we needed */
-	if (sp->stream.avail_out != 0) {
+	if (sp->tbuf_left < nsamples) {
 		TIFFErrorExt(tif->tif_clientdata, module,
 		    "Not enough data at scanline %lu (short " TIFF_UINT64_FORMAT " bytes)",
-		    (unsigned long) tif->tif_row, (TIFF_UINT64_T) sp->stream.avail_out);
+		    (unsigned long) tif->tif_row,
+		    (TIFF_UINT64_T) ((nsamples - sp->tbuf_left) * sizeof(uint16)));
+		sp->tbuf_left = 0;
+		sp->tbuf_odd = 0;
 		return (0);
 	}
 
-        tif->tif_rawcp = sp->stream.next_in;
-        tif->tif_rawcc = sp->stream.avail_in;
-
-	up = sp->tbuf;
-	/* Swap bytes in the data if from a different endian machine. */
-	if (tif->tif_flags & TIFF_SWAB)
-		TIFFSwabArrayOfShort(up, nsamples);
+	up = sp->tbuf_next;
+	sp->tbuf_next += nsamples;
+	sp->tbuf_left -= nsamples;
 
 	/*
 	 * if llen is not an exact multiple of nsamples, the decode operation
@@ -919,7 +975,7 @@ PixarLogSetupEncode(TIFF* tif)
 				      td->td_rowsperstrip), sizeof(uint16));
 	if (tbuf_size == 0)
 		return (0);  /* TODO: this is an error return without error report through TIFFErrorExt */
-	sp->tbuf = (uint16 *) _TIFFmalloc(tbuf_size);
+	sp->tbuf = (uint16 *) _TIFFmallocExt(tif, tbuf_size);
 	if (sp->tbuf == NULL)
 		return (0);
 	if (sp->user_datafmt == PIXARLOGDATAFMT_UNKNOWN)
@@ -1294,12 +1350,12 @@ PixarLogCleanup(TIFF* tif)
 	tif->tif_tagmethods.vgetfield = sp->vgetparent;
 	tif->tif_tagmethods.vsetfield = sp->vsetparent;
 
-	if (sp->FromLT2) _TIFFfree(sp->FromLT2);
-	if (sp->From14) _TIFFfree(sp->From14);
-	if (sp->From8) _TIFFfree(sp->From8);
-	if (sp->ToLinearF) _TIFFfree(sp->ToLinearF);
-	if (sp->ToLinear16) _TIFFfree(sp->ToLinear16);
-	if (sp->ToLinear8) _TIFFfree(sp->ToLinear8);
+	if (sp->FromLT2) _TIFFfreeExt(tif, sp->FromLT2);
+	if (sp->From14) _TIFFfreeExt(tif, sp->From14);
+	if (sp->From8) _TIFFfreeExt(tif, sp->From8);
+	if (sp->ToLinearF) _TIFFfreeExt(tif, sp->ToLinearF);
+	if (sp->ToLinear16) _TIFFfreeExt(tif, sp->ToLinear16);
+	if (sp->ToLinear8) _TIFFfreeExt(tif, sp->ToLinear8);
 	if (sp->state&PLSTATE_INIT) {
 		if (tif->tif_mode == O_RDONLY)
 			inflateEnd(&sp->stream);
@@ -1307,8 +1363,8 @@ PixarLogCleanup(TIFF* tif)
 			deflateEnd(&sp->stream);
 	}
 	if (sp->tbuf)
-		_TIFFfree(sp->tbuf);
-	_TIFFfree(sp);
+		_TIFFfreeExt(tif, sp->tbuf);
+	_TIFFfreeExt(tif, sp);
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -1421,11 +1477,14 @@ TIFFInitPixarLog(TIFF* tif, int scheme)
 	/*
 	 * Allocate state block so tag methods have storage to record values.
 	 */
-	tif->tif_data = (uint8*) _TIFFmalloc(sizeof (PixarLogState));
+	tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof (PixarLogState));
 	if (tif->tif_data == NULL)
 		goto bad;
 	sp = (PixarLogState*) tif->tif_data;
 	_TIFFmemset(sp, 0, sizeof (*sp));
+	sp->stream.zalloc = PixarLogAlloc;
+	sp->stream.zfree = PixarLogFree;
+	sp->stream.opaque = (voidpf) tif;
 	sp->stream.data_type = Z_BINARY;
 	sp->user_datafmt = PIXARLOGDATAFMT_UNKNOWN;
 
@@ -1465,7 +1524,7 @@ TIFFInitPixarLog(TIFF* tif, int scheme)
 	/*
 	 * build the companding tables 
 	 */
-	PixarLogMakeTables(sp);
+	PixarLogMakeTables(tif, sp);
 
 	return (1);
 bad:
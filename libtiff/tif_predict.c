@@ -425,7 +425,7 @@ fpAcc(TIFF* tif, uint8* cp0, tmsize_t cc)
         return 0;
     }
 
-    tmp = (uint8 *)_TIFFmalloc(cc);
+    tmp = (uint8 *)_TIFFBufferGet(tif, cc);
 	if (!tmp)
 		return 0;
 
@@ -448,7 +448,7 @@ fpAcc(TIFF* tif, uint8* cp0, tmsize_t cc)
 			#endif
 		}
 	}
-	_TIFFfree(tmp);
+	_TIFFBufferPut(tif, tmp);
     return 1;
 }
 
@@ -661,7 +661,7 @@ fpDiff(TIFF* tif, uint8* cp0, tmsize_t cc)
         return 0;
     }
 
-    tmp = (uint8 *)_TIFFmalloc(cc);
+    tmp = (uint8 *)_TIFFBufferGet(tif, cc);
 	if (!tmp)
 		return 0;
 
@@ -677,7 +677,7 @@ fpDiff(TIFF* tif, uint8* cp0, tmsize_t cc)
 			#endif
 		}
 	}
-	_TIFFfree(tmp);
+	_TIFFBufferPut(tif, tmp);
 
 	cp = (uint8 *) cp0;
 	cp += cc - stride - 1;
@@ -719,7 +719,7 @@ PredictorEncodeTile(TIFF* tif, uint8* bp0, tmsize_t cc0, uint16 s)
          * Do predictor manipulation in a working buffer to avoid altering
          * the callers buffer. http://trac.osgeo.org/gdal/ticket/1965
          */
-        working_copy = (uint8*) _TIFFmalloc(cc0);
+        working_copy = (uint8*) _TIFFBufferGet(tif, cc0);
         if( working_copy == NULL )
         {
             TIFFErrorExt(tif->tif_clientdata, module, 
@@ -736,7 +736,7 @@ PredictorEncodeTile(TIFF* tif, uint8* bp0, tmsize_t cc0, uint16 s)
     {
         TIFFErrorExt(tif->tif_clientdata, "PredictorEncodeTile",
                      "%s", "(cc0%rowsize)!=0");
-        _TIFFfree( working_copy );
+        _TIFFBufferPut(tif, working_copy );
         return 0;
     }
 	while (cc > 0) {
@@ -746,7 +746,7 @@ PredictorEncodeTile(TIFF* tif, uint8* bp0, tmsize_t cc0, uint16 s)
 	}
 	result_code = (*sp->encodetile)(tif, working_copy, cc0, s);
 
-        _TIFFfree( working_copy );
+        _TIFFBufferPut(tif, working_copy );
 
         return result_code;
 }
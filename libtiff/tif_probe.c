@@ -0,0 +1,388 @@
+/* $Id$ */
+
+/*
+ * TIFF Library.
+ *
+ * Probing: the basic description of every directory of a file, read from
+ * the directory entries alone.  Nothing is set up for reading the image:
+ * no field tables, no tag values beyond the first one of the few tags
+ * looked at, no strip/tile arrays, no codec.  Each directory usually
+ * costs a single read.
+ */
+#include "tiffiop.h"
+
+#define	TIFF_PROBE_CHUNK	4096	/* read at each directory offset */
+
+/*
+ * Read up to size bytes at off, fewer at the end of the file.
+ */
+static tmsize_t
+_tiffProbeRead(TIFF* tif, uint64 off, void* buf, tmsize_t size)
+{
+	if (isMapped(tif)) {
+		if (off >= (uint64) tif->tif_size)
+			return (0);
+		if ((uint64) size > (uint64) tif->tif_size - off)
+			size = (tmsize_t) ((uint64) tif->tif_size - off);
+		_TIFFmemcpy(buf, tif->tif_base + off, size);
+		return (size);
+	}
+	if (!SeekOK(tif, off))
+		return ((tmsize_t) -1);
+	return (TIFFReadFile(tif, buf, size));
+}
+
+static uint16
+_tiffProbeShort(TIFF* tif, const uint8* p)
+{
+	uint16 v;
+
+	_TIFFmemcpy(&v, p, 2);
+	if (tif->tif_flags & TIFF_SWAB)
+		TIFFSwabShort(&v);
+	return (v);
+}
+
+static uint32
+_tiffProbeLong(TIFF* tif, const uint8* p)
+{
+	uint32 v;
+
+	_TIFFmemcpy(&v, p, 4);
+	if (tif->tif_flags & TIFF_SWAB)
+		TIFFSwabLong(&v);
+	return (v);
+}
+
+static uint64
+_tiffProbeLong8(TIFF* tif, const uint8* p)
+{
+	uint64 v;
+
+	_TIFFmemcpy(&v, p, 8);
+	if (tif->tif_flags & TIFF_SWAB)
+		TIFFSwabLong8(&v);
+	return (v);
+}
+
+/*
+ * First value of the unsigned integer entry at p.  It is only read from
+ * the file when the values do not fit in the entry.
+ */
+static int
+_tiffProbeValue(TIFF* tif, const uint8* p, uint64* value)
+{
+	int big = (tif->tif_flags & TIFF_BIGTIFF) != 0;
+	const uint8* v = p + (big ? 12 : 8);
+	uint64 count, fieldsize = big ? 8 : 4;
+	uint8 buf[8];
+	int size;
+
+	switch (_tiffProbeShort(tif, p + 2)) {
+	case TIFF_BYTE:
+		size = 1;
+		break;
+	case TIFF_SHORT:
+		size = 2;
+		break;
+	case TIFF_LONG:
+	case TIFF_IFD:
+		size = 4;
+		break;
+	case TIFF_LONG8:
+	case TIFF_IFD8:
+		size = 8;
+		break;
+	default:
+		return (0);
+	}
+	count = big ? _tiffProbeLong8(tif, p + 4) : _tiffProbeLong(tif, p + 4);
+	if (count == 0)
+		return (0);
+	if (count > fieldsize / (uint64) size) {
+		uint64 off = big ? _tiffProbeLong8(tif, v)
+		    : _tiffProbeLong(tif, v);
+		if (_tiffProbeRead(tif, off, buf, size) != size)
+			return (0);
+		v = buf;
+	}
+	switch (size) {
+	case 1:
+		*value = *v;
+		break;
+	case 2:
+		*value = _tiffProbeShort(tif, v);
+		break;
+	case 4:
+		*value = _tiffProbeLong(tif, v);
+		break;
+	default:
+		*value = _tiffProbeLong8(tif, v);
+		break;
+	}
+	return (1);
+}
+
+static void
+_tiffProbeEntries(TIFF* tif, const uint8* entries, uint64 count,
+		  TIFFProbeDirectory* dir)
+{
+	tmsize_t entrysize = (tif->tif_flags & TIFF_BIGTIFF) ? 20 : 12;
+	uint64 n, value;
+
+	dir->width = 0;
+	dir->length = 0;
+	dir->tilewidth = 0;
+	dir->tilelength = 0;
+	dir->rowsperstrip = (uint32) -1;
+	dir->subfiletype = 0;
+	dir->bitspersample = 1;
+	dir->samplesperpixel = 1;
+	dir->sampleformat = SAMPLEFORMAT_UINT;
+	dir->compression = COMPRESSION_NONE;
+	dir->photometric = (uint16) -1;
+	dir->planarconfig = PLANARCONFIG_CONTIG;
+	for (n = 0; n < count; n++) {
+		const uint8* p = entries + n * entrysize;
+		uint16 tag = _tiffProbeShort(tif, p);
+
+		switch (tag) {
+		case TIFFTAG_SUBFILETYPE:
+		case TIFFTAG_IMAGEWIDTH:
+		case TIFFTAG_IMAGELENGTH:
+		case TIFFTAG_BITSPERSAMPLE:
+		case TIFFTAG_COMPRESSION:
+		case TIFFTAG_PHOTOMETRIC:
+		case TIFFTAG_SAMPLESPERPIXEL:
+		case TIFFTAG_ROWSPERSTRIP:
+		case TIFFTAG_PLANARCONFIG:
+		case TIFFTAG_TILEWIDTH:
+		case TIFFTAG_TILELENGTH:
+		case TIFFTAG_SAMPLEFORMAT:
+			break;
+		default:
+			continue;
+		}
+		if (!_tiffProbeValue(tif, p, &value))
+			continue;
+		switch (tag) {
+		case TIFFTAG_SUBFILETYPE:
+			dir->subfiletype = (uint32) value;
+			break;
+		case TIFFTAG_IMAGEWIDTH:
+			dir->width = (uint32) value;
+			break;
+		case TIFFTAG_IMAGELENGTH:
+			dir->length = (uint32) value;
+			break;
+		case TIFFTAG_BITSPERSAMPLE:
+			dir->bitspersample = (uint16) value;
+			break;
+		case TIFFTAG_COMPRESSION:
+			dir->compression = (uint16) value;
+			break;
+		case TIFFTAG_PHOTOMETRIC:
+			dir->photometric = (uint16) value;
+			break;
+		case TIFFTAG_SAMPLESPERPIXEL:
+			dir->samplesperpixel = (uint16) value;
+			break;
+		case TIFFTAG_ROWSPERSTRIP:
+			dir->rowsperstrip = (uint32) value;
+			break;
+		case TIFFTAG_PLANARCONFIG:
+			dir->planarconfig = (uint16) value;
+			break;
+		case TIFFTAG_TILEWIDTH:
+			dir->tilewidth = (uint32) value;
+			break;
+		case TIFFTAG_TILELENGTH:
+			dir->tilelength = (uint32) value;
+			break;
+		case TIFFTAG_SAMPLEFORMAT:
+			dir->sampleformat = (uint16) value;
+			break;
+		}
+	}
+	if (dir->tilewidth == 0 || dir->tilelength == 0)
+		dir->tilewidth = dir->tilelength = 0;
+}
+
+/*
+ * Read the directory at off, describe it in dir unless NULL, and return
+ * the offset of the next one in *nextoff.
+ */
+static int
+_tiffProbeDirectory(TIFF* tif, uint64 off, TIFFProbeDirectory* dir,
+		    uint64* nextoff)
+{
+	static const char module[] = "TIFFProbeDirectories";
+	int big = (tif->tif_flags & TIFF_BIGTIFF) != 0;
+	tmsize_t countsize = big ? 8 : 2;
+	tmsize_t entrysize = big ? 20 : 12;
+	tmsize_t offsize = big ? 8 : 4;
+	uint8 chunk[TIFF_PROBE_CHUNK];
+	uint8* buf = chunk;
+	tmsize_t got, total;
+	uint64 count;
+
+	got = _tiffProbeRead(tif, off, chunk, sizeof (chunk));
+	if (got < countsize) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: Cannot read directory count at offset " TIFF_UINT64_FORMAT,
+		    tif->tif_name, off);
+		return (0);
+	}
+	count = big ? _tiffProbeLong8(tif, chunk) : _tiffProbeShort(tif, chunk);
+	if (big && count > 4096) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: Sanity check on directory count failed",
+		    tif->tif_name);
+		return (0);
+	}
+	total = countsize + (tmsize_t) count * entrysize + offsize;
+	if (total > got) {
+		if (got < (tmsize_t) sizeof (chunk)) {
+			TIFFErrorExt(tif->tif_clientdata, module,
+			    "%s: Directory at offset " TIFF_UINT64_FORMAT
+			    " is truncated", tif->tif_name, off);
+			return (0);
+		}
+		buf = (uint8*) _TIFFmallocExt(tif, total);
+		if (buf == NULL) {
+			TIFFErrorExt(tif->tif_clientdata, module,
+			    "%s: Out of memory (directory)", tif->tif_name);
+			return (0);
+		}
+		_TIFFmemcpy(buf, chunk, got);
+		if (_tiffProbeRead(tif, off + (uint64) got, buf + got,
+				   total - got) != total - got) {
+			TIFFErrorExt(tif->tif_clientdata, module,
+			    "%s: Directory at offset " TIFF_UINT64_FORMAT
+			    " is truncated", tif->tif_name, off);
+			_TIFFfreeExt(tif, buf);
+			return (0);
+		}
+	}
+	if (dir != NULL) {
+		dir->offset = off;
+		_tiffProbeEntries(tif, buf + countsize, count, dir);
+	}
+	*nextoff = big ? _tiffProbeLong8(tif, buf + total - offsize)
+	    : _tiffProbeLong(tif, buf + total - offsize);
+	if (buf != chunk)
+		_TIFFfreeExt(tif, buf);
+	return (1);
+}
+
+/*
+ * Insert off in the sorted list of directory offsets already seen;
+ * return 0 if it is there already.
+ */
+static int
+_tiffProbeSeen(uint64* seen, tdir_t n, uint64 off)
+{
+	tdir_t lo = 0, hi = n;
+
+	while (lo < hi) {
+		tdir_t mid = (tdir_t) ((lo + hi) / 2);
+		if (seen[mid] == off)
+			return (0);
+		if (seen[mid] < off)
+			lo = (tdir_t) (mid + 1);
+		else
+			hi = mid;
+	}
+	memmove(seen + lo + 1, seen + lo, (n - lo) * sizeof (uint64));
+	seen[lo] = off;
+	return (1);
+}
+
+/*
+ * Describe the first maxdirs directories of the main chain of tif in
+ * dirs, and return the number of directories in *ndirs.  The current
+ * directory of tif is left alone, and tif may have been opened with the
+ * ``h'' mode flag.  A directory that cannot be read ends the chain with
+ * a warning, unless it is the first one.
+ */
+int
+TIFFProbeDirectories(TIFF* tif, TIFFProbeDirectory* dirs, tdir_t maxdirs,
+		     tdir_t* ndirs)
+{
+	static const char module[] = "TIFFProbeDirectories";
+	uint64 off, nextoff;
+	uint64* seen = NULL;
+	uint32 maxseen = 0;
+	tdir_t n = 0;
+
+	off = (tif->tif_flags & TIFF_BIGTIFF) ? tif->tif_header.big.tiff_diroff
+	    : tif->tif_header.classic.tiff_diroff;
+	while (off != 0 && n < 65535) {
+		if (n == maxseen) {
+			uint64* p;
+			maxseen = maxseen ? 2 * maxseen : 8;
+			p = (uint64*) _TIFFreallocExt(tif, seen,
+			    (tmsize_t) (maxseen * sizeof (uint64)));
+			if (p == NULL) {
+				TIFFErrorExt(tif->tif_clientdata, module,
+				    "%s: Out of memory (directory list)",
+				    tif->tif_name);
+				break;
+			}
+			seen = p;
+		}
+		/* seen holds the offsets of the n directories read */
+		if (!_tiffProbeSeen(seen, n, off)) {
+			TIFFWarningExt(tif->tif_clientdata, module,
+			    "%s: Directory loop at offset " TIFF_UINT64_FORMAT,
+			    tif->tif_name, off);
+			break;
+		}
+		if (!_tiffProbeDirectory(tif, off,
+					 n < maxdirs ? &dirs[n] : NULL,
+					 &nextoff)) {
+			if (n > 0)
+				TIFFWarningExt(tif->tif_clientdata, module,
+				    "%s: Directories after %u are not readable",
+				    tif->tif_name, (unsigned) n - 1);
+			break;
+		}
+		n++;
+		off = nextoff;
+	}
+	_TIFFfreeExt(tif, seen);
+	*ndirs = n;
+	if (n == 0) {
+		TIFFErrorExt(tif->tif_clientdata, module,
+		    "%s: No readable directory", tif->tif_name);
+		return (0);
+	}
+	return (1);
+}
+
+/*
+ * TIFFProbeDirectories() on the named file.
+ */
+int
+TIFFProbeFile(const char* name, TIFFProbeDirectory* dirs, tdir_t maxdirs,
+	      tdir_t* ndirs)
+{
+	TIFF* tif;
+	int ok;
+
+	tif = TIFFOpen(name, "rhm");
+	if (tif == NULL)
+		return (0);
+	ok = TIFFProbeDirectories(tif, dirs, maxdirs, ndirs);
+	TIFFClose(tif);
+	return (ok);
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 8
+ * fill-column: 78
+ * End:
+ */
@@ -0,0 +1,562 @@
+/* $Id$ */
+
+/*
+ * TIFF Library.
+ *
+ * Read-only access to files through a range reading procedure, for files
+ * living behind a network protocol or an object store where every read
+ * is a round trip.  Reads go through a cache of fixed size blocks with
+ * least recently used eviction; neighbouring missing blocks are fetched
+ * with a single request, and sequential access reads ahead.
+ *
+ * The cache belongs to a source which several handles can read at
+ * their own positions, see tif_dataset.c.  The lock guarding the cache
+ * is released while the read procedure runs: the blocks being fetched
+ * are reserved, so that other handles neither evict nor fetch them
+ * again, and filled once the data has arrived.
+ */
+#include "tiffiop.h"
+
+#define	TIFF_RANGE_BLOCKSIZE	16384	/* default block size */
+#define	TIFF_RANGE_MAXBLOCKS	64	/* default number of cached blocks */
+#define	TIFF_RANGE_READAHEAD	8	/* default blocks read ahead */
+#define	TIFF_RANGE_NOBLOCK	(~(uint64)0)
+
+typedef struct {
+	uint64		block;		/* block number or TIFF_RANGE_NOBLOCK */
+	tmsize_t	len;		/* valid bytes, less at end of file */
+	uint32		lastuse;	/* clock value of the last access */
+	void*		fetcher;	/* handle fetching the block, if any */
+	uint8*		data;		/* allocated on first use */
+} TIFFRangeBlock;
+
+struct TIFFRangeSource {
+	thandle_t	handle;		/* client handle for the procedures */
+	TIFFRangeReadProc readproc;
+	TIFFCloseProc	closeproc;
+	TIFFLockProc	lockproc;	/* guard the cache, if set */
+	TIFFLockProc	unlockproc;
+	void*		lockdata;
+	int		refcount;	/* open handles and owner */
+	uint64		size;		/* file size */
+	tmsize_t	blocksize;
+	int		nblocks;	/* cache capacity */
+	int		readahead;	/* max blocks read ahead */
+	uint32		clock;
+	TIFFRangeBlock*	blocks;
+};
+
+/* Client handle of a TIFF opened on a source */
+typedef struct {
+	TIFFRangeSource* src;
+	uint64		pos;		/* current file position */
+	uint64		nextblock;	/* block after the end of the last read */
+	uint8*		scratch;	/* landing buffer of fetches */
+	tmsize_t	scratchsize;
+} TIFFRangeFile;
+
+static void
+_tiffRangeLock(TIFFRangeSource* src)
+{
+	if (src->lockproc != NULL)
+		(*src->lockproc)(src->lockdata);
+}
+
+static void
+_tiffRangeUnlock(TIFFRangeSource* src)
+{
+	if (src->unlockproc != NULL)
+		(*src->unlockproc)(src->lockdata);
+}
+
+static TIFFRangeBlock*
+_tiffRangeFind(TIFFRangeSource* src, uint64 block)
+{
+	int i;
+
+	for (i = 0; i < src->nblocks; i++)
+		if (src->blocks[i].block == block)
+			return (&src->blocks[i]);
+	return (NULL);
+}
+
+/*
+ * The least recently used block, leaving out those being fetched and
+ * those used by the read in progress (tagged with the current clock
+ * value).
+ */
+static TIFFRangeBlock*
+_tiffRangeVictim(TIFFRangeSource* src)
+{
+	TIFFRangeBlock* victim = NULL;
+	int i;
+
+	for (i = 0; i < src->nblocks; i++) {
+		TIFFRangeBlock* b = &src->blocks[i];
+		if (b->block == TIFF_RANGE_NOBLOCK)
+			return (b);
+		if (b->fetcher == NULL && b->lastuse != src->clock
+		    && (victim == NULL || b->lastuse < victim->lastuse))
+			victim = b;
+	}
+	return (victim);
+}
+
+/*
+ * Fetch count blocks from first on into the scratch buffer of rf with a
+ * single request, and store the missing ones in the cache.  Called with
+ * the source locked; the lock is released during the request.  Return
+ * the number of bytes read, or -1.
+ */
+static tmsize_t
+_tiffRangeFetch(TIFFRangeFile* rf, uint64 first, uint64 count)
+{
+	TIFFRangeSource* src = rf->src;
+	uint64 offset = first * (uint64) src->blocksize;
+	uint64 want64 = count * (uint64) src->blocksize;
+	uint64 n;
+	tmsize_t want, got;
+
+	if (want64 > src->size - offset)
+		want64 = src->size - offset;
+	want = (tmsize_t) want64;
+	if (want > rf->scratchsize) {
+		uint8* p = (uint8*) _TIFFrealloc(rf->scratch, want);
+		if (p == NULL)
+			return ((tmsize_t) -1);
+		rf->scratch = p;
+		rf->scratchsize = want;
+	}
+
+	/*
+	 * Reserve the blocks missing from the cache.  Those being fetched
+	 * by another handle are read again rather than waited for.
+	 */
+	for (n = 0; n < count; n++) {
+		TIFFRangeBlock* b;
+
+		if (_tiffRangeFind(src, first + n) != NULL)
+			continue;
+		b = _tiffRangeVictim(src);
+		if (b == NULL)
+			break;
+		if (b->data == NULL) {
+			b->data = (uint8*) _TIFFmalloc(src->blocksize);
+			if (b->data == NULL)
+				break;
+		}
+		b->block = first + n;
+		b->len = 0;
+		b->lastuse = src->clock;
+		b->fetcher = rf;
+	}
+
+	_tiffRangeUnlock(src);
+	got = (*src->readproc)(src->handle, offset, rf->scratch, want);
+	_tiffRangeLock(src);
+
+	for (n = 0; n < count; n++) {
+		TIFFRangeBlock* b = _tiffRangeFind(src, first + n);
+		tmsize_t done = (tmsize_t) n * src->blocksize;
+
+		if (b == NULL || b->fetcher != rf)
+			continue;
+		b->fetcher = NULL;
+		/*
+		 * A short block stands for the end of the file; one cut
+		 * short by the read procedure is returned but not kept.
+		 */
+		if (got - done < src->blocksize
+		    && (got <= done || offset + (uint64) got < src->size)) {
+			b->block = TIFF_RANGE_NOBLOCK;
+			continue;
+		}
+		b->len = got - done < src->blocksize ? got - done : src->blocksize;
+		_TIFFmemcpy(b->data, rf->scratch + done, b->len);
+	}
+	return (got);
+}
+
+/*
+ * Copy the bytes at the position of rf from the len bytes of block,
+ * advancing the position.  Return 0 if the block holds none of them.
+ */
+static int
+_tiffRangeCopy(TIFFRangeFile* rf, void* buf, tmsize_t size, tmsize_t* done,
+	       uint64 block, const uint8* data, tmsize_t len)
+{
+	uint64 skip = rf->pos - block * (uint64) rf->src->blocksize;
+	tmsize_t n;
+
+	if (skip >= (uint64) len)
+		return (0);
+	n = len - (tmsize_t) skip;
+	if (n > size - *done)
+		n = size - *done;
+	_TIFFmemcpy((uint8*) buf + *done, data + skip, n);
+	*done += n;
+	rf->pos += (uint64) n;
+	return (1);
+}
+
+/*
+ * Read size bytes at the position of rf through the cache, with the
+ * source locked.
+ */
+static tmsize_t
+_tiffRangeReadCached(TIFFRangeFile* rf, void* buf, tmsize_t size,
+		     uint64 first, uint64 last)
+{
+	TIFFRangeSource* src = rf->src;
+	uint64 block, start, end;
+	tmsize_t done, got;
+	int i;
+
+	if (++src->clock == 0) {
+		for (i = 0; i < src->nblocks; i++)
+			src->blocks[i].lastuse = 0;
+		src->clock = 1;
+	}
+	for (block = first; block <= last; block++) {
+		TIFFRangeBlock* b = _tiffRangeFind(src, block);
+		if (b != NULL)
+			b->lastuse = src->clock;
+	}
+
+	/*
+	 * Copy the cached blocks, and fetch each run of the others at once.
+	 * Cached blocks may be evicted while a fetch is in progress, so
+	 * each block is looked up again when it is reached.
+	 */
+	for (done = 0, block = first; block <= last; ) {
+		TIFFRangeBlock* b = _tiffRangeFind(src, block);
+
+		if (b != NULL && b->fetcher == NULL) {
+			if (!_tiffRangeCopy(rf, buf, size, &done, block,
+					    b->data, b->len)
+			    || b->len < src->blocksize)
+				break;
+			block++;
+			continue;
+		}
+		start = block;
+		while (++block <= last) {
+			b = _tiffRangeFind(src, block);
+			if (b != NULL && b->fetcher == NULL)
+				break;
+		}
+		end = block;
+		/*
+		 * A read continuing the previous one is taken as sequential
+		 * access and extended beyond what was asked for.
+		 */
+		if (end > last && (first == rf->nextblock
+				   || first + 1 == rf->nextblock)) {
+			uint64 nfileblocks = (src->size + src->blocksize - 1)
+			    / (uint64) src->blocksize;
+			uint64 limit = end + (uint64) src->readahead;
+			if (limit > first + (uint64) src->nblocks)
+				limit = first + (uint64) src->nblocks;
+			if (limit > nfileblocks)
+				limit = nfileblocks;
+			while (end < limit && _tiffRangeFind(src, end) == NULL)
+				end++;
+		}
+		got = _tiffRangeFetch(rf, start, end - start);
+		if (got < 0)
+			return ((tmsize_t) -1);
+		for (end = start; end < block; end++) {
+			tmsize_t off = (tmsize_t) (end - start) * src->blocksize;
+			tmsize_t len;
+
+			if (off >= got)
+				return (done);
+			len = got - off < src->blocksize ? got - off
+			    : src->blocksize;
+			if (!_tiffRangeCopy(rf, buf, size, &done, end,
+					    rf->scratch + off, len)
+			    || len < src->blocksize)
+				return (done);
+		}
+	}
+	return (done);
+}
+
+static tmsize_t
+_tiffRangeReadProc(thandle_t h, void* buf, tmsize_t size)
+{
+	TIFFRangeFile* rf = (TIFFRangeFile*) h;
+	TIFFRangeSource* src = rf->src;
+	uint64 first, last;
+	tmsize_t got;
+
+	if (size <= 0 || rf->pos >= src->size)
+		return (0);
+	if ((uint64) size > src->size - rf->pos)
+		size = (tmsize_t) (src->size - rf->pos);
+	first = rf->pos / (uint64) src->blocksize;
+	last = (rf->pos + (uint64) size - 1) / (uint64) src->blocksize;
+
+	/*
+	 * Large reads would only flush the cache; they are passed through
+	 * as a single request.
+	 */
+	if (last - first + 1 > (uint64) (src->nblocks / 2)) {
+		got = (*src->readproc)(src->handle, rf->pos, buf, size);
+		if (got > 0) {
+			rf->pos += (uint64) got;
+			rf->nextblock = last + 1;
+		}
+		return (got);
+	}
+
+	_tiffRangeLock(src);
+	got = _tiffRangeReadCached(rf, buf, size, first, last);
+	_tiffRangeUnlock(src);
+	rf->nextblock = last + 1;
+	return (got);
+}
+
+static tmsize_t
+_tiffRangeWriteProc(thandle_t h, void* buf, tmsize_t size)
+{
+	(void) h; (void) buf; (void) size;
+	return ((tmsize_t) -1);
+}
+
+static uint64
+_tiffRangeSeekProc(thandle_t h, uint64 off, int whence)
+{
+	TIFFRangeFile* rf = (TIFFRangeFile*) h;
+
+	switch (whence) {
+	case SEEK_SET:
+		rf->pos = off;
+		break;
+	case SEEK_CUR:
+		rf->pos += off;
+		break;
+	case SEEK_END:
+		rf->pos = rf->src->size + off;
+		break;
+	default:
+		return ((uint64) -1);
+	}
+	return (rf->pos);
+}
+
+static int
+_tiffRangeCloseProc(thandle_t h)
+{
+	TIFFRangeFile* rf = (TIFFRangeFile*) h;
+	int ret = _TIFFRangeSourceRelease(rf->src, 1);
+
+	_TIFFfree(rf->scratch);
+	_TIFFfree(rf);
+	return (ret);
+}
+
+static uint64
+_tiffRangeSizeProc(thandle_t h)
+{
+	return (((TIFFRangeFile*) h)->src->size);
+}
+
+static int
+_tiffRangeMapProc(thandle_t h, void** base, toff_t* size)
+{
+	(void) h; (void) base; (void) size;
+	return (0);
+}
+
+static void
+_tiffRangeUnmapProc(thandle_t h, void* base, toff_t size)
+{
+	(void) h; (void) base; (void) size;
+}
+
+/*
+ * Create a source read through readproc, with a reference held by the
+ * caller.  Cache blocks are only allocated when they are first filled.
+ * Once a lock is set, readproc may be called from several threads at
+ * once.
+ */
+TIFFRangeSource*
+_TIFFRangeSourceNew(const char* module, const char* name, thandle_t handle,
+		    uint64 size, TIFFRangeReadProc readproc,
+		    TIFFCloseProc closeproc, TIFFOpenOptions* opts)
+{
+	TIFFRangeSource* src;
+	tmsize_t blocksize = TIFF_RANGE_BLOCKSIZE;
+	int nblocks = TIFF_RANGE_MAXBLOCKS;
+	int readahead = TIFF_RANGE_READAHEAD;
+	uint64 alloc, total;
+	int i;
+
+	if (readproc == NULL || closeproc == NULL) {
+		TIFFErrorExt(handle, module,
+			     "One of the client procedures is NULL pointer.");
+		return (NULL);
+	}
+	if (opts != NULL && opts->range_cache) {
+		if (opts->range_block_size > 0)
+			blocksize = opts->range_block_size;
+		if (opts->range_max_blocks > 0)
+			nblocks = opts->range_max_blocks;
+		if (opts->range_readahead >= 0)
+			readahead = opts->range_readahead;
+	}
+	if (nblocks < 2)
+		nblocks = 2;
+	if (readahead > nblocks / 2)
+		readahead = nblocks / 2;
+
+	alloc = (uint64) sizeof (TIFFRangeSource)
+	    + (uint64) nblocks * sizeof (TIFFRangeBlock);
+	total = alloc + (uint64) nblocks * (uint64) blocksize;
+	if ((uint64) (tmsize_t) total != total || (tmsize_t) total < 0) {
+		TIFFErrorExt(handle, module, "%s: Cache too large", name);
+		return (NULL);
+	}
+	src = (TIFFRangeSource*) _TIFFmalloc((tmsize_t) alloc);
+	if (src == NULL) {
+		TIFFErrorExt(handle, module, "%s: Out of memory (block cache)",
+			     name);
+		return (NULL);
+	}
+	_TIFFmemset(src, 0, sizeof (TIFFRangeSource));
+	src->handle = handle;
+	src->readproc = readproc;
+	src->closeproc = closeproc;
+	src->refcount = 1;
+	src->size = size;
+	src->blocksize = blocksize;
+	src->nblocks = nblocks;
+	src->readahead = readahead;
+	src->blocks = (TIFFRangeBlock*) (src + 1);
+	for (i = 0; i < nblocks; i++) {
+		src->blocks[i].block = TIFF_RANGE_NOBLOCK;
+		src->blocks[i].lastuse = 0;
+		src->blocks[i].len = 0;
+		src->blocks[i].fetcher = NULL;
+		src->blocks[i].data = NULL;
+	}
+	return (src);
+}
+
+void
+_TIFFRangeSourceSetLock(TIFFRangeSource* src, TIFFLockProc lockproc,
+			TIFFLockProc unlockproc, void* lockdata)
+{
+	if (lockproc == NULL || unlockproc == NULL) {
+		lockproc = NULL;
+		unlockproc = NULL;
+		lockdata = NULL;
+	}
+	src->lockproc = lockproc;
+	src->unlockproc = unlockproc;
+	src->lockdata = lockdata;
+}
+
+/*
+ * Drop a reference to src.  The last one frees it, and closes the client
+ * handle if closefile is set; the value of the close procedure is
+ * returned.
+ */
+int
+_TIFFRangeSourceRelease(TIFFRangeSource* src, int closefile)
+{
+	int refcount, ret = 0, i;
+
+	_tiffRangeLock(src);
+	refcount = --src->refcount;
+	_tiffRangeUnlock(src);
+	if (refcount > 0)
+		return (0);
+	if (closefile)
+		ret = (*src->closeproc)(src->handle);
+	for (i = 0; i < src->nblocks; i++)
+		_TIFFfree(src->blocks[i].data);
+	_TIFFfree(src);
+	return (ret);
+}
+
+/*
+ * Open a read-only handle on src, reading at its own position.  The
+ * handle holds a reference to src until it is closed.
+ */
+TIFF*
+_TIFFRangeSourceOpen(TIFFRangeSource* src, const char* name,
+		     const char* mode, TIFFOpenOptions* opts)
+{
+	static const char module[] = "TIFFRangeOpen";
+	TIFFRangeFile* rf;
+	TIFF* tif;
+
+	if (_TIFFgetMode(mode, module) != O_RDONLY) {
+		TIFFErrorExt(src->handle, module,
+			     "%s: Only reading is supported", name);
+		return ((TIFF*) 0);
+	}
+	rf = (TIFFRangeFile*) _TIFFmalloc(sizeof (TIFFRangeFile));
+	if (rf == NULL) {
+		TIFFErrorExt(src->handle, module, "%s: Out of memory", name);
+		return ((TIFF*) 0);
+	}
+	rf->src = src;
+	rf->pos = 0;
+	rf->nextblock = 0;
+	rf->scratch = NULL;
+	rf->scratchsize = 0;
+	_tiffRangeLock(src);
+	src->refcount++;
+	_tiffRangeUnlock(src);
+
+	tif = TIFFClientOpenExt(name, mode, (thandle_t) rf,
+	    _tiffRangeReadProc, _tiffRangeWriteProc,
+	    _tiffRangeSeekProc, _tiffRangeCloseProc, _tiffRangeSizeProc,
+	    _tiffRangeMapProc, _tiffRangeUnmapProc, opts);
+	if (tif == NULL) {
+		_TIFFRangeSourceRelease(src, 0);
+		_TIFFfree(rf);
+	}
+	return (tif);
+}
+
+/*
+ * Open a file of the given size read through readproc.  closeproc is
+ * called on the handle by TIFFClose(); if the open fails the handle is
+ * left to the caller.
+ */
+TIFF*
+TIFFRangeOpen(const char* name, const char* mode, thandle_t handle,
+	      uint64 size, TIFFRangeReadProc readproc, TIFFCloseProc closeproc,
+	      TIFFOpenOptions* opts)
+{
+	static const char module[] = "TIFFRangeOpen";
+	TIFFRangeSource* src;
+	TIFF* tif;
+
+	if (_TIFFgetMode(mode, module) != O_RDONLY) {
+		TIFFErrorExt(handle, module, "%s: Only reading is supported",
+			     name);
+		return ((TIFF*) 0);
+	}
+	src = _TIFFRangeSourceNew(module, name, handle, size, readproc,
+				  closeproc, opts);
+	if (src == NULL)
+		return ((TIFF*) 0);
+	tif = _TIFFRangeSourceOpen(src, name, mode, opts);
+	/* The handle holds the only reference left, if opened */
+	_TIFFRangeSourceRelease(src, 0);
+	return (tif);
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
+/*
+ * Local Variables:
+ * mode: c
+ * c-basic-offset: 8
+ * fill-column: 78
+ * End:
+ */
@@ -136,6 +136,39 @@ _tiffSeekProc(thandle_t fd, uint64 off, int whence)
 	return((uint64)_TIFF_lseek_f(fdh.fd,off_io,whence));
 }
 
+/*
+ * Positional read, for handles sharing the descriptor, see
+ * TIFFDatasetOpen().
+ */
+static tmsize_t
+_tiffPreadProc(thandle_t fd, uint64 off, void* buf, tmsize_t size)
+{
+	fd_as_handle_union_t fdh;
+	const size_t bytes_total = (size_t) size;
+	size_t bytes_read;
+	tmsize_t count = -1;
+	if ((tmsize_t) bytes_total != size || (uint64) (_TIFF_off_t) off != off)
+	{
+		errno=EINVAL;
+		return (tmsize_t) -1;
+	}
+	fdh.h = fd;
+	for (bytes_read=0; bytes_read < bytes_total; bytes_read+=count)
+	{
+		char *buf_offset = (char *) buf+bytes_read;
+		size_t io_size = bytes_total-bytes_read;
+		if (io_size > TIFF_IO_MAX)
+			io_size = TIFF_IO_MAX;
+		count=pread(fdh.fd, buf_offset, (TIFFIOSize_t) io_size,
+			    (_TIFF_off_t) (off + bytes_read));
+		if (count <= 0)
+			break;
+	}
+	if (count < 0)
+		return (tmsize_t)-1;
+	return (tmsize_t) bytes_read;
+}
+
 static int
 _tiffCloseProc(thandle_t fd)
 {
@@ -203,16 +236,23 @@ _tiffUnmapProc(thandle_t fd, void* base, toff_t size)
  */
 TIFF*
 TIFFFdOpen(int fd, const char* name, const char* mode)
+{
+	return (TIFFFdOpenExt(fd, name, mode, NULL));
+}
+
+TIFF*
+TIFFFdOpenExt(int fd, const char* name, const char* mode,
+	      TIFFOpenOptions* opts)
 {
 	TIFF* tif;
 
 	fd_as_handle_union_t fdh;
 	fdh.fd = fd;
-	tif = TIFFClientOpen(name, mode,
+	tif = TIFFClientOpenExt(name, mode,
 	    fdh.h,
 	    _tiffReadProc, _tiffWriteProc,
 	    _tiffSeekProc, _tiffCloseProc, _tiffSizeProc,
-	    _tiffMapProc, _tiffUnmapProc);
+	    _tiffMapProc, _tiffUnmapProc, opts);
 	if (tif)
 		tif->tif_fd = fd;
 	return (tif);
@@ -223,6 +263,12 @@ TIFFFdOpen(int fd, const char* name, const char* mode)
  */
 TIFF*
 TIFFOpen(const char* name, const char* mode)
+{
+	return (TIFFOpenExt(name, mode, NULL));
+}
+
+TIFF*
+TIFFOpenExt(const char* name, const char* mode, TIFFOpenOptions* opts)
 {
 	static const char module[] = "TIFFOpen";
 	int m, fd;
@@ -247,12 +293,44 @@ TIFFOpen(const char* name, const char* mode)
 		return ((TIFF *)0);
 	}
 
-	tif = TIFFFdOpen((int)fd, name, mode);
+	tif = TIFFFdOpenExt((int)fd, name, mode, opts);
 	if(!tif)
 		close(fd);
 	return tif;
 }
 
+/*
+ * Open a file for reading as a dataset, see tif_dataset.c.
+ */
+TIFFDataset*
+TIFFDatasetOpen(const char* name, TIFFOpenOptions* opts)
+{
+	static const char module[] = "TIFFDatasetOpen";
+	fd_as_handle_union_t fdh;
+	TIFFDataset* ds;
+	int m = O_RDONLY;
+
+/* for cygwin and mingw */
+#ifdef O_BINARY
+	m |= O_BINARY;
+#endif
+
+	fdh.fd = open(name, m, 0);
+	if (fdh.fd < 0) {
+		if (errno > 0 && strerror(errno) != NULL ) {
+			TIFFErrorExt(0, module, "%s: %s", name, strerror(errno) );
+		} else {
+			TIFFErrorExt(0, module, "%s: Cannot open", name);
+		}
+		return ((TIFFDataset*)0);
+	}
+	ds = _TIFFDatasetOpen(name, fdh.h, _tiffSizeProc(fdh.h),
+	    _tiffPreadProc, _tiffCloseProc, opts);
+	if (!ds)
+		close(fdh.fd);
+	return ds;
+}
+
 #ifdef __WIN32__
 #include <windows.h>
 /*
@@ -260,6 +338,12 @@ TIFFOpen(const char* name, const char* mode)
  */
 TIFF*
 TIFFOpenW(const wchar_t* name, const char* mode)
+{
+	return (TIFFOpenWExt(name, mode, NULL));
+}
+
+TIFF*
+TIFFOpenWExt(const wchar_t* name, const char* mode, TIFFOpenOptions* opts)
 {
 	static const char module[] = "TIFFOpenW";
 	int m, fd;
@@ -296,8 +380,8 @@ TIFFOpenW(const wchar_t* name, const char* mode)
 				    NULL, NULL);
 	}
 
-	tif = TIFFFdOpen((int)fd, (mbname != NULL) ? mbname : "<unknown>",
-			 mode);
+	tif = TIFFFdOpenExt((int)fd, (mbname != NULL) ? mbname : "<unknown>",
+			    mode, opts);
 	
 	_TIFFfree(mbname);
 	
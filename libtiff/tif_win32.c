@@ -87,6 +87,46 @@ _tiffReadProc(thandle_t fd, void* buf, tmsize_t size)
 	return(p);
 }
 
+/*
+ * Positional read, for handles sharing the file handle, see
+ * TIFFDatasetOpen().
+ */
+static tmsize_t
+_tiffPreadProc(thandle_t fd, uint64 off, void* buf, tmsize_t size)
+{
+	uint8* ma;
+	uint64 mb;
+	DWORD n;
+	DWORD o;
+	tmsize_t p;
+	OVERLAPPED ov;
+	ma=(uint8*)buf;
+	mb=size;
+	p=0;
+	while (mb>0)
+	{
+		n=0x80000000UL;
+		if ((uint64)n>mb)
+			n=(DWORD)mb;
+		_TIFFmemset(&ov,0,sizeof(ov));
+		ov.Offset=(DWORD)off;
+		ov.OffsetHigh=(DWORD)(off>>32);
+		if (!ReadFile(fd,(LPVOID)ma,n,&o,&ov))
+		{
+			if (GetLastError()==ERROR_HANDLE_EOF)
+				break;
+			return((tmsize_t)-1);
+		}
+		ma+=o;
+		mb-=o;
+		p+=o;
+		off+=o;
+		if (o!=n)
+			break;
+	}
+	return(p);
+}
+
 static tmsize_t
 _tiffWriteProc(thandle_t fd, void* buf, tmsize_t size)
 {
@@ -226,6 +266,13 @@ _tiffUnmapProc(thandle_t fd, void* base, toff_t size)
  */
 TIFF*
 TIFFFdOpen(int ifd, const char* name, const char* mode)
+{
+	return (TIFFFdOpenExt(ifd, name, mode, NULL));
+}
+
+TIFF*
+TIFFFdOpenExt(int ifd, const char* name, const char* mode,
+	      TIFFOpenOptions* opts)
 {
 	TIFF* tif;
 	int fSuppressMap;
@@ -239,11 +286,12 @@ TIFFFdOpen(int ifd, const char* name, const char* mode)
 			break;
 		}
 	}
-	tif = TIFFClientOpen(name, mode, (thandle_t)ifd, /* FIXME: WIN64 cast to pointer warning */
+	tif = TIFFClientOpenExt(name, mode, (thandle_t)ifd, /* FIXME: WIN64 cast to pointer warning */
 			_tiffReadProc, _tiffWriteProc,
 			_tiffSeekProc, _tiffCloseProc, _tiffSizeProc,
 			fSuppressMap ? _tiffDummyMapProc : _tiffMapProc,
-			fSuppressMap ? _tiffDummyUnmapProc : _tiffUnmapProc);
+			fSuppressMap ? _tiffDummyUnmapProc : _tiffUnmapProc,
+			opts);
 	if (tif)
 		tif->tif_fd = ifd;
 	return (tif);
@@ -256,6 +304,12 @@ TIFFFdOpen(int ifd, const char* name, const char* mode)
  */
 TIFF*
 TIFFOpen(const char* name, const char* mode)
+{
+	return (TIFFOpenExt(name, mode, NULL));
+}
+
+TIFF*
+TIFFOpenExt(const char* name, const char* mode, TIFFOpenOptions* opts)
 {
 	static const char module[] = "TIFFOpen";
 	thandle_t fd;
@@ -284,17 +338,48 @@ TIFFOpen(const char* name, const char* mode)
 		return ((TIFF *)0);
 	}
 
-	tif = TIFFFdOpen((int)fd, name, mode);   /* FIXME: WIN64 cast from pointer to int warning */
+	tif = TIFFFdOpenExt((int)fd, name, mode, opts);   /* FIXME: WIN64 cast from pointer to int warning */
 	if(!tif)
 		CloseHandle(fd);
 	return tif;
 }
 
+/*
+ * Open a file for reading as a dataset, see tif_dataset.c.
+ */
+TIFFDataset*
+TIFFDatasetOpen(const char* name, TIFFOpenOptions* opts)
+{
+	static const char module[] = "TIFFDatasetOpen";
+	thandle_t fd;
+	TIFFDataset* ds;
+
+	fd = (thandle_t)CreateFileA(name, GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_READONLY, NULL);
+	if (fd == INVALID_HANDLE_VALUE) {
+		TIFFErrorExt(0, module, "%s: Cannot open", name);
+		return ((TIFFDataset *)0);
+	}
+
+	ds = _TIFFDatasetOpen(name, fd, _tiffSizeProc(fd),
+	    _tiffPreadProc, _tiffCloseProc, opts);
+	if(!ds)
+		CloseHandle(fd);
+	return ds;
+}
+
 /*
  * Open a TIFF file with a Unicode filename, for read/writing.
  */
 TIFF*
 TIFFOpenW(const wchar_t* name, const char* mode)
+{
+	return (TIFFOpenWExt(name, mode, NULL));
+}
+
+TIFF*
+TIFFOpenWExt(const wchar_t* name, const char* mode, TIFFOpenOptions* opts)
 {
 	static const char module[] = "TIFFOpenW";
 	thandle_t fd;
@@ -339,8 +424,8 @@ TIFFOpenW(const wchar_t* name, const char* mode)
 				    NULL, NULL);
 	}
 
-	tif = TIFFFdOpen((int)fd,    /* FIXME: WIN64 cast from pointer to int warning */
-			 (mbname != NULL) ? mbname : "<unknown>", mode);
+	tif = TIFFFdOpenExt((int)fd,    /* FIXME: WIN64 cast from pointer to int warning */
+			 (mbname != NULL) ? mbname : "<unknown>", mode, opts);
 	if(!tif)
 		CloseHandle(fd);
 
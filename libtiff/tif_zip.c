@@ -86,6 +86,25 @@ typedef struct {
 static int ZIPEncode(TIFF* tif, uint8* bp, tmsize_t cc, uint16 s);
 static int ZIPDecode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s);
 
+/*
+ * zlib allocation hooks: route the inflate/deflate working storage
+ * through the allocator of the handle that owns the stream.
+ */
+static voidpf
+ZIPAlloc(voidpf opaque, uInt items, uInt size)
+{
+	if (size != 0 && items > ((uInt) ~ (uInt) 0) / size)
+		return (Z_NULL);
+	return ((voidpf) _TIFFmallocExt((TIFF*) opaque,
+	    (tmsize_t) items * (tmsize_t) size));
+}
+
+static void
+ZIPFree(voidpf opaque, voidpf ptr)
+{
+	_TIFFfreeExt((TIFF*) opaque, ptr);
+}
+
 static int
 ZIPFixupTags(TIFF* tif)
 {
@@ -347,7 +366,7 @@ ZIPCleanup(TIFF* tif)
 		inflateEnd(&sp->stream);
 		sp->state = 0;
 	}
-	_TIFFfree(sp);
+	_TIFFfreeExt(tif, sp);
 	tif->tif_data = NULL;
 
 	_TIFFSetDefaultCompressionState(tif);
@@ -417,13 +436,13 @@ TIFFInitZIP(TIFF* tif, int scheme)
 	/*
 	 * Allocate state block so tag methods have storage to record values.
 	 */
-	tif->tif_data = (uint8*) _TIFFmalloc(sizeof (ZIPState));
+	tif->tif_data = (uint8*) _TIFFmallocExt(tif, sizeof (ZIPState));
 	if (tif->tif_data == NULL)
 		goto bad;
 	sp = ZState(tif);
-	sp->stream.zalloc = NULL;
-	sp->stream.zfree = NULL;
-	sp->stream.opaque = NULL;
+	sp->stream.zalloc = ZIPAlloc;
+	sp->stream.zfree = ZIPFree;
+	sp->stream.opaque = (voidpf) tif;
 	sp->stream.data_type = Z_BINARY;
 
 	/*
@@ -603,6 +603,10 @@ typedef enum {
 #define TIFFTAG_PERSAMPLE       65563	/* interface for per sample tags */
 #define     PERSAMPLE_MERGED        0	/* present as a single value */
 #define     PERSAMPLE_MULTI         1	/* present as multiple values */
+#define	TIFFTAG_JPEGSCALEDENOM		65564	/* JPEG reduced resolution decoding */
+/* Note: one of 1 (default, full resolution), 2, 4 or 8 */
+#define	TIFFTAG_LZMATHREADS		65565	/* LZMA2 encoder/decoder threads */
+/* Note: 1 (default) is single-threaded, 0 uses one thread per CPU */
 
 /*
  * EXIF tags
@@ -255,6 +255,22 @@ typedef struct {
 	TIFFInitMethod init;
 } TIFFCodec;
 
+/*
+ * Codec capabilities, as returned by TIFFGetCODECCapabilities().
+ */
+#define TIFFCODEC_DECODE	0x0001	/* data can be decoded */
+#define TIFFCODEC_ENCODE	0x0002	/* data can be encoded */
+#define TIFFCODEC_ROWDECODE	0x0004	/* scanline (partial) decoding */
+#define TIFFCODEC_THREADSAFE	0x0008	/* TIFF handles decode concurrently */
+#define TIFFCODEC_REDUCEDRES	0x0010	/* reduced resolution decoding */
+#define TIFFCODEC_MULTITHREAD	0x0020	/* uses threads within a strip/tile */
+
+/*
+ * Entry point of a codec plugin, see TIFFLoadCODECPlugins().
+ */
+#define TIFFCODEC_PLUGIN_INIT	"TIFFCodecPluginInit"
+typedef int (*TIFFCodecPluginInitMethod)(void);
+
 #include <stdio.h>
 #include <stdarg.h>
 
@@ -278,15 +294,60 @@ typedef int (*TIFFCloseProc)(thandle_t);
 typedef toff_t (*TIFFSizeProc)(thandle_t);
 typedef int (*TIFFMapFileProc)(thandle_t, void** base, toff_t* size);
 typedef void (*TIFFUnmapFileProc)(thandle_t, void* base, toff_t size);
+typedef tmsize_t (*TIFFRangeReadProc)(thandle_t, uint64, void*, tmsize_t);
 typedef void (*TIFFExtendProc)(TIFF*);
+typedef void* (*TIFFArenaAllocProc)(void*, tmsize_t);
+typedef void (*TIFFArenaFreeProc)(void*, void*);
+typedef void* (*TIFFAllocProc)(void*, tmsize_t);
+typedef void* (*TIFFReallocProc)(void*, void*, tmsize_t);
+typedef void (*TIFFFreeProc)(void*, void*);
+typedef void (*TIFFLockProc)(void*);
+
+/*
+ * Options applying to a single TIFF handle, see TIFFOpenExt().
+ */
+typedef struct TIFFOpenOptions TIFFOpenOptions;
+
+/*
+ * Parsed directory kept aside, see TIFFSnapshotDirectory().
+ */
+typedef struct TIFFDirSnapshot TIFFDirSnapshot;
+
+/*
+ * Directories of a file read through handles sharing one file
+ * descriptor and block cache, see TIFFDatasetOpen().
+ */
+typedef struct TIFFDataset TIFFDataset;
+
+/*
+ * Basic description of a directory, see TIFFProbeDirectories().
+ */
+typedef struct {
+	uint64	offset;			/* file offset of the directory */
+	uint32	width;
+	uint32	length;
+	uint32	tilewidth;		/* 0 if the image is in strips */
+	uint32	tilelength;
+	uint32	rowsperstrip;
+	uint32	subfiletype;
+	uint16	bitspersample;
+	uint16	samplesperpixel;
+	uint16	sampleformat;
+	uint16	compression;
+	uint16	photometric;		/* (uint16) -1 if not set */
+	uint16	planarconfig;
+} TIFFProbeDirectory;
 
 extern const char* TIFFGetVersion(void);
 
 extern const TIFFCodec* TIFFFindCODEC(uint16);
 extern TIFFCodec* TIFFRegisterCODEC(uint16, const char*, TIFFInitMethod);
+extern TIFFCodec* TIFFRegisterCODECExt(uint16, const char*, TIFFInitMethod, uint32);
 extern void TIFFUnRegisterCODEC(TIFFCodec*);
 extern int TIFFIsCODECConfigured(uint16);
+extern uint32 TIFFGetCODECCapabilities(uint16);
 extern TIFFCodec* TIFFGetConfiguredCODECs(void);
+extern int TIFFLoadCODECPlugins(const char*);
 
 /*
  * Auxiliary functions.
@@ -300,6 +361,14 @@ extern void _TIFFmemcpy(void* d, const void* s, tmsize_t c);
 extern int _TIFFmemcmp(const void* p1, const void* p2, tmsize_t c);
 extern void _TIFFfree(void* p);
 
+/*
+ * Allocation on behalf of a TIFF handle; tif may be NULL.
+ */
+extern void* _TIFFmallocExt(TIFF* tif, tmsize_t s);
+extern void* _TIFFcallocExt(TIFF* tif, tmsize_t nmemb, tmsize_t siz);
+extern void* _TIFFreallocExt(TIFF* tif, void* p, tmsize_t s);
+extern void _TIFFfreeExt(TIFF* tif, void* p);
+
 /*
 ** Stuff, related to tag handling and creating custom tags.
 */
@@ -349,6 +418,11 @@ extern int TIFFGetField(TIFF* tif, uint32 tag, ...);
 extern int TIFFVGetField(TIFF* tif, uint32 tag, va_list ap);
 extern int TIFFGetFieldDefaulted(TIFF* tif, uint32 tag, ...);
 extern int TIFFVGetFieldDefaulted(TIFF* tif, uint32 tag, va_list ap);
+extern int TIFFGetFieldUInt16(TIFF* tif, uint32 tag, uint16* value);
+extern int TIFFGetFieldUInt32(TIFF* tif, uint32 tag, uint32* value);
+extern int TIFFGetFieldUInt64(TIFF* tif, uint32 tag, uint64* value);
+extern int TIFFGetFieldDouble(TIFF* tif, uint32 tag, double* value);
+extern int TIFFGetFieldArray(TIFF* tif, uint32 tag, TIFFDataType* type, uint32* count, const void** data);
 extern int TIFFReadDirectory(TIFF* tif);
 extern int TIFFReadCustomDirectory(TIFF* tif, toff_t diroff, const TIFFFieldArray* infoarray);
 extern int TIFFReadEXIFDirectory(TIFF* tif, toff_t diroff);
@@ -405,6 +479,9 @@ extern int TIFFCreateEXIFDirectory(TIFF*);
 extern int TIFFLastDirectory(TIFF*);
 extern int TIFFSetDirectory(TIFF*, uint16);
 extern int TIFFSetSubDirectory(TIFF*, uint64);
+extern TIFFDirSnapshot* TIFFSnapshotDirectory(TIFF*);
+extern int TIFFRestoreDirectory(TIFF*, TIFFDirSnapshot*);
+extern void TIFFFreeDirectorySnapshot(TIFF*, TIFFDirSnapshot*);
 extern int TIFFUnlinkDirectory(TIFF*, uint16);
 extern int TIFFSetField(TIFF*, uint32, ...);
 extern int TIFFVSetField(TIFF*, uint32, va_list);
@@ -413,6 +490,8 @@ extern int TIFFWriteDirectory(TIFF *);
 extern int TIFFWriteCustomDirectory(TIFF *, uint64 *);
 extern int TIFFCheckpointDirectory(TIFF *);
 extern int TIFFRewriteDirectory(TIFF *);
+extern int TIFFDeferStrileArrayWriting(TIFF *);
+extern int TIFFForceStrileArrayWriting(TIFF *);
 
 #if defined(c_plusplus) || defined(__cplusplus)
 extern void TIFFPrintDirectory(TIFF*, FILE*, long = 0);
@@ -437,17 +516,56 @@ extern int TIFFRGBAImageOK(TIFF*, char [1024]);
 extern int TIFFRGBAImageBegin(TIFFRGBAImage*, TIFF*, int, char [1024]);
 extern int TIFFRGBAImageGet(TIFFRGBAImage*, uint32*, uint32, uint32);
 extern void TIFFRGBAImageEnd(TIFFRGBAImage*);
+extern TIFFOpenOptions* TIFFOpenOptionsAlloc(void);
+extern void TIFFOpenOptionsFree(TIFFOpenOptions*);
+extern void TIFFOpenOptionsSetAllocator(TIFFOpenOptions*, TIFFAllocProc,
+	    TIFFReallocProc, TIFFFreeProc, void*);
+extern void TIFFOpenOptionsSetMemoryAccounting(TIFFOpenOptions*, int);
+extern void TIFFOpenOptionsSetMaxSingleMemAlloc(TIFFOpenOptions*, tmsize_t);
+extern void TIFFOpenOptionsSetMaxCumulatedMemAlloc(TIFFOpenOptions*, tmsize_t);
+extern void TIFFOpenOptionsSetDirectoryAllocator(TIFFOpenOptions*,
+	    TIFFArenaAllocProc, TIFFArenaFreeProc, void*);
+extern void TIFFOpenOptionsSetRangeCache(TIFFOpenOptions*, tmsize_t, int, int);
+extern int TIFFGetMemoryUsage(TIFF*, uint64*, uint64*, uint64*);
+extern int TIFFGetMemoryBudget(TIFF*, uint64*, uint64*);
 extern TIFF* TIFFOpen(const char*, const char*);
+extern TIFF* TIFFOpenExt(const char*, const char*, TIFFOpenOptions*);
 # ifdef __WIN32__
 extern TIFF* TIFFOpenW(const wchar_t*, const char*);
+extern TIFF* TIFFOpenWExt(const wchar_t*, const char*, TIFFOpenOptions*);
 # endif /* __WIN32__ */
 extern TIFF* TIFFFdOpen(int, const char*, const char*);
+extern TIFF* TIFFFdOpenExt(int, const char*, const char*, TIFFOpenOptions*);
 extern TIFF* TIFFClientOpen(const char*, const char*,
 	    thandle_t,
 	    TIFFReadWriteProc, TIFFReadWriteProc,
 	    TIFFSeekProc, TIFFCloseProc,
 	    TIFFSizeProc,
 	    TIFFMapFileProc, TIFFUnmapFileProc);
+extern TIFF* TIFFClientOpenExt(const char*, const char*,
+	    thandle_t,
+	    TIFFReadWriteProc, TIFFReadWriteProc,
+	    TIFFSeekProc, TIFFCloseProc,
+	    TIFFSizeProc,
+	    TIFFMapFileProc, TIFFUnmapFileProc,
+	    TIFFOpenOptions*);
+extern TIFF* TIFFRangeOpen(const char*, const char*, thandle_t, uint64,
+	    TIFFRangeReadProc, TIFFCloseProc, TIFFOpenOptions*);
+# ifndef __WIN32__
+extern TIFF* TIFFOpenHTTP(const char*, const char*, TIFFOpenOptions*);
+# endif /* __WIN32__ */
+extern TIFFDataset* TIFFDatasetOpen(const char*, TIFFOpenOptions*);
+extern TIFFDataset* TIFFDatasetClientOpen(const char*, thandle_t, uint64,
+	    TIFFRangeReadProc, TIFFCloseProc, TIFFOpenOptions*);
+extern void TIFFDatasetSetLockProcs(TIFFDataset*, TIFFLockProc, TIFFLockProc,
+	    void*);
+extern tdir_t TIFFDatasetNumberOfDirectories(TIFFDataset*);
+extern uint64 TIFFDatasetDirectoryOffset(TIFFDataset*, tdir_t);
+extern int TIFFDatasetGetImageSize(TIFFDataset*, tdir_t, uint32*, uint32*);
+extern TIFF* TIFFDatasetOpenDirectory(TIFFDataset*, tdir_t, const char*);
+extern void TIFFDatasetClose(TIFFDataset*);
+extern int TIFFProbeDirectories(TIFF*, TIFFProbeDirectory*, tdir_t, tdir_t*);
+extern int TIFFProbeFile(const char*, TIFFProbeDirectory*, tdir_t, tdir_t*);
 extern const char* TIFFFileName(TIFF*);
 extern const char* TIFFSetFileName(TIFF*, const char *);
 extern void TIFFError(const char*, const char*, ...) __attribute__((__format__ (__printf__,2,3)));
@@ -466,6 +584,10 @@ extern tmsize_t TIFFReadTile(TIFF* tif, void* buf, uint32 x, uint32 y, uint32 z,
 extern tmsize_t TIFFWriteTile(TIFF* tif, void* buf, uint32 x, uint32 y, uint32 z, uint16 s);
 extern uint32 TIFFComputeStrip(TIFF*, uint32, uint16);
 extern uint32 TIFFNumberOfStrips(TIFF*);
+extern uint64 TIFFGetStrileOffset(TIFF* tif, uint32 strile);
+extern uint64 TIFFGetStrileByteCount(TIFF* tif, uint32 strile);
+extern uint64 TIFFGetStrileOffsetWithErr(TIFF* tif, uint32 strile, int* pbErr);
+extern uint64 TIFFGetStrileByteCountWithErr(TIFF* tif, uint32 strile, int* pbErr);
 extern tmsize_t TIFFReadEncodedStrip(TIFF* tif, uint32 strip, void* buf, tmsize_t size);
 extern tmsize_t TIFFReadRawStrip(TIFF* tif, uint32 strip, void* buf, tmsize_t size);  
 extern tmsize_t TIFFReadEncodedTile(TIFF* tif, uint32 tile, void* buf, tmsize_t size);  
@@ -474,6 +596,7 @@ extern tmsize_t TIFFWriteEncodedStrip(TIFF* tif, uint32 strip, void* data, tmsiz
 extern tmsize_t TIFFWriteRawStrip(TIFF* tif, uint32 strip, void* data, tmsize_t cc);  
 extern tmsize_t TIFFWriteEncodedTile(TIFF* tif, uint32 tile, void* data, tmsize_t cc);  
 extern tmsize_t TIFFWriteRawTile(TIFF* tif, uint32 tile, void* data, tmsize_t cc);  
+extern int TIFFJPEGCopyCoefficients(TIFF* in, TIFF* out);
 extern int TIFFDataWidth(TIFFDataType);    /* table of tag datatype widths */
 extern void TIFFSetWriteOffset(TIFF* tif, toff_t off);
 extern void TIFFSwabShort(uint16*);
@@ -100,6 +100,22 @@ typedef void (*TIFFPostMethod)(TIFF* tif, uint8* buf, tmsize_t size);
 typedef uint32 (*TIFFStripMethod)(TIFF*, uint32);
 typedef void (*TIFFTileMethod)(TIFF*, uint32*, uint32*);
 
+/*
+ * Arena used for storage that lives as long as the current directory.
+ * Allocations are carved from the end of the newest block and are only
+ * ever released all together.
+ */
+typedef struct _TIFFArenaBlock {
+	struct _TIFFArenaBlock* next;
+	tmsize_t             size;             /* usable bytes in block */
+	tmsize_t             used;             /* bytes handed out */
+} TIFFArenaBlock;
+
+/*
+ * Number of work buffers kept by the buffer pool of a handle.
+ */
+#define	TIFF_BUFPOOL_SLOTS	8
+
 struct tiff {
 	char*                tif_name;         /* name of open file */
 	int                  tif_fd;           /* open file descriptor */
@@ -128,13 +144,21 @@ struct tiff {
         #define TIFF_DIRTYSTRIP 0x200000U /* stripoffsets/stripbytecount dirty*/
         #define TIFF_PERSAMPLE  0x400000U /* get/set per sample tags as arrays */
         #define TIFF_BUFFERMMAP 0x800000U /* read buffer (tif_rawdata) points into mmap() memory */
+        #define TIFF_LAZYDIR   0x1000000U /* fetch array and blob tag values on first use */
+        #define TIFF_DEFERSTRILELOAD 0x2000000U /* load strile arrays on first use */
+        #define TIFF_LAZYSTRILELOAD  0x4000000U /* read single strile values on demand */
+        #define TIFF_NOROWDECODE     0x8000000U /* codec cannot decode single scanlines */
 	uint64               tif_diroff;       /* file offset of current directory */
 	uint64               tif_nextdiroff;   /* file offset of following directory */
+	uint64               tif_lastdiroff;   /* file offset of last directory in the chain, 0 if unknown */
+	uint64               tif_lastdirlink;  /* file offset of its next directory link */
 	uint64*              tif_dirlist;      /* list of offsets to already seen directories to prevent IFD looping */
 	uint16               tif_dirlistsize;  /* number of entries in offset list */
 	uint16               tif_dirnumber;    /* number of already seen directories */
 	TIFFDirectory        tif_dir;          /* internal rep of current directory */
 	TIFFDirectory        tif_customdir;    /* custom IFDs are separated from the main ones */
+	TIFFDirSnapshot*     tif_dirsnapshots; /* snapshots taken, see TIFFSnapshotDirectory */
+	TIFFDirSnapshot*     tif_dirsnapshot;  /* snapshot owning the current directory */
 	union {
 		TIFFHeaderCommon common;
 		TIFFHeaderClassic classic;
@@ -200,15 +224,56 @@ struct tiff {
 	/* tag support */
 	TIFFField**          tif_fields;       /* sorted table of registered tags */
 	size_t               tif_nfields;      /* # entries in registered tag table */
-	const TIFFField*     tif_foundfield;   /* cached pointer to already found tag */
+	uint32*              tif_fieldslookup; /* tag and name lookup tables */
+	uint32               tif_fieldshashbits; /* log2 of hash table size */
+	int                  tif_fieldsnamevalid; /* name table up to date */
 	TIFFTagMethods       tif_tagmethods;   /* tag get/set/print routines */
 	TIFFClientInfoLink*  tif_clientinfo;   /* extra client information. */
 	/* Backward compatibility stuff. We need these two fields for
 	 * setting up an old tag extension scheme. */
 	TIFFFieldArray*      tif_fieldscompat;
 	size_t               tif_nfieldscompat;
+	/* directory-lifetime storage, released by TIFFFreeDirectory */
+	TIFFArenaBlock*      tif_arena;        /* arena blocks, newest first */
+	TIFFArenaAllocProc   tif_arenaalloc;   /* NULL: use _TIFFmallocExt */
+	TIFFArenaFreeProc    tif_arenafree;
+	void*                tif_arenauser;    /* allocator callback parameter */
+	/* per-handle memory allocation, see TIFFOpenOptions */
+	TIFFAllocProc        tif_allocproc;    /* NULL: use _TIFFmalloc */
+	TIFFReallocProc      tif_reallocproc;
+	TIFFFreeProc         tif_freeproc;
+	void*                tif_allocdata;    /* allocator callback parameter */
+	int                  tif_memaccount;   /* track allocated sizes */
+	uint64               tif_curmem;       /* bytes currently allocated */
+	uint64               tif_peakmem;      /* high water mark of tif_curmem */
+	uint64               tif_totalmem;     /* bytes allocated over lifetime */
+	tmsize_t             tif_maxsinglememalloc; /* 0: no limit */
+	tmsize_t             tif_maxcumulatedmemalloc; /* 0: no limit */
+	uint64               tif_memrefused;   /* allocations refused by limits */
+	/* work buffers kept for reuse, see _TIFFBufferGet */
+	void*                tif_bufpool[TIFF_BUFPOOL_SLOTS];
+};
+
+struct TIFFOpenOptions {
+	TIFFAllocProc        alloc;
+	TIFFReallocProc      realloc;
+	TIFFFreeProc         free;
+	void*                user_data;
+	int                  memaccount;
+	tmsize_t             max_single_mem_alloc;
+	tmsize_t             max_cumulated_mem_alloc;
+	TIFFArenaAllocProc   arena_alloc;      /* directory arena blocks */
+	TIFFArenaFreeProc    arena_free;
+	void*                arena_user_data;
+	int                  range_cache;      /* range_* set, see tif_range.c */
+	tmsize_t             range_block_size;
+	int                  range_max_blocks;
+	int                  range_readahead;
 };
 
+/* Block cache shared by handles, see tif_range.c */
+typedef struct TIFFRangeSource TIFFRangeSource;
+
 #define isPseudoTag(t) (t > 0xffff)            /* is tag value normal or pseudo */
 
 #define isTiled(tif) (((tif)->tif_flags & TIFF_ISTILED) != 0)
@@ -367,6 +432,30 @@ extern uint32 _TIFFMultiply32(TIFF*, uint32, uint32, const char*);
 extern uint64 _TIFFMultiply64(TIFF*, uint64, uint64, const char*);
 extern void* _TIFFCheckMalloc(TIFF*, tmsize_t, tmsize_t, const char*);
 extern void* _TIFFCheckRealloc(TIFF*, void*, tmsize_t, tmsize_t, const char*);
+extern void* _TIFFCheckMallocExt(TIFF*, tmsize_t, tmsize_t, const char*);
+extern void* _TIFFCheckReallocExt(TIFF*, void*, tmsize_t, tmsize_t,
+    const char*);
+extern void* _TIFFArenaMalloc(TIFF*, tmsize_t, tmsize_t, const char*);
+extern void* _TIFFArenaReplace(TIFF*, void*, tmsize_t, tmsize_t, const char*);
+extern void _TIFFArenaFree(TIFF*, void*);
+extern void _TIFFArenaReset(TIFF*);
+extern void _TIFFArenaRelease(TIFF*);
+extern void* _TIFFBufferGet(TIFF*, tmsize_t);
+extern void _TIFFBufferPut(TIFF*, void*);
+extern void _TIFFBufferPoolRelease(TIFF*);
+extern int _TIFFCheckMemoryBudget(TIFF*, uint64);
+extern void* _TIFFArenaBlockAlloc(TIFF*, tmsize_t);
+extern void _TIFFArenaBlockFree(TIFF*, void*);
+extern TIFFRangeSource* _TIFFRangeSourceNew(const char*, const char*,
+	    thandle_t, uint64, TIFFRangeReadProc, TIFFCloseProc,
+	    TIFFOpenOptions*);
+extern void _TIFFRangeSourceSetLock(TIFFRangeSource*, TIFFLockProc,
+	    TIFFLockProc, void*);
+extern int _TIFFRangeSourceRelease(TIFFRangeSource*, int);
+extern TIFF* _TIFFRangeSourceOpen(TIFFRangeSource*, const char*, const char*,
+	    TIFFOpenOptions*);
+extern TIFFDataset* _TIFFDatasetOpen(const char*, thandle_t, uint64,
+	    TIFFRangeReadProc, TIFFCloseProc, TIFFOpenOptions*);
 
 extern double _TIFFUInt64ToDouble(uint64);
 extern float _TIFFUInt64ToFloat(uint64);
@@ -429,6 +518,7 @@ extern const TIFFCodec _TIFFBuiltinCODECS[];
 #else
 extern TIFFCodec _TIFFBuiltinCODECS[];
 #endif
+extern uint32 _TIFFBuiltinCODECCapabilities(uint16);
 
 #if defined(__cplusplus)
 }
@@ -0,0 +1,44 @@
+# CMake tests for libtiff
+#
+# Lossless JPEG retiling with tiffcp, as in tiffcp-lossless-quad-tile.jpg.sh:
+# output retiled and copied back to the tiles of the input decodes exactly
+# like the input, and retiling strips that are not on block boundaries
+# falls back to recompression.
+
+include(${CMAKE_CURRENT_LIST_DIR}/TiffTestCommon.cmake)
+
+# Decompress to strips, to compare with tiffcmp
+macro(decode infile outfile)
+  test_convert("${TIFFCP};-c;none;-s;-r;16" "${infile}" "${outfile}")
+endmacro()
+
+macro(compare file1 file2 message)
+  execute_process(COMMAND ${TIFFCMP} "${file1}" "${file2}"
+                  RESULT_VARIABLE TEST_STATUS)
+  if(TEST_STATUS)
+    message(FATAL_ERROR "${message}")
+  endif()
+endmacro()
+
+test_convert("${TIFFCP};-s;-r;16" "${INFILE}" "${OUTPUT}-strips.tiff")
+tiffinfo_validate("${OUTPUT}-strips.tiff")
+test_convert("${TIFFCP};-t;-w;64;-l;64" "${OUTPUT}-strips.tiff" "${OUTPUT}-tiles.tiff")
+tiffinfo_validate("${OUTPUT}-tiles.tiff")
+test_convert("${TIFFCP};-t;-w;128;-l;128" "${OUTPUT}-strips.tiff" "${OUTPUT}-strips-back.tiff")
+test_convert("${TIFFCP};-t;-w;128;-l;128" "${OUTPUT}-tiles.tiff" "${OUTPUT}-tiles-back.tiff")
+
+decode("${INFILE}" "${OUTPUT}-none.tiff")
+foreach(copy strips-back tiles-back)
+  decode("${OUTPUT}-${copy}.tiff" "${OUTPUT}-${copy}-none.tiff")
+  compare("${OUTPUT}-none.tiff" "${OUTPUT}-${copy}-none.tiff"
+          "JPEG data changed by the ${copy} copy")
+endforeach()
+
+# Same result as recompressing
+test_convert("${TIFFCP};-s;-r;16" "${UNALIGNED}" "${FALLBACK}.tiff")
+tiffinfo_validate("${FALLBACK}.tiff")
+test_convert("${TIFFCP};-c;jpeg;-s;-r;16" "${UNALIGNED}" "${FALLBACK}-jpeg.tiff")
+decode("${FALLBACK}.tiff" "${FALLBACK}-none.tiff")
+decode("${FALLBACK}-jpeg.tiff" "${FALLBACK}-jpeg-none.tiff")
+compare("${FALLBACK}-jpeg-none.tiff" "${FALLBACK}-none.tiff"
+        "Unaligned strips not recompressed")
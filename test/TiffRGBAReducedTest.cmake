@@ -0,0 +1,89 @@
+# CMake tests for libtiff
+#
+# Reduced resolution JPEG decoding with tiff2rgba, as in
+# tiff2rgba-reduced-quad-tile.jpg.sh: the output is a quarter of the
+# input size, close to the average of the full resolution pixels, and
+# flipped to top-left orientation like the full resolution output.
+
+include(${CMAKE_CURRENT_LIST_DIR}/TiffTestCommon.cmake)
+
+# Value of byte k of the hex string in variable hexvar
+macro(hex_byte hexvar k var)
+  math(EXPR _pos "2 * (${k})")
+  string(SUBSTRING "${${hexvar}}" ${_pos} 1 _hi)
+  math(EXPR _pos "${_pos} + 1")
+  string(SUBSTRING "${${hexvar}}" ${_pos} 1 _lo)
+  string(FIND "0123456789abcdef" "${_hi}" _hi)
+  string(FIND "0123456789abcdef" "${_lo}" _lo)
+  math(EXPR ${var} "${_hi} * 16 + ${_lo}")
+endmacro()
+
+# File offset of the single strip of file
+macro(strip_offset file var)
+  execute_process(COMMAND ${TIFFINFO} -s "${file}"
+                  OUTPUT_VARIABLE _info RESULT_VARIABLE TEST_STATUS)
+  if(TEST_STATUS OR NOT _info MATCHES "0: \\[ *([0-9]+),")
+    message(FATAL_ERROR "Can't find the strip of ${file}")
+  endif()
+  set(${var} "${CMAKE_MATCH_1}")
+endmacro()
+
+test_convert("${TIFF2RGBA};-s;4;-n;-c;none;-r;96" "${INFILE}" "${REDUCED}")
+tiffinfo_validate("${REDUCED}")
+execute_process(COMMAND ${TIFFINFO} "${REDUCED}" OUTPUT_VARIABLE info)
+if(NOT info MATCHES "Image Width: 128 Image Length: 96")
+  message(FATAL_ERROR "Wrong size of reduced image")
+endif()
+
+# Mean difference with the 4x4 averages of the full resolution image,
+# over a grid of reduced pixels
+test_convert("${TIFF2RGBA};-n;-c;none;-r;384" "${INFILE}" "${FULL}")
+strip_offset("${REDUCED}" reduced_offset)
+strip_offset("${FULL}" full_offset)
+set(total 0)
+set(count 0)
+foreach(y RANGE 4 95 8)
+  math(EXPR offset "${reduced_offset} + ${y} * 128 * 3")
+  file(READ "${REDUCED}" reduced_row OFFSET ${offset} LIMIT 384 HEX)
+  math(EXPR offset "${full_offset} + 4 * ${y} * 512 * 3")
+  file(READ "${FULL}" full_rows OFFSET ${offset} LIMIT 6144 HEX)
+  foreach(x RANGE 4 127 8)
+    foreach(c 0 1 2)
+      math(EXPR k "${x} * 3 + ${c}")
+      hex_byte(reduced_row ${k} v)
+      math(EXPR d "16 * ${v}")
+      foreach(j 0 1 2 3)
+        foreach(i 0 1 2 3)
+          math(EXPR k "(${j} * 512 + 4 * ${x} + ${i}) * 3 + ${c}")
+          hex_byte(full_rows ${k} v)
+          math(EXPR d "${d} - ${v}")
+        endforeach()
+      endforeach()
+      if(d LESS 0)
+        math(EXPR d "-(${d})")
+      endif()
+      math(EXPR total "${total} + ${d}")
+      math(EXPR count "${count} + 1")
+    endforeach()
+  endforeach()
+endforeach()
+math(EXPR limit "3 * 16 * ${count}")
+if(total GREATER limit)
+  math(EXPR mean "${total} / (16 * ${count})")
+  message(FATAL_ERROR "Reduced image differs from full resolution: ${mean}")
+endif()
+
+# Bottom-right orientation, turned back to top-left
+configure_file("${INFILE}" "${BOTRIGHT_IN}" COPYONLY)
+execute_process(COMMAND ${TIFFSET} -s 274 3 "${BOTRIGHT_IN}"
+                RESULT_VARIABLE TEST_STATUS)
+if(TEST_STATUS)
+  message(FATAL_ERROR "Can't set the orientation of ${BOTRIGHT_IN}")
+endif()
+test_convert("${TIFF2RGBA};-s;4;-n;-c;none;-r;96" "${BOTRIGHT_IN}" "${BOTRIGHT}")
+test_convert("${TIFFCROP};-R;180" "${BOTRIGHT}" "${ROTATED}")
+execute_process(COMMAND ${TIFFCMP} "${REDUCED}" "${ROTATED}"
+                RESULT_VARIABLE TEST_STATUS)
+if(TEST_STATUS)
+  message(FATAL_ERROR "Orientation not applied to reduced image")
+endif()
@@ -0,0 +1,148 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test codec plugins: the xor_codec plugin is loaded with
+ * TIFFLoadCODECPlugins(), its codec looked up, used to write and read
+ * back a strip, and unregistered.  It cannot decode scanlines, which
+ * must then be refused.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffiop.h"
+#include "tifftest.h"
+#include "xor_codec.h"
+
+#ifndef PLUGIN_DIR
+# define PLUGIN_DIR	".libs"
+#endif
+#define WIDTH		16
+#define LENGTH		16
+
+static const char	filename[] = "codec_plugin.tif";
+
+static int
+is_listed(uint16 scheme)
+{
+	TIFFCodec	*codecs, *c;
+	int		found = 0;
+
+	codecs = TIFFGetConfiguredCODECs();
+	if (!codecs)
+		return 0;
+	for (c = codecs; c->name; c++)
+		if (c->scheme == scheme)
+			found = 1;
+	_TIFFfree(codecs);
+	return found;
+}
+
+/* Whether the XOR codec is known to the library, as expected */
+static int
+check_registered(const TIFFCodec* codec, int registered)
+{
+	if (TIFFFindCODEC(COMPRESSION_XOR) != codec
+	    || TIFFIsCODECConfigured(COMPRESSION_XOR) != registered
+	    || TIFFGetCODECCapabilities(COMPRESSION_XOR)
+	       != (registered ? XOR_CAPS : 0)
+	    || is_listed(COMPRESSION_XOR) != registered) {
+		fprintf (stderr, "XOR codec %s registered.\n",
+			 registered ? "not" : "still");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+write_strip(void)
+{
+	TIFF	*tif;
+	int	ok;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = fixture_set_tags(tif, WIDTH, LENGTH, 0, LENGTH, COMPRESSION_XOR)
+	    && fixture_write_image(tif, 0);
+	TIFFClose(tif);
+	return ok;
+}
+
+/*
+ * Read the strip back, raw to check that it went through the codec, and
+ * decoded.  Decoding fails once the codec is unregistered, and scanline
+ * access always.
+ */
+static int
+read_strip(int registered)
+{
+	TIFF		*tif;
+	unsigned char	buf[WIDTH * LENGTH];
+	uint32		i;
+	uint16		compression;
+	int		ok = 1;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	if (!TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression)
+	    || compression != COMPRESSION_XOR
+	    || TIFFReadRawStrip(tif, 0, buf, sizeof(buf))
+	       != (tmsize_t) sizeof(buf)) {
+		fprintf (stderr, "Can't read raw strip.\n");
+		TIFFClose(tif);
+		return 0;
+	}
+	for (i = 0; ok && i < sizeof(buf); i++)
+		if (buf[i] != (fixture_pixel(0, i % WIDTH, i / WIDTH)
+			       ^ XOR_KEY)) {
+			fprintf (stderr, "Strip not encoded by the codec.\n");
+			ok = 0;
+		}
+	if (ok && registered) {
+		ok = fixture_check_strile(tif, 0, 0);
+		if (ok && TIFFReadScanline(tif, buf, 0, 0) >= 0) {
+			fprintf (stderr, "Scanline decoded by a strip codec.\n");
+			ok = 0;
+		}
+	} else if (ok && TIFFReadEncodedStrip(tif, 0, buf, sizeof(buf)) >= 0) {
+		fprintf (stderr, "Strip decoded without codec.\n");
+		ok = 0;
+	}
+	TIFFClose(tif);
+	return ok;
+}
+
+int
+main()
+{
+	const TIFFCodec	*codec;
+	int		ok;
+
+	if (!check_registered(NULL, 0))
+		return 1;
+	if (TIFFLoadCODECPlugins(PLUGIN_DIR) != 1) {
+		fprintf (stderr, "Can't load the plugin from %s.\n", PLUGIN_DIR);
+		return 1;
+	}
+	codec = TIFFFindCODEC(COMPRESSION_XOR);
+	ok = check_registered(codec, 1) && write_strip() && read_strip(1);
+	if (codec)
+		TIFFUnRegisterCODEC((TIFFCodec*) codec);
+	ok = ok && check_registered(NULL, 0) && read_strip(0);
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
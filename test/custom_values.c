@@ -0,0 +1,204 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test the storage of custom tag values: many tags set in
+ * arbitrary order, replaced and unset must read back right, both from
+ * memory and once written to a file.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define NTAGS		2000
+#define FIRST_TAG	60000
+
+static TIFFFieldInfo	field_info[NTAGS];
+static char		field_names[NTAGS][16];
+
+/* Visit the tags in a scrambled but complete order */
+static uint32
+scrambled(int i)
+{
+	return (uint32) ((i * 7919) % NTAGS);
+}
+
+static uint32
+tag_value(uint32 n, int pass)
+{
+	return n * 3 + (uint32) pass;
+}
+
+static TIFFExtendProc	parent_extender;
+
+static void
+register_tags(TIFF* tif)
+{
+	TIFFMergeFieldInfo(tif, field_info, NTAGS);
+	if (parent_extender)
+		(*parent_extender)(tif);
+}
+
+static int
+check_values(TIFF* tif, int pass, int unset)
+{
+	uint32	n, value;
+
+	for (n = 0; n < NTAGS; n++) {
+		int present = TIFFGetField(tif, FIRST_TAG + n, &value);
+
+		if (unset && n % 2 == 1) {
+			if (present) {
+				fprintf (stderr, "Unset tag %lu still present.\n",
+					 (unsigned long) (FIRST_TAG + n));
+				return 0;
+			}
+		} else if (!present || value != tag_value(n, pass)) {
+			fprintf (stderr, "Wrong value for tag %lu.\n",
+				 (unsigned long) (FIRST_TAG + n));
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static int
+check_list(TIFF* tif, int expected)
+{
+	int	i, count = TIFFGetTagListCount(tif);
+	uint32	last = 0, tag;
+	int	found = 0;
+
+	for (i = 0; i < count; i++) {
+		tag = TIFFGetTagListEntry(tif, i);
+		if (tag >= FIRST_TAG && tag < FIRST_TAG + NTAGS) {
+			if (tag <= last) {
+				fprintf (stderr, "Custom tag list out of order.\n");
+				return 0;
+			}
+			last = tag;
+			found++;
+		}
+	}
+	if (found != expected) {
+		fprintf (stderr, "%d custom tags listed, %d expected.\n", found,
+			 expected);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+write_image(const char* filename)
+{
+	TIFF		*tif;
+	unsigned char	buf[16];
+	uint32		row;
+	int		i, pass;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, 16)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, 16)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 16)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK)) {
+		fprintf (stderr, "Can't set tags.\n");
+		goto failure;
+	}
+
+	/* Set every tag twice, the second value replacing the first */
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < NTAGS; i++) {
+			uint32 n = scrambled(i);
+			if (!TIFFSetField(tif, FIRST_TAG + n,
+					  tag_value(n, pass))) {
+				fprintf (stderr, "Can't set tag %lu.\n",
+					 (unsigned long) (FIRST_TAG + n));
+				goto failure;
+			}
+		}
+	}
+	if (!check_values(tif, 1, 0) || !check_list(tif, NTAGS))
+		goto failure;
+	for (i = 0; i < NTAGS; i++) {
+		uint32 n = scrambled(i);
+		if (n % 2 == 1 && !TIFFUnsetField(tif, FIRST_TAG + n)) {
+			fprintf (stderr, "Can't unset tag %lu.\n",
+				 (unsigned long) (FIRST_TAG + n));
+			goto failure;
+		}
+	}
+	if (!check_values(tif, 1, 1) || !check_list(tif, NTAGS / 2))
+		goto failure;
+
+	for (row = 0; row < 16; row++) {
+		memset(buf, (int) row, sizeof(buf));
+		if (TIFFWriteScanline(tif, buf, row, 0) < 0) {
+			fprintf (stderr, "Can't write image data.\n");
+			goto failure;
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+static int
+read_image(const char* filename)
+{
+	TIFF	*tif;
+	int	ok;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = check_values(tif, 1, 1) && check_list(tif, NTAGS / 2);
+	TIFFClose(tif);
+	return ok;
+}
+
+int
+main()
+{
+	const char	*filename = "custom_values.tif";
+	int		i, ok;
+
+	for (i = 0; i < NTAGS; i++) {
+		sprintf(field_names[i], "Custom%d", i);
+		field_info[i].field_tag = FIRST_TAG + i;
+		field_info[i].field_readcount = 1;
+		field_info[i].field_writecount = 1;
+		field_info[i].field_type = TIFF_LONG;
+		field_info[i].field_bit = FIELD_CUSTOM;
+		field_info[i].field_oktochange = 1;
+		field_info[i].field_passcount = 0;
+		field_info[i].field_name = field_names[i];
+	}
+	parent_extender = TIFFSetTagExtender(register_tags);
+	ok = write_image(filename) && read_image(filename);
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
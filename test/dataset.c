@@ -0,0 +1,307 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test datasets: handles opened with TIFFDatasetOpenDirectory()
+ * on the levels of a pyramid are read side by side, share the file and
+ * its block cache, and outlive the dataset.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tifftest.h"
+
+#define NLEVELS	3
+#define TILE	16
+
+static const char	filename[] = "dataset.tif";
+static const uint32	sizes[NLEVELS] = { 128, 64, 32 };
+
+static int
+write_pyramid(void)
+{
+	TIFF	*tif;
+	int	level;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	for (level = 0; level < NLEVELS; level++) {
+		if (!TIFFSetField(tif, TIFFTAG_SUBFILETYPE,
+				  level ? FILETYPE_REDUCEDIMAGE : 0)
+		    || !fixture_set_tags(tif, sizes[level], sizes[level], 1,
+					 TILE, COMPRESSION_LZW)
+		    || !fixture_write_image(tif, level))
+			goto failure;
+		if (!TIFFWriteDirectory(tif)) {
+			fprintf (stderr, "Can't write directory %d.\n", level);
+			goto failure;
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+/* Check tile number n of a level, n running over all tiles */
+static int
+check_tile(TIFF* tif, int level, uint32 n)
+{
+	uint32	across = sizes[level] / TILE;
+
+	return fixture_check_strile(tif, level, n % (across * across));
+}
+
+static int
+check_level(TIFF* tif, int level)
+{
+	uint32	width;
+
+	if (TIFFCurrentDirectory(tif) != level
+	    || !TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width)
+	    || width != sizes[level]) {
+		fprintf (stderr, "Handle not on level %d.\n", level);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+check_index(TIFFDataset* ds)
+{
+	uint32	width, length;
+	int	level;
+
+	if (TIFFDatasetNumberOfDirectories(ds) != NLEVELS) {
+		fprintf (stderr, "%d directories found, %d expected.\n",
+			 (int) TIFFDatasetNumberOfDirectories(ds), NLEVELS);
+		return 0;
+	}
+	for (level = 0; level < NLEVELS; level++) {
+		if (!TIFFDatasetGetImageSize(ds, level, &width, &length)
+		    || width != sizes[level] || length != sizes[level]
+		    || TIFFDatasetDirectoryOffset(ds, level) == 0) {
+			fprintf (stderr, "Wrong index for level %d.\n", level);
+			return 0;
+		}
+	}
+	if (TIFFDatasetGetImageSize(ds, NLEVELS, &width, &length)
+	    || TIFFDatasetDirectoryOffset(ds, NLEVELS) != 0
+	    || TIFFDatasetOpenDirectory(ds, NLEVELS, "r")
+	    || TIFFDatasetOpenDirectory(ds, 0, "w")) {
+		fprintf (stderr, "Directory out of range or mode accepted.\n");
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * Read all the levels at once, a tile of each in turn, the dataset
+ * being closed halfway.  mode is the opening mode of the handles.
+ */
+static int
+read_levels(TIFFDataset* ds, const char* mode)
+{
+	TIFF	*tif[NLEVELS];
+	uint32	n;
+	int	level, ok = 1;
+
+	for (level = 0; level < NLEVELS; level++)
+		tif[level] = NULL;
+	for (level = NLEVELS - 1; level >= 0; level--) {
+		tif[level] = TIFFDatasetOpenDirectory(ds, level, mode);
+		if (!tif[level] || !check_level(tif[level], level)) {
+			ok = 0;
+			goto close;
+		}
+	}
+	for (n = 0; ok && n < 64; n++)
+		for (level = 0; ok && level < NLEVELS; level++)
+			ok = check_tile(tif[level], level, n);
+	TIFFDatasetClose(ds);
+	for (n = 64; ok && n < 128; n++)
+		for (level = 0; ok && level < NLEVELS; level++)
+			ok = check_tile(tif[level], level, n * 7);
+
+	/* The chain goes on from the directory a handle was opened on */
+	if (ok && (!TIFFReadDirectory(tif[1]) || !check_level(tif[1], 2)
+		   || !check_tile(tif[1], 2, 5)
+		   || !TIFFSetDirectory(tif[2], 0)
+		   || !check_level(tif[2], 0) || !check_tile(tif[2], 0, 9))) {
+		fprintf (stderr, "Can't move between directories.\n");
+		ok = 0;
+	}
+
+close:
+	for (level = 0; level < NLEVELS; level++)
+		if (tif[level])
+			TIFFClose(tif[level]);
+	return ok;
+}
+
+static int
+test_local(void)
+{
+	TIFFDataset	*ds;
+
+	ds = TIFFDatasetOpen(filename, NULL);
+	if (!ds) {
+		fprintf (stderr, "Can't open dataset %s.\n", filename);
+		return 0;
+	}
+	if (!check_index(ds)) {
+		TIFFDatasetClose(ds);
+		return 0;
+	}
+	return read_levels(ds, "r");
+}
+
+/*
+ * The file as seen through a range reading procedure, counting the
+ * requests and the use of the lock, which must not be held while
+ * reading.
+ */
+typedef struct {
+	unsigned char	*data;
+	uint64		size;
+	long		requests;
+	long		closed;
+	long		locks;
+	long		unlocks;
+} remote_file;
+
+static tmsize_t
+remote_read(thandle_t h, uint64 off, void* buf, tmsize_t size)
+{
+	remote_file	*rf = (remote_file*) h;
+
+	rf->requests++;
+	if (rf->locks != rf->unlocks)
+		rf->requests += 1000;	/* read with the lock held */
+	if (off >= rf->size)
+		return 0;
+	if ((uint64) size > rf->size - off)
+		size = (tmsize_t) (rf->size - off);
+	memcpy(buf, rf->data + off, (size_t) size);
+	return size;
+}
+
+static int
+remote_close(thandle_t h)
+{
+	((remote_file*) h)->closed++;
+	return 0;
+}
+
+static void
+remote_lock(void* arg)
+{
+	((remote_file*) arg)->locks++;
+}
+
+static void
+remote_unlock(void* arg)
+{
+	((remote_file*) arg)->unlocks++;
+}
+
+static int
+test_client(void)
+{
+	remote_file	rf;
+	TIFFDataset	*ds;
+	TIFF		*tif[NLEVELS];
+	FILE		*fd;
+	long		requests;
+	int		level, ok = 0;
+
+	memset(&rf, 0, sizeof(rf));
+	fd = fopen(filename, "rb");
+	if (!fd)
+		return 0;
+	fseek(fd, 0, SEEK_END);
+	rf.size = (uint64) ftell(fd);
+	fseek(fd, 0, SEEK_SET);
+	rf.data = (unsigned char*) malloc((size_t) rf.size);
+	if (!rf.data
+	    || fread(rf.data, 1, (size_t) rf.size, fd) != (size_t) rf.size) {
+		fclose(fd);
+		free(rf.data);
+		return 0;
+	}
+	fclose(fd);
+
+	ds = TIFFDatasetClientOpen("remote", (thandle_t) &rf, rf.size,
+				   remote_read, remote_close, NULL);
+	if (!ds) {
+		fprintf (stderr, "Can't open remote dataset.\n");
+		free(rf.data);
+		return 0;
+	}
+	TIFFDatasetSetLockProcs(ds, remote_lock, remote_unlock, &rf);
+	if (!check_index(ds)) {
+		TIFFDatasetClose(ds);
+		goto done;
+	}
+
+	/* The directories were read when the dataset was opened */
+	requests = rf.requests;
+	for (level = 0; level < NLEVELS; level++) {
+		tif[level] = TIFFDatasetOpenDirectory(ds, level, "r");
+		if (!tif[level]) {
+			while (level-- > 0)
+				TIFFClose(tif[level]);
+			TIFFDatasetClose(ds);
+			goto done;
+		}
+	}
+	for (level = 0; level < NLEVELS; level++)
+		TIFFClose(tif[level]);
+	if (rf.requests != requests) {
+		fprintf (stderr, "Directories read again: %ld requests.\n",
+			 rf.requests - requests);
+		TIFFDatasetClose(ds);
+		goto done;
+	}
+
+	if (!read_levels(ds, "rO"))
+		goto done;
+	if (rf.closed != 1 || rf.locks == 0 || rf.locks != rf.unlocks
+	    || rf.requests >= 1000) {
+		fprintf (stderr, "Closed %ld times, %ld locks, %ld unlocks, "
+			 "%ld requests.\n", rf.closed, rf.locks, rf.unlocks,
+			 rf.requests);
+		goto done;
+	}
+	ok = 1;
+
+done:
+	free(rf.data);
+	return ok;
+}
+
+int
+main()
+{
+	int	ok;
+
+	ok = write_pyramid() && test_local() && test_client();
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,167 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test deferred ('D') and lazy ('O') loading of the strip and
+ * tile offset and byte count arrays: every strile must report the same
+ * offset and byte count, and decode to the same data, as with eager
+ * loading, whatever the order the striles are visited in.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tifftest.h"
+
+/* Enough striles to span several blocks of the strile cache */
+const uint32	width = 16 * 30;
+const uint32	length = 16 * 70;
+const uint32	tile_size = 16;
+
+static int
+write_image(const char* filename, const char* mode, int tiled)
+{
+	TIFF	*tif;
+	int	ok;
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = fixture_set_tags(tif, width, length, tiled, tiled ? tile_size : 1,
+			      COMPRESSION_NONE)
+	    && fixture_write_image(tif, 0);
+	TIFFClose(tif);
+	return ok;
+}
+
+static int
+check_strile(TIFF* tif, uint32 strile, uint64 offset, uint64 bytecount)
+{
+	int	err;
+
+	if (TIFFGetStrileOffsetWithErr(tif, strile, &err) != offset || err
+	    || TIFFGetStrileByteCountWithErr(tif, strile, &err) != bytecount
+	    || err) {
+		fprintf (stderr, "Wrong offset or byte count for strile %lu.\n",
+			 (unsigned long) strile);
+		return 0;
+	}
+	return fixture_check_strile(tif, 0, strile);
+}
+
+static int
+test_read(const char* filename, const char* mode)
+{
+	TIFF		*tif;
+	uint64		*offsets, *bytecounts;
+	uint64		*ref_offsets = NULL, *ref_bytecounts = NULL;
+	uint32		nstriles, strile;
+	int		err, ok = 0;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	nstriles = TIFFIsTiled(tif) ? TIFFNumberOfTiles(tif)
+	    : TIFFNumberOfStrips(tif);
+	ref_offsets = (uint64*) malloc(nstriles * sizeof(uint64));
+	ref_bytecounts = (uint64*) malloc(nstriles * sizeof(uint64));
+	if (!ref_offsets || !ref_bytecounts
+	    || !TIFFGetField(tif, TIFFIsTiled(tif) ? TIFFTAG_TILEOFFSETS
+			     : TIFFTAG_STRIPOFFSETS, &offsets)
+	    || !TIFFGetField(tif, TIFFIsTiled(tif) ? TIFFTAG_TILEBYTECOUNTS
+			     : TIFFTAG_STRIPBYTECOUNTS, &bytecounts)) {
+		fprintf (stderr, "Can't get strile arrays.\n");
+		TIFFClose(tif);
+		goto done;
+	}
+	memcpy(ref_offsets, offsets, nstriles * sizeof(uint64));
+	memcpy(ref_bytecounts, bytecounts, nstriles * sizeof(uint64));
+	TIFFClose(tif);
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		goto done;
+	}
+	/* Backwards and then with a stride, to go through the cache blocks */
+	for (strile = nstriles; strile-- > 0;) {
+		if (!check_strile(tif, strile, ref_offsets[strile],
+				  ref_bytecounts[strile]))
+			goto close;
+	}
+	for (strile = 0; strile < nstriles; strile += 97) {
+		if (!check_strile(tif, strile, ref_offsets[strile],
+				  ref_bytecounts[strile]))
+			goto close;
+	}
+	if (TIFFGetStrileOffsetWithErr(tif, nstriles, &err) != 0 || !err
+	    || TIFFGetStrileByteCountWithErr(tif, nstriles, &err) != 0
+	    || !err) {
+		fprintf (stderr, "Out of range strile not reported.\n");
+		goto close;
+	}
+
+	/* Full arrays must still be available on request */
+	if (!TIFFGetField(tif, TIFFIsTiled(tif) ? TIFFTAG_TILEOFFSETS
+			  : TIFFTAG_STRIPOFFSETS, &offsets)
+	    || !TIFFGetField(tif, TIFFIsTiled(tif) ? TIFFTAG_TILEBYTECOUNTS
+			     : TIFFTAG_STRIPBYTECOUNTS, &bytecounts)
+	    || memcmp(offsets, ref_offsets, nstriles * sizeof(uint64)) != 0
+	    || memcmp(bytecounts, ref_bytecounts,
+		      nstriles * sizeof(uint64)) != 0) {
+		fprintf (stderr, "Wrong strile arrays.\n");
+		goto close;
+	}
+	ok = 1;
+
+close:
+	TIFFClose(tif);
+done:
+	free(ref_offsets);
+	free(ref_bytecounts);
+	return ok;
+}
+
+static int
+test_file(const char* write_mode, int tiled)
+{
+	const char	*filename = "defer_strile_loading.tif";
+	int		ok;
+
+	ok = write_image(filename, write_mode, tiled)
+	    && test_read(filename, "r")
+	    && test_read(filename, "rD")
+	    && test_read(filename, "rO")
+	    && test_read(filename, "rmO");
+	unlink(filename);
+	if (!ok)
+		fprintf (stderr, "Failed for %s, %s.\n", write_mode,
+			 tiled ? "tiled" : "stripped");
+	return ok;
+}
+
+int
+main()
+{
+	if (!test_file("w", 0)
+	    || !test_file("w", 1)
+	    || !test_file("w8", 0)
+	    || !test_file("w8", 1)
+	    || !test_file("wb", 1))
+		return 1;
+	return 0;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,201 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test TIFFDeferStrileArrayWriting() and
+ * TIFFForceStrileArrayWriting(): a full resolution image and its
+ * overviews are laid out with all the directories and strile arrays at
+ * the start of the file, followed by the tile data of each level, from
+ * the smallest overview to the full resolution image.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tifftest.h"
+
+#define NLEVELS	3
+
+const uint32	full_size = 256;
+const uint32	tile_size = 16;
+
+static int
+set_tags(TIFF* tif, int level, uint16 compression)
+{
+	uint32 size = full_size >> level;
+
+	return TIFFSetField(tif, TIFFTAG_SUBFILETYPE,
+			    level ? FILETYPE_REDUCEDIMAGE : 0)
+	    && fixture_set_tags(tif, size, size, 1, tile_size, compression);
+}
+
+static int
+write_image(const char* filename, const char* mode, uint16 compression)
+{
+	TIFF	*tif;
+	int	level, ok = 0;
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+
+	/* The directories first, without their strile arrays */
+	for (level = 0; level < NLEVELS; level++) {
+		if (!set_tags(tif, level, compression)
+		    || !TIFFDeferStrileArrayWriting(tif)
+		    || !TIFFWriteDirectory(tif)) {
+			fprintf (stderr, "Can't write directory %d.\n", level);
+			goto close;
+		}
+	}
+	if (!TIFFSetDirectory(tif, 0) || TIFFDeferStrileArrayWriting(tif)) {
+		fprintf (stderr, "Deferred writing of a written directory.\n");
+		goto close;
+	}
+
+	/* Then the strile arrays, which are sized but not filled yet */
+	for (level = 0; level < NLEVELS; level++) {
+		if (!TIFFSetDirectory(tif, (uint16) level)
+		    || !TIFFForceStrileArrayWriting(tif)) {
+			fprintf (stderr, "Can't write strile arrays %d.\n",
+				 level);
+			goto close;
+		}
+	}
+
+	/* And the image data, smallest overview first */
+	for (level = NLEVELS - 1; level >= 0; level--) {
+		if (!TIFFSetDirectory(tif, (uint16) level)) {
+			fprintf (stderr, "Can't read directory %d.\n", level);
+			goto close;
+		}
+		if (!fixture_write_image(tif, level))
+			goto close;
+		if (!TIFFForceStrileArrayWriting(tif)) {
+			fprintf (stderr, "Can't update strile arrays %d.\n",
+				 level);
+			goto close;
+		}
+	}
+	ok = 1;
+
+close:
+	TIFFClose(tif);
+	return ok;
+}
+
+static int
+check_level(TIFF* tif, int level, uint64* data_start, uint64* data_end)
+{
+	uint32		tile;
+	uint64		offset, bytecount;
+
+	for (tile = 0; tile < TIFFNumberOfTiles(tif); tile++) {
+		offset = TIFFGetStrileOffset(tif, tile);
+		bytecount = TIFFGetStrileByteCount(tif, tile);
+		if (tile == 0)
+			*data_start = offset;
+		else if (offset != *data_end) {
+			fprintf (stderr, "Tile data of level %d not "
+				 "contiguous.\n", level);
+			return 0;
+		}
+		*data_end = offset + bytecount;
+		if (!fixture_check_strile(tif, level, tile))
+			return 0;
+	}
+	return 1;
+}
+
+static int
+check_image(const char* filename, const char* mode, int entry_size)
+{
+	TIFF	*tif;
+	uint64	diroff[NLEVELS], start[NLEVELS], end[NLEVELS];
+	uint64	arrays_size = 0;
+	int	level;
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	for (level = 0; level < NLEVELS; level++) {
+		if (level > 0 && !TIFFReadDirectory(tif)) {
+			fprintf (stderr, "Missing directory %d.\n", level);
+			goto failure;
+		}
+		diroff[level] = TIFFCurrentDirOffset(tif);
+		arrays_size += 2 * (uint64) TIFFNumberOfTiles(tif) * entry_size;
+		if (!check_level(tif, level, &start[level], &end[level]))
+			goto failure;
+	}
+	if (TIFFReadDirectory(tif)) {
+		fprintf (stderr, "Too many directories.\n");
+		goto failure;
+	}
+	if (TIFFForceStrileArrayWriting(tif)) {
+		fprintf (stderr, "Strile arrays written in read-only mode.\n");
+		goto failure;
+	}
+	TIFFClose(tif);
+
+	/* Directories, then strile arrays, then smallest level first */
+	for (level = 1; level < NLEVELS; level++) {
+		if (diroff[level] <= diroff[level - 1]
+		    || end[level] != start[level - 1]) {
+			fprintf (stderr, "Wrong layout for level %d.\n", level);
+			return 0;
+		}
+	}
+	if (start[NLEVELS - 1] < diroff[NLEVELS - 1] + arrays_size) {
+		fprintf (stderr, "Image data before the strile arrays.\n");
+		return 0;
+	}
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+static int
+test_layout(const char* mode, uint16 compression)
+{
+	const char	*filename = "defer_strile_writing.tif";
+	int		entry_size = strchr(mode, '8') ? 8 : 4;
+	int		ok;
+
+	if (!TIFFIsCODECConfigured(compression))
+		return 1;
+	ok = write_image(filename, mode, compression)
+	    && check_image(filename, "r", entry_size)
+	    && check_image(filename, "rO", entry_size);
+	unlink(filename);
+	if (!ok)
+		fprintf (stderr, "Failed for %s, compression %d.\n", mode,
+			 compression);
+	return ok;
+}
+
+int
+main()
+{
+	if (!test_layout("w", COMPRESSION_NONE)
+	    || !test_layout("w8", COMPRESSION_NONE)
+	    || !test_layout("wb", COMPRESSION_LZW)
+	    || !test_layout("w8", COMPRESSION_ADOBE_DEFLATE))
+		return 1;
+	return 0;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,219 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test the linking of directories: pages written, checkpointed,
+ * appended, rewritten and unlinked, with SubIFDs in between, must leave
+ * a directory chain holding the expected pages in the expected order, in
+ * classic TIFF and BigTIFF.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH		8
+#define LENGTH		4
+#define NSUBIFDS	2
+#define REWRITTEN	0x100	/* flag for the description of a page */
+#define SUBIFD		0x200
+
+static const char	filename[] = "dir_link.tif";
+
+static void
+describe(char* description, int page)
+{
+	sprintf(description, "%s %d%s", page & SUBIFD ? "SubIFD" : "Page",
+		page & 0xff, page & REWRITTEN ? ", rewritten" : "");
+}
+
+/*
+ * Write a page, filled with its number.  The page with SubIFDs is
+ * followed by them, and the checkpointed one is written twice.
+ */
+static int
+write_page(TIFF* tif, int page, int nsubifds, int checkpoint)
+{
+	unsigned char	buf[WIDTH * LENGTH];
+	uint64		subifds[NSUBIFDS];
+	char		description[32];
+	int		i;
+
+	describe(description, page);
+	memset(buf, page & 0xff, sizeof(buf));
+	memset(subifds, 0, sizeof(subifds));
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, LENGTH)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, LENGTH)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description)
+	    || (nsubifds
+		&& !TIFFSetField(tif, TIFFTAG_SUBIFD, nsubifds, subifds))
+	    || (checkpoint && !TIFFCheckpointDirectory(tif))
+	    || TIFFWriteEncodedStrip(tif, 0, buf, sizeof(buf)) < 0
+	    || !TIFFWriteDirectory(tif)) {
+		fprintf (stderr, "Can't write %s.\n", description);
+		return 0;
+	}
+	for (i = 0; i < nsubifds; i++)
+		if (!write_page(tif, SUBIFD | i, 0, 0))
+			return 0;
+	return 1;
+}
+
+static int
+check_page(TIFF* tif, int page)
+{
+	unsigned char	buf[WIDTH * LENGTH];
+	char		description[32];
+	char		*value = NULL;
+	uint32		i;
+
+	describe(description, page);
+	if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &value)
+	    || strcmp(value, description) != 0) {
+		fprintf (stderr, "Found %s instead of %s.\n",
+			 value ? value : "no description", description);
+		return 0;
+	}
+	if (TIFFReadEncodedStrip(tif, 0, buf, sizeof(buf))
+	    != (tmsize_t) sizeof(buf)) {
+		fprintf (stderr, "Can't read %s.\n", description);
+		return 0;
+	}
+	for (i = 0; i < sizeof(buf); i++)
+		if (buf[i] != (page & 0xff)) {
+			fprintf (stderr, "Wrong data in %s.\n", description);
+			return 0;
+		}
+	return 1;
+}
+
+/* The chain must hold exactly the npages pages, with page 1's SubIFDs */
+static int
+check_chain(const int* pages, int npages)
+{
+	TIFF	*tif;
+	uint64	*subifds, offsets[NSUBIFDS];
+	uint16	nsubifds;
+	int	i, k, ok;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	ok = TIFFNumberOfDirectories(tif) == npages;
+	if (!ok)
+		fprintf (stderr, "%d directories, %d expected.\n",
+			 TIFFNumberOfDirectories(tif), npages);
+	for (i = 0; ok && i < npages; i++) {
+		ok = TIFFSetDirectory(tif, (uint16) i)
+		    && check_page(tif, pages[i]);
+		if (!ok || (pages[i] & 0xff) != 1)
+			continue;
+		if (!TIFFGetField(tif, TIFFTAG_SUBIFD, &nsubifds, &subifds)
+		    || nsubifds != NSUBIFDS) {
+			fprintf (stderr, "SubIFDs of page 1 missing.\n");
+			ok = 0;
+			continue;
+		}
+		/* Reading a SubIFD frees the array */
+		memcpy(offsets, subifds, sizeof(offsets));
+		for (k = 0; ok && k < NSUBIFDS; k++)
+			ok = TIFFSetSubDirectory(tif, offsets[k])
+			    && check_page(tif, SUBIFD | k);
+	}
+	TIFFClose(tif);
+	return ok;
+}
+
+/* Rewrite a page with a new description, in place in the chain */
+static int
+rewrite_page(TIFF* tif, int index, int page)
+{
+	char	description[32];
+
+	describe(description, page | REWRITTEN);
+	if (!TIFFSetDirectory(tif, (uint16) index)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description)
+	    || !TIFFRewriteDirectory(tif)) {
+		fprintf (stderr, "Can't rewrite page %d.\n", page);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+check(const char* mode)
+{
+	static const int	written[] = { 0, 1, 2, 3 };
+	static const int	appended[] = { 0, 1, 2, 3, 4, 5 };
+	static const int	rewritten[] = {
+		0, 1, 2 | REWRITTEN, 3, 4, 5, 6, 7 | REWRITTEN, 8
+	};
+	static const int	unlinked[] = {
+		0, 1, 2 | REWRITTEN, 4, 5, 6, 7 | REWRITTEN, 8, 9, 11
+	};
+	TIFF	*tif;
+	int	ok;
+
+	/* Page 1 has SubIFDs, page 3 is checkpointed before its data */
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = write_page(tif, 0, 0, 0) && write_page(tif, 1, NSUBIFDS, 0)
+	    && write_page(tif, 2, 0, 0) && write_page(tif, 3, 0, 1);
+	TIFFClose(tif);
+	ok = ok && check_chain(written, 4);
+
+	tif = ok ? TIFFOpen(filename, "a") : NULL;
+	ok = tif && write_page(tif, 4, 0, 0) && write_page(tif, 5, 0, 0);
+	if (tif)
+		TIFFClose(tif);
+	ok = ok && check_chain(appended, 6);
+
+	/* A page in the middle, then the last one */
+	tif = ok ? TIFFOpen(filename, "r+") : NULL;
+	ok = tif && rewrite_page(tif, 2, 2)
+	    && write_page(tif, 6, 0, 0) && write_page(tif, 7, 0, 0)
+	    && rewrite_page(tif, 7, 7) && write_page(tif, 8, 0, 0);
+	if (tif)
+		TIFFClose(tif);
+	ok = ok && check_chain(rewritten, 9);
+
+	/* A page in the middle, then the last one just appended */
+	tif = ok ? TIFFOpen(filename, "r+") : NULL;
+	ok = tif && TIFFUnlinkDirectory(tif, 4)
+	    && write_page(tif, 9, 0, 0) && write_page(tif, 10, 0, 0)
+	    && TIFFUnlinkDirectory(tif, 10) && write_page(tif, 11, 0, 0);
+	if (tif)
+		TIFFClose(tif);
+	ok = ok && check_chain(unlinked, 10);
+
+	if (!ok)
+		fprintf (stderr, "Failed in mode %s.\n", mode);
+	return ok;
+}
+
+int
+main()
+{
+	int	ok;
+
+	ok = check("w") && check("w8");
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
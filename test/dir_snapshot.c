@@ -0,0 +1,218 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test TIFFSnapshotDirectory() and TIFFRestoreDirectory():
+ * switching back and forth between directories with different codecs
+ * and layouts must give back their tags, codec fields and image data.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tifftest.h"
+
+#define NDIRS	3
+
+static const uint32	sizes[NDIRS] = { 64, 32, 16 };
+
+static uint16
+dir_compression(int dir)
+{
+	if (dir == 0)
+		return COMPRESSION_LZW;
+	if (dir == 1 && TIFFIsCODECConfigured(COMPRESSION_ADOBE_DEFLATE))
+		return COMPRESSION_ADOBE_DEFLATE;
+	return COMPRESSION_NONE;
+}
+
+static int
+write_image(const char* filename)
+{
+	TIFF	*tif;
+	char	description[32];
+	int	dir;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	for (dir = 0; dir < NDIRS; dir++) {
+		/* A tiled directory between two striped ones */
+		sprintf(description, "Directory %d", dir);
+		if (!fixture_set_tags(tif, sizes[dir], sizes[dir], dir == 1,
+				      dir == 1 ? 16 : 8, dir_compression(dir))
+		    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION,
+				     description)) {
+			fprintf (stderr, "Can't set tags.\n");
+			goto failure;
+		}
+		if (dir_compression(dir) != COMPRESSION_NONE
+		    && !TIFFSetField(tif, TIFFTAG_PREDICTOR,
+				     PREDICTOR_HORIZONTAL)) {
+			fprintf (stderr, "Can't set predictor.\n");
+			goto failure;
+		}
+		if (!fixture_write_image(tif, dir))
+			goto failure;
+		if (!TIFFWriteDirectory(tif)) {
+			fprintf (stderr, "Can't write directory %d.\n", dir);
+			goto failure;
+		}
+	}
+	if (TIFFSnapshotDirectory(tif)) {
+		fprintf (stderr, "Snapshot taken in write mode.\n");
+		goto failure;
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+/* Check that the current directory is dir, tags and data */
+static int
+check_dir(TIFF* tif, int dir)
+{
+	unsigned char	*buf;
+	char		*description, expected[32];
+	uint32		width, x, y;
+	uint16		compression, predictor;
+	int		ok = 1;
+
+	sprintf(expected, "Directory %d", dir);
+	if (TIFFCurrentDirectory(tif) != dir
+	    || !TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width)
+	    || width != sizes[dir]
+	    || !TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &description)
+	    || strcmp(description, expected) != 0
+	    || !TIFFGetField(tif, TIFFTAG_COMPRESSION, &compression)
+	    || compression != dir_compression(dir)
+	    || TIFFIsTiled(tif) != (dir == 1)) {
+		fprintf (stderr, "Wrong tags for directory %d.\n", dir);
+		return 0;
+	}
+	if (compression != COMPRESSION_NONE
+	    && (!TIFFGetField(tif, TIFFTAG_PREDICTOR, &predictor)
+		|| predictor != PREDICTOR_HORIZONTAL)) {
+		fprintf (stderr, "Wrong codec field for directory %d.\n", dir);
+		return 0;
+	}
+
+	if (TIFFIsTiled(tif)) {
+		uint32 tile;
+		for (tile = 0; ok && tile < TIFFNumberOfTiles(tif); tile++)
+			ok = fixture_check_strile(tif, dir, tile);
+		return ok;
+	}
+	/* Striped directories by scanline */
+	buf = (unsigned char*) malloc(TIFFScanlineSize(tif));
+	if (!buf)
+		return 0;
+	for (y = 0; ok && y < width; y++) {
+		if (TIFFReadScanline(tif, buf, y, 0) < 0)
+			ok = 0;
+		for (x = 0; ok && x < width; x++)
+			if (buf[x] != fixture_pixel(dir, x, y))
+				ok = 0;
+	}
+	free(buf);
+	if (!ok)
+		fprintf (stderr, "Wrong image data for directory %d.\n", dir);
+	return ok;
+}
+
+static int
+check_snapshots(const char* filename, const char* mode)
+{
+	TIFF		*tif;
+	TIFFDirSnapshot	*snap[NDIRS];
+	int		dir, round;
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+
+	/* Snapshot every directory as it is read */
+	for (dir = 0; dir < NDIRS; dir++) {
+		if ((dir > 0 && !TIFFReadDirectory(tif))
+		    || !check_dir(tif, dir))
+			goto failure;
+		snap[dir] = TIFFSnapshotDirectory(tif);
+		if (!snap[dir] || TIFFSnapshotDirectory(tif) != snap[dir]) {
+			fprintf (stderr, "Can't snapshot directory %d.\n", dir);
+			goto failure;
+		}
+	}
+
+	/* Switch back and forth, in the middle of the image data too */
+	for (round = 0; round < 4; round++) {
+		for (dir = NDIRS - 1; dir >= 0; dir--) {
+			int other = (dir + 1 + round) % NDIRS;
+			if (!TIFFRestoreDirectory(tif, snap[dir])
+			    || !check_dir(tif, dir)
+			    || !TIFFRestoreDirectory(tif, snap[other])
+			    || !check_dir(tif, other))
+				goto failure;
+		}
+	}
+
+	/* Reading on from a restored directory */
+	if (!TIFFRestoreDirectory(tif, snap[0])
+	    || !TIFFReadDirectory(tif) || !check_dir(tif, 1)
+	    || !TIFFRestoreDirectory(tif, snap[2]) || !check_dir(tif, 2)
+	    || !TIFFSetDirectory(tif, 1) || !check_dir(tif, 1)
+	    || !TIFFRestoreDirectory(tif, snap[1]) || !check_dir(tif, 1)) {
+		fprintf (stderr, "Can't mix snapshots and directory reads.\n");
+		goto failure;
+	}
+
+	/* Released snapshots, current or not */
+	TIFFFreeDirectorySnapshot(tif, snap[0]);
+	TIFFFreeDirectorySnapshot(tif, snap[1]);
+	if (!check_dir(tif, 1) || TIFFRestoreDirectory(tif, snap[1])) {
+		fprintf (stderr, "Released snapshot still usable.\n");
+		goto failure;
+	}
+	if (!TIFFRestoreDirectory(tif, snap[2]) || !check_dir(tif, 2)
+	    || !TIFFSetDirectory(tif, 0) || !check_dir(tif, 0))
+		goto failure;
+
+	/* snap[2] is released by TIFFClose() */
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	fprintf (stderr, "Failed in mode %s.\n", mode);
+	return 0;
+}
+
+int
+main()
+{
+	const char	*filename = "dir_snapshot.tif";
+	int		ok;
+
+	ok = write_image(filename)
+	    && check_snapshots(filename, "r")
+	    && check_snapshots(filename, "rm")
+	    && check_snapshots(filename, "rzO");
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,149 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Test images shared by the tests: 8-bit greyscale images, in strips or
+ * tiles, whose pixels depend on their directory and position, so that
+ * data read from the wrong place or the wrong directory is detected.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tifftest.h"
+
+/* Noisy enough for compressed striles not to be tiny */
+unsigned char
+fixture_pixel(int dir, uint32 x, uint32 y)
+{
+	return (unsigned char) ((x * 73 + y * 151 + dir * 37) ^ (x * y));
+}
+
+/*
+ * Set the tags of a width x length image, in block x block tiles or in
+ * strips of block rows.
+ */
+int
+fixture_set_tags(TIFF* tif, uint32 width, uint32 length, int tiled,
+		 uint32 block, uint16 compression)
+{
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, length)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK)
+	    || !TIFFSetField(tif, TIFFTAG_COMPRESSION, compression)
+	    || (tiled && (!TIFFSetField(tif, TIFFTAG_TILEWIDTH, block)
+			  || !TIFFSetField(tif, TIFFTAG_TILELENGTH, block)))
+	    || (!tiled && !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, block))) {
+		fprintf (stderr, "Can't set tags.\n");
+		return 0;
+	}
+	return 1;
+}
+
+static uint32
+number_of_striles(TIFF* tif)
+{
+	return TIFFIsTiled(tif) ? TIFFNumberOfTiles(tif)
+	    : TIFFNumberOfStrips(tif);
+}
+
+static tmsize_t
+strile_buffer_size(TIFF* tif)
+{
+	return TIFFIsTiled(tif) ? TIFFTileSize(tif) : TIFFStripSize(tif);
+}
+
+/* Fill buf with a strile of directory dir, returning the strile size */
+static tmsize_t
+fill_strile(TIFF* tif, int dir, uint32 strile, unsigned char* buf)
+{
+	uint32		width, length, blockwidth, blocklength, x0, y0, i;
+	tmsize_t	size;
+
+	TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+	TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &length);
+	if (TIFFIsTiled(tif)) {
+		TIFFGetField(tif, TIFFTAG_TILEWIDTH, &blockwidth);
+		TIFFGetField(tif, TIFFTAG_TILELENGTH, &blocklength);
+		x0 = strile % ((width + blockwidth - 1) / blockwidth)
+		    * blockwidth;
+		y0 = strile / ((width + blockwidth - 1) / blockwidth)
+		    * blocklength;
+		size = TIFFTileSize(tif);
+	} else {
+		TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP, &blocklength);
+		blockwidth = width;
+		x0 = 0;
+		y0 = strile * blocklength;
+		/* The last strip may be shorter */
+		if (blocklength > length - y0)
+			blocklength = length - y0;
+		size = TIFFVStripSize(tif, blocklength);
+	}
+	for (i = 0; i < (uint32) size; i++)
+		buf[i] = fixture_pixel(dir, x0 + i % blockwidth,
+				       y0 + i / blockwidth);
+	return size;
+}
+
+/* Write all the striles of the current directory, as directory dir */
+int
+fixture_write_image(TIFF* tif, int dir)
+{
+	unsigned char	*buf;
+	tmsize_t	size, written;
+	uint32		strile, nstriles = number_of_striles(tif);
+	int		ok = 1;
+
+	buf = (unsigned char*) malloc(strile_buffer_size(tif));
+	if (!buf)
+		return 0;
+	for (strile = 0; ok && strile < nstriles; strile++) {
+		size = fill_strile(tif, dir, strile, buf);
+		written = TIFFIsTiled(tif)
+		    ? TIFFWriteEncodedTile(tif, strile, buf, size)
+		    : TIFFWriteEncodedStrip(tif, strile, buf, size);
+		if (written != size) {
+			fprintf (stderr, "Can't write strile %lu of directory "
+				 "%d.\n", (unsigned long) strile, dir);
+			ok = 0;
+		}
+	}
+	free(buf);
+	return ok;
+}
+
+/* Read a strile of the current directory, which must be directory dir */
+int
+fixture_check_strile(TIFF* tif, int dir, uint32 strile)
+{
+	unsigned char	*buf, *expected;
+	tmsize_t	bufsize = strile_buffer_size(tif), size, got;
+	int		ok = 1;
+
+	buf = (unsigned char*) malloc(2 * bufsize);
+	if (!buf)
+		return 0;
+	expected = buf + bufsize;
+	size = fill_strile(tif, dir, strile, expected);
+	got = TIFFIsTiled(tif) ? TIFFReadEncodedTile(tif, strile, buf, bufsize)
+	    : TIFFReadEncodedStrip(tif, strile, buf, bufsize);
+	if (got != size) {
+		fprintf (stderr, "Can't read strile %lu of directory %d.\n",
+			 (unsigned long) strile, dir);
+		ok = 0;
+	} else if (memcmp(buf, expected, size) != 0) {
+		fprintf (stderr, "Wrong data in strile %lu of directory %d.\n",
+			 (unsigned long) strile, dir);
+		ok = 0;
+	}
+	free(buf);
+	return ok;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
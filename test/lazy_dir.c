@@ -0,0 +1,194 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test lazy directory reading ('z' open mode): array and blob
+ * tag values must read back the same as with eager reading, and fetching
+ * them on demand must not dirty the directory.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+const uint32	width = 16;
+const uint32	length = 16;
+const char	*description = "lazy directory reading test image";
+
+static uint16	cmap[3][256];
+static unsigned char	xmp[600];
+
+static int
+write_image(const char* filename)
+{
+	TIFF		*tif;
+	unsigned char	buf[16];
+	uint32		row;
+	int		i;
+
+	for (i = 0; i < 256; i++) {
+		cmap[0][i] = (uint16) (i * 257);
+		cmap[1][i] = (uint16) (65535 - i * 257);
+		cmap[2][i] = (uint16) (i * 100);
+	}
+	for (i = 0; i < (int) sizeof(xmp); i++)
+		xmp[i] = (unsigned char) ('a' + i % 26);
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, length)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, length)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_PALETTE)
+	    || !TIFFSetField(tif, TIFFTAG_COLORMAP, cmap[0], cmap[1], cmap[2])
+	    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description)
+	    || !TIFFSetField(tif, TIFFTAG_XMLPACKET, (uint32) sizeof(xmp), xmp)) {
+		fprintf (stderr, "Can't set tags.\n");
+		TIFFClose(tif);
+		return 0;
+	}
+	for (row = 0; row < length; row++) {
+		memset(buf, (int) row, sizeof(buf));
+		if (TIFFWriteScanline(tif, buf, row, 0) < 0) {
+			fprintf (stderr, "Can't write image data.\n");
+			TIFFClose(tif);
+			return 0;
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+}
+
+static int
+check_tags(TIFF* tif)
+{
+	uint16	*r, *g, *b;
+	char	*desc;
+	uint32	count;
+	void	*data;
+
+	if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &desc)
+	    || strcmp(desc, description) != 0) {
+		fprintf (stderr, "Wrong ImageDescription.\n");
+		return 0;
+	}
+	if (!TIFFGetField(tif, TIFFTAG_COLORMAP, &r, &g, &b)
+	    || memcmp(r, cmap[0], sizeof(cmap[0])) != 0
+	    || memcmp(g, cmap[1], sizeof(cmap[1])) != 0
+	    || memcmp(b, cmap[2], sizeof(cmap[2])) != 0) {
+		fprintf (stderr, "Wrong Colormap.\n");
+		return 0;
+	}
+	if (!TIFFGetField(tif, TIFFTAG_XMLPACKET, &count, &data)
+	    || count != sizeof(xmp) || memcmp(data, xmp, sizeof(xmp)) != 0) {
+		fprintf (stderr, "Wrong XMLPacket.\n");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+test_read(const char* filename, const char* mode)
+{
+	TIFF	*tif;
+	int	eager_count, ok;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	eager_count = TIFFGetTagListCount(tif);
+	TIFFClose(tif);
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = check_tags(tif);
+	TIFFClose(tif);
+	if (!ok)
+		return 0;
+
+	/* Enumerating the custom tags must bring in the deferred ones */
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (TIFFGetTagListCount(tif) != eager_count) {
+		fprintf (stderr, "Wrong number of custom tags.\n");
+		TIFFClose(tif);
+		return 0;
+	}
+	ok = check_tags(tif);
+	TIFFClose(tif);
+	return ok;
+}
+
+static int
+test_unchanged(const char* filename)
+{
+	TIFF	*tif;
+	FILE	*fp;
+	long	before, after;
+
+	fp = fopen(filename, "rb");
+	if (!fp || fseek(fp, 0, SEEK_END) != 0)
+		return 0;
+	before = ftell(fp);
+	fclose(fp);
+
+	tif = TIFFOpen(filename, "r+z");
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!check_tags(tif)) {
+		TIFFClose(tif);
+		return 0;
+	}
+	TIFFClose(tif);
+
+	fp = fopen(filename, "rb");
+	if (!fp || fseek(fp, 0, SEEK_END) != 0)
+		return 0;
+	after = ftell(fp);
+	fclose(fp);
+	if (before != after) {
+		fprintf (stderr, "Directory rewritten after lazy fetches.\n");
+		return 0;
+	}
+	return 1;
+}
+
+int
+main()
+{
+	const char	*filename = "lazy_dir.tif";
+	int		ok;
+
+	ok = write_image(filename)
+	    && test_read(filename, "rz")
+	    && test_read(filename, "rzm")
+	    && test_unchanged(filename);
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,159 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test TIFFTAG_LZMATHREADS: a strip large enough to be split
+ * into several blocks by the multithreaded encoder must decode with a
+ * single thread, and a strip written with a single thread must decode
+ * with several, by strip and by scanline.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tifftest.h"
+#include "lzma.h"
+
+#define WIDTH	1024
+#define LENGTH	1536	/* 1.5 megabytes, blocks being of one at preset 1 */
+#define THREADS	4
+
+static const char	filename[] = "lzma_threads.tif";
+
+static int
+write_image(int threads)
+{
+	TIFF	*tif;
+	int	ok;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = fixture_set_tags(tif, WIDTH, LENGTH, 0, LENGTH, COMPRESSION_LZMA)
+	    && TIFFSetField(tif, TIFFTAG_LZMAPRESET, 1)
+	    && TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads)
+	    && fixture_write_image(tif, 0);
+	if (!ok)
+		fprintf (stderr, "Can't write strip with %d threads.\n",
+			 threads);
+	TIFFClose(tif);
+	return ok;
+}
+
+/* Number of blocks of the xz stream in the strip, 0 on error */
+static lzma_vli
+count_blocks(TIFF* tif)
+{
+	uint64		*bytecounts;
+	uint8		*raw;
+	tmsize_t	size;
+	lzma_stream_flags	flags;
+	lzma_index	*index = NULL;
+	uint64_t	memlimit = UINT64_MAX;
+	size_t		pos = 0;
+	lzma_vli	count = 0;
+
+	if (!TIFFGetField(tif, TIFFTAG_STRIPBYTECOUNTS, &bytecounts))
+		return 0;
+	size = (tmsize_t) bytecounts[0];
+	raw = (uint8*) malloc(size);
+	if (!raw)
+		return 0;
+	if (size > LZMA_STREAM_HEADER_SIZE
+	    && TIFFReadRawStrip(tif, 0, raw, size) == size
+	    && lzma_stream_footer_decode(&flags,
+		raw + size - LZMA_STREAM_HEADER_SIZE) == LZMA_OK
+	    && flags.backward_size < (lzma_vli) size - LZMA_STREAM_HEADER_SIZE
+	    && lzma_index_buffer_decode(&index, &memlimit, NULL,
+		raw + size - LZMA_STREAM_HEADER_SIZE - flags.backward_size,
+		&pos, (size_t) flags.backward_size) == LZMA_OK) {
+		count = lzma_index_block_count(index);
+		lzma_index_end(index, NULL);
+	}
+	free(raw);
+	return count;
+}
+
+static int
+check_row(const unsigned char* buf, uint32 y)
+{
+	uint32	x;
+
+	for (x = 0; x < WIDTH; x++)
+		if (buf[x] != fixture_pixel(0, x, y)) {
+			fprintf (stderr, "Wrong value at row %lu, column %lu.\n",
+				 (unsigned long) y, (unsigned long) x);
+			return 0;
+		}
+	return 1;
+}
+
+static int
+read_image(int threads, lzma_vli nblocks)
+{
+	TIFF		*tif;
+	unsigned char	buf[WIDTH];
+	lzma_vli	count;
+	uint32		y;
+	int		ok;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	count = count_blocks(tif);
+	ok = count == nblocks
+	    || (nblocks > 1 && count > 1);
+	if (!ok)
+		fprintf (stderr, "Strip has %lu blocks, %lu expected.\n",
+			 (unsigned long) count, (unsigned long) nblocks);
+	ok = ok && TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads)
+	    && fixture_check_strile(tif, 0, 0);
+	if (!ok)
+		fprintf (stderr, "Failed reading with %d threads.\n", threads);
+	TIFFClose(tif);
+
+	/* Scanlines, from a handle that did not decode the strip yet */
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	ok = ok && TIFFSetField(tif, TIFFTAG_LZMATHREADS, threads);
+	for (y = 0; ok && y < LENGTH; y++) {
+		if (TIFFReadScanline(tif, buf, y, 0) < 0) {
+			fprintf (stderr, "Can't read scanline %lu with %d "
+				 "threads.\n", (unsigned long) y, threads);
+			ok = 0;
+		} else
+			ok = check_row(buf, y);
+	}
+	TIFFClose(tif);
+	return ok;
+}
+
+int
+main()
+{
+	/* Without the multithreaded encoder, strips are one block */
+	lzma_vli	nblocks = 1;
+	int		ok;
+
+#if LZMA_VERSION >= 50020002
+	nblocks = 2;
+#endif
+	ok = write_image(THREADS) && read_image(1, nblocks)
+	    && write_image(1) && read_image(THREADS, 1)
+	    && write_image(THREADS) && read_image(THREADS, nblocks);
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
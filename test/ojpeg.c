@@ -0,0 +1,192 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test the old-style JPEG codec on images/ycbcr-3c-8b.ojpeg.tiff,
+ * a crop of images/rgb-3c-8b.tiff.  Strips must decode the same whether
+ * the file is memory-mapped or read, and whether they are read in order
+ * or not, and the image must decode close to the original pixels.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tiffio.h"
+
+#define WIDTH	128
+#define LENGTH	128
+#define XOFF	12	/* position of the crop in rgb-3c-8b.tiff */
+#define YOFF	12
+
+static const char	ojpegfile[] = "images/ycbcr-3c-8b.ojpeg.tiff";
+static const char	rgbfile[] = "images/rgb-3c-8b.tiff";
+
+static TIFF*
+open_image(const char* name, const char* mode)
+{
+	const char	*srcdir = getenv("srcdir");
+	char		path[1024];
+	TIFF		*tif;
+
+	if (srcdir == NULL)
+		srcdir = ".";
+	if (strlen(srcdir) + 1 + strlen(name) >= sizeof(path)) {
+		fprintf (stderr, "srcdir too long %s\n", srcdir);
+		return NULL;
+	}
+	sprintf(path, "%s/%s", srcdir, name);
+	tif = TIFFOpen(path, mode);
+	if (!tif)
+		fprintf (stderr, "Could not open %s\n", path);
+	return tif;
+}
+
+/*
+ * Decode all strips, in order or last to first, each into its place in
+ * buf.
+ */
+static int
+read_strips(const char* mode, int backwards, unsigned char** pbuf,
+	    tmsize_t* psize)
+{
+	TIFF		*tif;
+	unsigned char	*buf;
+	tmsize_t	stripsize;
+	uint32		nstrips, i;
+	int		ok = 1;
+
+	tif = open_image(ojpegfile, mode);
+	if (!tif)
+		return 0;
+	stripsize = TIFFStripSize(tif);
+	nstrips = TIFFNumberOfStrips(tif);
+	buf = (unsigned char*) malloc(stripsize * nstrips);
+	if (!buf) {
+		TIFFClose(tif);
+		return 0;
+	}
+	for (i = 0; ok && i < nstrips; i++) {
+		uint32 strip = backwards ? nstrips - 1 - i : i;
+
+		if (TIFFReadEncodedStrip(tif, strip, buf + strip * stripsize,
+					 stripsize) != stripsize) {
+			fprintf (stderr, "Can't read strip %lu in mode %s.\n",
+				 (unsigned long) strip, mode);
+			ok = 0;
+		}
+	}
+	TIFFClose(tif);
+	if (!ok) {
+		free(buf);
+		return 0;
+	}
+	*pbuf = buf;
+	*psize = stripsize * nstrips;
+	return 1;
+}
+
+/* The RGBA image must be close to the crop of the original it came from */
+static int
+check_rgba(const char* mode, const uint32* orig, uint32 origwidth)
+{
+	TIFF		*tif;
+	uint32		*rgba;
+	uint32		x, y;
+	unsigned long	sum = 0, maxdiff = 0;
+	int		ok;
+
+	tif = open_image(ojpegfile, mode);
+	if (!tif)
+		return 0;
+	rgba = (uint32*) _TIFFmalloc(WIDTH * LENGTH * sizeof(uint32));
+	ok = rgba != NULL
+	    && TIFFReadRGBAImageOriented(tif, WIDTH, LENGTH, rgba,
+					 ORIENTATION_TOPLEFT, 0);
+	TIFFClose(tif);
+	if (!ok) {
+		fprintf (stderr, "Can't read RGBA image in mode %s.\n", mode);
+		_TIFFfree(rgba);
+		return 0;
+	}
+	for (y = 0; y < LENGTH; y++)
+		for (x = 0; x < WIDTH; x++) {
+			uint32 p = rgba[y * WIDTH + x];
+			uint32 q = orig[(y + YOFF) * origwidth + x + XOFF];
+			int d[3];
+			int i;
+
+			d[0] = (int) TIFFGetR(p) - (int) TIFFGetR(q);
+			d[1] = (int) TIFFGetG(p) - (int) TIFFGetG(q);
+			d[2] = (int) TIFFGetB(p) - (int) TIFFGetB(q);
+			for (i = 0; i < 3; i++) {
+				unsigned long a = d[i] < 0 ? -d[i] : d[i];
+				sum += a;
+				if (a > maxdiff)
+					maxdiff = a;
+			}
+		}
+	_TIFFfree(rgba);
+	/*
+	 * Quality 95 JPEG with 2x2 chroma subsampling of a noisy image: the
+	 * mean difference is about 4.5, and misplaced data would give more
+	 * than 20.
+	 */
+	if (sum > 6UL * WIDTH * LENGTH * 3 || maxdiff > 128) {
+		fprintf (stderr, "Image too far from the original in mode %s: "
+			 "mean difference %.2f, maximum %lu.\n", mode,
+			 (double) sum / (WIDTH * LENGTH * 3), maxdiff);
+		return 0;
+	}
+	return 1;
+}
+
+int
+main()
+{
+	TIFF		*tif;
+	unsigned char	*mapped = NULL, *read = NULL, *backwards = NULL;
+	tmsize_t	size, size2, size3;
+	uint32		*orig = NULL;
+	uint32		width = 0, length = 0;
+	int		ok;
+
+	ok = read_strips("r", 0, &mapped, &size)
+	    && read_strips("rm", 0, &read, &size2)
+	    && read_strips("rm", 1, &backwards, &size3);
+	if (ok && (size != size2 || memcmp(mapped, read, size) != 0)) {
+		fprintf (stderr, "Strips differ when the file is not mapped.\n");
+		ok = 0;
+	}
+	if (ok && (size != size3 || memcmp(mapped, backwards, size) != 0)) {
+		fprintf (stderr, "Strips differ when read out of order.\n");
+		ok = 0;
+	}
+
+	tif = ok ? open_image(rgbfile, "r") : NULL;
+	if (tif) {
+		TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &width);
+		TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &length);
+		orig = (uint32*) _TIFFmalloc(width * length * sizeof(uint32));
+		if (!orig || width < XOFF + WIDTH || length < YOFF + LENGTH
+		    || !TIFFReadRGBAImageOriented(tif, width, length, orig,
+						  ORIENTATION_TOPLEFT, 0)) {
+			fprintf (stderr, "Can't read %s.\n", rgbfile);
+			ok = 0;
+		}
+		TIFFClose(tif);
+	} else
+		ok = 0;
+	ok = ok && check_rgba("r", orig, width) && check_rgba("rm", orig, width);
+
+	free(mapped);
+	free(read);
+	free(backwards);
+	_TIFFfree(orig);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
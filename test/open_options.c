@@ -0,0 +1,401 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test TIFFOpenExt() with per-handle allocator callbacks,
+ * directory arena allocator, memory accounting and memory limits.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+const uint32	width = 64;
+const uint32	length = 64;
+const uint32	rows_per_strip = 8;
+
+/*
+ * Every block handed out by the test allocator carries a header, so a
+ * block freed by the wrong allocator is caught.
+ */
+#define BLOCK_MAGIC	0x54494646
+
+typedef union {
+	struct {
+		uint32	magic;
+		tmsize_t size;
+	} h;
+	double	align;
+} block_header;
+
+typedef struct {
+	long	outstanding;
+	long	allocs;
+	long	foreign;
+} alloc_stats;
+
+static void*
+test_alloc(void* user_data, tmsize_t size)
+{
+	alloc_stats* stats = (alloc_stats*) user_data;
+	block_header* b = (block_header*) malloc(sizeof(block_header) + size);
+
+	if (!b)
+		return NULL;
+	b->h.magic = BLOCK_MAGIC;
+	b->h.size = size;
+	stats->outstanding++;
+	stats->allocs++;
+	return b + 1;
+}
+
+static void
+test_free(void* user_data, void* p)
+{
+	alloc_stats* stats = (alloc_stats*) user_data;
+	block_header* b;
+
+	if (!p)
+		return;
+	b = (block_header*) p - 1;
+	if (b->h.magic != BLOCK_MAGIC) {
+		stats->foreign++;
+		return;
+	}
+	b->h.magic = 0;
+	stats->outstanding--;
+	free(b);
+}
+
+static void*
+test_realloc(void* user_data, void* p, tmsize_t size)
+{
+	alloc_stats* stats = (alloc_stats*) user_data;
+	block_header* b;
+
+	if (!p)
+		return test_alloc(user_data, size);
+	b = (block_header*) p - 1;
+	if (b->h.magic != BLOCK_MAGIC) {
+		stats->foreign++;
+		return NULL;
+	}
+	b = (block_header*) realloc(b, sizeof(block_header) + size);
+	if (!b)
+		return NULL;
+	b->h.size = size;
+	return b + 1;
+}
+
+static int
+write_image(const char* filename, TIFFOpenOptions* opts, uint16 compression)
+{
+	TIFF		*tif;
+	unsigned char	buf[64];
+	uint32		row;
+
+	tif = TIFFOpenExt(filename, "w", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, length)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, rows_per_strip)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK)
+	    || !TIFFSetField(tif, TIFFTAG_COMPRESSION, compression)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, "open options")) {
+		fprintf (stderr, "Can't set tags.\n");
+		TIFFClose(tif);
+		return 0;
+	}
+	for (row = 0; row < length; row++) {
+		memset(buf, (int) row, sizeof(buf));
+		if (TIFFWriteScanline(tif, buf, row, 0) < 0) {
+			fprintf (stderr, "Can't write image data.\n");
+			TIFFClose(tif);
+			return 0;
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+}
+
+static int
+read_image(const char* filename, TIFFOpenOptions* opts, int accounting)
+{
+	TIFF		*tif;
+	unsigned char	buf[64];
+	uint32		row;
+	uint64		current, peak, total;
+	char		*desc;
+
+	tif = TIFFOpenExt(filename, "r", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &desc)
+	    || strcmp(desc, "open options") != 0) {
+		fprintf (stderr, "Wrong ImageDescription.\n");
+		goto failure;
+	}
+	for (row = 0; row < length; row++) {
+		if (TIFFReadScanline(tif, buf, row, 0) < 0) {
+			fprintf (stderr, "Can't read image data.\n");
+			goto failure;
+		}
+		if (buf[0] != (unsigned char) row
+		    || buf[sizeof(buf) - 1] != (unsigned char) row) {
+			fprintf (stderr, "Wrong data in row %lu.\n",
+				 (unsigned long) row);
+			goto failure;
+		}
+	}
+	if (TIFFGetMemoryUsage(tif, &current, &peak, &total) != accounting) {
+		fprintf (stderr, "Unexpected TIFFGetMemoryUsage() result.\n");
+		goto failure;
+	}
+	if (accounting && (current == 0 || peak < current || total < peak
+			   || peak < (uint64) TIFFStripSize(tif))) {
+		fprintf (stderr, "Inconsistent memory usage: current %lu, "
+			 "peak %lu, total %lu.\n", (unsigned long) current,
+			 (unsigned long) peak, (unsigned long) total);
+		goto failure;
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+static int
+test_options(uint16 compression, int accounting)
+{
+	const char	*filename = "open_options.tif";
+	TIFFOpenOptions	*opts;
+	alloc_stats	stats;
+	int		ok;
+
+	if (!TIFFIsCODECConfigured(compression))
+		return 1;
+
+	memset(&stats, 0, sizeof(stats));
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts) {
+		fprintf (stderr, "Can't allocate open options.\n");
+		return 0;
+	}
+	TIFFOpenOptionsSetAllocator(opts, test_alloc, test_realloc, test_free,
+				    &stats);
+	TIFFOpenOptionsSetMemoryAccounting(opts, accounting);
+
+	ok = write_image(filename, opts, compression)
+	    && read_image(filename, opts, accounting);
+	TIFFOpenOptionsFree(opts);
+	unlink(filename);
+
+	if (!ok)
+		return 0;
+	if (stats.allocs == 0) {
+		fprintf (stderr, "Allocator callback was never called.\n");
+		return 0;
+	}
+	if (stats.outstanding != 0 || stats.foreign != 0) {
+		fprintf (stderr, "Compression %d: %ld blocks leaked, %ld foreign "
+			 "blocks freed.\n", compression, stats.outstanding,
+			 stats.foreign);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+test_limits(void)
+{
+	const char	*filename = "open_options_limits.tif";
+	TIFFOpenOptions	*opts;
+	alloc_stats	stats;
+	TIFF		*tif;
+	void		*p;
+	uint64		remaining, refused, current;
+	int		ok = 0;
+
+	memset(&stats, 0, sizeof(stats));
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts) {
+		fprintf (stderr, "Can't allocate open options.\n");
+		return 0;
+	}
+	if (!write_image(filename, opts, COMPRESSION_NONE))
+		goto done;
+	TIFFOpenOptionsSetAllocator(opts, test_alloc, test_realloc, test_free,
+				    &stats);
+
+	/* Too small a budget to even open the file */
+	TIFFOpenOptionsSetMaxCumulatedMemAlloc(opts, 256);
+	tif = TIFFOpenExt(filename, "r", opts);
+	if (tif) {
+		fprintf (stderr, "Open succeeded beyond the memory budget.\n");
+		TIFFClose(tif);
+		goto done;
+	}
+
+	TIFFOpenOptionsSetMaxSingleMemAlloc(opts, 64 * 1024);
+	TIFFOpenOptionsSetMaxCumulatedMemAlloc(opts, 256 * 1024);
+	tif = TIFFOpenExt(filename, "r", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		goto done;
+	}
+	if (!TIFFGetMemoryBudget(tif, &remaining, &refused) || refused != 0
+	    || !TIFFGetMemoryUsage(tif, &current, NULL, NULL)
+	    || current + remaining != 256 * 1024) {
+		fprintf (stderr, "Inconsistent memory budget.\n");
+		goto close;
+	}
+	if (_TIFFmallocExt(tif, 64 * 1024 + 1) != NULL) {
+		fprintf (stderr, "Single allocation limit not enforced.\n");
+		goto close;
+	}
+	p = _TIFFmallocExt(tif, 60 * 1024);
+	if (!p) {
+		fprintf (stderr, "Allocation within the limits failed.\n");
+		goto close;
+	}
+	if (_TIFFreallocExt(tif, p, 128 * 1024) != NULL) {
+		fprintf (stderr, "Single reallocation limit not enforced.\n");
+		_TIFFfreeExt(tif, p);
+		goto close;
+	}
+	_TIFFfreeExt(tif, p);
+	if (_TIFFmallocExt(tif, (tmsize_t) remaining + 1) != NULL
+	    || !TIFFGetMemoryBudget(tif, NULL, &refused) || refused != 3) {
+		fprintf (stderr, "Cumulated allocation limit not enforced.\n");
+		goto close;
+	}
+	ok = 1;
+
+close:
+	TIFFClose(tif);
+done:
+	TIFFOpenOptionsFree(opts);
+	unlink(filename);
+	if (ok && (stats.outstanding != 0 || stats.foreign != 0)) {
+		fprintf (stderr, "Limits: %ld blocks leaked, %ld foreign "
+			 "blocks freed.\n", stats.outstanding, stats.foreign);
+		ok = 0;
+	}
+	return ok;
+}
+
+/*
+ * Directory arena blocks from their own allocator, within the memory
+ * accounting and limits of the handle.
+ */
+static int
+test_arena(void)
+{
+	const char	*filename = "open_options_arena.tif";
+	TIFFOpenOptions	*opts;
+	alloc_stats	arena;
+	TIFF		*tif = NULL;
+	char		desc[16 * 1024];
+	uint64		before, after, refused;
+	int		ok = 0;
+
+	memset(&arena, 0, sizeof(arena));
+	memset(desc, 'x', sizeof(desc) - 1);
+	desc[sizeof(desc) - 1] = '\0';
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts) {
+		fprintf (stderr, "Can't allocate open options.\n");
+		return 0;
+	}
+	TIFFOpenOptionsSetDirectoryAllocator(opts, test_alloc, test_free,
+					     &arena);
+	TIFFOpenOptionsSetMemoryAccounting(opts, 1);
+	if (!write_image(filename, opts, COMPRESSION_NONE)
+	    || !read_image(filename, opts, 1))
+		goto done;
+	if (arena.allocs == 0) {
+		fprintf (stderr, "Arena allocator was never called.\n");
+		goto done;
+	}
+
+	/* A large tag value gets an arena block of its own */
+	tif = TIFFOpenExt(filename, "r", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		goto done;
+	}
+	if (!TIFFGetMemoryUsage(tif, &before, NULL, NULL)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, desc)
+	    || !TIFFGetMemoryUsage(tif, &after, NULL, NULL)
+	    || after < before + sizeof(desc)) {
+		fprintf (stderr, "Arena block not accounted for.\n");
+		goto done;
+	}
+	TIFFClose(tif);
+
+	/* and counts against the limits */
+	TIFFOpenOptionsSetMaxSingleMemAlloc(opts, 8 * 1024);
+	tif = TIFFOpenExt(filename, "r", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		goto done;
+	}
+	if (TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, desc)
+	    || !TIFFGetMemoryBudget(tif, NULL, &refused) || refused != 1) {
+		fprintf (stderr, "Limit not enforced on arena blocks.\n");
+		goto done;
+	}
+	ok = 1;
+
+done:
+	if (tif)
+		TIFFClose(tif);
+	TIFFOpenOptionsFree(opts);
+	unlink(filename);
+	if (ok && (arena.outstanding != 0 || arena.foreign != 0)) {
+		fprintf (stderr, "Arena: %ld blocks leaked, %ld foreign "
+			 "blocks freed.\n", arena.outstanding, arena.foreign);
+		ok = 0;
+	}
+	return ok;
+}
+
+int
+main()
+{
+	static const uint16 schemes[] = {
+		COMPRESSION_NONE, COMPRESSION_LZW, COMPRESSION_PACKBITS,
+		COMPRESSION_ADOBE_DEFLATE, COMPRESSION_LZMA
+	};
+	size_t	i;
+
+	for (i = 0; i < sizeof(schemes) / sizeof(schemes[0]); i++) {
+		if (!test_options(schemes[i], 0)
+		    || !test_options(schemes[i], 1))
+			return 1;
+	}
+	if (!test_limits() || !test_arena())
+		return 1;
+	return 0;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,245 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test the PixarLog codec: 1-sample and separate plane images,
+ * in 8-bit and float data formats, must decode back to their values,
+ * whether read by scanline or by strip.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH	256
+#define LENGTH	192
+#define ROWS	96
+
+static const char	filename[] = "pixarlog.tif";
+
+/*
+ * Noisy enough not to compress much: where partial strip reading is
+ * enabled, 8-bit strips are then read in several chunks.
+ */
+static uint8
+sample_8bit(uint32 x, uint32 y, int s)
+{
+	return (uint8) ((x * 73 + y * 151 + s * 37) ^ (x * y));
+}
+
+static float
+sample_float(uint32 x, uint32 y, int s)
+{
+	return (float) (0.01 + sample_8bit(x, y, s) / 64.);
+}
+
+static int
+write_image(uint16 spp, uint16 planar, uint16 bps)
+{
+	TIFF	*tif;
+	float	fbuf[WIDTH * 3];
+	uint8	buf[WIDTH * 3];
+	uint16	nplanes = planar == PLANARCONFIG_SEPARATE ? spp : 1;
+	uint16	nsamples = planar == PLANARCONFIG_SEPARATE ? 1 : spp;
+	uint32	x, y;
+	int	s;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, LENGTH)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, bps == 32 ?
+			     SAMPLEFORMAT_IEEEFP : SAMPLEFORMAT_UINT)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, planar)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, spp == 1 ?
+			     PHOTOMETRIC_MINISBLACK : PHOTOMETRIC_RGB)
+	    || !TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_PIXARLOG)
+	    || !TIFFSetField(tif, TIFFTAG_PIXARLOGDATAFMT, bps == 32 ?
+			     PIXARLOGDATAFMT_FLOAT : PIXARLOGDATAFMT_8BIT)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, ROWS)) {
+		fprintf (stderr, "Can't set tags.\n");
+		goto failure;
+	}
+	for (s = 0; s < nplanes; s++) {
+		for (y = 0; y < LENGTH; y++) {
+			for (x = 0; x < WIDTH; x++) {
+				int i;
+				for (i = 0; i < nsamples; i++) {
+					fbuf[x * nsamples + i] =
+					    sample_float(x, y, s + i);
+					buf[x * nsamples + i] =
+					    sample_8bit(x, y, s + i);
+				}
+			}
+			if (TIFFWriteScanline(tif, bps == 32 ? (void*) fbuf :
+					      (void*) buf, y, (uint16) s) < 0) {
+				fprintf (stderr, "Can't write scanline %lu.\n",
+					 (unsigned long) y);
+				goto failure;
+			}
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+/*
+ * Check nrows rows of plane s decoded into buf, starting at row y.  The
+ * log coding keeps 8-bit data exact.
+ */
+static int
+check_rows(const void* buf, uint32 y, uint32 nrows, int s, uint16 nsamples,
+	   uint16 bps)
+{
+	uint32	x, row;
+	int	i;
+
+	for (row = 0; row < nrows; row++)
+		for (x = 0; x < WIDTH; x++)
+			for (i = 0; i < nsamples; i++) {
+				uint32 k = (row * WIDTH + x) * nsamples + i;
+				if (bps == 32) {
+					double v = sample_float(x, y + row,
+								s + i);
+					if (fabs(((const float*) buf)[k] - v)
+					    > 0.01 * v)
+						goto failure;
+				} else if (((const uint8*) buf)[k]
+					   != sample_8bit(x, y + row, s + i))
+					goto failure;
+			}
+	return 1;
+
+failure:
+	fprintf (stderr, "Wrong value at row %lu, column %lu, sample %d.\n",
+		 (unsigned long) (y + row), (unsigned long) x, s + i);
+	return 0;
+}
+
+static TIFF*
+open_image(uint16 bps, const char* mode)
+{
+	TIFF	*tif;
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif)
+		return NULL;
+	if (!TIFFSetField(tif, TIFFTAG_PIXARLOGDATAFMT, bps == 32 ?
+			  PIXARLOGDATAFMT_FLOAT : PIXARLOGDATAFMT_8BIT)) {
+		TIFFClose(tif);
+		return NULL;
+	}
+	return tif;
+}
+
+/* Scanline reads, from the file or from its mapping */
+static int
+check_scanlines(uint16 nplanes, uint16 nsamples, uint16 bps,
+		const char* mode)
+{
+	TIFF	*tif;
+	float	buf[WIDTH * 3];
+	uint32	y;
+	int	s, ok = 1;
+
+	tif = open_image(bps, mode);
+	if (!tif)
+		return 0;
+	for (s = 0; ok && s < nplanes; s++)
+		for (y = 0; ok && y < LENGTH; y++) {
+			if (TIFFReadScanline(tif, buf, y, (uint16) s) < 0) {
+				fprintf (stderr, "Can't read scanline %lu.\n",
+					 (unsigned long) y);
+				ok = 0;
+			} else
+				ok = check_rows(buf, y, 1, s, nsamples, bps);
+		}
+	TIFFClose(tif);
+	return ok;
+}
+
+static int
+check_strips(uint16 nplanes, uint16 nsamples, uint16 bps)
+{
+	TIFF	*tif;
+	float	*buf;
+	uint32	strip, nstrips = LENGTH / ROWS;
+	int	s, ok = 1;
+
+	tif = open_image(bps, "r");
+	if (!tif)
+		return 0;
+	buf = (float*) malloc(ROWS * WIDTH * 3 * sizeof(float));
+	if (!buf) {
+		TIFFClose(tif);
+		return 0;
+	}
+	for (s = 0; ok && s < nplanes; s++)
+		for (strip = 0; ok && strip < nstrips; strip++) {
+			if (TIFFReadEncodedStrip(tif, s * nstrips + strip,
+						 buf, (tmsize_t) -1)
+			    != TIFFStripSize(tif)) {
+				fprintf (stderr, "Can't read strip %lu.\n",
+					 (unsigned long) strip);
+				ok = 0;
+			} else
+				ok = check_rows(buf, strip * ROWS, ROWS, s,
+						nsamples, bps);
+		}
+	free(buf);
+	TIFFClose(tif);
+	return ok;
+}
+
+static int
+check(uint16 spp, uint16 planar, uint16 bps)
+{
+	uint16	nplanes = planar == PLANARCONFIG_SEPARATE ? spp : 1;
+	uint16	nsamples = planar == PLANARCONFIG_SEPARATE ? 1 : spp;
+	int	ok;
+
+	if (!write_image(spp, planar, bps))
+		return 0;
+	ok = check_scanlines(nplanes, nsamples, bps, "r")
+	    && check_scanlines(nplanes, nsamples, bps, "rm")
+	    && check_strips(nplanes, nsamples, bps);
+	if (!ok)
+		fprintf (stderr, "Failed with %d samples, planar config %d, "
+			 "%d bits.\n", spp, planar, bps);
+	return ok;
+}
+
+int
+main()
+{
+	int	ok;
+
+	ok = check(1, PLANARCONFIG_CONTIG, 8)
+	    && check(1, PLANARCONFIG_CONTIG, 32)
+	    && check(3, PLANARCONFIG_SEPARATE, 8)
+	    && check(3, PLANARCONFIG_SEPARATE, 32)
+	    && check(3, PLANARCONFIG_CONTIG, 8);
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
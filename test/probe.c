@@ -0,0 +1,274 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test TIFFProbeDirectories() and TIFFProbeFile(): what they
+ * report must agree with TIFFGetField() after a full directory read, in
+ * classic, BigTIFF and big-endian files.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define NDIRS	3
+
+static const char	filename[] = "probe.tif";
+
+static int
+write_dir(TIFF* tif, int dir)
+{
+	unsigned char	buf[64 * 4 * 3];
+	uint32		width = 64 >> dir, length = 48 >> dir, row;
+	uint16		spp = dir == 0 ? 3 : (dir == 1 ? 1 : 2);
+	uint16		bps = dir == 0 ? 8 : (dir == 1 ? 16 : 32);
+
+	memset(buf, 0x5a, sizeof(buf));
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, length)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, bps)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, dir == 0
+			     ? PHOTOMETRIC_RGB : PHOTOMETRIC_MINISBLACK))
+		return 0;
+	switch (dir) {
+	case 0:
+		if (!TIFFSetField(tif, TIFFTAG_COMPRESSION, COMPRESSION_LZW)
+		    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG,
+				     PLANARCONFIG_CONTIG)
+		    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 4))
+			return 0;
+		for (row = 0; row < length; row++)
+			if (TIFFWriteScanline(tif, buf, row, 0) < 0)
+				return 0;
+		break;
+	case 1:
+		if (!TIFFSetField(tif, TIFFTAG_SUBFILETYPE,
+				  FILETYPE_REDUCEDIMAGE)
+		    || !TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,
+				     SAMPLEFORMAT_INT)
+		    || !TIFFSetField(tif, TIFFTAG_TILEWIDTH, 16)
+		    || !TIFFSetField(tif, TIFFTAG_TILELENGTH, 16)
+		    || TIFFWriteEncodedTile(tif, 0, buf, 16 * 16 * 2) < 0
+		    || TIFFWriteEncodedTile(tif, 1, buf, 16 * 16 * 2) < 0)
+			return 0;
+		break;
+	default:
+		if (!TIFFSetField(tif, TIFFTAG_SUBFILETYPE,
+				  FILETYPE_REDUCEDIMAGE)
+		    || !TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT,
+				     SAMPLEFORMAT_IEEEFP)
+		    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG,
+				     PLANARCONFIG_SEPARATE)
+		    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, length))
+			return 0;
+		for (row = 0; row < length; row++)
+			if (TIFFWriteScanline(tif, buf, row, 0) < 0
+			    || TIFFWriteScanline(tif, buf, row, 1) < 0)
+				return 0;
+		break;
+	}
+	return TIFFWriteDirectory(tif);
+}
+
+static int
+write_file(const char* mode)
+{
+	TIFF	*tif;
+	int	dir;
+
+	tif = TIFFOpen(filename, mode);
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	for (dir = 0; dir < NDIRS; dir++)
+		if (!write_dir(tif, dir)) {
+			fprintf (stderr, "Can't write directory %d.\n", dir);
+			TIFFClose(tif);
+			return 0;
+		}
+	TIFFClose(tif);
+	return 1;
+}
+
+static int
+same_u16(TIFF* tif, uint32 tag, uint16 value)
+{
+	uint16	v;
+
+	return TIFFGetFieldDefaulted(tif, tag, &v) && v == value;
+}
+
+static int
+same_u32(TIFF* tif, uint32 tag, uint32 value)
+{
+	uint32	v;
+
+	if (!TIFFGetField(tif, tag, &v))
+		return value == 0;
+	return v == value;
+}
+
+/* Compare the probe of the current directory of tif with its tags */
+static int
+check_dir(TIFF* tif, const TIFFProbeDirectory* pd)
+{
+	uint32	rowsperstrip;
+
+	if (pd->offset != TIFFCurrentDirOffset(tif)
+	    || !same_u32(tif, TIFFTAG_IMAGEWIDTH, pd->width)
+	    || !same_u32(tif, TIFFTAG_IMAGELENGTH, pd->length)
+	    || !same_u32(tif, TIFFTAG_SUBFILETYPE, pd->subfiletype)
+	    || !same_u32(tif, TIFFTAG_TILEWIDTH, pd->tilewidth)
+	    || !same_u32(tif, TIFFTAG_TILELENGTH, pd->tilelength)
+	    || (pd->tilewidth != 0) != (TIFFIsTiled(tif) != 0)
+	    || !same_u16(tif, TIFFTAG_BITSPERSAMPLE, pd->bitspersample)
+	    || !same_u16(tif, TIFFTAG_SAMPLESPERPIXEL, pd->samplesperpixel)
+	    || !same_u16(tif, TIFFTAG_SAMPLEFORMAT, pd->sampleformat)
+	    || !same_u16(tif, TIFFTAG_COMPRESSION, pd->compression)
+	    || !same_u16(tif, TIFFTAG_PHOTOMETRIC, pd->photometric)
+	    || !same_u16(tif, TIFFTAG_PLANARCONFIG, pd->planarconfig)) {
+		fprintf (stderr, "Probe of directory %d differs.\n",
+			 (int) TIFFCurrentDirectory(tif));
+		return 0;
+	}
+	if (!TIFFIsTiled(tif)
+	    && (!TIFFGetFieldDefaulted(tif, TIFFTAG_ROWSPERSTRIP,
+				       &rowsperstrip)
+		|| rowsperstrip != pd->rowsperstrip)) {
+		fprintf (stderr, "Wrong rows per strip.\n");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+check_file(const char* mode)
+{
+	TIFFProbeDirectory	pd[NDIRS + 1];
+	TIFF			*tif;
+	tdir_t			ndirs, dir;
+	int			ok = 1;
+
+	if (!write_file(mode))
+		return 0;
+
+	memset(pd, 0, sizeof(pd));
+	if (!TIFFProbeFile(filename, pd, NDIRS + 1, &ndirs)
+	    || ndirs != NDIRS || pd[NDIRS].offset != 0) {
+		fprintf (stderr, "Can't probe %s.\n", filename);
+		return 0;
+	}
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	for (dir = 0; ok && dir < NDIRS; dir++)
+		ok = (dir == 0 || TIFFReadDirectory(tif))
+		    && check_dir(tif, &pd[dir]);
+
+	/* The probe leaves the current directory alone */
+	if (ok) {
+		memset(pd, 0, sizeof(pd));
+		if (!TIFFSetDirectory(tif, 1)
+		    || !TIFFProbeDirectories(tif, pd, 1, &ndirs)
+		    || ndirs != NDIRS || pd[1].offset != 0
+		    || TIFFCurrentDirectory(tif) != 1
+		    || !TIFFReadDirectory(tif) || TIFFCurrentDirectory(tif) != 2
+		    || !TIFFSetDirectory(tif, 0) || !check_dir(tif, &pd[0])) {
+			fprintf (stderr, "Probing moved the handle.\n");
+			ok = 0;
+		}
+	}
+	TIFFClose(tif);
+	if (!ok)
+		fprintf (stderr, "Failed in mode %s.\n", mode);
+	return ok;
+}
+
+/*
+ * Make the last directory link back to the first one: the probe stops
+ * at the loop.
+ */
+static int
+check_loop(void)
+{
+	TIFFProbeDirectory	pd[NDIRS];
+	tdir_t			ndirs;
+	FILE			*fd;
+	unsigned char		b[4];
+	uint64			first;
+	long			next;
+	uint16			count;
+
+	if (!write_file("wl")
+	    || !TIFFProbeFile(filename, pd, NDIRS, &ndirs) || ndirs != NDIRS)
+		return 0;
+	fd = fopen(filename, "r+b");
+	if (!fd)
+		return 0;
+	if (fseek(fd, (long) pd[NDIRS - 1].offset, SEEK_SET) != 0
+	    || fread(b, 1, 2, fd) != 2) {
+		fclose(fd);
+		return 0;
+	}
+	count = (uint16) (b[0] | (b[1] << 8));
+	next = (long) pd[NDIRS - 1].offset + 2 + 12 * (long) count;
+	first = pd[0].offset;
+	b[0] = (unsigned char) first;
+	b[1] = (unsigned char) (first >> 8);
+	b[2] = (unsigned char) (first >> 16);
+	b[3] = (unsigned char) (first >> 24);
+	if (fseek(fd, next, SEEK_SET) != 0 || fwrite(b, 1, 4, fd) != 4) {
+		fclose(fd);
+		return 0;
+	}
+	fclose(fd);
+	if (!TIFFProbeFile(filename, pd, NDIRS, &ndirs) || ndirs != NDIRS) {
+		fprintf (stderr, "Directory loop not detected.\n");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+check_not_tiff(void)
+{
+	TIFFProbeDirectory	pd;
+	tdir_t			ndirs;
+	FILE			*fd;
+
+	fd = fopen(filename, "wb");
+	if (!fd)
+		return 0;
+	fputs("This is not a TIFF file.\n", fd);
+	fclose(fd);
+	if (TIFFProbeFile(filename, &pd, 1, &ndirs)) {
+		fprintf (stderr, "Text file probed as a TIFF file.\n");
+		return 0;
+	}
+	return 1;
+}
+
+int
+main()
+{
+	int	ok;
+
+	ok = check_file("wl") && check_file("wb")
+	    && check_file("w8") && check_file("wb8")
+	    && check_loop() && check_not_tiff();
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -0,0 +1,480 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test TIFFRangeOpen() and TIFFOpenHTTP(): tiles read through
+ * the block cache must match the data written, sequential access must be
+ * served with few merged requests, and cached blocks must not be fetched
+ * again.  The HTTP backend is exercised against a minimal server forked
+ * on the loopback interface.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#ifndef _WIN32
+# include <signal.h>
+# include <sys/socket.h>
+# include <sys/wait.h>
+# include <netinet/in.h>
+# include <arpa/inet.h>
+#endif
+
+#include "tifftest.h"
+
+const uint32	width = 512;
+const uint32	length = 512;
+const uint32	tile_size = 16;
+
+/* Stand-in for a remote store: the file in memory, with request counts */
+typedef struct {
+	unsigned char	*data;
+	uint64		size;
+	long		requests;
+	long		closed;
+	int		shortreads;	/* next requests to cut short */
+} remote_file;
+
+static int
+write_image(const char* filename)
+{
+	TIFF	*tif;
+	int	ok;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	ok = fixture_set_tags(tif, width, length, 1, tile_size,
+			      COMPRESSION_NONE)
+	    && fixture_write_image(tif, 0);
+	TIFFClose(tif);
+	return ok;
+}
+
+static int
+load_file(const char* filename, remote_file* rf)
+{
+	FILE	*fp;
+	long	size;
+
+	memset(rf, 0, sizeof(*rf));
+	fp = fopen(filename, "rb");
+	if (!fp)
+		return 0;
+	if (fseek(fp, 0, SEEK_END) != 0 || (size = ftell(fp)) <= 0
+	    || fseek(fp, 0, SEEK_SET) != 0
+	    || (rf->data = (unsigned char*) malloc(size)) == NULL
+	    || fread(rf->data, 1, size, fp) != (size_t) size) {
+		fclose(fp);
+		free(rf->data);
+		return 0;
+	}
+	fclose(fp);
+	rf->size = (uint64) size;
+	return 1;
+}
+
+static tmsize_t
+remote_read(thandle_t h, uint64 offset, void* buf, tmsize_t size)
+{
+	remote_file* rf = (remote_file*) h;
+
+	rf->requests++;
+	if (offset >= rf->size)
+		return 0;
+	if ((uint64) size > rf->size - offset)
+		size = (tmsize_t) (rf->size - offset);
+	if (rf->shortreads > 0 && size > 100) {
+		rf->shortreads--;
+		size -= 100;
+	}
+	memcpy(buf, rf->data + offset, size);
+	return size;
+}
+
+static int
+remote_close(thandle_t h)
+{
+	((remote_file*) h)->closed++;
+	return 0;
+}
+
+static int
+check_all_tiles(TIFF* tif)
+{
+	uint32	tile, ntiles = TIFFNumberOfTiles(tif);
+
+	for (tile = 0; tile < ntiles; tile++)
+		if (!fixture_check_strile(tif, 0, tile))
+			return 0;
+	/* Backwards with a stride, to go through evictions */
+	for (tile = ntiles; tile >= 97; tile -= 97)
+		if (!fixture_check_strile(tif, 0, tile - 97))
+			return 0;
+	return 1;
+}
+
+/*
+ * Sequential reads must be merged into few requests, and blocks already
+ * cached must not be requested again.
+ */
+static int
+test_sequential(remote_file* rf)
+{
+	TIFFOpenOptions	*opts;
+	TIFF		*tif;
+	long		nblocks = (long) (rf->size / 4096) + 1;
+	long		requests;
+	int		ok = 0;
+
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts)
+		return 0;
+	TIFFOpenOptionsSetRangeCache(opts, 4096, 32, 8);
+	rf->requests = rf->closed = 0;
+	tif = TIFFRangeOpen("remote", "r", (thandle_t) rf, rf->size,
+			    remote_read, remote_close, opts);
+	TIFFOpenOptionsFree(opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open remote file.\n");
+		return 0;
+	}
+	if (!fixture_check_strile(tif, 0, 0))
+		goto close;
+	requests = rf->requests;
+	if (!fixture_check_strile(tif, 0, 0)
+	    || !fixture_check_strile(tif, 0, 1)
+	    || rf->requests != requests) {
+		fprintf (stderr, "Cached blocks requested again.\n");
+		goto close;
+	}
+	if (!check_all_tiles(tif))
+		goto close;
+	if (rf->requests * 4 > nblocks) {
+		fprintf (stderr, "Too many requests: %ld for %ld blocks.\n",
+			 rf->requests, nblocks);
+		goto close;
+	}
+	ok = 1;
+
+close:
+	TIFFClose(tif);
+	if (rf->closed != 1) {
+		fprintf (stderr, "Close procedure called %ld times.\n",
+			 rf->closed);
+		return 0;
+	}
+	return ok;
+}
+
+/*
+ * A single tile out of the file with lazy strile loading costs a handful
+ * of requests, and a tiny cache still returns the right data.
+ */
+static int
+test_random(remote_file* rf)
+{
+	TIFFOpenOptions	*opts;
+	TIFF		*tif;
+	int		ok;
+
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts)
+		return 0;
+	TIFFOpenOptionsSetRangeCache(opts, 512, 4, 0);
+	rf->requests = rf->closed = 0;
+	tif = TIFFRangeOpen("remote", "rO", (thandle_t) rf, rf->size,
+			    remote_read, remote_close, opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open remote file.\n");
+		TIFFOpenOptionsFree(opts);
+		return 0;
+	}
+	ok = fixture_check_strile(tif, 0, 700);
+	if (ok && rf->requests > 6) {
+		fprintf (stderr, "Too many requests for one tile: %ld.\n",
+			 rf->requests);
+		ok = 0;
+	}
+	ok = ok && check_all_tiles(tif);
+	TIFFClose(tif);
+	if (!ok)
+		goto done;
+
+	/* Whole strile arrays are larger than the cache */
+	tif = TIFFRangeOpen("remote", "r", (thandle_t) rf, rf->size,
+			    remote_read, remote_close, opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open remote file.\n");
+		ok = 0;
+		goto done;
+	}
+	ok = check_all_tiles(tif);
+	TIFFClose(tif);
+
+	/* Read-only, and the handle stays with the caller on failure */
+	rf->closed = 0;
+	tif = TIFFRangeOpen("remote", "w", (thandle_t) rf, rf->size,
+			    remote_read, remote_close, opts);
+	if (tif || rf->closed) {
+		fprintf (stderr, "Remote file opened for writing.\n");
+		if (tif)
+			TIFFClose(tif);
+		ok = 0;
+	}
+done:
+	TIFFOpenOptionsFree(opts);
+	return ok;
+}
+
+/*
+ * A request returning less than asked for, short of the end of the file,
+ * must not leave a truncated block in the cache.
+ */
+static int
+test_short_read(remote_file* rf)
+{
+	TIFFOpenOptions	*opts;
+	TIFF		*tif;
+	int		ok;
+
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts)
+		return 0;
+	TIFFOpenOptionsSetRangeCache(opts, 512, 64, 4);
+	rf->requests = rf->closed = 0;
+	tif = TIFFRangeOpen("remote", "r", (thandle_t) rf, rf->size,
+			    remote_read, remote_close, opts);
+	TIFFOpenOptionsFree(opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open remote file.\n");
+		return 0;
+	}
+	rf->shortreads = 1;
+	fixture_check_strile(tif, 0, 100);	/* may fail on the short read */
+	ok = rf->shortreads == 0 && check_all_tiles(tif);
+	if (!ok)
+		fprintf (stderr, "Short read left in the cache.\n");
+	rf->shortreads = 0;
+	TIFFClose(tif);
+	return ok;
+}
+
+#ifndef _WIN32
+
+/*
+ * Serve the file with range support over keep-alive connections, which
+ * are dropped every few requests to exercise reconnection.  As
+ * norange.tif, it is served whole, once only; badstatus.tif gets a
+ * truncated status line.
+ */
+static void
+serve(int listener, remote_file* rf)
+{
+	char		req[2048], head[256], *reply;
+	int		fd, served, norange, wholefiles = 0;
+	size_t		len;
+	ssize_t		n;
+
+	for (;;) {
+		fd = accept(listener, NULL, NULL);
+		if (fd < 0)
+			continue;
+		for (served = 0, len = 0; served < 5; ) {
+			unsigned long	start, end;
+			const char	*range;
+
+			n = recv(fd, req + len, sizeof(req) - 1 - len, 0);
+			if (n <= 0)
+				break;
+			len += (size_t) n;
+			req[len] = '\0';
+			if (!strstr(req, "\r\n\r\n"))
+				continue;
+			len = 0;
+			served++;
+			if (strncmp(req, "GET /badstatus.tif ", 19) == 0) {
+				send(fd, "HTTP/1.\r\n\r\n", 11, 0);
+				continue;
+			}
+			norange = strncmp(req, "GET /norange.tif ", 17) == 0;
+			if (norange && wholefiles++ > 0) {
+				sprintf(head, "HTTP/1.1 500 Downloaded again\r\n"
+					"Content-Length: 0\r\n\r\n");
+				send(fd, head, strlen(head), 0);
+				continue;
+			}
+			if (!norange
+			    && strncmp(req, "GET /range_io.tif ", 18) != 0) {
+				sprintf(head, "HTTP/1.1 404 Not Found\r\n"
+					"Content-Length: 0\r\n\r\n");
+				send(fd, head, strlen(head), 0);
+				continue;
+			}
+			range = norange ? NULL : strstr(req, "Range: bytes=");
+			if (!range || sscanf(range + 13, "%lu-%lu", &start,
+					     &end) != 2) {
+				sprintf(head, "HTTP/1.1 200 OK\r\n"
+					"Content-Length: %lu\r\n\r\n",
+					(unsigned long) rf->size);
+				start = 0;
+				end = (unsigned long) rf->size - 1;
+			} else if (start >= rf->size) {
+				sprintf(head, "HTTP/1.1 416 Range Not "
+					"Satisfiable\r\nContent-Range: "
+					"bytes */%lu\r\nContent-Length: 0"
+					"\r\n\r\n", (unsigned long) rf->size);
+				send(fd, head, strlen(head), 0);
+				continue;
+			} else {
+				if (end >= rf->size)
+					end = (unsigned long) rf->size - 1;
+				sprintf(head, "HTTP/1.1 206 Partial Content\r\n"
+					"Content-Range: bytes %lu-%lu/%lu\r\n"
+					"Content-Length: %lu\r\n\r\n", start,
+					end, (unsigned long) rf->size,
+					end - start + 1);
+			}
+			/* In one piece, not to wait for delayed acknowledgements */
+			reply = (char*) malloc(strlen(head) + end - start + 1);
+			if (!reply)
+				break;
+			strcpy(reply, head);
+			memcpy(reply + strlen(head), rf->data + start,
+			       end - start + 1);
+			send(fd, reply, strlen(head) + end - start + 1, 0);
+			free(reply);
+		}
+		close(fd);
+	}
+}
+
+static int
+test_http(remote_file* rf)
+{
+	struct sockaddr_in	addr;
+	socklen_t		addrlen = sizeof(addr);
+	TIFFOpenOptions		*opts;
+	TIFF			*tif;
+	char			url[64];
+	int			listener, ok = 0;
+	pid_t			pid;
+
+	listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (listener < 0)
+		return 0;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+	if (bind(listener, (struct sockaddr*) &addr, sizeof(addr)) != 0
+	    || listen(listener, 4) != 0
+	    || getsockname(listener, (struct sockaddr*) &addr, &addrlen) != 0) {
+		fprintf (stderr, "Can't set up the test server.\n");
+		close(listener);
+		return 0;
+	}
+	pid = fork();
+	if (pid < 0) {
+		close(listener);
+		return 0;
+	}
+	if (pid == 0) {
+		serve(listener, rf);
+		_exit(0);
+	}
+	close(listener);
+
+	opts = TIFFOpenOptionsAlloc();
+	if (!opts)
+		goto done;
+	TIFFOpenOptionsSetRangeCache(opts, 2048, 16, 4);
+	sprintf(url, "http://127.0.0.1:%d/missing.tif",
+		(int) ntohs(addr.sin_port));
+	tif = TIFFOpenHTTP(url, "r", opts);
+	if (tif) {
+		fprintf (stderr, "Opened a missing file.\n");
+		TIFFClose(tif);
+		goto done;
+	}
+	sprintf(url, "http://127.0.0.1:%d/badstatus.tif",
+		(int) ntohs(addr.sin_port));
+	tif = TIFFOpenHTTP(url, "r", opts);
+	if (tif) {
+		fprintf (stderr, "Opened a file with a bad response.\n");
+		TIFFClose(tif);
+		goto done;
+	}
+	sprintf(url, "http://127.0.0.1:%d/range_io.tif",
+		(int) ntohs(addr.sin_port));
+	tif = TIFFOpenHTTP(url, "r", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open %s.\n", url);
+		goto done;
+	}
+	ok = check_all_tiles(tif);
+	TIFFClose(tif);
+	tif = TIFFOpenHTTP(url, "rO", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open %s.\n", url);
+		ok = 0;
+		goto done;
+	}
+	ok = ok && fixture_check_strile(tif, 0, 1000)
+	    && check_all_tiles(tif);
+	TIFFClose(tif);
+
+	/* Downloaded once when opened, then read from memory */
+	sprintf(url, "http://127.0.0.1:%d/norange.tif",
+		(int) ntohs(addr.sin_port));
+	tif = TIFFOpenHTTP(url, "r", opts);
+	if (!tif) {
+		fprintf (stderr, "Can't open %s.\n", url);
+		ok = 0;
+		goto done;
+	}
+	ok = ok && check_all_tiles(tif);
+	TIFFClose(tif);
+
+done:
+	TIFFOpenOptionsFree(opts);
+	kill(pid, SIGTERM);
+	waitpid(pid, NULL, 0);
+	return ok;
+}
+
+#endif
+
+int
+main()
+{
+	const char	*filename = "range_io.tif";
+	remote_file	rf;
+	int		ok;
+
+	if (!write_image(filename) || !load_file(filename, &rf)) {
+		unlink(filename);
+		return 1;
+	}
+	unlink(filename);
+	ok = test_sequential(&rf)
+	    && test_random(&rf)
+	    && test_short_read(&rf);
+#ifndef _WIN32
+	ok = ok && test_http(&rf);
+#endif
+	free(rf.data);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
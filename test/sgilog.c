@@ -0,0 +1,181 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test the SGILog codec: LogL and LogLuv images written with
+ * SGILOG and SGILOG24 compression must decode back to their values, in
+ * float and 8-bit data formats.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+#define WIDTH	64
+#define LENGTH	8
+
+static const char	filename[] = "sgilog.tif";
+
+static float
+sample_value(uint32 x, uint32 y, int s)
+{
+	return (float) (0.05 + 0.01 * x + 0.1 * y + 0.2 * s);
+}
+
+static int
+write_image(uint16 compression, uint16 photometric)
+{
+	TIFF	*tif;
+	float	buf[WIDTH * 3];
+	uint16	spp = photometric == PHOTOMETRIC_LOGL ? 1 : 3;
+	uint32	x, y;
+	int	s;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, WIDTH)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, LENGTH)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 32)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, spp)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLEFORMAT, SAMPLEFORMAT_IEEEFP)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, photometric)
+	    || !TIFFSetField(tif, TIFFTAG_COMPRESSION, compression)
+	    || !TIFFSetField(tif, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_FLOAT)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 4)) {
+		fprintf (stderr, "Can't set tags.\n");
+		goto failure;
+	}
+	for (y = 0; y < LENGTH; y++) {
+		for (x = 0; x < WIDTH; x++)
+			for (s = 0; s < spp; s++)
+				buf[x * spp + s] = sample_value(x, y, s);
+		if (TIFFWriteScanline(tif, buf, y, 0) < 0) {
+			fprintf (stderr, "Can't write scanline %lu.\n",
+				 (unsigned long) y);
+			goto failure;
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+static int
+check_float(uint16 spp)
+{
+	TIFF	*tif;
+	float	buf[WIDTH * 3];
+	uint32	x, y;
+	int	s, ok = 1;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	if (!TIFFSetField(tif, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_FLOAT)) {
+		TIFFClose(tif);
+		return 0;
+	}
+	for (y = 0; ok && y < LENGTH; y++) {
+		if (TIFFReadScanline(tif, buf, y, 0) < 0) {
+			ok = 0;
+			break;
+		}
+		for (x = 0; ok && x < WIDTH; x++)
+			for (s = 0; ok && s < spp; s++) {
+				double v = sample_value(x, y, s);
+				/* LogLuv chroma is coarser than LogL */
+				double tolerance = spp == 1 ? 0.01 : 0.05;
+				if (fabs(buf[x * spp + s] - v) > tolerance * v)
+					ok = 0;
+			}
+	}
+	TIFFClose(tif);
+	if (!ok)
+		fprintf (stderr, "Wrong float value in row %lu.\n",
+			 (unsigned long) (y - 1));
+	return ok;
+}
+
+/* Y in [0,1] is coded as sqrt(Y) in 8 bits, see L16toGry() */
+static int
+check_8bit(void)
+{
+	TIFF	*tif;
+	uint8	buf[WIDTH];
+	uint32	x, y;
+	int	ok = 1;
+
+	tif = TIFFOpen(filename, "r");
+	if (!tif)
+		return 0;
+	if (!TIFFSetField(tif, TIFFTAG_SGILOGDATAFMT, SGILOGDATAFMT_8BIT)) {
+		TIFFClose(tif);
+		return 0;
+	}
+	for (y = 0; ok && y < LENGTH; y++) {
+		if (TIFFReadScanline(tif, buf, y, 0) < 0) {
+			ok = 0;
+			break;
+		}
+		for (x = 0; ok && x < WIDTH; x++) {
+			double v = sample_value(x, y, 0);
+			int expected = v >= 1. ? 255 : (int) (256. * sqrt(v));
+			if (abs(buf[x] - expected) > 1)
+				ok = 0;
+		}
+	}
+	TIFFClose(tif);
+	if (!ok)
+		fprintf (stderr, "Wrong 8-bit value in row %lu.\n",
+			 (unsigned long) (y - 1));
+	return ok;
+}
+
+static int
+check(uint16 compression, uint16 photometric)
+{
+	int	ok;
+
+	if (!write_image(compression, photometric))
+		return 0;
+	if (photometric == PHOTOMETRIC_LOGL)
+		ok = check_float(1) && check_8bit();
+	else
+		ok = check_float(3);
+	if (!ok)
+		fprintf (stderr, "Failed with compression %d, photometric %d.\n",
+			 compression, photometric);
+	return ok;
+}
+
+int
+main()
+{
+	int	ok;
+
+	ok = check(COMPRESSION_SGILOG, PHOTOMETRIC_LOGL)
+	    && check(COMPRESSION_SGILOG24, PHOTOMETRIC_LOGL)
+	    && check(COMPRESSION_SGILOG, PHOTOMETRIC_LOGLUV)
+	    && check(COMPRESSION_SGILOG24, PHOTOMETRIC_LOGLUV);
+	unlink(filename);
+	return ok ? 0 : 1;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
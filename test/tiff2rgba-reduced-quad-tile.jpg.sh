@@ -0,0 +1,67 @@
+#!/bin/sh
+#
+# Reduced resolution JPEG decoding with tiff2rgba: the output is a
+# quarter of the input size, close to the average of the full resolution
+# pixels, and flipped to top-left orientation like the full resolution
+# output.
+#
+. ${srcdir:-.}/common.sh
+# Not infile and outfile, which the helpers of common.sh overwrite
+image="$srcdir/images/quad-tile.jpg.tiff"
+reduced="o-tiff2rgba-reduced-quad-tile.jpg.tiff"
+fullfile="o-tiff2rgba-reduced-quad-tile.jpg-full.tiff"
+botright="o-tiff2rgba-reduced-quad-tile.jpg-botright-in.tiff"
+flipfile="o-tiff2rgba-reduced-quad-tile.jpg-botright.tiff"
+rotfile="o-tiff2rgba-reduced-quad-tile.jpg-rotated.tiff"
+f_test_convert "${TIFF2RGBA} -s 4 -n -c none" $image $reduced
+f_tiffinfo_validate $reduced
+
+if ! ${TIFFINFO} $reduced | grep "Image Width: 128 Image Length: 96" >/dev/null
+then
+  echo "Wrong size of reduced image"
+  exit 1
+fi
+
+# Mean difference with the 4x4 averages of the full resolution image
+f_test_convert "${TIFF2RGBA} -n -c none" $image $fullfile
+( ${TIFFINFO} -d $fullfile; ${TIFFINFO} -d $reduced ) | awk '
+  BEGIN { hex = "0123456789abcdef" }
+  /^TIFF Directory/ { file++; data = 0; n = 0; next }
+  /^Strip / { data = 1; next }
+  data {
+    for (i = 1; i <= NF; i++) {
+      v = (index(hex, substr($i, 1, 1)) - 1) * 16 \
+          + index(hex, substr($i, 2, 1)) - 1
+      if (file == 1) full[n++] = v; else reduced[n++] = v
+    }
+  }
+  END {
+    for (y = 0; y < 96; y++)
+      for (x = 0; x < 128; x++)
+        for (c = 0; c < 3; c++) {
+          s = 0
+          for (j = 0; j < 4; j++)
+            for (i = 0; i < 4; i++)
+              s += full[((4 * y + j) * 512 + 4 * x + i) * 3 + c]
+          d = reduced[(y * 128 + x) * 3 + c] - s / 16
+          total += d < 0 ? -d : d
+        }
+    mean = total / (96 * 128 * 3)
+    if (mean > 3) {
+      print "Reduced image differs from full resolution: " mean
+      exit 1
+    }
+  }' || exit 1
+
+# Bottom-right orientation, turned back to top-left
+rm -f $botright
+cp $image $botright
+chmod u+w $botright
+${TIFFSET} -s 274 3 $botright || exit 1
+f_test_convert "${TIFF2RGBA} -s 4 -n -c none" $botright $flipfile
+f_test_convert "${TIFFCROP} -R 180" $flipfile $rotfile
+if ! ${TIFFCMP} $reduced $rotfile
+then
+  echo "Orientation not applied to reduced image"
+  exit 1
+fi
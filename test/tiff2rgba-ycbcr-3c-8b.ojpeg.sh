@@ -0,0 +1,7 @@
+#!/bin/sh
+# Generated file, master is Makefile.am
+. ${srcdir:-.}/common.sh
+infile="$srcdir/images/ycbcr-3c-8b.ojpeg.tiff"
+outfile="o-tiff2rgba-ycbcr-3c-8b.ojpeg.tiff"
+f_test_convert "$TIFF2RGBA" $infile $outfile
+f_tiffinfo_validate $outfile
@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# tiffcp copying JPEG data at the DCT coefficient level: output retiled
+# and copied back to the tiles of the input decodes exactly like the
+# input, which decompressing and recompressing would not do.  Retiling
+# strips that are not on block boundaries falls back to recompression.
+#
+. ${srcdir:-.}/common.sh
+# Not infile and outfile, which the helpers of common.sh overwrite
+image="$srcdir/images/quad-tile.jpg.tiff"
+unaligned="$srcdir/images/minisblack-1c-8b-r12.jpg.tiff"
+out="o-tiffcp-lossless-quad-tile.jpg"
+fallback="o-tiffcp-lossless-minisblack-1c-8b-r12.jpg"
+
+# f_decode infile outfile: decompress to strips, to compare with tiffcmp
+f_decode ()
+{
+  f_test_convert "${TIFFCP} -c none -s -r 16" $1 $2
+}
+
+f_test_convert "${TIFFCP} -s -r 16" $image $out-strips.tiff
+f_tiffinfo_validate $out-strips.tiff
+f_test_convert "${TIFFCP} -t -w 64 -l 64" $out-strips.tiff $out-tiles.tiff
+f_tiffinfo_validate $out-tiles.tiff
+f_test_convert "${TIFFCP} -t -w 128 -l 128" $out-strips.tiff $out-strips-back.tiff
+f_test_convert "${TIFFCP} -t -w 128 -l 128" $out-tiles.tiff $out-tiles-back.tiff
+
+f_decode $image $out-none.tiff
+for copy in strips-back tiles-back
+do
+  f_decode $out-$copy.tiff $out-$copy-none.tiff
+  if ! ${TIFFCMP} $out-none.tiff $out-$copy-none.tiff
+  then
+    echo "JPEG data changed by the $copy copy"
+    exit 1
+  fi
+done
+
+# Same result as recompressing
+f_test_convert "${TIFFCP} -s -r 16" $unaligned $fallback.tiff
+f_tiffinfo_validate $fallback.tiff
+f_test_convert "${TIFFCP} -c jpeg -s -r 16" $unaligned $fallback-jpeg.tiff
+f_decode $fallback.tiff $fallback-none.tiff
+f_decode $fallback-jpeg.tiff $fallback-jpeg-none.tiff
+if ! ${TIFFCMP} $fallback-jpeg-none.tiff $fallback-none.tiff
+then
+  echo "Unaligned strips not recompressed"
+  exit 1
+fi
@@ -0,0 +1,15 @@
+#!/bin/sh
+#
+# Check that tiffcp passes the number of LZMA2 threads to the encoder
+#
+. ${srcdir:-.}/common.sh
+f_test_convert "${TIFFCP} -c lzma:p1:t2" "${IMG_RGB_3C_8B}" "o-tiffcp-lzma-threads.tiff"
+f_tiffinfo_validate "o-tiffcp-lzma-threads.tiff"
+echo "$MEMCHECK ${TIFFCMP} ${IMG_RGB_3C_8B} o-tiffcp-lzma-threads.tiff"
+eval "$MEMCHECK ${TIFFCMP} ${IMG_RGB_3C_8B} o-tiffcp-lzma-threads.tiff"
+status=$?
+if [ $status != 0 ] ; then
+  echo "Returned failed status $status!"
+  echo "Output (if any) is in \"o-tiffcp-lzma-threads.tiff\"."
+  exit $status
+fi
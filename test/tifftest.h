@@ -38,5 +38,10 @@ int CheckShortField(TIFF *, const ttag_t, const uint16);
 int CheckShortPairedField(TIFF *, const ttag_t, const uint16*);
 int CheckLongField(TIFF *, const ttag_t, const uint32);
 
+unsigned char fixture_pixel(int, uint32, uint32);
+int fixture_set_tags(TIFF *, uint32, uint32, int, uint32, uint16);
+int fixture_write_image(TIFF *, int);
+int fixture_check_strile(TIFF *, int, uint32);
+
 #endif /* _TIFFTEST_ */
 
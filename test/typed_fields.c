@@ -0,0 +1,210 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Module to test the typed field accessors: TIFFGetFieldUInt16() and
+ * friends, and TIFFGetFieldArray(), checked against TIFFGetField() for
+ * standard, custom and codec tags.
+ */
+
+#include "tif_config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef HAVE_UNISTD_H
+# include <unistd.h>
+#endif
+
+#include "tiffio.h"
+
+const uint32	width = 40;
+const uint32	length = 30;
+const char	description[] = "Typed accessors";
+
+static int
+write_image(const char* filename, uint16 compression)
+{
+	TIFF		*tif;
+	unsigned char	buf[40];
+	uint32		row;
+
+	tif = TIFFOpen(filename, "w");
+	if (!tif) {
+		fprintf (stderr, "Can't create test TIFF file %s.\n", filename);
+		return 0;
+	}
+	if (!TIFFSetField(tif, TIFFTAG_IMAGEWIDTH, width)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGELENGTH, length)
+	    || !TIFFSetField(tif, TIFFTAG_BITSPERSAMPLE, 8)
+	    || !TIFFSetField(tif, TIFFTAG_SAMPLESPERPIXEL, 1)
+	    || !TIFFSetField(tif, TIFFTAG_ROWSPERSTRIP, 8)
+	    || !TIFFSetField(tif, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG)
+	    || !TIFFSetField(tif, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_MINISBLACK)
+	    || !TIFFSetField(tif, TIFFTAG_COMPRESSION, compression)
+	    || !TIFFSetField(tif, TIFFTAG_XRESOLUTION, 72.5)
+	    || !TIFFSetField(tif, TIFFTAG_PAGENUMBER, 3, 7)
+	    || !TIFFSetField(tif, TIFFTAG_IMAGEDESCRIPTION, description)) {
+		fprintf (stderr, "Can't set tags.\n");
+		goto failure;
+	}
+	if (compression != COMPRESSION_NONE
+	    && !TIFFSetField(tif, TIFFTAG_PREDICTOR, PREDICTOR_HORIZONTAL)) {
+		fprintf (stderr, "Can't set predictor.\n");
+		goto failure;
+	}
+	for (row = 0; row < length; row++) {
+		memset(buf, (int) row, sizeof(buf));
+		if (TIFFWriteScanline(tif, buf, row, 0) < 0) {
+			fprintf (stderr, "Can't write image data.\n");
+			goto failure;
+		}
+	}
+	TIFFClose(tif);
+	return 1;
+
+failure:
+	TIFFClose(tif);
+	return 0;
+}
+
+static int
+check_scalars(TIFF* tif, uint16 compression)
+{
+	uint16	u16, v16;
+	uint32	u32;
+	uint64	u64;
+	double	d;
+	float	f;
+
+	if (!TIFFGetFieldUInt32(tif, TIFFTAG_IMAGEWIDTH, &u32) || u32 != width
+	    || !TIFFGetFieldUInt64(tif, TIFFTAG_IMAGELENGTH, &u64)
+	    || u64 != length
+	    || !TIFFGetFieldDouble(tif, TIFFTAG_ROWSPERSTRIP, &d) || d != 8) {
+		fprintf (stderr, "Wrong image dimensions.\n");
+		return 0;
+	}
+	if (TIFFGetFieldUInt16(tif, TIFFTAG_IMAGEWIDTH, &u16)) {
+		fprintf (stderr, "Long value narrowed to 16 bits.\n");
+		return 0;
+	}
+	if (!TIFFGetFieldUInt16(tif, TIFFTAG_BITSPERSAMPLE, &u16) || u16 != 8
+	    || !TIFFGetFieldUInt16(tif, TIFFTAG_COMPRESSION, &u16)
+	    || u16 != compression) {
+		fprintf (stderr, "Wrong short values.\n");
+		return 0;
+	}
+	if (!TIFFGetField(tif, TIFFTAG_XRESOLUTION, &f)
+	    || !TIFFGetFieldDouble(tif, TIFFTAG_XRESOLUTION, &d) || d != f
+	    || TIFFGetFieldUInt32(tif, TIFFTAG_XRESOLUTION, &u32)) {
+		fprintf (stderr, "Wrong resolution.\n");
+		return 0;
+	}
+	if (TIFFGetFieldUInt16(tif, TIFFTAG_PAGENUMBER, &u16)) {
+		fprintf (stderr, "Pair returned as a single value.\n");
+		return 0;
+	}
+	if (TIFFGetFieldUInt32(tif, TIFFTAG_ARTIST, &u32)
+	    || TIFFGetFieldDouble(tif, TIFFTAG_IMAGEDESCRIPTION, &d)) {
+		fprintf (stderr, "Value returned for a missing or string "
+			 "tag.\n");
+		return 0;
+	}
+	if (compression != COMPRESSION_NONE
+	    && (!TIFFGetField(tif, TIFFTAG_PREDICTOR, &v16)
+		|| !TIFFGetFieldUInt16(tif, TIFFTAG_PREDICTOR, &u16)
+		|| u16 != v16 || u16 != PREDICTOR_HORIZONTAL)) {
+		fprintf (stderr, "Wrong codec value.\n");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+check_arrays(TIFF* tif)
+{
+	TIFFDataType	type;
+	uint32		count;
+	const void	*data;
+	uint64		*offsets;
+	char		*text;
+	uint16		*colormap[3];
+
+	if (!TIFFGetField(tif, TIFFTAG_STRIPOFFSETS, &offsets)
+	    || !TIFFGetFieldArray(tif, TIFFTAG_STRIPOFFSETS, &type, &count,
+				  &data)
+	    || type != TIFF_LONG8 || count != TIFFNumberOfStrips(tif)
+	    || data != (const void*) offsets) {
+		fprintf (stderr, "Wrong strip offsets array.\n");
+		return 0;
+	}
+	if (!TIFFGetFieldArray(tif, TIFFTAG_PAGENUMBER, &type, &count, &data)
+	    || type != TIFF_SHORT || count != 2
+	    || ((const uint16*) data)[0] != 3
+	    || ((const uint16*) data)[1] != 7) {
+		fprintf (stderr, "Wrong page number.\n");
+		return 0;
+	}
+	if (!TIFFGetField(tif, TIFFTAG_IMAGEDESCRIPTION, &text)
+	    || !TIFFGetFieldArray(tif, TIFFTAG_IMAGEDESCRIPTION, &type, &count,
+				  &data)
+	    || type != TIFF_ASCII || count != sizeof(description)
+	    || data != (const void*) text
+	    || strcmp((const char*) data, description) != 0) {
+		fprintf (stderr, "Wrong image description.\n");
+		return 0;
+	}
+	if (!TIFFGetFieldArray(tif, TIFFTAG_XRESOLUTION, &type, &count, &data)
+	    || type != TIFF_FLOAT || count != 1
+	    || *(const float*) data != 72.5) {
+		fprintf (stderr, "Wrong resolution array.\n");
+		return 0;
+	}
+	if (TIFFGetField(tif, TIFFTAG_COLORMAP, &colormap[0], &colormap[1],
+			 &colormap[2])
+	    || TIFFGetFieldArray(tif, TIFFTAG_COLORMAP, &type, &count, &data)) {
+		fprintf (stderr, "Colormap found in a greyscale image.\n");
+		return 0;
+	}
+	return 1;
+}
+
+static int
+test_fields(uint16 compression)
+{
+	const char	*filename = "typed_fields.tif";
+	TIFF		*tif;
+	int		ok = 0;
+
+	if (!TIFFIsCODECConfigured(compression))
+		return 1;
+	if (!write_image(filename, compression))
+		goto done;
+	tif = TIFFOpen(filename, "r");
+	if (!tif) {
+		fprintf (stderr, "Can't open test TIFF file %s.\n", filename);
+		goto done;
+	}
+	ok = check_scalars(tif, compression) && check_arrays(tif);
+	TIFFClose(tif);
+
+done:
+	unlink(filename);
+	if (!ok)
+		fprintf (stderr, "Failed for compression %d.\n", compression);
+	return ok;
+}
+
+int
+main()
+{
+	if (!test_fields(COMPRESSION_NONE)
+	    || !test_fields(COMPRESSION_LZW)
+	    || !test_fields(COMPRESSION_ADOBE_DEFLATE))
+		return 1;
+	return 0;
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
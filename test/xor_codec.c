@@ -0,0 +1,75 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Codec plugin for the codec_plugin test, loaded with
+ * TIFFLoadCODECPlugins(): every byte is xored with XOR_KEY.  The codec
+ * only handles whole strips, and says so in its capabilities.
+ */
+
+#include "tif_config.h"
+
+#include "tiffiop.h"
+#include "xor_codec.h"
+
+static int
+XORDecode(TIFF* tif, uint8* op, tmsize_t occ, uint16 s)
+{
+	tmsize_t i;
+
+	(void) s;
+	if (tif->tif_rawcc < occ) {
+		TIFFErrorExt(tif->tif_clientdata, "XORDecode",
+			     "Not enough data for strip %lu",
+			     (unsigned long) tif->tif_curstrip);
+		return (0);
+	}
+	for (i = 0; i < occ; i++)
+		op[i] = tif->tif_rawcp[i] ^ XOR_KEY;
+	tif->tif_rawcp += occ;
+	tif->tif_rawcc -= occ;
+	return (1);
+}
+
+static int
+XOREncode(TIFF* tif, uint8* pp, tmsize_t cc, uint16 s)
+{
+	(void) s;
+	while (cc > 0) {
+		tmsize_t n = cc, i;
+
+		if (tif->tif_rawcc + n > tif->tif_rawdatasize)
+			n = tif->tif_rawdatasize - tif->tif_rawcc;
+		for (i = 0; i < n; i++)
+			tif->tif_rawcp[i] = pp[i] ^ XOR_KEY;
+		tif->tif_rawcp += n;
+		tif->tif_rawcc += n;
+		pp += n;
+		cc -= n;
+		if (tif->tif_rawcc >= tif->tif_rawdatasize &&
+		    !TIFFFlushData1(tif))
+			return (0);
+	}
+	return (1);
+}
+
+static int
+TIFFInitXOR(TIFF* tif, int scheme)
+{
+	(void) scheme;
+	tif->tif_decodestrip = XORDecode;
+	tif->tif_decodetile = XORDecode;
+	tif->tif_encodestrip = XOREncode;
+	tif->tif_encodetile = XOREncode;
+	return (1);
+}
+
+int
+TIFFCodecPluginInit(void)
+{
+	return (TIFFRegisterCODECExt(COMPRESSION_XOR, "XOR", TIFFInitXOR,
+				     XOR_CAPS) != NULL);
+}
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
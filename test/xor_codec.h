@@ -0,0 +1,20 @@
+/* $Id$ */
+
+/*
+ * TIFF Library
+ *
+ * Definitions shared by the xor_codec plugin and the codec_plugin test.
+ */
+
+#ifndef _XOR_CODEC_
+#define	_XOR_CODEC_
+
+#define	COMPRESSION_XOR	65000
+#define	XOR_CAPS	(TIFFCODEC_DECODE | TIFFCODEC_ENCODE)
+#define	XOR_KEY		0x5a
+
+extern int TIFFCodecPluginInit(void);
+
+#endif /* _XOR_CODEC_ */
+
+/* vim: set ts=8 sts=8 sw=8 noet: */
@@ -55,6 +55,7 @@ uint32 rowsperstrip = (uint32) -1;
 int process_by_block = 0; /* default is whole image at once */
 int no_alpha = 0;
 int bigtiff_output = 0;
+int jpeg_scale_denom = 1; /* reduced resolution decoding of JPEG input */
 
 
 static int tiffcvt(TIFF* in, TIFF* out);
@@ -70,7 +71,7 @@ main(int argc, char* argv[])
 	extern char *optarg;
 #endif
 
-	while ((c = getopt(argc, argv, "c:r:t:bn8")) != -1)
+	while ((c = getopt(argc, argv, "c:r:s:t:bn8")) != -1)
 		switch (c) {
 			case 'b':
 				process_by_block = 1;
@@ -95,6 +96,15 @@ main(int argc, char* argv[])
 				rowsperstrip = atoi(optarg);
 				break;
 
+			case 's':
+				jpeg_scale_denom = atoi(optarg);
+				if (jpeg_scale_denom != 1 &&
+				    jpeg_scale_denom != 2 &&
+				    jpeg_scale_denom != 4 &&
+				    jpeg_scale_denom != 8)
+					usage(-1);
+				break;
+
 			case 't':
 				rowsperstrip = atoi(optarg);
 				break;
@@ -480,6 +490,172 @@ cvt_whole_image( TIFF *in, TIFF *out )
     return 1;
 }
 
+/*
+ * Can the image be decoded at reduced resolution by the JPEG codec
+ * (TIFFTAG_JPEGSCALEDENOM) ?  We only handle the common 8 bit gray and
+ * RGB/YCbCr cases, the rest goes through the RGBA image interface.
+ */
+static int
+jpeg_reduced_supported( TIFF *in )
+{
+    uint16 compression_in, bitspersample, samplesperpixel, planarconfig;
+    uint16 photometric;
+
+    TIFFGetFieldDefaulted(in, TIFFTAG_COMPRESSION, &compression_in);
+    TIFFGetFieldDefaulted(in, TIFFTAG_BITSPERSAMPLE, &bitspersample);
+    TIFFGetFieldDefaulted(in, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+    TIFFGetFieldDefaulted(in, TIFFTAG_PLANARCONFIG, &planarconfig);
+    if (!TIFFGetField(in, TIFFTAG_PHOTOMETRIC, &photometric))
+        return 0;
+
+    if (compression_in != COMPRESSION_JPEG || bitspersample != 8)
+        return 0;
+    if (samplesperpixel == 1)
+        return photometric == PHOTOMETRIC_MINISBLACK;
+    return samplesperpixel == 3 && planarconfig == PLANARCONFIG_CONTIG &&
+        (photometric == PHOTOMETRIC_RGB || photometric == PHOTOMETRIC_YCBCR);
+}
+
+/*
+ * Decode the strips or tiles of a JPEG image at 1/jpeg_scale_denom of
+ * their resolution, and write the resulting reduced RGB(A) image.  Like
+ * TIFFReadRGBAImageOriented(), the image is flipped to top-left
+ * orientation, the transposed orientations being taken for their
+ * unflipped counterparts.
+ */
+static int
+cvt_jpeg_reduced( TIFF *in, TIFF *out, uint32 width, uint32 height )
+
+{
+    uint32 rwidth = howmany(width, jpeg_scale_denom);
+    uint32 rheight = howmany(height, jpeg_scale_denom);
+    uint32 block_width, block_height;	/* strip or tile dimensions */
+    uint32 rblock_width, rblock_height;	/* same, once reduced */
+    uint32 x, y, row, col;
+    uint16 samplesperpixel, photometric, orientation;
+    int bytes_per_pixel = no_alpha ? 3 : 4;
+    int flip_horiz = 0, flip_vert = 0;
+    tmsize_t bufsize;
+    unsigned char *buf, *raster;
+    int ok = 1;
+
+    TIFFGetFieldDefaulted(in, TIFFTAG_SAMPLESPERPIXEL, &samplesperpixel);
+    TIFFGetField(in, TIFFTAG_PHOTOMETRIC, &photometric);
+    TIFFGetFieldDefaulted(in, TIFFTAG_ORIENTATION, &orientation);
+    switch (orientation) {
+    case ORIENTATION_TOPRIGHT:
+    case ORIENTATION_RIGHTTOP:
+        flip_horiz = 1;
+        break;
+    case ORIENTATION_BOTRIGHT:
+    case ORIENTATION_RIGHTBOT:
+        flip_horiz = flip_vert = 1;
+        break;
+    case ORIENTATION_BOTLEFT:
+    case ORIENTATION_LEFTBOT:
+        flip_vert = 1;
+        break;
+    }
+    if (photometric == PHOTOMETRIC_YCBCR)
+        TIFFSetField(in, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+    if (!TIFFSetField(in, TIFFTAG_JPEGSCALEDENOM, jpeg_scale_denom))
+        return 0;
+
+    if (TIFFIsTiled(in)) {
+        TIFFGetField(in, TIFFTAG_TILEWIDTH, &block_width);
+        TIFFGetField(in, TIFFTAG_TILELENGTH, &block_height);
+        bufsize = TIFFTileSize(in);
+    } else {
+        block_width = width;
+        TIFFGetFieldDefaulted(in, TIFFTAG_ROWSPERSTRIP, &block_height);
+        if (block_height > height)
+            block_height = height;
+        bufsize = TIFFStripSize(in);
+    }
+    if (block_width == 0 || block_height == 0 || bufsize <= 0)
+        return 0;
+    rblock_width = howmany(block_width, jpeg_scale_denom);
+    rblock_height = howmany(block_height, jpeg_scale_denom);
+
+    rowsperstrip = TIFFDefaultStripSize(out, rowsperstrip);
+    TIFFSetField(out, TIFFTAG_ROWSPERSTRIP, rowsperstrip);
+
+    raster = (unsigned char *)_TIFFCheckMalloc(in, (tmsize_t)rwidth * rheight,
+                                               bytes_per_pixel, "raster buffer");
+    buf = (unsigned char *)_TIFFmalloc(bufsize);
+    if (raster == NULL || buf == NULL) {
+        TIFFError(TIFFFileName(in), "No space for raster buffer");
+        _TIFFfree(raster);
+        _TIFFfree(buf);
+        return 0;
+    }
+
+    /*
+     * JPEG strips and tiles are multiple of 8 pixels, so block origins
+     * map exactly to pixels of the reduced image.
+     */
+    for (y = 0; ok && y < height; y += block_height) {
+        for (x = 0; ok && x < width; x += block_width) {
+            uint32 rx = x / jpeg_scale_denom, ry = y / jpeg_scale_denom;
+            uint32 nrows = rblock_height, ncols = rblock_width;
+
+            if (TIFFIsTiled(in))
+                ok = TIFFReadEncodedTile(in, TIFFComputeTile(in, x, y, 0, 0),
+                                         buf, bufsize) >= 0;
+            else
+                ok = TIFFReadEncodedStrip(in, TIFFComputeStrip(in, y, 0),
+                                          buf, bufsize) >= 0;
+            if (!ok)
+                break;
+
+            if (ry + nrows > rheight)
+                nrows = rheight - ry;
+            if (rx + ncols > rwidth)
+                ncols = rwidth - rx;
+            for (row = 0; row < nrows; row++) {
+                unsigned char *src = buf +
+                    (tmsize_t)row * rblock_width * samplesperpixel;
+                uint32 drow = flip_vert ? rheight - 1 - (ry + row) : ry + row;
+                uint32 dcol = flip_horiz ? rwidth - 1 - rx : rx;
+                unsigned char *dst = raster +
+                    ((tmsize_t)drow * rwidth + dcol) * bytes_per_pixel;
+                int step = flip_horiz ? -bytes_per_pixel : bytes_per_pixel;
+
+                for (col = 0; col < ncols; col++) {
+                    if (samplesperpixel == 1) {
+                        dst[0] = dst[1] = dst[2] = src[0];
+                    } else {
+                        dst[0] = src[0];
+                        dst[1] = src[1];
+                        dst[2] = src[2];
+                    }
+                    if (!no_alpha)
+                        dst[3] = 255;
+                    src += samplesperpixel;
+                    dst += step;
+                }
+            }
+        }
+    }
+    _TIFFfree(buf);
+
+    /*
+     * Write out the result in strips
+     */
+    for (row = 0; ok && row < rheight; row += rowsperstrip) {
+        uint32 rows_to_write = rowsperstrip;
+
+        if (row + rowsperstrip > rheight)
+            rows_to_write = rheight - row;
+        if (TIFFWriteEncodedStrip(out, row / rowsperstrip,
+                                  raster + (tmsize_t)row * rwidth * bytes_per_pixel,
+                                  (tmsize_t)rows_to_write * rwidth * bytes_per_pixel) == -1)
+            ok = 0;
+    }
+
+    _TIFFfree(raster);
+    return ok;
+}
 
 static int
 tiffcvt(TIFF* in, TIFF* out)
@@ -490,13 +666,29 @@ tiffcvt(TIFF* in, TIFF* out)
 	char *stringv;
 	uint32 longv;
         uint16 v[1];
+	int reduced = 0;
 
 	TIFFGetField(in, TIFFTAG_IMAGEWIDTH, &width);
 	TIFFGetField(in, TIFFTAG_IMAGELENGTH, &height);
 
+	if (jpeg_scale_denom > 1) {
+		reduced = jpeg_reduced_supported(in);
+		if (!reduced)
+			TIFFWarning(TIFFFileName(in),
+			    "Reduced resolution decoding not supported for "
+			    "this image, converting at full resolution");
+	}
+
 	CopyField(TIFFTAG_SUBFILETYPE, longv);
-	TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
-	TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+	if (reduced) {
+		TIFFSetField(out, TIFFTAG_IMAGEWIDTH,
+			     howmany(width, jpeg_scale_denom));
+		TIFFSetField(out, TIFFTAG_IMAGELENGTH,
+			     howmany(height, jpeg_scale_denom));
+	} else {
+		TIFFSetField(out, TIFFTAG_IMAGEWIDTH, width);
+		TIFFSetField(out, TIFFTAG_IMAGELENGTH, height);
+	}
 	TIFFSetField(out, TIFFTAG_BITSPERSAMPLE, 8);
 	TIFFSetField(out, TIFFTAG_COMPRESSION, compression);
 	TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_RGB);
@@ -515,14 +707,25 @@ tiffcvt(TIFF* in, TIFF* out)
             TIFFSetField(out, TIFFTAG_EXTRASAMPLES, 1, v);
         }
 
-	CopyField(TIFFTAG_XRESOLUTION, floatv);
-	CopyField(TIFFTAG_YRESOLUTION, floatv);
+	if (reduced) {
+		if (TIFFGetField(in, TIFFTAG_XRESOLUTION, &floatv))
+			TIFFSetField(out, TIFFTAG_XRESOLUTION,
+				     floatv / jpeg_scale_denom);
+		if (TIFFGetField(in, TIFFTAG_YRESOLUTION, &floatv))
+			TIFFSetField(out, TIFFTAG_YRESOLUTION,
+				     floatv / jpeg_scale_denom);
+	} else {
+		CopyField(TIFFTAG_XRESOLUTION, floatv);
+		CopyField(TIFFTAG_YRESOLUTION, floatv);
+	}
 	CopyField(TIFFTAG_RESOLUTIONUNIT, shortv);
 	TIFFSetField(out, TIFFTAG_PLANARCONFIG, PLANARCONFIG_CONTIG);
 	TIFFSetField(out, TIFFTAG_SOFTWARE, TIFFGetVersion());
 	CopyField(TIFFTAG_DOCUMENTNAME, stringv);
 
-        if( process_by_block && TIFFIsTiled( in ) )
+        if( reduced )
+            return( cvt_jpeg_reduced( in, out, width, height ) );
+        else if( process_by_block && TIFFIsTiled( in ) )
             return( cvt_by_tile( in, out ) );
         else if( process_by_block )
             return( cvt_by_strip( in, out ) );
@@ -531,7 +734,7 @@ tiffcvt(TIFF* in, TIFF* out)
 }
 
 static char* stuff[] = {
-    "usage: tiff2rgba [-c comp] [-r rows] [-b] [-n] [-8] input... output",
+    "usage: tiff2rgba [-c comp] [-r rows] [-s denom] [-b] [-n] [-8] input... output",
     "where comp is one of the following compression algorithms:",
     " jpeg\t\tJPEG encoding",
     " zip\t\tZip/Deflate encoding",
@@ -540,6 +743,7 @@ static char* stuff[] = {
     " none\t\tno compression",
     "and the other options are:",
     " -r\trows/strip",
+    " -s\tdecode JPEG images at 1/denom resolution (denom = 2, 4 or 8)",
     " -b (progress by block rather than as a whole image)",
     " -n don't emit alpha component.",
     " -8 write BigTIFF file instead of ClassicTIFF",
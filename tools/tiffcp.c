@@ -74,6 +74,7 @@ static uint16 config;
 static uint16 compression;
 static uint16 predictor;
 static int preset;
+static int lzmathreads;
 static uint16 fillorder;
 static uint16 orientation;
 static uint32 rowsperstrip;
@@ -85,6 +86,7 @@ static int jpegcolormode = JPEGCOLORMODE_RGB;
 static uint16 defcompression = (uint16) -1;
 static uint16 defpredictor = (uint16) -1;
 static int defpreset =  -1;
+static int deflzmathreads = -1;
 
 static int tiffcp(TIFF*, TIFF*);
 static int processCompressOptions(char*);
@@ -295,6 +297,7 @@ main(int argc, char* argv[])
 			compression = defcompression;
 			predictor = defpredictor;
                         preset = defpreset;
+			lzmathreads = deflzmathreads;
 			fillorder = deffillorder;
 			rowsperstrip = defrowsperstrip;
 			tilewidth = deftilewidth;
@@ -327,6 +330,9 @@ processZIPOptions(char* cp)
 				defpredictor = atoi(cp);
 			else if (*cp == 'p')
 				defpreset = atoi(++cp);
+			else if (*cp == 't'
+				 && defcompression == COMPRESSION_LZMA)
+				deflzmathreads = atoi(++cp);
 			else
 				usage();
 		} while( (cp = strchr(cp, ':')) );
@@ -386,11 +392,11 @@ processCompressOptions(char* opt)
 			defpredictor = atoi(cp+1);
 		defcompression = COMPRESSION_LZW;
 	} else if (strneq(opt, "zip", 3)) {
-		processZIPOptions(opt);
 		defcompression = COMPRESSION_ADOBE_DEFLATE;
-	} else if (strneq(opt, "lzma", 4)) {
 		processZIPOptions(opt);
+	} else if (strneq(opt, "lzma", 4)) {
 		defcompression = COMPRESSION_LZMA;
+		processZIPOptions(opt);
 	} else if (strneq(opt, "jbig", 4)) {
 		defcompression = COMPRESSION_JBIG;
 	} else if (strneq(opt, "sgilog", 6)) {
@@ -451,9 +457,10 @@ char* stuff[] = {
 "LZW, Deflate (ZIP) and LZMA2 options:",
 " #               set predictor value",
 " p#              set compression level (preset)",
+" t#              set number of LZMA2 threads (0 for one per CPU)",
 "For example, -c lzw:2 to get LZW-encoded data with horizontal differencing,",
 "-c zip:3:p9 for Deflate encoding with maximum compression level and floating",
-"point predictor.",
+"point predictor, -c lzma:t4 for LZMA2 encoding with 4 threads.",
 "",
 "Note that input filenames may be of the form filename,x,y,z",
 "where x, y, and z specify image numbers in the filename to copy.",
@@ -593,6 +600,7 @@ tiffcp(TIFF* in, TIFF* out)
 {
 	uint16 bitspersample = 1, samplesperpixel = 1;
 	uint16 input_compression, input_photometric = PHOTOMETRIC_MINISBLACK;
+	int jpegcopy;
 	copyFunc cf;
 	uint32 width, length;
 	struct cpTag* p;
@@ -607,9 +615,17 @@ tiffcp(TIFF* in, TIFF* out)
 		CopyField(TIFFTAG_COMPRESSION, compression);
 	TIFFGetFieldDefaulted(in, TIFFTAG_COMPRESSION, &input_compression);
 	TIFFGetFieldDefaulted(in, TIFFTAG_PHOTOMETRIC, &input_photometric);
+	/*
+	 * JPEG data kept as JPEG without other changes is copied losslessly
+	 * at the DCT coefficient level, when the layout permits it.
+	 */
+	jpegcopy = input_compression == COMPRESSION_JPEG &&
+	    defcompression == (uint16) -1 && bias == NULL &&
+	    (config == (uint16) -1 || config == PLANARCONFIG_CONTIG);
 	if (input_compression == COMPRESSION_JPEG) {
 		/* Force conversion to RGB */
-		TIFFSetField(in, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+		if (!jpegcopy)
+			TIFFSetField(in, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
 	} else if (input_photometric == PHOTOMETRIC_YCBCR) {
 		/* Otherwise, can't handle subsampled input */
 		uint16 subsamplinghor,subsamplingver;
@@ -624,7 +640,7 @@ tiffcp(TIFF* in, TIFF* out)
 	}
 	if (compression == COMPRESSION_JPEG) {
 		if (input_photometric == PHOTOMETRIC_RGB &&
-		    jpegcolormode == JPEGCOLORMODE_RGB)
+		    jpegcolormode == JPEGCOLORMODE_RGB && !jpegcopy)
 		  TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_YCBCR);
 		else
 		  TIFFSetField(out, TIFFTAG_PHOTOMETRIC, input_photometric);
@@ -744,6 +760,8 @@ tiffcp(TIFF* in, TIFF* out)
 				else if (compression == COMPRESSION_LZMA)
 					TIFFSetField(out, TIFFTAG_LZMAPRESET, preset);
                         }
+			if (compression == COMPRESSION_LZMA && lzmathreads != -1)
+				TIFFSetField(out, TIFFTAG_LZMATHREADS, lzmathreads);
 			break;
 		case COMPRESSION_CCITTFAX3:
 		case COMPRESSION_CCITTFAX4:
@@ -810,6 +828,17 @@ tiffcp(TIFF* in, TIFF* out)
 	for (p = tags; p < &tags[NTAGS]; p++)
 		CopyTag(p->tag, p->count, p->type);
 
+	if (jpegcopy) {
+		int ret = TIFFJPEGCopyCoefficients(in, out);
+		if (ret != 0)
+			return (ret > 0);
+		/* Not possible, fall back to decompressing and recompressing */
+		TIFFSetField(in, TIFFTAG_JPEGCOLORMODE, JPEGCOLORMODE_RGB);
+		if (input_photometric == PHOTOMETRIC_RGB &&
+		    jpegcolormode == JPEGCOLORMODE_RGB)
+			TIFFSetField(out, TIFFTAG_PHOTOMETRIC, PHOTOMETRIC_YCBCR);
+	}
+
 	cf = pickCopyFunc(in, out, bitspersample, samplesperpixel);
 	return (cf ? (*cf)(in, out, length, width, samplesperpixel) : FALSE);
 }